@@ -15,6 +15,7 @@
 #include <time.h>
 #include <string.h>
 #include <assert.h>
+#include <stddef.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "freertos/timers.h"
@@ -26,21 +27,238 @@
 #include "esp_log.h"
 #include "esp_mac.h"
 #include "esp_now.h"
+#include "esp_timer.h"
 #include "esp_crc.h"
+#include "esp_partition.h"
+#include "esp_console.h"
 #include "espnow_example.h"
+#include "espnow_rx_pool.h"
+#include "espnow_crc16.h"
+#include "espnow_event_ring.h"
+#include "espnow_aggr.h"
+#include "espnow_handshake.h"
+#include "espnow_peer_table.h"
+#include "espnow_peer_slots.h"
+#include "espnow_reliable.h"
+#include "espnow_replay.h"
+#include "espnow_frag.h"
+#include "espnow_bulk.h"
+#include "espnow_mcast.h"
+#include "espnow_rtt.h"
+#include "espnow_bench.h"
+#include "espnow_metrics.h"
+#include "espnow_dlog.h"
+#include "espnow_pcap.h"
+#include "espnow_frame.h"
+#include "espnow_stage.h"
+#include "espnow_lanes.h"
+#include "espnow_workers.h"
 
 #define ESPNOW_MAXDELAY 512
+#define ESPNOW_BATCH_LOG_INTERVAL 1000
+#define ESPNOW_MSG_LOG_INTERVAL 1000
+#define ESPNOW_SLOTS_LOG_INTERVAL 1000
+#define ESPNOW_REPLAY_LOG_INTERVAL 100
+#define ESPNOW_REPLY_MAX 64
+#define ESPNOW_BULK_LOG_PERIOD_MS 1000
 
 static const char *TAG = "espnow_master";
 
+/* Messages logged once per frame, see espnow_dlog.h. */
+typedef enum {
+    EXAMPLE_DLOG_SEND_QUEUE_FAIL,
+    EXAMPLE_DLOG_RECV_QUEUE_FAIL,
+    EXAMPLE_DLOG_PREPARE,
+    EXAMPLE_DLOG_RECV_BROADCAST,
+    EXAMPLE_DLOG_RECV_UNICAST,
+    EXAMPLE_DLOG_RECV_ERROR,
+    EXAMPLE_DLOG_SEND_REPLY,
+    EXAMPLE_DLOG_MAX,
+} example_dlog_fmt_id_t;
+
+static const espnow_dlog_fmt_t s_example_dlog_fmts[EXAMPLE_DLOG_MAX] = {
+    [EXAMPLE_DLOG_SEND_QUEUE_FAIL] = { ESP_LOG_WARN, "Send send queue fail" },
+    [EXAMPLE_DLOG_RECV_QUEUE_FAIL] = { ESP_LOG_WARN, "Send receive queue fail" },
+    [EXAMPLE_DLOG_PREPARE] = { ESP_LOG_INFO, "Prepare to send data %u to "MACSTR", len: %u" },
+    [EXAMPLE_DLOG_RECV_BROADCAST] = { ESP_LOG_ERROR, "Received %uth broadcast data from "MACSTR", state: %u, magic: %u, len: %u" },
+    [EXAMPLE_DLOG_RECV_UNICAST] = { ESP_LOG_INFO, "Receive %uth unicast data from: "MACSTR", len: %u" },
+    [EXAMPLE_DLOG_RECV_ERROR] = { ESP_LOG_INFO, "Receive error data from: "MACSTR", len: %u" },
+    [EXAMPLE_DLOG_SEND_REPLY] = { ESP_LOG_INFO, "Send data to "MACSTR"" },
+};
+
+#if CONFIG_ESPNOW_EVENT_TRANSPORT_QUEUE
 static QueueHandle_t s_example_espnow_queue;
+#endif
 
 static uint8_t s_example_broadcast_mac[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
 static uint16_t s_example_espnow_seq[EXAMPLE_ESPNOW_DATA_MAX] = { 0, 0 };
+/* Reliable data received from each device, indexed by peer id. */
+static espnow_reliable_rx_t s_example_espnow_rx[ESPNOW_PEER_TABLE_MAX];
+/* Frame types whose copies are dropped, and their window in s_example_espnow_replay plus one.
+ * Broadcasts are not retried by the MAC layer, and acknowledgements, fragments, bulk, multicast
+ * and benchmark frames are recognised as copies by their own modules. */
+enum {
+    EXAMPLE_REPLAY_UNICAST = 1,
+    EXAMPLE_REPLAY_AGGREGATE,
+    EXAMPLE_REPLAY_RELIABLE,
+    EXAMPLE_REPLAY_PROBE,
+    EXAMPLE_REPLAY_ECHO,
+    EXAMPLE_REPLAY_MAX,
+};
+static const uint8_t s_example_espnow_replay_of_type[EXAMPLE_ESPNOW_DATA_MAX] = {
+    [EXAMPLE_ESPNOW_DATA_UNICAST] = EXAMPLE_REPLAY_UNICAST,
+    [EXAMPLE_ESPNOW_DATA_AGGREGATE] = EXAMPLE_REPLAY_AGGREGATE,
+    [EXAMPLE_ESPNOW_DATA_RELIABLE] = EXAMPLE_REPLAY_RELIABLE,
+    [EXAMPLE_ESPNOW_DATA_PROBE] = EXAMPLE_REPLAY_PROBE,
+    [EXAMPLE_ESPNOW_DATA_ECHO] = EXAMPLE_REPLAY_ECHO,
+};
+/* Sequence numbers seen from each device, indexed by peer id and window. */
+static espnow_replay_t s_example_espnow_replay[ESPNOW_PEER_TABLE_MAX][EXAMPLE_REPLAY_MAX - 1];
+/* Both arrays are in internal RAM for every device the peer table can hold. */
+_Static_assert(sizeof(s_example_espnow_rx) + sizeof(s_example_espnow_replay) <= 72 * 1024,
+               "Per-peer receive state too large, lower CONFIG_ESPNOW_PEER_TABLE_SIZE");
+#if CONFIG_ESPNOW_BULK_ENABLE || CONFIG_ESPNOW_MCAST_ENABLE
+static const esp_partition_t *s_example_espnow_image_part;
+static uint32_t s_example_espnow_image_len;       //Bytes sent to every slave, 0 while there is nothing to send.
+static uint32_t s_example_espnow_image_crc;
+#endif
+#if CONFIG_ESPNOW_MCAST_ENABLE
+static espnow_mcast_tx_t s_example_espnow_mcast;
+static int64_t s_example_espnow_mcast_start_us;
+static uint8_t s_example_espnow_mcast_logged;     //Rounds logged so far.
+#endif
+#if CONFIG_ESPNOW_BULK_ENABLE
+static espnow_bulk_tx_t s_example_espnow_bulk;
+static uint16_t s_example_espnow_bulk_next_id;    //Peer id of the next slave to push the image to.
+static uint8_t s_example_espnow_bulk_xfer;
+static int64_t s_example_espnow_bulk_log_us;
+static uint32_t s_example_espnow_bulk_log_bytes;
+#endif
+#if CONFIG_ESPNOW_BENCH_SENDER
+static espnow_bench_tx_t s_example_espnow_bench;
+#endif
+#if CONFIG_ESPNOW_METRICS_PERIOD > 0
+static int64_t s_example_espnow_metrics_at;       //Time the next metrics snapshot is due.
+static uint8_t s_example_espnow_metrics_mac[ESP_NOW_ETH_ALEN];   //Of this device, read at init.
+#endif
 
 static void example_espnow_deinit(example_espnow_send_param_t *send_param);
 
 int count = 0;
+/* Events from the ESPNOW callbacks reach the ESPNOW task either through a FreeRTOS
+ * queue or through a lock-free ring, selected in menuconfig. */
+static esp_err_t example_espnow_event_transport_init(void)
+{
+#if CONFIG_ESPNOW_EVENT_TRANSPORT_RING
+    espnow_event_ring_init();
+#else
+    s_example_espnow_queue = xQueueCreate(ESPNOW_QUEUE_SIZE, sizeof(example_espnow_event_t));
+    if (s_example_espnow_queue == NULL) {
+        ESP_LOGE(TAG, "Create queue fail");
+        return ESP_FAIL;
+    }
+#endif
+    return ESP_OK;
+}
+
+static void example_espnow_event_transport_deinit(void)
+{
+#if CONFIG_ESPNOW_EVENT_TRANSPORT_QUEUE
+    vSemaphoreDelete(s_example_espnow_queue);
+#endif
+}
+
+/* Called from the WiFi task. Never blocks in ring mode, where the event goes into the
+ * ring of its priority lane. Counts the events dropped and the most events waiting at
+ * the same time. */
+static bool example_espnow_event_post(espnow_lane_t lane, const example_espnow_event_t *evt)
+{
+#if CONFIG_ESPNOW_EVENT_TRANSPORT_RING
+    bool posted = espnow_event_ring_push(lane, evt);
+    uint32_t waiting = espnow_event_ring_count();
+#else
+    bool posted = xQueueSend(s_example_espnow_queue, evt, ESPNOW_MAXDELAY) == pdTRUE;
+    uint32_t waiting = uxQueueMessagesWaiting(s_example_espnow_queue);
+#endif
+
+    if (!posted) {
+        espnow_metrics_inc(ESPNOW_METRIC_QUEUE_FULL);
+    }
+    espnow_metrics_max(ESPNOW_METRIC_QUEUE_HIGH_WATER, waiting);
+    return posted;
+}
+
+static bool example_espnow_event_wait(example_espnow_event_t *evt, TickType_t ticks)
+{
+#if CONFIG_ESPNOW_EVENT_TRANSPORT_RING
+    return espnow_event_ring_wait(evt, ticks);
+#else
+    return xQueueReceive(s_example_espnow_queue, evt, ticks) == pdTRUE;
+#endif
+}
+
+/* Wait for one event, then take whatever else is already pending, up to max events.
+ * Returns the number of events stored in evts. */
+static int example_espnow_event_wait_batch(example_espnow_event_t *evts, int max, TickType_t ticks)
+{
+    int num = 0;
+
+    /* Frames the priority lanes could not send come first, as failed sending callbacks. */
+    while (num < max && espnow_lanes_take_dropped(&evts[num])) {
+        num++;
+    }
+    if (num == 0) {
+        if (!example_espnow_event_wait(&evts[num], ticks)) {
+            return 0;
+        }
+        num = 1;
+    }
+    for (; num < max; num++) {
+        if (!example_espnow_event_wait(&evts[num], 0)) {
+            break;
+        }
+    }
+    return num;
+}
+
+/* Count one wakeup of the ESPNOW task that handled batch_size events. Every
+ * ESPNOW_BATCH_LOG_INTERVAL wakeups the batch size histogram and the event rate
+ * since the previous report are logged, then the histogram is cleared. */
+static void example_espnow_batch_record(int batch_size)
+{
+    static uint32_t hist[ESPNOW_EVENT_BATCH_SIZE + 1];
+    static uint32_t wakeups = 0;
+    static uint32_t events = 0;
+    static int64_t since = 0;
+    char line[16 * (ESPNOW_EVENT_BATCH_SIZE + 1)];
+    int pos = 0;
+
+    if (since == 0) {
+        since = esp_timer_get_time();
+    }
+    hist[batch_size]++;
+    events += batch_size;
+    espnow_metrics_max(ESPNOW_METRIC_BATCH_HIGH_WATER, batch_size);
+    if (++wakeups < ESPNOW_BATCH_LOG_INTERVAL) {
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    line[0] = '\0';
+    for (int i = 1; i <= ESPNOW_EVENT_BATCH_SIZE; i++) {
+        if (hist[i] != 0) {
+            pos += snprintf(line + pos, sizeof(line) - pos, " %d:%lu", i, (unsigned long)hist[i]);
+        }
+    }
+    ESP_LOGI(TAG, "Batches of %lu events in %lu wakeups, %lu events/s, size histogram:%s",
+             (unsigned long)events, (unsigned long)wakeups,
+             (unsigned long)((uint64_t)events * 1000000 / (now - since + 1)), line);
+    memset(hist, 0, sizeof(hist));
+    wakeups = 0;
+    events = 0;
+    since = now;
+}
+
 /* WiFi should start before using ESPNOW */
 static void example_wifi_init(void)
 {
@@ -62,7 +280,7 @@ static void example_wifi_init(void)
  * Users should not do lengthy operations from this task. Instead, post
  * necessary data to a queue and handle it from a lower priority task. */
 ///////////////////////////////////////////////////////////////////////////////////////////////
-static void example_espnow_send_cb(const uint8_t *mac_addr, esp_now_send_status_t status)
+static void example_espnow_ingest_send(const uint8_t *mac_addr, esp_now_send_status_t status, int64_t start_us)
 {
     example_espnow_event_t evt;
     example_espnow_event_send_cb_t *send_cb = &evt.info.send_cb;
@@ -72,81 +290,126 @@ static void example_espnow_send_cb(const uint8_t *mac_addr, esp_now_send_status_
         return;
     }
     evt.id = EXAMPLE_ESPNOW_SEND_CB;
+    evt.time_us = (uint32_t)start_us;
     memcpy(send_cb->mac_addr, mac_addr, ESP_NOW_ETH_ALEN);
     send_cb->status = status;
-    if (xQueueSend(s_example_espnow_queue, &evt, ESPNOW_MAXDELAY) != pdTRUE) {
-        ESP_LOGW(TAG, "Send send queue fail");
+    espnow_lanes_sent();
+    espnow_metrics_inc(ESPNOW_METRIC_TX_FRAMES);
+    if (status != ESP_NOW_SEND_SUCCESS) {
+        espnow_metrics_inc(ESPNOW_METRIC_SEND_FAIL);
+    }
+    if (!example_espnow_event_post(espnow_lane_of_send_cb(), &evt)) {
+        ESPNOW_DLOG(EXAMPLE_DLOG_SEND_QUEUE_FAIL);
     }
 }
 ///////////////////////////////////////////////////////////////////////////////////////////////
-static void example_espnow_recv_cb(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len)
+static void example_espnow_ingest_recv(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len,
+                                      int64_t start_us)
 {
     example_espnow_event_t evt;
     example_espnow_event_recv_cb_t *recv_cb = &evt.info.recv_cb;
     uint8_t * mac_addr = recv_info->src_addr;  ///note
-    uint8_t * des_addr = recv_info->des_addr;  ///note
     count ++;
-    if (mac_addr == NULL || data == NULL || len <= 0) {
+    if (mac_addr == NULL || data == NULL || len <= 0 || len > ESPNOW_RX_POOL_SLOT_LEN) {
         ESP_LOGE(TAG, "Receive cb arg error");
         return;
     }
-    recv_cb->data = malloc(len);
-    if (recv_cb->data == NULL) {
-        ESP_LOGE(TAG, "Malloc receive data fail");
-        return;
-    }
+    espnow_metrics_inc(ESPNOW_METRIC_RX_FRAMES);
+    espnow_pcap_rx(recv_info, data, len);
     // if (IS_BROADCAST_ADDR(des_addr)) {
     //     ESP_LOGD(TAG, "Receive broadcast ESPNOW data");
     // } else {
     //     ESP_LOGD(TAG, "Receive unicast ESPNOW data");
     // }
     evt.id = EXAMPLE_ESPNOW_RECV_CB;
+    evt.time_us = (uint32_t)start_us;
     memcpy(recv_cb->mac_addr, mac_addr, ESP_NOW_ETH_ALEN);
-    recv_cb->data = malloc(len);
-    if (recv_cb->data == NULL) {
-        ESP_LOGE(TAG, "Malloc receive data fail");
+    recv_cb->slot = espnow_rx_pool_claim();
+    if (recv_cb->slot == ESPNOW_RX_POOL_INVALID_SLOT) {
+        espnow_metrics_inc(ESPNOW_METRIC_NO_MEM);
         return;
     }
-    memcpy(recv_cb->data, data, len);
+    memcpy(espnow_rx_pool_data(recv_cb->slot), data, len);
     recv_cb->data_len = len;
-    if (xQueueSend(s_example_espnow_queue, &evt, ESPNOW_MAXDELAY) != pdTRUE) {
-        ESP_LOGW(TAG, "Send receive queue fail");
-        //free(recv_cb->data);
-        if (recv_cb->data != NULL) {
-            free(recv_cb->data);
-            recv_cb->data = NULL;
-        }
+    recv_cb->rssi = recv_info->rx_ctrl->rssi;
+    if (!example_espnow_event_post(espnow_lane_of_frame(data, len), &evt)) {
+        ESPNOW_DLOG(EXAMPLE_DLOG_RECV_QUEUE_FAIL);
+        espnow_rx_pool_release(recv_cb->slot);
     }
-    ////RSSI
-    int8_t rssi = recv_info->rx_ctrl->rssi;
-    ESP_LOGI(TAG, "RSSI: %d", rssi);
-    /////
 }
 
-/* Parse received ESPNOW data. */
-int example_espnow_data_parse(uint8_t *data, uint16_t data_len, uint8_t *state, uint16_t *seq, uint32_t *magic, uint8_t **payload, uint16_t *payload_len)
+/* The ingest stage of the receive pipeline, see espnow_stage.h. */
+static void example_espnow_send_cb(const uint8_t *mac_addr, esp_now_send_status_t status)
+{
+    int64_t start_us = esp_timer_get_time();
+
+    example_espnow_ingest_send(mac_addr, status, start_us);
+    espnow_stage_end(ESPNOW_STAGE_INGEST, start_us);
+}
+
+static void example_espnow_recv_cb(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len)
+{
+    int64_t start_us = esp_timer_get_time();
+
+    example_espnow_ingest_recv(recv_info, data, len, start_us);
+    espnow_stage_end(ESPNOW_STAGE_INGEST, start_us);
+}
+
+/* Check the length and type of received ESPNOW data and read what tells a copy apart,
+ * without computing the CRC. Returns the type, or a negative espnow_frame_err_t. */
+static int example_espnow_data_header(const uint8_t *data, uint16_t data_len, espnow_frame_t *frame)
 {
-    example_espnow_data_t *buf = (example_espnow_data_t *)data;
-    uint16_t crc, crc_cal = 0;
-    if (data_len < sizeof(example_espnow_data_t)) {
-        ESP_LOGE(TAG, "Receive ESPNOW data too short, len:%d", data_len);
-        return -1;
+    int ret = espnow_frame_header(data, data_len, frame);
+
+    if (ret == ESPNOW_FRAME_ERR_SHORT || ret == ESPNOW_FRAME_ERR_LONG) {
+        ESP_LOGE(TAG, "Receive ESPNOW data %s, len:%d", espnow_frame_err_name(ret), data_len);
     }
-    // Lưu các giá trị trạng thái, số thứ tự và magic
-    *state = buf->state;
-    *seq = buf->seq_num;
-    *magic = buf->magic;
-    crc = buf->crc;
-    // Tính toán CRC
-    buf->crc = 0;
-    crc_cal = esp_crc16_le(UINT16_MAX, (uint8_t const *)buf, data_len);
-    // So sánh CRC
-    if (crc_cal == crc) {
-        *payload = buf->payload;
-        *payload_len = data_len - sizeof(example_espnow_data_t);
-        return buf->type;
+    return ret;
+}
+
+/* Window of the frames of the given type from peer, or NULL if peer is NULL or copies of
+ * the type are not dropped. */
+static espnow_replay_t *example_espnow_replay_win(const espnow_peer_t *peer, int type)
+{
+    uint8_t win = s_example_espnow_replay_of_type[type];
+
+    return peer != NULL && win != 0 ? &s_example_espnow_replay[peer->id][win - 1] : NULL;
+}
+
+/* Parse received ESPNOW data. Returns the type, or a negative espnow_frame_err_t. */
+static int example_espnow_data_parse(const uint8_t *data, uint16_t data_len, espnow_frame_t *frame)
+{
+    int ret = espnow_frame_parse(data, data_len, frame);
+
+    if (ret == ESPNOW_FRAME_ERR_CRC) {
+        espnow_metrics_inc(ESPNOW_METRIC_CRC_FAIL);
     }
-    return -1;
+    return ret;
+}
+
+/* Delivery callback of the reassembly: log every message with the rate at which its fragments arrived. */
+static void example_espnow_frag_deliver(const uint8_t *mac, const uint8_t *data, size_t len, int64_t elapsed_us, void *arg)
+{
+    espnow_frag_stats_t stats;
+
+    espnow_frag_get_stats(&stats);
+    ESP_LOGI(TAG, "Reassembled %u byte message %lu from "MACSTR" in %lld ms, %llu KB/s, %lu dropped", (unsigned)len,
+             (unsigned long)stats.messages, MAC2STR(mac), (long long)(elapsed_us / 1000),
+             (unsigned long long)len * 1000000 / 1024 / (elapsed_us + 1),
+             (unsigned long)(stats.timeouts + stats.superseded + stats.no_mem));
+}
+
+/* Log the duplicate statistics every ESPNOW_REPLAY_LOG_INTERVAL copies dropped. */
+static void example_espnow_replay_record(void)
+{
+    espnow_replay_stats_t stats;
+
+    espnow_replay_get_stats(&stats);
+    if (stats.duplicates % ESPNOW_REPLAY_LOG_INTERVAL != 0) {
+        return;
+    }
+    ESP_LOGI(TAG, "Dropped %lu duplicates of %lu frames, %lu restarted senders", (unsigned long)stats.duplicates,
+             (unsigned long)stats.checked, (unsigned long)stats.restarts);
 }
 
 /* Prepare ESPNOW data to be sent. */
@@ -166,110 +429,705 @@ void example_espnow_data_prepare(example_espnow_send_param_t *send_param, const
     memcpy(buf->payload, message, strlen(message) + 1); // +1 để bao gồm ký tự kết thúc chuỗi '\0'
     // send_param->len = sizeof(example_espnow_data_t) + strlen(message) + 1; // +1 để bao gồm ký tự kết thúc chuỗi '\0'
     //strncpy((char*)buf->payload, message, send_param->len - sizeof(example_espnow_data_t) - 1);
-    buf->payload[send_param->len - sizeof(example_espnow_data_t) - 1] = '\0';
+    /* A length without room for any payload must not cut into the magic number. */
+    if (send_param->len > sizeof(example_espnow_data_t)) {
+        buf->payload[send_param->len - sizeof(example_espnow_data_t) - 1] = '\0';
+    }
     send_param->len = sizeof(example_espnow_data_t) + strlen((char*)buf->payload) + 1;
 
     //size_t message_len = strlen(message);
     // strncpy((char*)buf->payload, message, send_param->len - sizeof(example_espnow_data_t));
     // send_param->len = sizeof(example_espnow_data_t) + message_len;
 
-    ESP_LOGI(TAG, "Prepare to send data from SLAVE: %s", buf->payload);
-    buf->crc = esp_crc16_le(UINT16_MAX, (uint8_t const *)buf, send_param->len);
+    ESPNOW_DLOG(EXAMPLE_DLOG_PREPARE, buf->seq_num, ESPNOW_DLOG_MAC(send_param->dest_mac), send_param->len);
+    buf->crc = espnow_crc16_frame(send_param->buffer, send_param->len, offsetof(example_espnow_data_t, crc));
 }
 
-static void example_espnow_task(void *pvParameter)
+/* Prepare ESPNOW data of the given type carrying len bytes of binary payload. */
+void example_espnow_data_prepare_raw(example_espnow_send_param_t *send_param, uint8_t type, const uint8_t *payload, size_t len)
 {
-    example_espnow_event_t evt;
-    uint8_t recv_state = 0;
-    uint16_t recv_seq = 0;
-    uint32_t recv_magic = 0;
-    uint8_t *payload = NULL;
-    uint16_t payload_len = 0;
+    example_espnow_data_t *buf = (example_espnow_data_t *)send_param->buffer;
+    assert(send_param->len >= sizeof(example_espnow_data_t) + len);
+
+    buf->type = type;
+    buf->state = send_param->state;
+    buf->seq_num = s_example_espnow_seq[type]++;
+    buf->crc = 0;
+    buf->magic = send_param->magic;
+    memcpy(buf->payload, payload, len);
+    send_param->len = sizeof(example_espnow_data_t) + len;
+    buf->crc = espnow_crc16_frame(send_param->buffer, send_param->len, offsetof(example_espnow_data_t, crc));
+}
+
+/* Unicast reply owed to a device: the answer to its broadcast, the acknowledgement
+ * of reliable data received from it, or the echo of its round trip time probe. */
+typedef struct {
+    espnow_peer_t *peer;
+    uint8_t type;                         //EXAMPLE_ESPNOW_DATA_UNICAST, EXAMPLE_ESPNOW_DATA_ACK or EXAMPLE_ESPNOW_DATA_ECHO.
+    uint32_t magic;
+    espnow_rtt_probe_t probe;             //EXAMPLE_ESPNOW_DATA_ECHO: the probe to send back.
+} example_espnow_reply_t;
+
+/* Add a reply to the pending ones. A device owed the same kind of reply already gets
+ * only one, so acknowledgements of all data received in a batch share one frame. Returns
+ * the reply, or NULL if there are too many. */
+static example_espnow_reply_t *example_espnow_reply_queue(example_espnow_reply_t *replies, int *reply_num, espnow_peer_t *peer,
+                                       uint8_t type, uint32_t magic)
+{
+    int i;
+
+    for (i = 0; i < *reply_num && (replies[i].peer != peer || replies[i].type != type); i++) {
+    }
+    if (i == ESPNOW_REPLY_MAX) {
+        ESP_LOGW(TAG, "Too many pending replies, "MACSTR" not answered", MAC2STR(peer->mac_addr));
+        return NULL;
+    }
+    replies[i].peer = peer;
+    replies[i].type = type;
+    replies[i].magic = magic;
+    if (i == *reply_num) {
+        (*reply_num)++;
+    }
+    return &replies[i];
+}
+
+/* Handle one application message carried in aggregated or reliable data. Every ESPNOW_MSG_LOG_INTERVAL
+ * messages the message rate since the previous report is logged. Called by the application workers,
+ * see espnow_workers.h, so the counters take a lock. */
+static void example_espnow_handle_message(const uint8_t *msg, size_t len, void *arg)
+{
+    static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+    const uint8_t *mac_addr = (const uint8_t *)arg;
+    static uint32_t messages = 0;
+    static int64_t since = 0;
+    int64_t now = esp_timer_get_time();
+    uint32_t logged = 0;
+    int64_t elapsed = 0;
+
+    ESP_LOGD(TAG, "Message from "MACSTR": %.*s", MAC2STR(mac_addr), (int)len, (const char *)msg);
+#if CONFIG_ESPNOW_APP_MSG_DELAY_MS > 0
+    vTaskDelay((CONFIG_ESPNOW_APP_MSG_DELAY_MS * configTICK_RATE_HZ + 999) / 1000);
+#endif
+    taskENTER_CRITICAL(&lock);
+    if (since == 0) {
+        since = now;
+    }
+    if (++messages == ESPNOW_MSG_LOG_INTERVAL) {
+        logged = messages;
+        elapsed = now - since;
+        messages = 0;
+        since = now;
+    }
+    taskEXIT_CRITICAL(&lock);
+    if (logged > 0) {
+        ESP_LOGI(TAG, "Received %lu messages, %lu messages/s", (unsigned long)logged,
+                 (unsigned long)((uint64_t)logged * 1000000 / (elapsed + 1)));
+    }
+}
+
+/* Run the application on data handed to the workers by example_espnow_deliver(), then
+ * give its receive buffer back. */
+static void example_espnow_run_job(const espnow_worker_job_t *job, void *arg)
+{
+    const uint8_t *data = espnow_rx_pool_data(job->slot) + job->offset;
+
+    if (job->type == EXAMPLE_ESPNOW_DATA_AGGREGATE) {
+        if (espnow_aggr_split(data, job->len, example_espnow_handle_message, (void *)job->mac) < 0) {
+            ESP_LOGI(TAG, "Receive malformed aggregated data from: "MACSTR", len: %u", MAC2STR(job->mac), job->len);
+        }
+    } else {
+        example_espnow_handle_message(data, job->len, (void *)job->mac);
+    }
+    espnow_rx_pool_release(job->slot);
+}
+
+/* Hand the len bytes at data, within the receive buffer of recv_cb, to the application
+ * workers, which then own the buffer. The caller has checked there is room. */
+static void example_espnow_deliver(const example_espnow_event_recv_cb_t *recv_cb, uint16_t key, uint8_t type,
+                                   const uint8_t *data, size_t len)
+{
+    espnow_worker_job_t job = {
+        .key = key,
+        .slot = recv_cb->slot,
+        .type = type,
+        .offset = data - espnow_rx_pool_data(recv_cb->slot),
+        .len = len,
+        .time_us = (uint32_t)esp_timer_get_time(),
+    };
+
+    memcpy(job.mac, recv_cb->mac_addr, ESP_NOW_ETH_ALEN);
+    espnow_workers_submit(&job);
+}
+
+static void example_espnow_handle_recv(example_espnow_event_recv_cb_t *recv_cb, example_espnow_reply_t *replies, int *reply_num)
+{
+    espnow_peer_t *peer = NULL;
+    espnow_replay_t *win = NULL;
+    espnow_frame_t frame = { 0 };
+    espnow_reliable_hdr_t reliable_hdr;
+    uint8_t *data = espnow_rx_pool_data(recv_cb->slot);
+    uint16_t key;
+    bool delivered = false;
     int ret;
-    vTaskDelay(5000 / portTICK_PERIOD_MS);
-    while (xQueueReceive(s_example_espnow_queue, &evt, portMAX_DELAY) == pdTRUE) {
-        switch (evt.id) {
+
+    ret = example_espnow_data_header(data, recv_cb->data_len, &frame);
+    /* A device not in the table has sent nothing yet, so its frame cannot be a copy. It is
+     * added only once a frame of it passed its CRC, so corrupt or forged addresses do not
+     * fill the table. */
+    if (ret >= 0) {
+        peer = espnow_peer_table_lookup(recv_cb->mac_addr);
+        win = example_espnow_replay_win(peer, ret);
+    }
+    /* A copy of a frame already handled is dropped before its CRC is checked. Only a copy
+     * of reliable data needs an answer: its acknowledgement may have been lost. */
+    if (win != NULL && !espnow_replay_check(win, frame.magic, frame.seq)) {
+        if (ret == EXAMPLE_ESPNOW_DATA_RELIABLE) {
+            example_espnow_reply_queue(replies, reply_num, peer, EXAMPLE_ESPNOW_DATA_ACK, 0);
+        }
+        example_espnow_replay_record();
+        espnow_rx_pool_release(recv_cb->slot);
+        return;
+    }
+    if (ret >= 0) {
+#if CONFIG_ESPNOW_BENCH_RECEIVER
+        int type = ret;
+#endif
+        ret = example_espnow_data_parse(data, recv_cb->data_len, &frame);
+#if CONFIG_ESPNOW_BENCH_RECEIVER
+        /* The header is sound, so a failed parse is a failed CRC. */
+        if (ret < 0 && type == EXAMPLE_ESPNOW_DATA_BENCH) {
+            espnow_bench_rx_crc_error(recv_cb->mac_addr);
+        }
+#endif
+    }
+    if (ret >= 0 && peer == NULL) {
+        peer = espnow_peer_table_get_or_add(recv_cb->mac_addr);
+        if (peer == NULL) {
+            ESP_LOGW(TAG, "Peer table full, "MACSTR" not tracked", MAC2STR(recv_cb->mac_addr));
+            espnow_metrics_inc(ESPNOW_METRIC_PEER_ADD_FAIL);
+        }
+        win = example_espnow_replay_win(peer, ret);
+    }
+    /* Application data whose worker shard is full is dropped before it counts as
+     * received, as if lost on air, so that reliable data is sent again. */
+    key = peer != NULL ? peer->id : ESPNOW_PEER_INVALID_ID;
+    if ((ret == EXAMPLE_ESPNOW_DATA_AGGREGATE || ret == EXAMPLE_ESPNOW_DATA_RELIABLE) && !espnow_workers_has_room(key)) {
+        espnow_rx_pool_release(recv_cb->slot);
+        return;
+    }
+    if (ret >= 0 && win != NULL) {
+        espnow_replay_update(win, frame.magic, frame.seq);
+    }
+    if (ret >= 0 && peer != NULL) {
+        espnow_peer_table_seen(peer, frame.seq, recv_cb->rssi, esp_timer_get_time());
+        ESP_LOGD(TAG, "RSSI: %d", recv_cb->rssi);
+    }
+    if (ret == EXAMPLE_ESPNOW_DATA_BROADCAST) {
+        ESPNOW_DLOG(EXAMPLE_DLOG_RECV_BROADCAST, frame.seq, ESPNOW_DLOG_MAC(recv_cb->mac_addr), frame.state, frame.magic,
+                    recv_cb->data_len);
+        ESP_LOGD(TAG, "Message: %.*s", frame.payload_len, (const char *)frame.payload);
+        ///SEND UNICAST WHEN RECV BROADCAST FROM MASTER///
+        /* The reply itself is sent once the whole batch has been parsed and the device
+         * holds a peer slot. A device that broadcasts again meanwhile is answered once. */
+        if (peer != NULL && espnow_handshake_master_on_broadcast(frame.state, frame.magic) == ESPNOW_HANDSHAKE_REPLY) {
+            example_espnow_reply_queue(replies, reply_num, peer, EXAMPLE_ESPNOW_DATA_UNICAST, frame.magic);
+        }
+    } else if (ret == EXAMPLE_ESPNOW_DATA_UNICAST) {
+        ESPNOW_DLOG(EXAMPLE_DLOG_RECV_UNICAST, frame.seq, ESPNOW_DLOG_MAC(recv_cb->mac_addr), recv_cb->data_len);
+    } else if (ret == EXAMPLE_ESPNOW_DATA_PROBE && peer != NULL && frame.payload_len == sizeof(espnow_rtt_probe_t)) {
+        /* Only the newest probe of a device in a batch is echoed, the older ones count as lost. */
+        example_espnow_reply_t *reply = example_espnow_reply_queue(replies, reply_num, peer, EXAMPLE_ESPNOW_DATA_ECHO, 0);
+        if (reply != NULL) {
+            espnow_frame_read(&frame, 0, &reply->probe, sizeof(espnow_rtt_probe_t));
+        }
+    } else if (ret == EXAMPLE_ESPNOW_DATA_BENCH) {
+#if CONFIG_ESPNOW_BENCH_RECEIVER
+        if (espnow_bench_rx(recv_cb->mac_addr, frame.payload, frame.payload_len, esp_timer_get_time()) == ESP_ERR_INVALID_ARG) {
+            ESP_LOGI(TAG, "Receive malformed benchmark data from: "MACSTR", len: %d", MAC2STR(recv_cb->mac_addr), recv_cb->data_len);
+        }
+#endif
+    } else if (ret == EXAMPLE_ESPNOW_DATA_AGGREGATE) {
+        example_espnow_deliver(recv_cb, key, ret, frame.payload, frame.payload_len);
+        delivered = true;
+    } else if (ret == EXAMPLE_ESPNOW_DATA_RELIABLE && peer != NULL
+               && espnow_frame_read(&frame, 0, &reliable_hdr, sizeof(reliable_hdr))) {
+        /* New data is delivered on arrival, and every frame is acknowledged so that
+         * lost acknowledgements are repaired. */
+        if (espnow_reliable_rx_accept(&s_example_espnow_rx[peer->id], reliable_hdr.base, frame.seq)) {
+            example_espnow_deliver(recv_cb, key, ret, frame.payload + sizeof(espnow_reliable_hdr_t),
+                                   frame.payload_len - sizeof(espnow_reliable_hdr_t));
+            delivered = true;
+        }
+        example_espnow_reply_queue(replies, reply_num, peer, EXAMPLE_ESPNOW_DATA_ACK, 0);
+    } else if (ret == EXAMPLE_ESPNOW_DATA_FRAGMENT) {
+        if (espnow_frag_rx(recv_cb->mac_addr, frame.payload, frame.payload_len, esp_timer_get_time()) == ESP_ERR_INVALID_ARG) {
+            ESP_LOGI(TAG, "Receive malformed fragment from: "MACSTR", len: %d", MAC2STR(recv_cb->mac_addr), recv_cb->data_len);
+        }
+    } else if (ret == EXAMPLE_ESPNOW_DATA_BULK) {
+#if CONFIG_ESPNOW_BULK_ENABLE
+        /* Statuses of an earlier transfer are ignored. */
+        espnow_bulk_tx_on_status(&s_example_espnow_bulk, recv_cb->mac_addr, frame.payload, frame.payload_len, esp_timer_get_time());
+#endif
+    } else if (ret == EXAMPLE_ESPNOW_DATA_MCAST) {
+#if CONFIG_ESPNOW_MCAST_ENABLE
+        /* NACKs arriving after the wait for them are ignored. */
+        espnow_mcast_tx_on_nack(&s_example_espnow_mcast, frame.payload, frame.payload_len);
+#endif
+    } else if (ret == EXAMPLE_ESPNOW_DATA_METRICS) {
+        espnow_metrics_print(recv_cb->mac_addr, frame.payload, frame.payload_len);
+    } else {
+        ESPNOW_DLOG(EXAMPLE_DLOG_RECV_ERROR, ESPNOW_DLOG_MAC(recv_cb->mac_addr), recv_cb->data_len);
+    }
+    if (!delivered) {
+        espnow_rx_pool_release(recv_cb->slot);
+    }
+}
+
+#if CONFIG_ESPNOW_BULK_ENABLE || CONFIG_ESPNOW_MCAST_ENABLE
+/* Find the partition to send and compute the CRC32 of the image. Nothing is sent if
+ * there is no such partition. */
+static void example_espnow_image_init(void)
+{
+    uint8_t buf[256];
+    uint32_t len = CONFIG_ESPNOW_BULK_LEN;
+    uint32_t crc = 0;
+
+    s_example_espnow_image_part = esp_partition_find_first(ESP_PARTITION_TYPE_ANY, ESP_PARTITION_SUBTYPE_ANY,
+                                                           CONFIG_ESPNOW_BULK_PARTITION);
+    if (s_example_espnow_image_part == NULL) {
+        ESP_LOGW(TAG, "No partition %s, nothing to send", CONFIG_ESPNOW_BULK_PARTITION);
+        return;
+    }
+    if (len == 0 || len > s_example_espnow_image_part->size) {
+        len = s_example_espnow_image_part->size;
+    }
+    for (uint32_t offset = 0; offset < len; offset += sizeof(buf)) {
+        uint32_t n = len - offset < sizeof(buf) ? len - offset : sizeof(buf);
+        if (esp_partition_read(s_example_espnow_image_part, offset, buf, n) != ESP_OK) {
+            ESP_LOGW(TAG, "Read partition %s fail, nothing to send", CONFIG_ESPNOW_BULK_PARTITION);
+            return;
+        }
+        crc = esp_crc32_le(crc, buf, n);
+    }
+    s_example_espnow_image_len = len;
+    s_example_espnow_image_crc = crc;
+    ESP_LOGI(TAG, "Send %lu bytes of partition %s, CRC32 %08lx, to every slave", (unsigned long)len,
+             CONFIG_ESPNOW_BULK_PARTITION, (unsigned long)crc);
+}
+
+static esp_err_t example_espnow_image_read(uint32_t offset, uint8_t *data, size_t len, void *arg)
+{
+    return esp_partition_read(s_example_espnow_image_part, offset, data, len);
+}
+#endif
+
+#if CONFIG_ESPNOW_BULK_ENABLE
+
+/* Transmit callback of the bulk sender. The slave keeps its peer slot while chunks are
+ * in flight; if it lost the slot between chunks, it gets one again first. */
+static esp_err_t example_espnow_bulk_xmit(const uint8_t *mac, const uint8_t *payload, size_t len, void *arg)
+{
+    static uint8_t buffer[ESP_NOW_MAX_DATA_LEN];
+    example_espnow_send_param_t send_param;
+    espnow_peer_t *peer = espnow_peer_table_lookup(mac);
+    esp_err_t ret;
+
+    if (peer == NULL) {
+        return ESP_ERR_ESPNOW_NOT_FOUND;
+    }
+    if (!peer->in_peer_list && espnow_peer_slots_acquire(&peer, 1) == 0) {
+        return ESP_ERR_ESPNOW_NO_MEM;
+    }
+    memset(&send_param, 0, sizeof(example_espnow_send_param_t));
+    send_param.unicast = true;
+    send_param.len = sizeof(buffer);
+    send_param.buffer = buffer;
+    memcpy(send_param.dest_mac, mac, ESP_NOW_ETH_ALEN);
+    example_espnow_data_prepare_raw(&send_param, EXAMPLE_ESPNOW_DATA_BULK, payload, len);
+    ret = espnow_lanes_send(mac, buffer, send_param.len);
+    if (ret == ESP_OK) {
+        espnow_peer_slots_sending(peer);
+    }
+    return ret;
+}
+
+/* Drive the bulk transfer and log its throughput every ESPNOW_BULK_LOG_PERIOD_MS. Once
+ * it has ended, log the result and push the image to the next slave heard, in peer id
+ * order, so every slave gets it once. */
+static void example_espnow_bulk_poll(void)
+{
+    espnow_bulk_tx_t *tx = &s_example_espnow_bulk;
+    int64_t now = esp_timer_get_time();
+    espnow_peer_t *peer;
+
+    if (s_example_espnow_image_len == 0) {
+        return;
+    }
+    espnow_bulk_tx_poll(tx, now);
+    if (tx->state == ESPNOW_BULK_RUNNING && now - s_example_espnow_bulk_log_us >= ESPNOW_BULK_LOG_PERIOD_MS * 1000) {
+        uint32_t bytes = espnow_bulk_tx_acked_bytes(tx);
+        ESP_LOGI(TAG, "Bulk transfer to "MACSTR": %lu of %lu KB, %llu KB/s", MAC2STR(tx->dest_mac),
+                 (unsigned long)(bytes / 1024), (unsigned long)(tx->size / 1024),
+                 (unsigned long long)(bytes - s_example_espnow_bulk_log_bytes) * 1000000 / 1024 /
+                 (now - s_example_espnow_bulk_log_us));
+        s_example_espnow_bulk_log_us = now;
+        s_example_espnow_bulk_log_bytes = bytes;
+    }
+    if (tx->state == ESPNOW_BULK_DONE) {
+        int64_t elapsed = tx->end_us - tx->start_us;
+        ESP_LOGI(TAG, "Pushed %lu bytes to "MACSTR" in %lld ms, %llu KB/s, %lu chunks, %lu resent on NACK, "
+                 "%lu timeouts", (unsigned long)tx->size, MAC2STR(tx->dest_mac), (long long)(elapsed / 1000),
+                 (unsigned long long)tx->size * 1000000 / 1024 / (elapsed + 1), (unsigned long)tx->stats.chunks,
+                 (unsigned long)tx->stats.nacked, (unsigned long)tx->stats.timeouts);
+        tx->state = ESPNOW_BULK_IDLE;
+    } else if (tx->state == ESPNOW_BULK_FAILED) {
+        ESP_LOGW(TAG, "Bulk transfer to "MACSTR" failed after %lu of %lu bytes", MAC2STR(tx->dest_mac),
+                 (unsigned long)espnow_bulk_tx_acked_bytes(tx), (unsigned long)tx->size);
+        tx->state = ESPNOW_BULK_IDLE;
+    }
+    if (tx->state == ESPNOW_BULK_IDLE && (peer = espnow_peer_table_get(s_example_espnow_bulk_next_id)) != NULL) {
+        s_example_espnow_bulk_next_id++;
+        ESP_LOGI(TAG, "Offer %lu bytes to "MACSTR"", (unsigned long)s_example_espnow_image_len, MAC2STR(peer->mac_addr));
+        espnow_bulk_tx_start(tx, peer->mac_addr, ++s_example_espnow_bulk_xfer, s_example_espnow_image_len,
+                             s_example_espnow_image_crc, CONFIG_ESPNOW_BULK_WINDOW, CONFIG_ESPNOW_BULK_TIMEOUT,
+                             CONFIG_ESPNOW_BULK_MAX_TRIES, example_espnow_image_read, example_espnow_bulk_xmit, NULL);
+        s_example_espnow_bulk_log_us = now;
+        s_example_espnow_bulk_log_bytes = 0;
+        espnow_bulk_tx_poll(tx, now);
+    }
+}
+#endif
+
+#if CONFIG_ESPNOW_MCAST_ENABLE
+/* Transmit callback of the multicast sender: every frame is a broadcast. */
+static esp_err_t example_espnow_mcast_xmit(const uint8_t *mac, const uint8_t *payload, size_t len, void *arg)
+{
+    static uint8_t buffer[ESP_NOW_MAX_DATA_LEN];
+    example_espnow_send_param_t send_param;
+
+    memset(&send_param, 0, sizeof(example_espnow_send_param_t));
+    send_param.broadcast = true;
+    send_param.len = sizeof(buffer);
+    send_param.buffer = buffer;
+    memcpy(send_param.dest_mac, mac, ESP_NOW_ETH_ALEN);
+    example_espnow_data_prepare_raw(&send_param, EXAMPLE_ESPNOW_DATA_MCAST, payload, len);
+    return espnow_lanes_send(mac, buffer, send_param.len);
+}
+
+/* Start multicasting the image once the start delay is over, then drive the
+ * distribution and log every repair round and the result. */
+static void example_espnow_mcast_poll(void)
+{
+    espnow_mcast_tx_t *tx = &s_example_espnow_mcast;
+    int64_t now = esp_timer_get_time();
+
+    if (s_example_espnow_image_len == 0 || now < s_example_espnow_mcast_start_us) {
+        return;
+    }
+    if (tx->state == ESPNOW_MCAST_IDLE) {
+        if (espnow_mcast_tx_start(tx, 1, s_example_espnow_image_len, s_example_espnow_image_crc,
+                                  CONFIG_ESPNOW_MCAST_GROUP, CONFIG_ESPNOW_MCAST_PARITY, CONFIG_ESPNOW_MCAST_OVERHEAD,
+                                  CONFIG_ESPNOW_MCAST_NACK_WAIT, CONFIG_ESPNOW_MCAST_MAX_ROUNDS, example_espnow_image_read,
+                                  example_espnow_mcast_xmit, NULL) != ESP_OK) {
+            ESP_LOGW(TAG, "Image of %lu bytes too long to multicast", (unsigned long)s_example_espnow_image_len);
+            s_example_espnow_image_len = 0;
+            return;
+        }
+        ESP_LOGI(TAG, "Multicast %lu bytes in groups of %d chunks and %d parity chunks",
+                 (unsigned long)s_example_espnow_image_len, CONFIG_ESPNOW_MCAST_GROUP, CONFIG_ESPNOW_MCAST_PARITY);
+    }
+    espnow_mcast_tx_poll(tx, now);
+    if (tx->state == ESPNOW_MCAST_POLLING && tx->round == s_example_espnow_mcast_logged) {
+        s_example_espnow_mcast_logged++;
+        ESP_LOGI(TAG, "Multicast round %u sent, %lu repair chunks and %lu NACKs so far", tx->round,
+                 (unsigned long)tx->stats.repair, (unsigned long)tx->stats.nacks);
+    }
+    if (tx->state == ESPNOW_MCAST_DONE) {
+        int64_t elapsed = tx->end_us - tx->start_us;
+        uint32_t frames = tx->stats.data + tx->stats.parity + tx->stats.repair;
+        ESP_LOGI(TAG, "Multicast %lu bytes in %lld ms and %u rounds, %llu KB/s: %lu data, %lu parity and %lu "
+                 "repair chunks, %lu%% of the data chunks, %lu NACKs", (unsigned long)tx->size,
+                 (long long)(elapsed / 1000), tx->round + 1,
+                 (unsigned long long)tx->size * 1000000 / 1024 / (elapsed + 1), (unsigned long)tx->stats.data,
+                 (unsigned long)tx->stats.parity, (unsigned long)tx->stats.repair,
+                 (unsigned long)((uint64_t)frames * 100 / tx->count), (unsigned long)tx->stats.nacks);
+        s_example_espnow_image_len = 0;
+    } else if (tx->state == ESPNOW_MCAST_FAILED) {
+        ESP_LOGW(TAG, "Multicast failed after %u rounds", tx->round + 1);
+        s_example_espnow_image_len = 0;
+    }
+}
+#endif
+
+#if CONFIG_ESPNOW_BENCH_SENDER
+/* Transmit callback of the benchmark sender. The slave keeps its peer slot while frames
+ * are in flight; if it lost the slot between frames, it gets one again first. */
+static esp_err_t example_espnow_bench_xmit(const uint8_t *mac, const uint8_t *payload, size_t len, void *arg)
+{
+    static uint8_t buffer[ESP_NOW_MAX_DATA_LEN];
+    example_espnow_send_param_t send_param;
+    espnow_peer_t *peer = espnow_peer_table_lookup(mac);
+    esp_err_t ret;
+
+    if (peer == NULL) {
+        return ESP_ERR_ESPNOW_NOT_FOUND;
+    }
+    if (!peer->in_peer_list && espnow_peer_slots_acquire(&peer, 1) == 0) {
+        return ESP_ERR_ESPNOW_NO_MEM;
+    }
+    memset(&send_param, 0, sizeof(example_espnow_send_param_t));
+    send_param.unicast = true;
+    send_param.len = sizeof(buffer);
+    send_param.buffer = buffer;
+    memcpy(send_param.dest_mac, mac, ESP_NOW_ETH_ALEN);
+    example_espnow_data_prepare_raw(&send_param, EXAMPLE_ESPNOW_DATA_BENCH, payload, len);
+    ret = espnow_lanes_send(mac, buffer, send_param.len);
+    if (ret == ESP_OK) {
+        espnow_peer_slots_sending(peer);
+    }
+    return ret;
+}
+
+/* Start the benchmark to the first slave heard, drive it and log the result once. */
+static void example_espnow_bench_poll(void)
+{
+    espnow_bench_tx_t *tx = &s_example_espnow_bench;
+    int64_t now = esp_timer_get_time();
+    espnow_peer_t *peer;
+
+    if (tx->state == ESPNOW_BENCH_IDLE && (peer = espnow_peer_table_get(0)) != NULL) {
+        ESP_LOGI(TAG, "Start benchmark to "MACSTR"", MAC2STR(peer->mac_addr));
+        espnow_bench_tx_start(tx, peer->mac_addr, CONFIG_ESPNOW_SEND_LEN - sizeof(example_espnow_data_t),
+                              CONFIG_ESPNOW_BENCH_RATE, CONFIG_ESPNOW_BENCH_DURATION * 1000, example_espnow_bench_xmit,
+                              NULL, now);
+    }
+    if (tx->state != ESPNOW_BENCH_RUNNING && tx->state != ESPNOW_BENCH_ENDING) {
+        return;
+    }
+    if (espnow_bench_tx_poll(tx, now) != ESP_OK) {
+        ESP_LOGE(TAG, "Send error");
+        example_espnow_deinit(NULL);
+        vTaskDelete(NULL);
+    }
+    if (tx->state == ESPNOW_BENCH_DONE) {
+        espnow_bench_tx_log(tx);
+    }
+}
+#endif
+
+#if CONFIG_ESPNOW_METRICS_PERIOD > 0
+/* Print a snapshot of the metrics when one is due. */
+static void example_espnow_metrics_poll(void)
+{
+    espnow_metrics_snapshot_t snap;
+    int64_t now = esp_timer_get_time();
+
+    if (now < s_example_espnow_metrics_at) {
+        return;
+    }
+    s_example_espnow_metrics_at = now + (int64_t)CONFIG_ESPNOW_METRICS_PERIOD * 1000000;
+    espnow_metrics_snapshot(&snap);
+    espnow_metrics_print(s_example_espnow_metrics_mac, (const uint8_t *)&snap, sizeof(snap));
+}
+#endif
+
+/* How long the ESPNOW task may block waiting for events: with an image being sent,
+ * until its next frame, timeout or poll is due, in the throughput benchmark until
+ * a frame is due or a run ends, and until the next metrics snapshot is due. */
+static TickType_t example_espnow_wait_ticks(void)
+{
+    int64_t next = -1;
+
+#if CONFIG_ESPNOW_BULK_ENABLE
+    next = espnow_bulk_tx_next_deadline(&s_example_espnow_bulk);
+#endif
+#if CONFIG_ESPNOW_MCAST_ENABLE
+    if (s_example_espnow_image_len > 0) {
+        next = s_example_espnow_mcast.state == ESPNOW_MCAST_IDLE ? s_example_espnow_mcast_start_us
+                                                                 : espnow_mcast_tx_next_deadline(&s_example_espnow_mcast);
+    }
+#endif
+#if CONFIG_ESPNOW_BENCH_SENDER
+    next = espnow_bench_tx_next_deadline(&s_example_espnow_bench);
+#endif
+#if CONFIG_ESPNOW_BENCH_RECEIVER
+    int64_t bench_deadline = espnow_bench_rx_next_deadline();
+    if (bench_deadline >= 0 && (next < 0 || bench_deadline < next)) {
+        next = bench_deadline;
+    }
+#endif
+#if CONFIG_ESPNOW_METRICS_PERIOD > 0
+    if (next < 0 || s_example_espnow_metrics_at < next) {
+        next = s_example_espnow_metrics_at;
+    }
+#endif
+    if (next >= 0) {
+        int64_t wait_us = next - esp_timer_get_time();
+        if (wait_us <= 0) {
+            return 0;
+        }
+        TickType_t ticks = pdMS_TO_TICKS((wait_us + 999) / 1000);
+        return ticks > 0 ? ticks : 1;
+    }
+    return portMAX_DELAY;
+}
+
+/* Log the peer slot statistics every ESPNOW_SLOTS_LOG_INTERVAL devices acquired. */
+static void example_espnow_slots_record(void)
+{
+    static uint32_t logged = 0;
+    espnow_peer_slots_stats_t stats;
+
+    espnow_peer_slots_get_stats(&stats);
+    uint32_t acquired = stats.hits + stats.misses;
+    if (acquired - logged < ESPNOW_SLOTS_LOG_INTERVAL) {
+        return;
+    }
+    logged = acquired;
+    ESP_LOGI(TAG, "Peer slots: %u used, %lu hits, %lu misses (%lu%%), %lu evictions, %lu waited, %lu errors",
+             stats.used, (unsigned long)stats.hits, (unsigned long)stats.misses,
+             (unsigned long)((uint64_t)stats.misses * 100 / acquired), (unsigned long)stats.evictions,
+             (unsigned long)stats.unavailable, (unsigned long)stats.errors);
+}
+
+/* Send the pending unicast replies. The peer slots for all of them are acquired
+ * together, and replies whose device gets no slot, or that ESPNOW cannot queue yet,
+ * stay pending for the next batch. ESPNOW copies the data in esp_now_send, so one
+ * buffer serves every reply. */
+static void example_espnow_send_replies(example_espnow_reply_t *replies, int *reply_num)
+{
+    static uint8_t buffer[ESP_NOW_MAX_DATA_LEN];
+    example_espnow_send_param_t send_param;
+    espnow_peer_t *peers[ESPNOW_REPLY_MAX];
+    int pending = 0;
+    esp_err_t ret;
+
+    if (*reply_num == 0) {
+        return;
+    }
+    for (int i = 0; i < *reply_num; i++) {
+        peers[i] = replies[i].peer;
+    }
+    espnow_peer_slots_acquire(peers, *reply_num);
+    example_espnow_slots_record();
+
+    for (int i = 0; i < *reply_num; i++) {
+        if (!replies[i].peer->in_peer_list) {
+            replies[pending++] = replies[i];
+            continue;
+        }
+        memset(&send_param, 0, sizeof(example_espnow_send_param_t));
+        send_param.unicast = true;
+        send_param.broadcast = false;
+        send_param.state = 0;
+        send_param.magic = replies[i].magic;
+        send_param.len = CONFIG_ESPNOW_SEND_LEN;
+        send_param.buffer = buffer;
+        //copy dia chi mac dich tu recv cb vao send param de gui
+        memcpy(send_param.dest_mac, replies[i].peer->mac_addr, ESP_NOW_ETH_ALEN);
+        if (replies[i].type == EXAMPLE_ESPNOW_DATA_ACK) {
+            espnow_reliable_ack_t ack;
+            espnow_reliable_rx_ack(&s_example_espnow_rx[replies[i].peer->id], &ack);
+            send_param.len = sizeof(buffer);
+            example_espnow_data_prepare_raw(&send_param, EXAMPLE_ESPNOW_DATA_ACK, (const uint8_t *)&ack, sizeof(ack));
+        } else if (replies[i].type == EXAMPLE_ESPNOW_DATA_ECHO) {
+            send_param.len = sizeof(buffer);
+            example_espnow_data_prepare_raw(&send_param, EXAMPLE_ESPNOW_DATA_ECHO, (const uint8_t *)&replies[i].probe,
+                                            sizeof(espnow_rtt_probe_t));
+        } else {
+            example_espnow_data_prepare(&send_param, "hello_master");
+            ESPNOW_DLOG(EXAMPLE_DLOG_SEND_REPLY, ESPNOW_DLOG_MAC(send_param.dest_mac));
+        }
+        ret = espnow_lanes_send(send_param.dest_mac, send_param.buffer, send_param.len);
+        if (ret == ESP_ERR_ESPNOW_NO_MEM) {
+            replies[pending++] = replies[i];
+            continue;
+        }
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Send error");
+            example_espnow_deinit(NULL);
+            vTaskDelete(NULL);
+        }
+        espnow_peer_slots_sending(replies[i].peer);
+    }
+    *reply_num = pending;
+}
+
+/* Handle a batch of events from the ESPNOW callbacks, then send the pending replies. */
+static void example_espnow_handle_events(example_espnow_event_t *evts, int evt_num, example_espnow_reply_t *replies,
+                                         int *reply_num)
+{
+    for (int i = 0; i < evt_num; i++) {
+        example_espnow_event_t *evt = &evts[i];
+        switch (evt->id) {
             case EXAMPLE_ESPNOW_RECV_CB:
-            {
-                example_espnow_event_recv_cb_t *recv_cb = &evt.info.recv_cb;
-                ret = example_espnow_data_parse(recv_cb->data, recv_cb->data_len, &recv_state, &recv_seq, &recv_magic, &payload, &payload_len);
-                free(recv_cb->data);
-                if (ret == EXAMPLE_ESPNOW_DATA_BROADCAST) {
-                    ESP_LOGE(TAG, "Received %dth broadcast data from " MACSTR ", state: %d, seq: %d, magic: %lu, message: %s",recv_seq, MAC2STR(recv_cb->mac_addr), recv_state, recv_seq, recv_magic, (char *)payload);
-                    if (payload != NULL) {
-                        //ESP_LOGI(TAG, "Recv from MaSter Payload: %.*s", payload_len, payload);
-                    }
-                    ESP_LOGI(TAG, "DATA FULL RECV %s",(char *)recv_cb->data);
-                    /* If MAC address does not exist in peer list, add it to peer list. */
-                    if (esp_now_is_peer_exist(recv_cb->mac_addr) == false) {
-                        esp_now_peer_info_t *peer = malloc(sizeof(esp_now_peer_info_t));
-                        if (peer == NULL) {
-                            ESP_LOGE(TAG, "Malloc peer information fail");
-                            example_espnow_deinit(NULL);
-                            vTaskDelete(NULL);
-                        }
-                        memset(peer, 0, sizeof(esp_now_peer_info_t));
-                        peer->channel = CONFIG_ESPNOW_CHANNEL;
-                        peer->ifidx = ESPNOW_WIFI_IF;
-                        peer->encrypt = false;
-                        memcpy(peer->peer_addr, recv_cb->mac_addr, ESP_NOW_ETH_ALEN);
-                        ESP_ERROR_CHECK( esp_now_add_peer(peer) );
-                        free(peer);
-                    }
-                    ///SEND UNICAST WHEN RECV BROADCAST FROM MASTER///
-                    /* Prepare to send unicast ESPNOW data. */
-                    example_espnow_send_param_t *send_param = malloc(sizeof(example_espnow_send_param_t));
-                    //example_espnow_send_param_t *send_param = (example_espnow_send_param_t *)pvParameter;
-
-                    if (send_param == NULL) {
-                        ESP_LOGE(TAG, "Malloc send parameter fail");
-                        example_espnow_deinit(NULL);
-                        vTaskDelete(NULL);
-                    }
-                    memset(send_param, 0, sizeof(example_espnow_send_param_t));
-                    send_param->unicast = true;
-                    send_param->broadcast = false;
-                    send_param->state = 0;
-                    send_param->magic = recv_magic;
-                    send_param->len = CONFIG_ESPNOW_SEND_LEN;
-                    send_param->buffer = malloc(CONFIG_ESPNOW_SEND_LEN);
-                    if (send_param->buffer == NULL) {
-                        ESP_LOGE(TAG, "Malloc send buffer fail");
-                        free(send_param);
-                        example_espnow_deinit(NULL);
-                        vTaskDelete(NULL);
-                    }
-                    //copy dia chi mac dich tu recv cb vao send param de gui
-                    memcpy(send_param->dest_mac, recv_cb->mac_addr, ESP_NOW_ETH_ALEN);
-                    example_espnow_data_prepare(send_param, "hello_master");
-                    
-                    ESP_LOGI(TAG, "Send data w to "MACSTR"", MAC2STR(send_param->dest_mac));
-                    ESP_LOGI(TAG, "////////////////////////////////////\n");
-                    if (esp_now_send(send_param->dest_mac, send_param->buffer, send_param->len) != ESP_OK) {
-                        ESP_LOGE(TAG, "Send error");
-                        example_espnow_deinit(send_param);
-                        vTaskDelete(NULL);
-                    }
-                    free(send_param->buffer);
-                    free(send_param);
-                } else if (ret == EXAMPLE_ESPNOW_DATA_UNICAST) {
-                    ESP_LOGI(TAG, "Receive %dth unicast data from: "MACSTR", len: %d", recv_seq, MAC2STR(recv_cb->mac_addr), recv_cb->data_len);
-                } else {
-                    ESP_LOGI(TAG, "Receive error data from: "MACSTR", len: %d", MAC2STR(recv_cb->mac_addr), recv_cb->data_len);
-                }
+                example_espnow_handle_recv(&evt->info.recv_cb, replies, reply_num);
                 break;
-            }
             case EXAMPLE_ESPNOW_SEND_CB:
             {
-                example_espnow_event_send_cb_t *send_cb = &evt.info.send_cb;
+                example_espnow_event_send_cb_t *send_cb = &evt->info.send_cb;
+                espnow_peer_t *peer = espnow_peer_table_lookup(send_cb->mac_addr);
                 ESP_LOGD(TAG, "Send data to "MACSTR"", MAC2STR(send_cb->mac_addr));
+                if (peer != NULL) {
+                    espnow_peer_slots_sent(peer);
+                }
+#if CONFIG_ESPNOW_BENCH_SENDER
+                espnow_bench_tx_on_sent(&s_example_espnow_bench, send_cb->mac_addr,
+                                        send_cb->status == ESP_NOW_SEND_SUCCESS, esp_timer_get_time());
+#endif
                 break;
             }
             default:
-                ESP_LOGE(TAG, "Unknown event id error: %d", evt.id);
+                ESP_LOGE(TAG, "Unknown event id error: %d", evt->id);
                 break;
         }
     }
+    example_espnow_send_replies(replies, reply_num);
+    /* Frames waiting in the priority lanes go out as the sending callbacks make room. */
+    espnow_lanes_pump();
+}
+
+static void example_espnow_task(void *pvParameter)
+{
+    example_espnow_event_t evts[ESPNOW_EVENT_BATCH_SIZE];
+    static example_espnow_reply_t replies[ESPNOW_REPLY_MAX];
+    int evt_num;
+    int reply_num = 0;
+
+#if CONFIG_ESPNOW_EVENT_TRANSPORT_RING
+    espnow_event_ring_set_consumer(xTaskGetCurrentTaskHandle());
+#endif
+    vTaskDelay(5000 / portTICK_PERIOD_MS);
+#if CONFIG_ESPNOW_METRICS_PERIOD > 0
+    s_example_espnow_metrics_at = esp_timer_get_time() + (int64_t)CONFIG_ESPNOW_METRICS_PERIOD * 1000000;
+#endif
+#if CONFIG_ESPNOW_MCAST_ENABLE
+    s_example_espnow_mcast_start_us = esp_timer_get_time() + (int64_t)CONFIG_ESPNOW_MCAST_START_DELAY * 1000;
+#endif
+    for (;;) {
+        evt_num = example_espnow_event_wait_batch(evts, ESPNOW_EVENT_BATCH_SIZE, example_espnow_wait_ticks());
+        int64_t start_us = esp_timer_get_time();
+        example_espnow_handle_events(evts, evt_num, replies, &reply_num);
+#if CONFIG_ESPNOW_BULK_ENABLE
+        example_espnow_bulk_poll();
+#endif
+#if CONFIG_ESPNOW_MCAST_ENABLE
+        example_espnow_mcast_poll();
+#endif
+#if CONFIG_ESPNOW_BENCH_SENDER
+        example_espnow_bench_poll();
+#endif
+#if CONFIG_ESPNOW_BENCH_RECEIVER
+        espnow_bench_rx_poll(esp_timer_get_time());
+#endif
+#if CONFIG_ESPNOW_METRICS_PERIOD > 0
+        example_espnow_metrics_poll();
+#endif
+        if (evt_num > 0) {
+            example_espnow_batch_record(evt_num);
+        }
+        espnow_stage_batch(evts, evt_num, start_us);
+    }
 }
 
 static esp_err_t get_peer_list() {
@@ -292,10 +1150,16 @@ static esp_err_t get_peer_list() {
         ESP_LOGE(TAG, "Không đủ bộ nhớ để lưu danh sách peer");
         return ESP_ERR_NO_MEM;
     }
-    // Lấy thông tin các peer
-    uint16_t num_peers = peer_num.total_num;
-    err = esp_now_fetch_peer(peer_list, &num_peers);
-    if (err != ESP_OK) {
+    // Lấy thông tin các peer, lần lượt từ đầu danh sách
+    int num_peers = 0;
+    while (num_peers < peer_num.total_num) {
+        err = esp_now_fetch_peer(num_peers == 0, &peer_list[num_peers]);
+        if (err != ESP_OK) {
+            break;
+        }
+        num_peers++;
+    }
+    if (err != ESP_OK && err != ESP_ERR_ESPNOW_NOT_FOUND) {
         ESP_LOGE(TAG, "Lấy thông tin peer thất bại: %s", esp_err_to_name(err));
         free(peer_list);
         return err;
@@ -316,12 +1180,41 @@ static esp_err_t get_peer_list() {
 
 static esp_err_t example_espnow_init(void)
 {
-    s_example_espnow_queue = xQueueCreate(ESPNOW_QUEUE_SIZE, sizeof(example_espnow_event_t));
-    if (s_example_espnow_queue == NULL) {
-        ESP_LOGE(TAG, "Create mutex fail");
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+
+    espnow_rx_pool_init();
+    espnow_lanes_init();
+    espnow_stage_reset();
+    espnow_peer_table_init();
+    for (int i = 0; i < ESPNOW_PEER_TABLE_MAX; i++) {
+        espnow_reliable_rx_init(&s_example_espnow_rx[i]);
+        for (int j = 0; j < EXAMPLE_REPLAY_MAX - 1; j++) {
+            espnow_replay_init(&s_example_espnow_replay[i][j]);
+        }
+    }
+    espnow_frag_rx_init(CONFIG_ESPNOW_FRAG_TIMEOUT, example_espnow_frag_deliver, NULL);
+    ESP_ERROR_CHECK( espnow_workers_init(CONFIG_ESPNOW_WORKERS, example_espnow_run_job, NULL) );
+#if CONFIG_ESPNOW_BULK_ENABLE || CONFIG_ESPNOW_MCAST_ENABLE
+    example_espnow_image_init();
+#endif
+#if CONFIG_ESPNOW_MCAST_ENABLE
+    espnow_fec_init();
+#endif
+#if CONFIG_ESPNOW_BENCH_RECEIVER
+    espnow_bench_rx_init();
+#endif
+    espnow_crc16_init();
+    ESP_ERROR_CHECK( espnow_dlog_init(TAG, s_example_dlog_fmts, EXAMPLE_DLOG_MAX) );
+    if (example_espnow_event_transport_init() != ESP_OK) {
         return ESP_FAIL;
     }
 
+    ESP_ERROR_CHECK( esp_wifi_get_mac(ESPNOW_WIFI_IF, mac) );
+    espnow_pcap_init(mac);
+#if CONFIG_ESPNOW_METRICS_PERIOD > 0
+    memcpy(s_example_espnow_metrics_mac, mac, ESP_NOW_ETH_ALEN);
+#endif
+
     /* Initialize ESPNOW and register sending and receiving callback function. */
     ESP_ERROR_CHECK( esp_now_init() );
     ESP_ERROR_CHECK( esp_now_register_send_cb(example_espnow_send_cb) );
@@ -333,7 +1226,8 @@ static esp_err_t example_espnow_init(void)
     esp_now_peer_info_t *peer = malloc(sizeof(esp_now_peer_info_t));
     if (peer == NULL) {
         ESP_LOGE(TAG, "Malloc peer information fail");
-        vSemaphoreDelete(s_example_espnow_queue);
+        espnow_metrics_inc(ESPNOW_METRIC_NO_MEM);
+        example_espnow_event_transport_deinit();
         return ESP_FAIL;
     }
     memset(peer, 0, sizeof(esp_now_peer_info_t));
@@ -342,17 +1236,40 @@ static esp_err_t example_espnow_init(void)
     peer->encrypt = false;
     memcpy(peer->peer_addr, s_example_broadcast_mac, ESP_NOW_ETH_ALEN);
     ESP_ERROR_CHECK( esp_now_add_peer(peer) );
+    /* Every other peer list entry is shared among the slaves by the peer slot manager. */
+    espnow_peer_slots_init(peer, ESP_NOW_MAX_TOTAL_PEER_NUM - 1);
     free(peer);
     //get_peer_list();
-    xTaskCreate(example_espnow_task, "example_espnow_task", 4096, NULL, 4, NULL);
+    xTaskCreatePinnedToCore(example_espnow_task, "example_espnow_task", 4096, NULL, CONFIG_ESPNOW_TASK_PRIORITY, NULL,
+                            ESPNOW_TASK_CORE);
     
     return ESP_OK;
     
 }
 
+#if CONFIG_ESPNOW_METRICS_CONSOLE
+/* Console on the UART with the metrics command. */
+static void example_console_init(void)
+{
+    esp_console_repl_t *repl = NULL;
+    esp_console_repl_config_t repl_config = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+    esp_console_dev_uart_config_t uart_config = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
+
+    repl_config.prompt = "espnow>";
+    ESP_ERROR_CHECK( esp_console_new_repl_uart(&uart_config, &repl_config, &repl) );
+    ESP_ERROR_CHECK( esp_console_register_help_command() );
+    ESP_ERROR_CHECK( espnow_metrics_register_cmd() );
+    ESP_ERROR_CHECK( espnow_pcap_register_cmd() );
+    ESP_ERROR_CHECK( espnow_stage_register_cmd() );
+    ESP_ERROR_CHECK( espnow_lanes_register_cmd() );
+    ESP_ERROR_CHECK( espnow_workers_register_cmd() );
+    ESP_ERROR_CHECK( esp_console_start_repl(repl) );
+}
+#endif
+
 static void example_espnow_deinit(example_espnow_send_param_t *send_param)
 {
-    vSemaphoreDelete(s_example_espnow_queue);
+    example_espnow_event_transport_deinit();
     if (send_param) {
         free(send_param->buffer);
         free(send_param);
@@ -370,8 +1287,16 @@ void app_main(void)
     }
     ESP_ERROR_CHECK(ret);
 
+#if CONFIG_ESPNOW_CRC16_BENCH
+    espnow_crc16_init();
+    ESP_ERROR_CHECK(espnow_crc16_bench());
+#endif
+
     example_wifi_init();
     ESP_ERROR_CHECK(example_espnow_init());
+#if CONFIG_ESPNOW_METRICS_CONSOLE
+    example_console_init();
+#endif
     //get_peer_list();
 
 }
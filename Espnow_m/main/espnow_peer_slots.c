@@ -0,0 +1,158 @@
+/* ESPNOW Example - peer slot manager
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <string.h>
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "espnow_peer_slots.h"
+#include "espnow_metrics.h"
+
+static const char *TAG = "espnow_peer_slots";
+
+static esp_now_peer_info_t s_slots_peer_info;
+static uint16_t s_slots_max;
+/* Least recently used list of the devices holding a slot: head is the most recently used. */
+static uint16_t s_slots_head = ESPNOW_PEER_INVALID_ID;
+static uint16_t s_slots_tail = ESPNOW_PEER_INVALID_ID;
+static uint32_t s_slots_acquired;
+static espnow_peer_slots_stats_t s_slots_stats;
+
+static void peer_slots_unlink(espnow_peer_t *peer)
+{
+    if (peer->lru_prev != ESPNOW_PEER_INVALID_ID) {
+        espnow_peer_table_get(peer->lru_prev)->lru_next = peer->lru_next;
+    } else {
+        s_slots_head = peer->lru_next;
+    }
+    if (peer->lru_next != ESPNOW_PEER_INVALID_ID) {
+        espnow_peer_table_get(peer->lru_next)->lru_prev = peer->lru_prev;
+    } else {
+        s_slots_tail = peer->lru_prev;
+    }
+}
+
+static void peer_slots_push_head(espnow_peer_t *peer)
+{
+    peer->lru_prev = ESPNOW_PEER_INVALID_ID;
+    peer->lru_next = s_slots_head;
+    if (s_slots_head != ESPNOW_PEER_INVALID_ID) {
+        espnow_peer_table_get(s_slots_head)->lru_prev = peer->id;
+    } else {
+        s_slots_tail = peer->id;
+    }
+    s_slots_head = peer->id;
+}
+
+/* Free the slot of the least recently used device that may give it up. */
+static bool peer_slots_evict(void)
+{
+    uint16_t id = s_slots_tail;
+
+    while (id != ESPNOW_PEER_INVALID_ID) {
+        espnow_peer_t *peer = espnow_peer_table_get(id);
+        if (peer->in_flight == 0 && peer->acquired != s_slots_acquired) {
+            esp_err_t err = esp_now_del_peer(peer->mac_addr);
+            if (err != ESP_OK && err != ESP_ERR_ESPNOW_NOT_FOUND) {
+                ESP_LOGW(TAG, "Delete peer "MACSTR" fail: %s", MAC2STR(peer->mac_addr), esp_err_to_name(err));
+                s_slots_stats.errors++;
+                return false;
+            }
+            peer_slots_unlink(peer);
+            peer->in_peer_list = false;
+            s_slots_stats.used--;
+            s_slots_stats.evictions++;
+            return true;
+        }
+        id = peer->lru_prev;
+    }
+    return false;
+}
+
+void espnow_peer_slots_init(const esp_now_peer_info_t *peer_info, uint16_t slots)
+{
+    s_slots_peer_info = *peer_info;
+    s_slots_max = slots;
+    s_slots_head = ESPNOW_PEER_INVALID_ID;
+    s_slots_tail = ESPNOW_PEER_INVALID_ID;
+    s_slots_acquired = 0;
+    memset(&s_slots_stats, 0, sizeof(s_slots_stats));
+}
+
+int espnow_peer_slots_acquire(espnow_peer_t *const *peers, int num)
+{
+    int missing = 0;
+    int held = 0;
+
+    /* Mark the devices of this call so that they are not evicted for each other. */
+    s_slots_acquired++;
+    for (int i = 0; i < num; i++) {
+        espnow_peer_t *peer = peers[i];
+        if (peer->acquired == s_slots_acquired) {
+            continue;
+        }
+        peer->acquired = s_slots_acquired;
+        if (peer->in_peer_list) {
+            s_slots_stats.hits++;
+            peer_slots_unlink(peer);
+            peer_slots_push_head(peer);
+        } else {
+            s_slots_stats.misses++;
+            missing++;
+        }
+    }
+
+    while (missing > s_slots_max - s_slots_stats.used && peer_slots_evict()) {
+    }
+
+    for (int i = 0; i < num; i++) {
+        espnow_peer_t *peer = peers[i];
+        if (peer->in_peer_list) {
+            held++;
+            continue;
+        }
+        if (s_slots_stats.used == s_slots_max) {
+            s_slots_stats.unavailable++;
+            espnow_metrics_inc(ESPNOW_METRIC_PEER_ADD_FAIL);
+            continue;
+        }
+        memcpy(s_slots_peer_info.peer_addr, peer->mac_addr, ESP_NOW_ETH_ALEN);
+        esp_err_t err = esp_now_add_peer(&s_slots_peer_info);
+        if (err != ESP_OK && err != ESP_ERR_ESPNOW_EXIST) {
+            ESP_LOGW(TAG, "Add peer "MACSTR" fail: %s", MAC2STR(peer->mac_addr), esp_err_to_name(err));
+            s_slots_stats.errors++;
+            espnow_metrics_inc(ESPNOW_METRIC_PEER_ADD_FAIL);
+            continue;
+        }
+        peer->in_peer_list = true;
+        peer->in_flight = 0;
+        peer_slots_push_head(peer);
+        s_slots_stats.used++;
+        held++;
+    }
+    return held;
+}
+
+void espnow_peer_slots_sending(espnow_peer_t *peer)
+{
+    if (peer->in_flight < UINT8_MAX) {
+        peer->in_flight++;
+    }
+}
+
+void espnow_peer_slots_sent(espnow_peer_t *peer)
+{
+    if (peer->in_flight > 0) {
+        peer->in_flight--;
+    }
+}
+
+void espnow_peer_slots_get_stats(espnow_peer_slots_stats_t *stats)
+{
+    *stats = s_slots_stats;
+}
@@ -0,0 +1,54 @@
+/* ESPNOW Example - peer slot manager
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESPNOW_PEER_SLOTS_H
+#define ESPNOW_PEER_SLOTS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_now.h"
+#include "espnow_peer_table.h"
+
+/* Shares a fixed number of ESPNOW peer list entries ("slots") among all devices of
+ * the peer table. Devices that hold a slot are kept in least recently used order.
+ * When a device without a slot is needed, the least recently used device that has
+ * no data in flight gives up its slot.
+ *
+ * Not thread-safe: all calls must come from the same task as the peer table. */
+
+typedef struct {
+    uint32_t hits;                        //Devices that already held a slot when acquired.
+    uint32_t misses;                      //Devices that had to be added to the peer list.
+    uint32_t evictions;                   //Devices removed from the peer list to free a slot.
+    uint32_t unavailable;                 //Devices left without a slot because every slot was busy.
+    uint32_t errors;                      //esp_now_add_peer or esp_now_del_peer failures.
+    uint16_t used;                        //Slots in use.
+} espnow_peer_slots_stats_t;
+
+/* Manage up to slots peer list entries. Devices are added with the channel,
+ * interface and encryption settings of peer_info; its peer_addr is ignored. */
+void espnow_peer_slots_init(const esp_now_peer_info_t *peer_info, uint16_t slots);
+
+/* Give every device in peers a slot and mark them most recently used. All slots
+ * needed are freed first, then the new devices are added, so the peer list is
+ * changed in one pass per call. Devices in peers are never evicted for each other.
+ * A device that ends up without a slot has in_peer_list false: every slot is held
+ * by data in flight or by other devices of the same call. Returns the number of
+ * devices that hold a slot. */
+int espnow_peer_slots_acquire(espnow_peer_t *const *peers, int num);
+
+/* Data to peer was handed to esp_now_send: its slot is kept until the send callback. */
+void espnow_peer_slots_sending(espnow_peer_t *peer);
+
+/* The send callback for data to peer was called. */
+void espnow_peer_slots_sent(espnow_peer_t *peer);
+
+void espnow_peer_slots_get_stats(espnow_peer_slots_stats_t *stats);
+
+#endif
@@ -0,0 +1,312 @@
+/* ESPNOW Example - application worker pool
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_console.h"
+#include "esp_timer.h"
+#include "espnow_workers.h"
+
+#define WORKERS_STACK_SIZE  3072
+
+_Static_assert(CONFIG_ESPNOW_WORKER_RX_RESERVE < ESPNOW_RX_POOL_SIZE,
+               "CONFIG_ESPNOW_WORKER_RX_RESERVE must leave the workers part of the receive pool");
+_Static_assert(ESPNOW_WORKERS_QUEUE_LEN < ESPNOW_WORKERS_SLOTS_MAX,
+               "CONFIG_ESPNOW_WORKER_QUEUE_LEN must be below the receive buffers the workers may hold, "
+               "so that one shard cannot hold them all");
+
+static const char *TAG = "espnow_workers";
+
+typedef struct {
+    espnow_worker_job_t job[ESPNOW_WORKERS_QUEUE_LEN];
+    uint16_t head;                        //Next job to run.
+    uint16_t count;                       //Jobs waiting.
+    bool running;                         //A worker is running a job of the shard.
+} workers_shard_t;
+
+static portMUX_TYPE s_workers_lock = portMUX_INITIALIZER_UNLOCKED;
+static workers_shard_t s_workers_shards[ESPNOW_WORKERS_SHARDS];
+static TaskHandle_t s_workers_tasks[ESPNOW_WORKERS_MAX];
+static uint8_t s_workers_next[ESPNOW_WORKERS_MAX];        //Shard each worker looks at first.
+static uint32_t s_workers_idle;                           //Bit n is set while worker n sleeps.
+static int s_workers_held;                                //Jobs waiting or running.
+static int s_workers_num;
+static espnow_worker_fn_t s_workers_fn;
+static void *s_workers_arg;
+static espnow_workers_report_t s_workers_stats;
+static int64_t s_workers_since_us;
+
+int espnow_workers_shard(uint16_t key)
+{
+    /* Peer ids are handed out in order, so their low bits spread devices evenly. */
+    return key & (ESPNOW_WORKERS_SHARDS - 1);
+}
+
+static int workers_owner(int shard)
+{
+    return shard % s_workers_num;
+}
+
+/* Called with the lock held. */
+static void workers_record(int self, const espnow_worker_job_t *job, int64_t start_us, int64_t end_us)
+{
+    espnow_worker_stats_t *stats = &s_workers_stats.worker[self];
+
+    stats->jobs++;
+    stats->busy_us += end_us - start_us;
+    espnow_rtt_hist_record(&s_workers_stats.wait, (uint32_t)start_us - job->time_us);
+    espnow_rtt_hist_record(&s_workers_stats.latency, (uint32_t)end_us - job->time_us);
+}
+
+/* Called with the lock held. */
+static bool workers_has_room(int shard)
+{
+    return s_workers_shards[shard].count < ESPNOW_WORKERS_QUEUE_LEN && s_workers_held < ESPNOW_WORKERS_SLOTS_MAX;
+}
+
+/* Called with the lock held. The next shard self may run: one of its own in turn,
+ * or else the fullest one of another worker. Returns -1 if there is none. */
+static int workers_pick(int self)
+{
+    int stolen = -1;
+
+    for (int i = 0; i < ESPNOW_WORKERS_SHARDS; i++) {
+        int shard = (s_workers_next[self] + i) % ESPNOW_WORKERS_SHARDS;
+        const workers_shard_t *s = &s_workers_shards[shard];
+
+        if (s->count == 0 || s->running) {
+            continue;
+        }
+        if (workers_owner(shard) == self) {
+            s_workers_next[self] = (shard + 1) % ESPNOW_WORKERS_SHARDS;
+            return shard;
+        }
+        if (stolen < 0 || s->count > s_workers_shards[stolen].count) {
+            stolen = shard;
+        }
+    }
+    return stolen;
+}
+
+static void workers_task(void *arg)
+{
+    int self = (int)(intptr_t)arg;
+    espnow_worker_job_t job;
+
+    for (;;) {
+        taskENTER_CRITICAL(&s_workers_lock);
+        int shard = workers_pick(self);
+        if (shard < 0) {
+            s_workers_idle |= 1U << self;
+            taskEXIT_CRITICAL(&s_workers_lock);
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        workers_shard_t *s = &s_workers_shards[shard];
+        job = s->job[s->head];
+        s->head = (s->head + 1) % ESPNOW_WORKERS_QUEUE_LEN;
+        s->count--;
+        s->running = true;
+        if (workers_owner(shard) != self) {
+            s_workers_stats.worker[self].stolen++;
+        }
+        taskEXIT_CRITICAL(&s_workers_lock);
+
+        int64_t start_us = esp_timer_get_time();
+        s_workers_fn(&job, s_workers_arg);
+        int64_t end_us = esp_timer_get_time();
+
+        taskENTER_CRITICAL(&s_workers_lock);
+        s->running = false;
+        s_workers_held--;
+        workers_record(self, &job, start_us, end_us);
+        taskEXIT_CRITICAL(&s_workers_lock);
+    }
+}
+
+esp_err_t espnow_workers_init(int workers, espnow_worker_fn_t fn, void *arg)
+{
+    static char names[ESPNOW_WORKERS_MAX][24];
+
+    if (workers < 0 || workers > ESPNOW_WORKERS_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_workers_fn = fn;
+    s_workers_arg = arg;
+    s_workers_num = workers;
+    espnow_workers_reset_stats();
+    for (int i = 0; i < workers; i++) {
+        snprintf(names[i], sizeof(names[i]), "espnow_worker%d", i);
+        if (xTaskCreatePinnedToCore(workers_task, names[i], WORKERS_STACK_SIZE, (void *)(intptr_t)i,
+                                    CONFIG_ESPNOW_WORKER_PRIORITY, &s_workers_tasks[i], tskNO_AFFINITY) != pdPASS) {
+            ESP_LOGE(TAG, "Create worker %d fail", i);
+            return ESP_FAIL;
+        }
+    }
+    return ESP_OK;
+}
+
+bool espnow_workers_has_room(uint16_t key)
+{
+    bool room;
+
+    if (s_workers_num == 0) {
+        return true;
+    }
+    taskENTER_CRITICAL(&s_workers_lock);
+    room = workers_has_room(espnow_workers_shard(key));
+    taskEXIT_CRITICAL(&s_workers_lock);
+    return room;
+}
+
+bool espnow_workers_submit(const espnow_worker_job_t *job)
+{
+    if (s_workers_num == 0) {
+        int64_t start_us = esp_timer_get_time();
+        s_workers_fn(job, s_workers_arg);
+        int64_t end_us = esp_timer_get_time();
+
+        taskENTER_CRITICAL(&s_workers_lock);
+        s_workers_stats.submitted++;
+        workers_record(0, job, start_us, end_us);
+        taskEXIT_CRITICAL(&s_workers_lock);
+        return true;
+    }
+
+    int shard = espnow_workers_shard(job->key);
+    workers_shard_t *s = &s_workers_shards[shard];
+    TaskHandle_t wake = NULL;
+
+    taskENTER_CRITICAL(&s_workers_lock);
+    if (!workers_has_room(shard)) {
+        s_workers_stats.full++;
+        taskEXIT_CRITICAL(&s_workers_lock);
+        return false;
+    }
+    s->job[(s->head + s->count) % ESPNOW_WORKERS_QUEUE_LEN] = *job;
+    s->count++;
+    s_workers_held++;
+    if (s_workers_held > s_workers_stats.held_high_water) {
+        s_workers_stats.held_high_water = s_workers_held;
+    }
+    s_workers_stats.submitted++;
+    if (s->count > s_workers_stats.high_water[shard]) {
+        s_workers_stats.high_water[shard] = s->count;
+    }
+    /* A shard being run is picked up again by its worker. Otherwise its owner runs it
+     * if it sleeps, or else any sleeping worker steals it. */
+    if (!s->running && s_workers_idle != 0) {
+        int owner = workers_owner(shard);
+        int worker = (s_workers_idle & (1U << owner)) ? owner : __builtin_ctz(s_workers_idle);
+        s_workers_idle &= ~(1U << worker);
+        wake = s_workers_tasks[worker];
+    }
+    taskEXIT_CRITICAL(&s_workers_lock);
+    if (wake != NULL) {
+        xTaskNotifyGive(wake);
+    }
+    return true;
+}
+
+void espnow_workers_reset_stats(void)
+{
+    taskENTER_CRITICAL(&s_workers_lock);
+    s_workers_stats.submitted = 0;
+    s_workers_stats.full = 0;
+    s_workers_stats.held_high_water = s_workers_held;
+    memset(s_workers_stats.high_water, 0, sizeof(s_workers_stats.high_water));
+    memset(s_workers_stats.worker, 0, sizeof(s_workers_stats.worker));
+    espnow_rtt_hist_reset(&s_workers_stats.wait);
+    espnow_rtt_hist_reset(&s_workers_stats.latency);
+    s_workers_since_us = esp_timer_get_time();
+    taskEXIT_CRITICAL(&s_workers_lock);
+}
+
+void espnow_workers_get_report(espnow_workers_report_t *report)
+{
+    int64_t now = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&s_workers_lock);
+    *report = s_workers_stats;
+    report->elapsed_us = now - s_workers_since_us;
+    report->workers = s_workers_num;
+    report->held = s_workers_held;
+    for (int i = 0; i < ESPNOW_WORKERS_SHARDS; i++) {
+        report->depth[i] = s_workers_shards[i].count;
+    }
+    taskEXIT_CRITICAL(&s_workers_lock);
+}
+
+static void workers_print_latency(const char *name, const espnow_rtt_hist_t *hist)
+{
+    if (hist->count == 0) {
+        printf("%-8s no jobs\n", name);
+        return;
+    }
+    printf("%-8s %lu jobs, mean %lu us, p50 %lu us, p99 %lu us, p999 %lu us, max %lu us\n", name,
+           (unsigned long)hist->count, (unsigned long)(hist->sum_us / hist->count),
+           (unsigned long)espnow_rtt_hist_percentile(hist, 500), (unsigned long)espnow_rtt_hist_percentile(hist, 990),
+           (unsigned long)espnow_rtt_hist_percentile(hist, 999), (unsigned long)hist->max_us);
+}
+
+static int workers_cmd(int argc, char **argv)
+{
+    /* Too large for the stack of the console task; only that task runs the command. */
+    static espnow_workers_report_t report;
+    char line[8 * ESPNOW_WORKERS_SHARDS + 1];
+    int pos = 0;
+
+    if (argc == 2 && strcmp(argv[1], "reset") == 0) {
+        espnow_workers_reset_stats();
+        return 0;
+    }
+    if (argc != 1) {
+        printf("usage: workers [reset]\n");
+        return 1;
+    }
+    espnow_workers_get_report(&report);
+    printf("%u workers, %lu jobs submitted, %lu refused with their shard or the receive buffers full\n",
+           report.workers, (unsigned long)report.submitted, (unsigned long)report.full);
+    printf("receive buffers held: %u, high water %u, at most %d of %d\n", report.held, report.held_high_water,
+           ESPNOW_WORKERS_SLOTS_MAX, ESPNOW_RX_POOL_SIZE);
+    printf("%-8s %10s %10s %7s\n", "worker", "jobs", "stolen", "busy");
+    for (int i = 0; i < (report.workers > 0 ? report.workers : 1); i++) {
+        const espnow_worker_stats_t *stats = &report.worker[i];
+        char name[12] = "inline";
+
+        if (report.workers > 0) {
+            snprintf(name, sizeof(name), "%d", i);
+        }
+        printf("%-8s %10lu %10lu %6.1f%%\n", name, (unsigned long)stats->jobs, (unsigned long)stats->stolen,
+               report.elapsed_us > 0 ? 100.0 * stats->busy_us / report.elapsed_us : 0.0);
+    }
+    for (int i = 0; i < ESPNOW_WORKERS_SHARDS; i++) {
+        pos += snprintf(line + pos, sizeof(line) - pos, " %u/%u", report.depth[i], report.high_water[i]);
+    }
+    printf("shard depth/high water:%s\n", line);
+    workers_print_latency("wait", &report.wait);
+    workers_print_latency("latency", &report.latency);
+    return 0;
+}
+
+esp_err_t espnow_workers_register_cmd(void)
+{
+    const esp_console_cmd_t cmd = {
+        .command = "workers",
+        .help = "Print the jobs and busy time of every application worker, the jobs waiting in every shard and "
+                "their latency, or clear them with 'workers reset'",
+        .hint = "[reset]",
+        .func = workers_cmd,
+    };
+
+    return esp_console_cmd_register(&cmd);
+}
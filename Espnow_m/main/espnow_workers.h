@@ -0,0 +1,107 @@
+/* ESPNOW Example - application worker pool
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESPNOW_WORKERS_H
+#define ESPNOW_WORKERS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_now.h"
+#include "espnow_rtt.h"
+#include "espnow_rx_pool.h"
+
+/* Pool of tasks running the application handler of received data, so that a slow
+ * handler for one device does not hold up the others. The ESPNOW task submits jobs;
+ * a job with a given key, the peer id of its device, always goes to the same one of
+ * ESPNOW_WORKERS_SHARDS shards, picked by the low bits of the key. A shard is a FIFO
+ * run by at most one worker at a time, so the jobs of one device run in order and
+ * never concurrently, while those of devices in other shards run in parallel.
+ *
+ * Every worker owns the shards whose index modulo the number of workers is its own,
+ * and runs them in turn. A worker that finds none of its shards ready steals the
+ * fullest shard that is waiting and not being run, so a busy worker's other devices
+ * are not left waiting behind it. With 0 workers, jobs run in the submitting task.
+ *
+ * Every job waiting or running holds the receive pool slot of its data. Together they
+ * hold at most ESPNOW_WORKERS_SLOTS_MAX slots, so that the ESPNOW task always finds
+ * slots for the frames it has still to parse, however slow the application.
+ *
+ * Each worker records the jobs it ran, those it stole and its busy time. The wait of
+ * every job, from the time the submitter gave it to the start of the job, and its
+ * latency to the end of the job, are recorded in espnow_rtt histograms.
+ *
+ * Thread-safe: the shards and statistics are protected by a short critical section.
+ * Jobs must be submitted from a single task. */
+#define ESPNOW_WORKERS_MAX          8
+#define ESPNOW_WORKERS_SHARD_BITS   4
+#define ESPNOW_WORKERS_SHARDS       (1 << ESPNOW_WORKERS_SHARD_BITS)
+#define ESPNOW_WORKERS_QUEUE_LEN    CONFIG_ESPNOW_WORKER_QUEUE_LEN
+#define ESPNOW_WORKERS_SLOTS_MAX    (ESPNOW_RX_POOL_SIZE - CONFIG_ESPNOW_WORKER_RX_RESERVE)
+
+typedef struct {
+    uint8_t mac[ESP_NOW_ETH_ALEN];        //Device the data comes from.
+    uint16_t key;                         //Jobs of the same key run in order, one at a time.
+    uint16_t slot;                        //Receive pool slot holding the data, see espnow_rx_pool.h.
+    uint8_t type;                         //Frame type of the data.
+    uint8_t offset;                       //Start of the data in the slot.
+    uint8_t len;                          //Length of the data.
+    uint32_t time_us;                     //Low bits of the esp_timer time the job is due from.
+} espnow_worker_job_t;
+
+/* Run a job. Called from a worker, or from the submitting task with 0 workers. */
+typedef void (*espnow_worker_fn_t)(const espnow_worker_job_t *job, void *arg);
+
+typedef struct {
+    uint32_t jobs;                        //Jobs run.
+    uint32_t stolen;                      //Jobs run from a shard owned by another worker.
+    uint64_t busy_us;                     //Time spent running jobs.
+} espnow_worker_stats_t;
+
+typedef struct {
+    int64_t elapsed_us;                   //Time since the last reset.
+    uint8_t workers;
+    uint32_t submitted;                   //Jobs accepted.
+    uint32_t full;                        //Jobs refused because their shard or the slots were full.
+    uint16_t held;                        //Jobs waiting or running, each holding a receive pool slot.
+    uint16_t held_high_water;             //Most jobs held at the same time.
+    uint16_t depth[ESPNOW_WORKERS_SHARDS];        //Jobs waiting in every shard.
+    uint16_t high_water[ESPNOW_WORKERS_SHARDS];   //Most jobs waiting in every shard at the same time.
+    espnow_worker_stats_t worker[ESPNOW_WORKERS_MAX];  //With 0 workers, the submitting task in worker[0].
+    espnow_rtt_hist_t wait;               //From the job's time to its start.
+    espnow_rtt_hist_t latency;            //From the job's time to its end.
+} espnow_workers_report_t;
+
+/* Start the given number of worker tasks, at most ESPNOW_WORKERS_MAX, at
+ * CONFIG_ESPNOW_WORKER_PRIORITY on any core, to run jobs with fn. Called once. */
+esp_err_t espnow_workers_init(int workers, espnow_worker_fn_t fn, void *arg);
+
+/* Shard of key. */
+int espnow_workers_shard(uint16_t key);
+
+/* Whether a job of key would be accepted now: its shard holds fewer than
+ * ESPNOW_WORKERS_QUEUE_LEN jobs and all shards fewer than ESPNOW_WORKERS_SLOTS_MAX.
+ * Only the submitting task fills the shards, so the answer holds until it submits. */
+bool espnow_workers_has_room(uint16_t key);
+
+/* Queue job on the shard of its key and wake a worker that can run it, or with 0
+ * workers run it at once. Returns false, and leaves the job to the caller, if
+ * espnow_workers_has_room() would have said no. */
+bool espnow_workers_submit(const espnow_worker_job_t *job);
+
+/* Clear the statistics; the busy share is relative to the time since. */
+void espnow_workers_reset_stats(void);
+
+void espnow_workers_get_report(espnow_workers_report_t *report);
+
+/* Register the "workers" console command, which prints the statistics, or with
+ * "workers reset" clears them. */
+esp_err_t espnow_workers_register_cmd(void);
+
+#endif
@@ -16,6 +16,7 @@
 #include <time.h>
 #include <string.h>
 #include <assert.h>
+#include <stddef.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "freertos/timers.h"
@@ -27,19 +28,263 @@
 #include "esp_log.h"
 #include "esp_mac.h"
 #include "esp_now.h"
+#include "esp_timer.h"
 #include "esp_crc.h"
+#include "esp_partition.h"
+#include "esp_console.h"
+#include "esp_ota_ops.h"
+#include "esp_attr.h"
+#include "driver/gpio.h"
 #include "espnow_example.h"
+#include "espnow_rx_pool.h"
+#include "espnow_crc16.h"
+#include "espnow_event_ring.h"
+#include "espnow_tx_window.h"
+#include "espnow_aggr.h"
+#include "espnow_handshake.h"
+#include "espnow_peer_table.h"
+#include "espnow_reliable.h"
+#include "espnow_replay.h"
+#include "espnow_frag.h"
+#include "espnow_bulk.h"
+#include "espnow_mcast.h"
+#include "espnow_rtt.h"
+#include "espnow_bench.h"
+#include "espnow_metrics.h"
+#include "espnow_dlog.h"
+#include "espnow_pcap.h"
+#include "espnow_frame.h"
+#include "espnow_stage.h"
+#include "espnow_lanes.h"
 
 #define ESPNOW_MAXDELAY 512
+#define ESPNOW_BATCH_LOG_INTERVAL 1000
+#define ESPNOW_REPLAY_LOG_INTERVAL 100
+#define ESPNOW_BROADCAST_LEN 100
+#define ESPNOW_BULK_SECTORS_MAX 4096
+#define ESPNOW_RTT_DRAIN_MS 1000
 #define DATA_TO_SEND "Hello from Slave using broadcast"
 static const char *TAG = "espnow_example";
 
+/* Messages logged once per frame, see espnow_dlog.h. */
+typedef enum {
+    EXAMPLE_DLOG_SEND_QUEUE_FAIL,
+    EXAMPLE_DLOG_RECV_QUEUE_FAIL,
+    EXAMPLE_DLOG_PREPARE,
+    EXAMPLE_DLOG_RECV_BROADCAST,
+    EXAMPLE_DLOG_RECV_UNICAST,
+    EXAMPLE_DLOG_RECV_ERROR,
+    EXAMPLE_DLOG_MAX,
+} example_dlog_fmt_id_t;
+
+static const espnow_dlog_fmt_t s_example_dlog_fmts[EXAMPLE_DLOG_MAX] = {
+    [EXAMPLE_DLOG_SEND_QUEUE_FAIL] = { ESP_LOG_WARN, "Send send queue fail" },
+    [EXAMPLE_DLOG_RECV_QUEUE_FAIL] = { ESP_LOG_WARN, "Send receive queue fail" },
+    [EXAMPLE_DLOG_PREPARE] = { ESP_LOG_INFO, "Prepare to send data %u to "MACSTR", len: %u" },
+    [EXAMPLE_DLOG_RECV_BROADCAST] = { ESP_LOG_INFO, "Receive %uth broadcast data from: "MACSTR", len: %u" },
+    [EXAMPLE_DLOG_RECV_UNICAST] = { ESP_LOG_ERROR, "Received %uth unicast data from "MACSTR", state: %u, magic: %u, len: %u" },
+    [EXAMPLE_DLOG_RECV_ERROR] = { ESP_LOG_INFO, "Receive error data from: "MACSTR"" },
+};
+
+#if CONFIG_ESPNOW_EVENT_TRANSPORT_QUEUE
 static QueueHandle_t s_example_espnow_queue;
+#endif
 
 static uint8_t s_example_broadcast_mac[ESP_NOW_ETH_ALEN] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
 static uint16_t s_example_espnow_seq[EXAMPLE_ESPNOW_DATA_MAX] = { 0, 0 };
 
+static uint32_t s_example_espnow_broadcasts = 0;
+static int64_t s_example_espnow_rebroadcast_at = -1;
+static int64_t s_example_espnow_send_at = -1;      //Time the send delay is over and the window is refilled, -1 if not waiting.
+
+static espnow_tx_window_t s_example_espnow_window;
+#if !CONFIG_ESPNOW_FRAG_ENABLE && !CONFIG_ESPNOW_RTT_PROBE && !CONFIG_ESPNOW_BENCH_SENDER && \
+    (!CONFIG_ESPNOW_AGGR_ENABLE || CONFIG_ESPNOW_SEND_WINDOW_BENCH)
+static const char *s_example_espnow_window_msg = "hello";
+#endif
+/* Reliable data received from each device, indexed by peer id. */
+static espnow_reliable_rx_t s_example_espnow_rx[ESPNOW_PEER_TABLE_MAX];
+/* Frame types whose copies are dropped, and their window in s_example_espnow_replay plus one.
+ * Broadcasts are not retried by the MAC layer, and acknowledgements, fragments, bulk, multicast
+ * and benchmark frames are recognised as copies by their own modules. */
+enum {
+    EXAMPLE_REPLAY_UNICAST = 1,
+    EXAMPLE_REPLAY_AGGREGATE,
+    EXAMPLE_REPLAY_RELIABLE,
+    EXAMPLE_REPLAY_PROBE,
+    EXAMPLE_REPLAY_ECHO,
+    EXAMPLE_REPLAY_MAX,
+};
+static const uint8_t s_example_espnow_replay_of_type[EXAMPLE_ESPNOW_DATA_MAX] = {
+    [EXAMPLE_ESPNOW_DATA_UNICAST] = EXAMPLE_REPLAY_UNICAST,
+    [EXAMPLE_ESPNOW_DATA_AGGREGATE] = EXAMPLE_REPLAY_AGGREGATE,
+    [EXAMPLE_ESPNOW_DATA_RELIABLE] = EXAMPLE_REPLAY_RELIABLE,
+    [EXAMPLE_ESPNOW_DATA_PROBE] = EXAMPLE_REPLAY_PROBE,
+    [EXAMPLE_ESPNOW_DATA_ECHO] = EXAMPLE_REPLAY_ECHO,
+};
+/* Sequence numbers seen from each device, indexed by peer id and window. */
+static espnow_replay_t s_example_espnow_replay[ESPNOW_PEER_TABLE_MAX][EXAMPLE_REPLAY_MAX - 1];
+/* Both arrays are in internal RAM for every device the peer table can hold. */
+_Static_assert(sizeof(s_example_espnow_rx) + sizeof(s_example_espnow_replay) <= 72 * 1024,
+               "Per-peer receive state too large, lower CONFIG_ESPNOW_PEER_TABLE_SIZE");
+#if CONFIG_ESPNOW_FRAG_ENABLE
+static uint8_t s_example_espnow_frag_msg[CONFIG_ESPNOW_FRAG_MSG_LEN];
+static espnow_frag_tx_t s_example_espnow_frag;
+static uint16_t s_example_espnow_frag_id;
+static int64_t s_example_espnow_frag_start_us;
+#endif
+#if CONFIG_ESPNOW_RELIABLE
+static espnow_reliable_tx_t s_example_espnow_reliable;
+static uint16_t s_example_espnow_reliable_left;   //Messages not handed to the reliable sender yet.
+static int64_t s_example_espnow_reliable_next_us; //Earliest time of the next new message.
+static int64_t s_example_espnow_reliable_start_us;
+#endif
+#if CONFIG_ESPNOW_SEND_WINDOW_BENCH
+static char s_example_espnow_bench_msg[ESP_NOW_MAX_DATA_LEN];
+static int64_t s_example_espnow_bench_start;
+#endif
+#if CONFIG_ESPNOW_BULK_RX_ENABLE
+static espnow_bulk_rx_t s_example_espnow_bulk;
+static espnow_mcast_rx_t s_example_espnow_mcast;
+static const esp_partition_t *s_example_espnow_image_part;
+static esp_ota_handle_t s_example_espnow_image_ota;   //Open OTA update of the next OTA partition, or 0.
+static uint8_t s_example_espnow_master_mac[ESP_NOW_ETH_ALEN];
+static bool s_example_espnow_master_paired;           //The master answered the discovery broadcast.
+static uint32_t s_example_espnow_image_erased[ESPNOW_BULK_SECTORS_MAX / 32];  //Bit i set: sector i of the partition erased.
+static int64_t s_example_espnow_image_start_us;
+#endif
+#if CONFIG_ESPNOW_RTT_PROBE
+static uint16_t s_example_espnow_probe_left;      //Probes not sent yet.
+static int64_t s_example_espnow_probe_next_us;    //Time the next probe is due.
+static int64_t s_example_espnow_probe_end_us = -1; //Time to stop waiting for the last echoes, -1 while probing.
+static bool s_example_espnow_probe_stalled;       //ESPNOW refused a probe, wait for the next sending callback.
+static espnow_rtt_hist_t s_example_espnow_probe_late;  //How late every probe was sent, unit: us.
+static volatile bool s_example_espnow_rtt_dump;
+#endif
+#if CONFIG_ESPNOW_BENCH_SENDER
+static espnow_bench_tx_t s_example_espnow_bench;
+#endif
+#if CONFIG_ESPNOW_METRICS_PERIOD > 0
+static int64_t s_example_espnow_metrics_at;       //Time the next metrics snapshot is due.
+static uint8_t s_example_espnow_metrics_mac[ESP_NOW_ETH_ALEN];   //Of this device, read at init.
+#endif
+
 static void example_espnow_deinit(example_espnow_send_param_t *send_param);
+static bool example_espnow_peer_list_add(espnow_peer_t *peer);
+
+/* Events from the ESPNOW callbacks reach the ESPNOW task either through a FreeRTOS
+ * queue or through a lock-free ring, selected in menuconfig. */
+static esp_err_t example_espnow_event_transport_init(void)
+{
+#if CONFIG_ESPNOW_EVENT_TRANSPORT_RING
+    espnow_event_ring_init();
+#else
+    s_example_espnow_queue = xQueueCreate(ESPNOW_QUEUE_SIZE, sizeof(example_espnow_event_t));
+    if (s_example_espnow_queue == NULL) {
+        ESP_LOGE(TAG, "Create queue fail");
+        return ESP_FAIL;
+    }
+#endif
+    return ESP_OK;
+}
+
+static void example_espnow_event_transport_deinit(void)
+{
+#if CONFIG_ESPNOW_EVENT_TRANSPORT_QUEUE
+    vSemaphoreDelete(s_example_espnow_queue);
+#endif
+}
+
+/* Called from the WiFi task. Never blocks in ring mode, where the event goes into the
+ * ring of its priority lane. Counts the events dropped and the most events waiting at
+ * the same time. */
+static bool example_espnow_event_post(espnow_lane_t lane, const example_espnow_event_t *evt)
+{
+#if CONFIG_ESPNOW_EVENT_TRANSPORT_RING
+    bool posted = espnow_event_ring_push(lane, evt);
+    uint32_t waiting = espnow_event_ring_count();
+#else
+    bool posted = xQueueSend(s_example_espnow_queue, evt, ESPNOW_MAXDELAY) == pdTRUE;
+    uint32_t waiting = uxQueueMessagesWaiting(s_example_espnow_queue);
+#endif
+
+    if (!posted) {
+        espnow_metrics_inc(ESPNOW_METRIC_QUEUE_FULL);
+    }
+    espnow_metrics_max(ESPNOW_METRIC_QUEUE_HIGH_WATER, waiting);
+    return posted;
+}
+
+static bool example_espnow_event_wait(example_espnow_event_t *evt, TickType_t ticks)
+{
+#if CONFIG_ESPNOW_EVENT_TRANSPORT_RING
+    return espnow_event_ring_wait(evt, ticks);
+#else
+    return xQueueReceive(s_example_espnow_queue, evt, ticks) == pdTRUE;
+#endif
+}
+
+/* Wait for one event, then take whatever else is already pending, up to max events.
+ * Returns the number of events stored in evts. */
+static int example_espnow_event_wait_batch(example_espnow_event_t *evts, int max, TickType_t ticks)
+{
+    int num = 0;
+
+    /* Frames the priority lanes could not send come first, as failed sending callbacks. */
+    while (num < max && espnow_lanes_take_dropped(&evts[num])) {
+        num++;
+    }
+    if (num == 0) {
+        if (!example_espnow_event_wait(&evts[num], ticks)) {
+            return 0;
+        }
+        num = 1;
+    }
+    for (; num < max; num++) {
+        if (!example_espnow_event_wait(&evts[num], 0)) {
+            break;
+        }
+    }
+    return num;
+}
+
+/* Count one wakeup of the ESPNOW task that handled batch_size events. Every
+ * ESPNOW_BATCH_LOG_INTERVAL wakeups the batch size histogram and the event rate
+ * since the previous report are logged, then the histogram is cleared. */
+static void example_espnow_batch_record(int batch_size)
+{
+    static uint32_t hist[ESPNOW_EVENT_BATCH_SIZE + 1];
+    static uint32_t wakeups = 0;
+    static uint32_t events = 0;
+    static int64_t since = 0;
+    char line[16 * (ESPNOW_EVENT_BATCH_SIZE + 1)];
+    int pos = 0;
+
+    if (since == 0) {
+        since = esp_timer_get_time();
+    }
+    hist[batch_size]++;
+    events += batch_size;
+    espnow_metrics_max(ESPNOW_METRIC_BATCH_HIGH_WATER, batch_size);
+    if (++wakeups < ESPNOW_BATCH_LOG_INTERVAL) {
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    line[0] = '\0';
+    for (int i = 1; i <= ESPNOW_EVENT_BATCH_SIZE; i++) {
+        if (hist[i] != 0) {
+            pos += snprintf(line + pos, sizeof(line) - pos, " %d:%lu", i, (unsigned long)hist[i]);
+        }
+    }
+    ESP_LOGI(TAG, "Batches of %lu events in %lu wakeups, %lu events/s, size histogram:%s",
+             (unsigned long)events, (unsigned long)wakeups,
+             (unsigned long)((uint64_t)events * 1000000 / (now - since + 1)), line);
+    memset(hist, 0, sizeof(hist));
+    wakeups = 0;
+    events = 0;
+    since = now;
+}
 
 /* WiFi should start before using ESPNOW */
 static void example_wifi_init(void)
@@ -61,7 +306,7 @@ static void example_wifi_init(void)
 /* ESPNOW sending or receiving callback function is called in WiFi task.
  * Users should not do lengthy operations from this task. Instead, post
  * necessary data to a queue and handle it from a lower priority task. */
-static void example_espnow_send_cb(const uint8_t *mac_addr, esp_now_send_status_t status)
+static void example_espnow_ingest_send(const uint8_t *mac_addr, esp_now_send_status_t status, int64_t start_us)
 {
     example_espnow_event_t evt;
     example_espnow_event_send_cb_t *send_cb = &evt.info.send_cb;
@@ -72,29 +317,33 @@ static void example_espnow_send_cb(const uint8_t *mac_addr, esp_now_send_status_
     }
 
     evt.id = EXAMPLE_ESPNOW_SEND_CB;
+    evt.time_us = (uint32_t)start_us;
     memcpy(send_cb->mac_addr, mac_addr, ESP_NOW_ETH_ALEN);
     send_cb->status = status;
-    if (xQueueSend(s_example_espnow_queue, &evt, ESPNOW_MAXDELAY) != pdTRUE) {
-        ESP_LOGW(TAG, "Send send queue fail");
+    espnow_lanes_sent();
+    espnow_metrics_inc(ESPNOW_METRIC_TX_FRAMES);
+    if (status != ESP_NOW_SEND_SUCCESS) {
+        espnow_metrics_inc(ESPNOW_METRIC_SEND_FAIL);
+    }
+    if (!example_espnow_event_post(espnow_lane_of_send_cb(), &evt)) {
+        ESPNOW_DLOG(EXAMPLE_DLOG_SEND_QUEUE_FAIL);
     }
 }
 
-static void example_espnow_recv_cb(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len)
+static void example_espnow_ingest_recv(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len,
+                                      int64_t start_us)
 {
     example_espnow_event_t evt;
     example_espnow_event_recv_cb_t *recv_cb = &evt.info.recv_cb;
     uint8_t * mac_addr = recv_info->src_addr;
     uint8_t * des_addr = recv_info->des_addr;
 
-    if (mac_addr == NULL || data == NULL || len <= 0) {
+    if (mac_addr == NULL || data == NULL || len <= 0 || len > ESPNOW_RX_POOL_SLOT_LEN) {
         ESP_LOGE(TAG, "Receive cb arg error");
         return;
     }
-    recv_cb->data = malloc(len);
-    if (recv_cb->data == NULL) {
-        ESP_LOGE(TAG, "Malloc receive data fail");
-        return;
-    }
+    espnow_metrics_inc(ESPNOW_METRIC_RX_FRAMES);
+    espnow_pcap_rx(recv_info, data, len);
 
     if (IS_BROADCAST_ADDR(des_addr)) {
         /* If added a peer with encryption before, the receive packets may be
@@ -107,48 +356,94 @@ static void example_espnow_recv_cb(const esp_now_recv_info_t *recv_info, const u
     }
 
     evt.id = EXAMPLE_ESPNOW_RECV_CB;
+    evt.time_us = (uint32_t)start_us;
     memcpy(recv_cb->mac_addr, mac_addr, ESP_NOW_ETH_ALEN);
-    recv_cb->data = malloc(len);
-    if (recv_cb->data == NULL) {
-        ESP_LOGE(TAG, "Malloc receive data fail");
+    recv_cb->slot = espnow_rx_pool_claim();
+    if (recv_cb->slot == ESPNOW_RX_POOL_INVALID_SLOT) {
+        espnow_metrics_inc(ESPNOW_METRIC_NO_MEM);
         return;
     }
-    memcpy(recv_cb->data, data, len);
+    memcpy(espnow_rx_pool_data(recv_cb->slot), data, len);
     recv_cb->data_len = len;
-    if (xQueueSend(s_example_espnow_queue, &evt, ESPNOW_MAXDELAY) != pdTRUE) {
-        ESP_LOGW(TAG, "Send receive queue fail");
-        //free(recv_cb->data);
-        if (recv_cb->data != NULL) {
-            free(recv_cb->data);
-            recv_cb->data = NULL;
-        }
+    recv_cb->rssi = recv_info->rx_ctrl->rssi;
+    if (!example_espnow_event_post(espnow_lane_of_frame(data, len), &evt)) {
+        ESPNOW_DLOG(EXAMPLE_DLOG_RECV_QUEUE_FAIL);
+        espnow_rx_pool_release(recv_cb->slot);
     }
 }
 
-/* Parse received ESPNOW data. */
-int example_espnow_data_parse(uint8_t *data, uint16_t data_len, uint8_t *state, uint16_t *seq, uint32_t *magic, uint8_t **payload, uint16_t *payload_len)
+/* The ingest stage of the receive pipeline, see espnow_stage.h. */
+static void example_espnow_send_cb(const uint8_t *mac_addr, esp_now_send_status_t status)
 {
-    example_espnow_data_t *buf = (example_espnow_data_t *)data;
-    uint16_t crc, crc_cal = 0;
+    int64_t start_us = esp_timer_get_time();
+
+    example_espnow_ingest_send(mac_addr, status, start_us);
+    espnow_stage_end(ESPNOW_STAGE_INGEST, start_us);
+}
 
-    if (data_len < sizeof(example_espnow_data_t)) {
-        ESP_LOGE(TAG, "Receive ESPNOW data too short, len:%d", data_len);
-        return -1;
+static void example_espnow_recv_cb(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len)
+{
+    int64_t start_us = esp_timer_get_time();
+
+    example_espnow_ingest_recv(recv_info, data, len, start_us);
+    espnow_stage_end(ESPNOW_STAGE_INGEST, start_us);
+}
+
+/* Check the length and type of received ESPNOW data and read what tells a copy apart,
+ * without computing the CRC. Returns the type, or a negative espnow_frame_err_t. */
+static int example_espnow_data_header(const uint8_t *data, uint16_t data_len, espnow_frame_t *frame)
+{
+    int ret = espnow_frame_header(data, data_len, frame);
+
+    if (ret == ESPNOW_FRAME_ERR_SHORT || ret == ESPNOW_FRAME_ERR_LONG) {
+        ESP_LOGE(TAG, "Receive ESPNOW data %s, len:%d", espnow_frame_err_name(ret), data_len);
     }
+    return ret;
+}
 
-    *state = buf->state;
-    *seq = buf->seq_num;
-    *magic = buf->magic;
-    crc = buf->crc;
-    buf->crc = 0;
-    crc_cal = esp_crc16_le(UINT16_MAX, (uint8_t const *)buf, data_len);
-     // So sánh CRC
-    if (crc_cal == crc) {
-        *payload = buf->payload;
-        *payload_len = data_len - sizeof(example_espnow_data_t);
-        return buf->type;
+/* Window of the frames of the given type from peer, or NULL if peer is NULL or copies of
+ * the type are not dropped. */
+static espnow_replay_t *example_espnow_replay_win(const espnow_peer_t *peer, int type)
+{
+    uint8_t win = s_example_espnow_replay_of_type[type];
+
+    return peer != NULL && win != 0 ? &s_example_espnow_replay[peer->id][win - 1] : NULL;
+}
+
+/* Parse received ESPNOW data. Returns the type, or a negative espnow_frame_err_t. */
+static int example_espnow_data_parse(const uint8_t *data, uint16_t data_len, espnow_frame_t *frame)
+{
+    int ret = espnow_frame_parse(data, data_len, frame);
+
+    if (ret == ESPNOW_FRAME_ERR_CRC) {
+        espnow_metrics_inc(ESPNOW_METRIC_CRC_FAIL);
     }
-    return -1;
+    return ret;
+}
+
+/* Delivery callback of the reassembly: log every message with the rate at which its fragments arrived. */
+static void example_espnow_frag_deliver(const uint8_t *mac, const uint8_t *data, size_t len, int64_t elapsed_us, void *arg)
+{
+    espnow_frag_stats_t stats;
+
+    espnow_frag_get_stats(&stats);
+    ESP_LOGI(TAG, "Reassembled %u byte message %lu from "MACSTR" in %lld ms, %llu KB/s, %lu dropped", (unsigned)len,
+             (unsigned long)stats.messages, MAC2STR(mac), (long long)(elapsed_us / 1000),
+             (unsigned long long)len * 1000000 / 1024 / (elapsed_us + 1),
+             (unsigned long)(stats.timeouts + stats.superseded + stats.no_mem));
+}
+
+/* Log the duplicate statistics every ESPNOW_REPLAY_LOG_INTERVAL copies dropped. */
+static void example_espnow_replay_record(void)
+{
+    espnow_replay_stats_t stats;
+
+    espnow_replay_get_stats(&stats);
+    if (stats.duplicates % ESPNOW_REPLAY_LOG_INTERVAL != 0) {
+        return;
+    }
+    ESP_LOGI(TAG, "Dropped %lu duplicates of %lu frames, %lu restarted senders", (unsigned long)stats.duplicates,
+             (unsigned long)stats.checked, (unsigned long)stats.restarts);
 }
 
 /* Prepare ESPNOW data to be sent. */
@@ -169,63 +464,1016 @@ void example_espnow_data_prepare(example_espnow_send_param_t *send_param, const
     memcpy(buf->payload, message, strlen(message) + 1); // +1 để bao gồm ký tự kết thúc chuỗi '\0'
     //strncpy((char*)buf->payload, message, send_param->len - sizeof(example_espnow_data_t) - 1);
     //strncpy((char*)buf->payload, message, send_param->len - sizeof(example_espnow_data_t) -1 );
-    buf->payload[send_param->len - sizeof(example_espnow_data_t) - 1] = '\0';
+    /* A length without room for any payload must not cut into the magic number. */
+    if (send_param->len > sizeof(example_espnow_data_t)) {
+        buf->payload[send_param->len - sizeof(example_espnow_data_t) - 1] = '\0';
+    }
     send_param->len = sizeof(example_espnow_data_t) + strlen(message) + 1; // +1 để bao gồm ký tự kết thúc chuỗi '\0'
     //send_param->len = sizeof(example_espnow_data_t) + strlen((char*)buf->payload);
     // ESP_LOGI(TAG, "Prepare to send data from SLAVE: %s", buf->payload);
     // buf->crc = esp_crc16_le(UINT16_MAX, (uint8_t const *)buf, send_param->len);
-    ESP_LOGI(TAG, "Prepare to send data to MASTER: %s", buf->payload);
-    buf->crc = esp_crc16_le(UINT16_MAX, (uint8_t const *)buf, send_param->len);
+    ESPNOW_DLOG(EXAMPLE_DLOG_PREPARE, buf->seq_num, ESPNOW_DLOG_MAC(send_param->dest_mac), send_param->len);
+    buf->crc = espnow_crc16_frame(send_param->buffer, send_param->len, offsetof(example_espnow_data_t, crc));
 }
 
-static void example_espnow_task(void *pvParameter)
+/* Prepare ESPNOW data of the given type carrying len bytes of binary payload. */
+void example_espnow_data_prepare_raw(example_espnow_send_param_t *send_param, uint8_t type, const uint8_t *payload, size_t len)
 {
-    example_espnow_event_t evt;
-    uint8_t recv_state = 0;
-    uint16_t recv_seq = 0;
-    uint32_t recv_magic = 0;
-    uint8_t *payload = NULL;
-    uint16_t payload_len = 0;
-    bool is_broadcast = false;
+    example_espnow_data_t *buf = (example_espnow_data_t *)send_param->buffer;
+    assert(send_param->len >= sizeof(example_espnow_data_t) + len);
+
+    buf->type = type;
+    buf->state = send_param->state;
+    buf->seq_num = s_example_espnow_seq[type]++;
+    buf->crc = 0;
+    buf->magic = send_param->magic;
+    memcpy(buf->payload, payload, len);
+    send_param->len = sizeof(example_espnow_data_t) + len;
+    buf->crc = espnow_crc16_frame(send_param->buffer, send_param->len, offsetof(example_espnow_data_t, crc));
+}
+
+#if CONFIG_ESPNOW_AGGR_ENABLE
+static espnow_aggr_t s_example_espnow_aggr;
+static int64_t s_example_espnow_msg_next_us;
+static uint32_t s_example_espnow_msg_seq;
+
+/* Flush callback of the aggregator: send one aggregated payload from a free window slot. */
+static esp_err_t example_espnow_aggr_flush(const uint8_t *dest_mac, const uint8_t *payload, size_t len, void *arg)
+{
+    example_espnow_send_param_t *send_param = (example_espnow_send_param_t *)arg;
+    example_espnow_send_param_t frame = *send_param;
+    espnow_tx_slot_t *slot = espnow_tx_window_next(&s_example_espnow_window);
+
+    if (slot == NULL || send_param->count <= s_example_espnow_window.in_flight) {
+        return ESP_ERR_NO_MEM;
+    }
+    frame.buffer = slot->buffer;
+    frame.len = sizeof(slot->buffer);
+    memcpy(frame.dest_mac, dest_mac, ESP_NOW_ETH_ALEN);
+    example_espnow_data_prepare_raw(&frame, EXAMPLE_ESPNOW_DATA_AGGREGATE, payload, len);
+    return espnow_tx_window_send(&s_example_espnow_window, slot, frame.dest_mac,
+                                 ((example_espnow_data_t *)slot->buffer)->seq_num, frame.len);
+}
+
+/* Stand-in for the sensors: queue every message of CONFIG_ESPNOW_AGGR_MSG_LEN bytes
+ * that is due by now, at CONFIG_ESPNOW_AGGR_MSG_RATE messages per second. */
+static void example_espnow_aggr_produce(example_espnow_send_param_t *send_param, int64_t now)
+{
+    uint8_t msg[CONFIG_ESPNOW_AGGR_MSG_LEN];
+
+    while (now >= s_example_espnow_msg_next_us) {
+        memset(msg, '.', sizeof(msg));
+        snprintf((char *)msg, sizeof(msg), "m%lu", (unsigned long)s_example_espnow_msg_seq++);
+        espnow_aggr_add(&s_example_espnow_aggr, send_param->dest_mac, msg, sizeof(msg), now);
+        s_example_espnow_msg_next_us += 1000000 / CONFIG_ESPNOW_AGGR_MSG_RATE;
+    }
+}
+#endif
+
+#if CONFIG_ESPNOW_FRAG_ENABLE
+/* Start sending CONFIG_ESPNOW_SEND_COUNT messages: send_param->count then counts their fragments. */
+static void example_espnow_frag_start(example_espnow_send_param_t *send_param)
+{
+    for (size_t i = 0; i < sizeof(s_example_espnow_frag_msg); i++) {
+        s_example_espnow_frag_msg[i] = (uint8_t)i;
+    }
+    send_param->count = CONFIG_ESPNOW_SEND_COUNT * espnow_frag_count(sizeof(s_example_espnow_frag_msg));
+    espnow_frag_tx_start(&s_example_espnow_frag, ++s_example_espnow_frag_id, s_example_espnow_frag_msg,
+                         sizeof(s_example_espnow_frag_msg));
+    s_example_espnow_frag_start_us = esp_timer_get_time();
+}
+
+/* Prepare the next fragment, moving on to the next message after the last fragment of one. */
+static void example_espnow_frag_prepare(example_espnow_send_param_t *frame)
+{
+    uint8_t payload[sizeof(espnow_frag_hdr_t) + ESPNOW_FRAG_DATA_MAX];
+    size_t len = espnow_frag_tx_next(&s_example_espnow_frag, payload);
+
+    if (len == 0) {
+        espnow_frag_tx_start(&s_example_espnow_frag, ++s_example_espnow_frag_id, s_example_espnow_frag_msg,
+                             sizeof(s_example_espnow_frag_msg));
+        len = espnow_frag_tx_next(&s_example_espnow_frag, payload);
+    }
+    example_espnow_data_prepare_raw(frame, EXAMPLE_ESPNOW_DATA_FRAGMENT, payload, len);
+}
+
+static void example_espnow_frag_log_stats(void)
+{
+    int64_t elapsed = esp_timer_get_time() - s_example_espnow_frag_start_us;
+    uint64_t bytes = (uint64_t)CONFIG_ESPNOW_SEND_COUNT * sizeof(s_example_espnow_frag_msg);
+
+    ESP_LOGI(TAG, "Sent %d messages of %u bytes in %lld ms, %llu KB/s, %lu fragments failed",
+             CONFIG_ESPNOW_SEND_COUNT, (unsigned)sizeof(s_example_espnow_frag_msg), (long long)(elapsed / 1000),
+             (unsigned long long)(bytes * 1000000 / 1024 / (elapsed + 1)), (unsigned long)s_example_espnow_window.failed);
+}
+#endif
+
+#if CONFIG_ESPNOW_RELIABLE
+/* Transmit callback of the reliable sender. The frame carries the sender's base and,
+ * piggybacked, the acknowledgement of reliable data received from the destination. */
+static esp_err_t example_espnow_reliable_xmit(const uint8_t *dest_mac, uint16_t seq, const uint8_t *data, size_t len, void *arg)
+{
+    static uint8_t buffer[ESP_NOW_MAX_DATA_LEN];
+    example_espnow_send_param_t *send_param = (example_espnow_send_param_t *)arg;
+    example_espnow_data_t *buf = (example_espnow_data_t *)buffer;
+    espnow_reliable_hdr_t *hdr = (espnow_reliable_hdr_t *)buf->payload;
+    espnow_peer_t *peer = espnow_peer_table_lookup(dest_mac);
+    size_t frame_len = sizeof(example_espnow_data_t) + sizeof(espnow_reliable_hdr_t) + len;
+
+    buf->type = EXAMPLE_ESPNOW_DATA_RELIABLE;
+    buf->state = send_param->state;
+    buf->seq_num = seq;
+    buf->crc = 0;
+    buf->magic = send_param->magic;
+    hdr->base = s_example_espnow_reliable.base;
+    if (peer != NULL) {
+        espnow_reliable_rx_ack(&s_example_espnow_rx[peer->id], &hdr->ack);
+    } else {
+        memset(&hdr->ack, 0, sizeof(espnow_reliable_ack_t));
+    }
+    memcpy(buf->payload + sizeof(espnow_reliable_hdr_t), data, len);
+    buf->crc = espnow_crc16_frame(buffer, frame_len, offsetof(example_espnow_data_t, crc));
+    return espnow_lanes_send(dest_mac, buffer, frame_len);
+}
+
+/* Delivery callback of the reliable sender: one message less to wait for. */
+static void example_espnow_reliable_done(uint16_t seq, bool delivered, void *arg)
+{
+    example_espnow_send_param_t *send_param = (example_espnow_send_param_t *)arg;
+
+    if (!delivered) {
+        ESP_LOGW(TAG, "Reliable data seq %u to "MACSTR" given up", seq, MAC2STR(send_param->dest_mac));
+    }
+    send_param->count--;
+}
+#endif
+
+#if CONFIG_ESPNOW_RTT_PROBE
+/* Transmit callback of the round trip time probes. */
+static esp_err_t example_espnow_probe_xmit(const uint8_t *mac, const uint8_t *payload, size_t len, void *arg)
+{
+    uint8_t buffer[sizeof(example_espnow_data_t) + sizeof(espnow_rtt_probe_t)];
+    example_espnow_send_param_t frame = *(example_espnow_send_param_t *)arg;
+
+    frame.buffer = buffer;
+    frame.len = sizeof(buffer);
+    example_espnow_data_prepare_raw(&frame, EXAMPLE_ESPNOW_DATA_PROBE, payload, len);
+    return espnow_lanes_send(mac, frame.buffer, frame.len);
+}
+
+/* Falling edge on CONFIG_ESPNOW_RTT_DUMP_GPIO: the ESPNOW task logs the histograms at its next wakeup. */
+static void IRAM_ATTR example_espnow_rtt_dump_isr(void *arg)
+{
+    s_example_espnow_rtt_dump = true;
+}
+
+static void example_espnow_rtt_log(bool buckets)
+{
+    espnow_rtt_dump(buckets);
+    espnow_rtt_hist_log("Probe lateness", &s_example_espnow_probe_late, buckets);
+}
+#endif
+
+#if CONFIG_ESPNOW_BENCH_SENDER
+/* Transmit callback of the benchmark sender. */
+static esp_err_t example_espnow_bench_xmit(const uint8_t *mac, const uint8_t *payload, size_t len, void *arg)
+{
+    uint8_t buffer[ESP_NOW_MAX_DATA_LEN];
+    example_espnow_send_param_t frame = *(example_espnow_send_param_t *)arg;
+
+    frame.buffer = buffer;
+    frame.len = sizeof(buffer);
+    example_espnow_data_prepare_raw(&frame, EXAMPLE_ESPNOW_DATA_BENCH, payload, len);
+    return espnow_lanes_send(mac, frame.buffer, frame.len);
+}
+#endif
+
+#if CONFIG_ESPNOW_METRICS_PERIOD > 0
+/* Print a snapshot of the metrics when one is due and, once discovery is over,
+ * broadcast it for the master to print. */
+static void example_espnow_metrics_poll(example_espnow_send_param_t *send_param)
+{
+    uint8_t buffer[sizeof(example_espnow_data_t) + sizeof(espnow_metrics_snapshot_t)];
+    example_espnow_send_param_t frame = *send_param;
+    espnow_metrics_snapshot_t snap;
+    int64_t now = esp_timer_get_time();
+    esp_err_t ret;
+
+    if (now < s_example_espnow_metrics_at) {
+        return;
+    }
+    s_example_espnow_metrics_at = now + (int64_t)CONFIG_ESPNOW_METRICS_PERIOD * 1000000;
+    espnow_metrics_snapshot(&snap);
+    espnow_metrics_print(s_example_espnow_metrics_mac, (const uint8_t *)&snap, sizeof(snap));
+    /* The sending callback of a broadcast would otherwise reschedule the discovery broadcast. */
+    if (send_param->broadcast) {
+        return;
+    }
+    frame.buffer = buffer;
+    frame.len = sizeof(buffer);
+    example_espnow_data_prepare_raw(&frame, EXAMPLE_ESPNOW_DATA_METRICS, (const uint8_t *)&snap, sizeof(snap));
+    ret = espnow_lanes_send(s_example_broadcast_mac, frame.buffer, frame.len);
+    if (ret != ESP_OK && ret != ESP_ERR_ESPNOW_NO_MEM) {
+        ESP_LOGW(TAG, "Send metrics fail: %s", esp_err_to_name(ret));
+    }
+}
+#endif
+
+/* How long the ESPNOW task may block waiting for events. The task also wakes up when
+ * the discovery broadcast is due again or the send delay is over, with aggregation
+ * when a message is due or an aggregated frame must be flushed, in reliable mode
+ * when a message is due or a retransmission timeout expires, while measuring the
+ * round trip time when a probe is due or the last echoes have had their time, in the
+ * throughput benchmark when a frame is due or a run ends, and when a metrics snapshot
+ * is due. */
+static TickType_t example_espnow_wait_ticks(const example_espnow_send_param_t *send_param)
+{
+    int64_t next = s_example_espnow_rebroadcast_at;
+
+    if (s_example_espnow_send_at >= 0 && (next < 0 || s_example_espnow_send_at < next)) {
+        next = s_example_espnow_send_at;
+    }
+
+#if CONFIG_ESPNOW_AGGR_ENABLE
+    if (send_param->unicast) {
+        int64_t deadline = espnow_aggr_next_deadline(&s_example_espnow_aggr);
+        if (next < 0 || s_example_espnow_msg_next_us < next) {
+            next = s_example_espnow_msg_next_us;
+        }
+        if (deadline >= 0 && deadline < next) {
+            next = deadline;
+        }
+    }
+#endif
+#if CONFIG_ESPNOW_RELIABLE
+    if (send_param->unicast) {
+        int64_t deadline = espnow_reliable_next_deadline(&s_example_espnow_reliable);
+        if (deadline >= 0 && (next < 0 || deadline < next)) {
+            next = deadline;
+        }
+        if (s_example_espnow_reliable_left > 0 && !espnow_reliable_full(&s_example_espnow_reliable) &&
+            !s_example_espnow_reliable.stalled && (next < 0 || s_example_espnow_reliable_next_us < next)) {
+            next = s_example_espnow_reliable_next_us;
+        }
+    }
+#endif
+#if CONFIG_ESPNOW_RTT_PROBE
+    if (send_param->unicast) {
+        int64_t deadline = s_example_espnow_probe_left > 0 ? (s_example_espnow_probe_stalled ? -1 : s_example_espnow_probe_next_us)
+                                                           : s_example_espnow_probe_end_us;
+        if (deadline >= 0 && (next < 0 || deadline < next)) {
+            next = deadline;
+        }
+    }
+#endif
+#if CONFIG_ESPNOW_BENCH_SENDER
+    if (send_param->unicast) {
+        int64_t deadline = espnow_bench_tx_next_deadline(&s_example_espnow_bench);
+        if (deadline >= 0 && (next < 0 || deadline < next)) {
+            next = deadline;
+        }
+    }
+#endif
+#if CONFIG_ESPNOW_BENCH_RECEIVER
+    int64_t bench_deadline = espnow_bench_rx_next_deadline();
+    if (bench_deadline >= 0 && (next < 0 || bench_deadline < next)) {
+        next = bench_deadline;
+    }
+#endif
+#if CONFIG_ESPNOW_METRICS_PERIOD > 0
+    if (next < 0 || s_example_espnow_metrics_at < next) {
+        next = s_example_espnow_metrics_at;
+    }
+#endif
+    if (next < 0) {
+        return portMAX_DELAY;
+    }
+    int64_t wait_us = next - esp_timer_get_time();
+    if (wait_us <= 0) {
+        return 0;
+    }
+    TickType_t ticks = pdMS_TO_TICKS((wait_us + 999) / 1000);
+    return ticks > 0 ? ticks : 1;
+}
+
+/* Send the discovery broadcast, carrying the current handshake state. */
+static esp_err_t example_espnow_broadcast(example_espnow_send_param_t *send_param)
+{
+    send_param->len = ESPNOW_BROADCAST_LEN;
+    memcpy(send_param->dest_mac, s_example_broadcast_mac, ESP_NOW_ETH_ALEN);
+    example_espnow_data_prepare(send_param, "first broadcast");
+    s_example_espnow_broadcasts++;
+    return espnow_lanes_send(send_param->dest_mac, send_param->buffer, send_param->len);
+}
+
+/* Build unicast frames into free window slots and send them, until the window is full
+ * or every remaining frame of send_param->count is in flight. */
+static esp_err_t example_espnow_window_fill(example_espnow_send_param_t *send_param)
+{
+#if CONFIG_ESPNOW_AGGR_ENABLE
+    /* Data frames are built by example_espnow_aggr_flush as aggregated messages fill up or time out. */
+    int64_t now = esp_timer_get_time();
+    example_espnow_aggr_produce(send_param, now);
+    espnow_aggr_poll(&s_example_espnow_aggr, now);
+#elif CONFIG_ESPNOW_RELIABLE
+    /* Retransmissions are due on their own; new messages go out one send delay apart
+     * while the window has room. */
+    int64_t now = esp_timer_get_time();
+    esp_err_t ret;
+
+    espnow_reliable_poll(&s_example_espnow_reliable, now);
+    while (s_example_espnow_reliable_left > 0 && !espnow_reliable_full(&s_example_espnow_reliable) &&
+           !s_example_espnow_reliable.stalled && now >= s_example_espnow_reliable_next_us) {
+        ret = espnow_reliable_send(&s_example_espnow_reliable, (const uint8_t *)s_example_espnow_window_msg,
+                                   strlen(s_example_espnow_window_msg) + 1, now);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        s_example_espnow_reliable_left--;
+        s_example_espnow_reliable_next_us = now + (int64_t)send_param->delay * 1000;
+    }
+#elif CONFIG_ESPNOW_RTT_PROBE
+    /* Probes are due one send delay apart on a fixed schedule, so how late each one
+     * leaves shows how late the task woke up. */
+    int64_t now = esp_timer_get_time();
+    esp_err_t ret;
+
+    while (s_example_espnow_probe_left > 0 && !s_example_espnow_probe_stalled && now >= s_example_espnow_probe_next_us) {
+        ret = espnow_rtt_probe(send_param->dest_mac, example_espnow_probe_xmit, send_param);
+        if (ret == ESP_ERR_ESPNOW_NO_MEM) {
+            /* ESPNOW is out of transmit buffers, try again after the next sending callback. */
+            s_example_espnow_probe_stalled = true;
+            break;
+        }
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        espnow_rtt_hist_record(&s_example_espnow_probe_late, (uint32_t)(now - s_example_espnow_probe_next_us));
+        s_example_espnow_probe_next_us += (int64_t)send_param->delay * 1000;
+        if (--s_example_espnow_probe_left == 0) {
+            s_example_espnow_probe_end_us = now + ESPNOW_RTT_DRAIN_MS * 1000;
+        }
+        now = esp_timer_get_time();
+    }
+#elif CONFIG_ESPNOW_BENCH_SENDER
+    /* Frames go out as fast as ESPNOW takes them or at the benchmark rate until the run ends. */
+    return espnow_bench_tx_poll(&s_example_espnow_bench, esp_timer_get_time());
+#else
+    espnow_tx_slot_t *slot;
+    example_espnow_send_param_t frame;
+    esp_err_t ret;
+
+    while (send_param->count > s_example_espnow_window.in_flight &&
+           (slot = espnow_tx_window_next(&s_example_espnow_window)) != NULL) {
+        frame = *send_param;
+        frame.buffer = slot->buffer;
+        frame.len = sizeof(slot->buffer);
+#if CONFIG_ESPNOW_FRAG_ENABLE
+        example_espnow_frag_prepare(&frame);
+#else
+        example_espnow_data_prepare(&frame, s_example_espnow_window_msg);
+#endif
+        ret = espnow_tx_window_send(&s_example_espnow_window, slot, frame.dest_mac,
+                                    ((example_espnow_data_t *)slot->buffer)->seq_num, frame.len);
+        if (ret == ESP_ERR_ESPNOW_NO_MEM) {
+            /* ESPNOW is out of transmit buffers, try again after the next sending callback. */
+            break;
+        }
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+#endif
+    return ESP_OK;
+}
+
+#if CONFIG_ESPNOW_SEND_WINDOW_BENCH
+/* Start a benchmark round: send count frames of CONFIG_ESPNOW_SEND_LEN bytes without delay. */
+static void example_espnow_bench_start(example_espnow_send_param_t *send_param, uint8_t window)
+{
+    size_t msg_len = 0;
+
+    if (CONFIG_ESPNOW_SEND_LEN > sizeof(example_espnow_data_t)) {
+        msg_len = CONFIG_ESPNOW_SEND_LEN - sizeof(example_espnow_data_t) - 1;
+    }
+    memset(s_example_espnow_bench_msg, 'x', msg_len);
+    s_example_espnow_bench_msg[msg_len] = '\0';
+    s_example_espnow_window_msg = s_example_espnow_bench_msg;
+
+    send_param->count = CONFIG_ESPNOW_SEND_COUNT;
+    send_param->delay = 0;
+    espnow_tx_window_init(&s_example_espnow_window, window);
+    s_example_espnow_bench_start = esp_timer_get_time();
+}
+
+/* Log the result of the round that just finished. Returns true if another round,
+ * with a window one larger, has been started. */
+static bool example_espnow_bench_next(example_espnow_send_param_t *send_param)
+{
+    espnow_tx_window_t *win = &s_example_espnow_window;
+    int64_t elapsed = esp_timer_get_time() - s_example_espnow_bench_start;
+
+    if (elapsed <= 0) {
+        elapsed = 1;
+    }
+    ESP_LOGI(TAG, "Window %2u: %lu frames, %lu failed, %llu frames/s, %llu bytes/s",
+             win->size, (unsigned long)win->succeeded, (unsigned long)win->failed,
+             (unsigned long long)win->succeeded * 1000000 / elapsed,
+             (unsigned long long)win->bytes * 1000000 / elapsed);
+    if (win->size >= ESPNOW_TX_WINDOW_MAX) {
+        return false;
+    }
+    example_espnow_bench_start(send_param, win->size + 1);
+    return true;
+}
+#endif
+
+#if CONFIG_ESPNOW_BULK_RX_ENABLE
+/* Begin callback of the bulk and multicast receivers: pick the destination partition.
+ * An image for the next OTA partition goes through esp_ota_begin(), which erases the
+ * sectors it covers at once; the master sends its offer again until it is answered.
+ * Sectors of a labelled partition are erased as the first chunk that touches them
+ * arrives, so no long erase holds up the ESPNOW task. */
+static esp_err_t example_espnow_image_begin(uint32_t size, void *arg)
+{
+    const char *label = CONFIG_ESPNOW_BULK_RX_PARTITION;
+    const esp_partition_t *part;
+    esp_err_t err;
+
+    /* An offer that replaces a transfer leaves its update open. */
+    if (s_example_espnow_image_ota != 0) {
+        esp_ota_abort(s_example_espnow_image_ota);
+        s_example_espnow_image_ota = 0;
+    }
+    if (label[0] != '\0') {
+        part = esp_partition_find_first(ESP_PARTITION_TYPE_ANY, ESP_PARTITION_SUBTYPE_ANY, label);
+    } else {
+        part = esp_ota_get_next_update_partition(NULL);
+    }
+    if (part == NULL) {
+        ESP_LOGW(TAG, "No partition to receive a bulk transfer into");
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (size > part->size || (size + part->erase_size - 1) / part->erase_size > ESPNOW_BULK_SECTORS_MAX) {
+        ESP_LOGW(TAG, "Image of %lu bytes does not fit partition %s", (unsigned long)size, part->label);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (label[0] == '\0') {
+        err = esp_ota_begin(part, size, &s_example_espnow_image_ota);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "OTA begin on partition %s fail: %s", part->label, esp_err_to_name(err));
+            s_example_espnow_image_ota = 0;
+            return err;
+        }
+    }
+    s_example_espnow_image_part = part;
+    memset(s_example_espnow_image_erased, 0, sizeof(s_example_espnow_image_erased));
+    s_example_espnow_image_start_us = esp_timer_get_time();
+    ESP_LOGI(TAG, "Receive %lu byte image into partition %s", (unsigned long)size, part->label);
+    return ESP_OK;
+}
+
+/* Write callback of the receivers. Chunks arrive out of order, so an OTA update is
+ * written at the chunk's offset. Otherwise erase the sectors the chunk is the first to
+ * touch, then write it. */
+static esp_err_t example_espnow_image_write(uint32_t offset, const uint8_t *data, size_t len, void *arg)
+{
+    uint32_t sector_size = s_example_espnow_image_part->erase_size;
+    esp_err_t err;
+
+    if (s_example_espnow_image_ota != 0) {
+        err = esp_ota_write_with_offset(s_example_espnow_image_ota, data, len, offset);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "OTA write at offset %lu fail: %s", (unsigned long)offset, esp_err_to_name(err));
+        }
+        return err;
+    }
+    for (uint32_t sector = offset / sector_size; sector <= (offset + len - 1) / sector_size; sector++) {
+        if (s_example_espnow_image_erased[sector / 32] & (1UL << (sector % 32))) {
+            continue;
+        }
+        err = esp_partition_erase_range(s_example_espnow_image_part, sector * sector_size, sector_size);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Erase sector %lu fail: %s", (unsigned long)sector, esp_err_to_name(err));
+            return err;
+        }
+        s_example_espnow_image_erased[sector / 32] |= 1UL << (sector % 32);
+    }
+    err = esp_partition_write(s_example_espnow_image_part, offset, data, len);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Write at offset %lu fail: %s", (unsigned long)offset, esp_err_to_name(err));
+    }
+    return err;
+}
+
+static esp_err_t example_espnow_image_read(uint32_t offset, uint8_t *data, size_t len, void *arg)
+{
+    return esp_partition_read(s_example_espnow_image_part, offset, data, len);
+}
+
+/* End callback of the receivers: read the image back to check its CRC32. The CRC32 only
+ * catches corruption on the way, it does not authenticate the image. An image written
+ * to the next OTA partition must then pass the checks of esp_ota_end() before it
+ * becomes the boot partition. */
+static esp_err_t example_espnow_image_end(uint32_t size, uint32_t crc, void *arg)
+{
+    uint8_t buf[256];
+    uint32_t crc_cal = 0;
+    int64_t elapsed = esp_timer_get_time() - s_example_espnow_image_start_us;
+    esp_err_t err = ESP_OK;
+
+    for (uint32_t offset = 0; offset < size; offset += sizeof(buf)) {
+        uint32_t n = size - offset < sizeof(buf) ? size - offset : sizeof(buf);
+        err = esp_partition_read(s_example_espnow_image_part, offset, buf, n);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Read at offset %lu fail: %s", (unsigned long)offset, esp_err_to_name(err));
+            break;
+        }
+        crc_cal = esp_crc32_le(crc_cal, buf, n);
+    }
+    if (err == ESP_OK && crc_cal != crc) {
+        ESP_LOGW(TAG, "Image CRC32 %08lx, expected %08lx", (unsigned long)crc_cal, (unsigned long)crc);
+        err = ESP_ERR_INVALID_CRC;
+    }
+    if (err != ESP_OK) {
+        if (s_example_espnow_image_ota != 0) {
+            esp_ota_abort(s_example_espnow_image_ota);
+            s_example_espnow_image_ota = 0;
+        }
+        return err;
+    }
+    ESP_LOGI(TAG, "Received %lu bytes in %lld ms, %llu KB/s", (unsigned long)size, (long long)(elapsed / 1000),
+             (unsigned long long)size * 1000000 / 1024 / (elapsed + 1));
+    if (s_example_espnow_image_ota != 0) {
+        /* esp_ota_end() frees the handle whatever it returns. */
+        err = esp_ota_end(s_example_espnow_image_ota);
+        s_example_espnow_image_ota = 0;
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Image in partition %s rejected: %s", s_example_espnow_image_part->label, esp_err_to_name(err));
+            return err;
+        }
+        err = esp_ota_set_boot_partition(s_example_espnow_image_part);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Set boot partition fail: %s", esp_err_to_name(err));
+            return err;
+        }
+        ESP_LOGI(TAG, "Partition %s boots at the next restart", s_example_espnow_image_part->label);
+    }
+    return ESP_OK;
+}
+
+/* Transmit callback of the bulk receiver, for its statuses. */
+static esp_err_t example_espnow_bulk_xmit(const uint8_t *mac, const uint8_t *payload, size_t len, void *arg)
+{
+    static uint8_t buffer[sizeof(example_espnow_data_t) + sizeof(espnow_bulk_hdr_t) + sizeof(espnow_bulk_status_t)];
+    example_espnow_send_param_t frame = *(example_espnow_send_param_t *)arg;
+
+    frame.buffer = buffer;
+    frame.len = sizeof(buffer);
+    example_espnow_data_prepare_raw(&frame, EXAMPLE_ESPNOW_DATA_BULK, payload, len);
+    return espnow_lanes_send(mac, frame.buffer, frame.len);
+}
+
+/* Transmit callback of the multicast receiver, for its NACKs. Among many devices the
+ * peer list may be full without the master: its NACKs are then broadcast instead. */
+static esp_err_t example_espnow_mcast_xmit(const uint8_t *mac, const uint8_t *payload, size_t len, void *arg)
+{
+    static uint8_t buffer[ESP_NOW_MAX_DATA_LEN];
+    example_espnow_send_param_t frame = *(example_espnow_send_param_t *)arg;
+    espnow_peer_t *peer = espnow_peer_table_lookup(mac);
+
+    if (peer == NULL || !example_espnow_peer_list_add(peer)) {
+        mac = s_example_broadcast_mac;
+    }
+    frame.buffer = buffer;
+    frame.len = sizeof(buffer);
+    example_espnow_data_prepare_raw(&frame, EXAMPLE_ESPNOW_DATA_MCAST, payload, len);
+    return espnow_lanes_send(mac, frame.buffer, frame.len);
+}
+
+/* Whether mac is the master the device paired with. Bulk and multicast frames of any
+ * other device are dropped, so that it can neither start nor replace a transfer. */
+static bool example_espnow_from_master(const uint8_t *mac)
+{
+    if (!s_example_espnow_master_paired || memcmp(mac, s_example_espnow_master_mac, ESP_NOW_ETH_ALEN) != 0) {
+        ESP_LOGD(TAG, "Drop image data from "MACSTR", not the paired master", MAC2STR(mac));
+        return false;
+    }
+    return true;
+}
+
+static void example_espnow_mcast_log_stats(void)
+{
+    const espnow_mcast_rx_stats_t *stats = &s_example_espnow_mcast.stats;
+
+    ESP_LOGI(TAG, "Multicast from "MACSTR": %lu chunks received, %lu rebuilt from parity, %lu duplicates, "
+             "%lu parity chunks unneeded, %lu NACKs sent", MAC2STR(s_example_espnow_mcast.src_mac),
+             (unsigned long)stats->chunks, (unsigned long)stats->recovered, (unsigned long)stats->duplicates,
+             (unsigned long)stats->unneeded, (unsigned long)stats->nacks);
+}
+#endif
+
+/* Add a device to the ESPNOW peer list, encrypted with the LMK. The peer table
+ * remembers which devices are already there, so known devices cost neither
+ * esp_now_is_peer_exist nor a heap allocation. Returns false if the peer list is full. */
+static bool example_espnow_peer_list_add(espnow_peer_t *peer)
+{
+    esp_now_peer_info_t peer_info;
+    esp_err_t err;
+
+    if (peer->in_peer_list) {
+        return true;
+    }
+    memset(&peer_info, 0, sizeof(esp_now_peer_info_t));
+    peer_info.channel = CONFIG_ESPNOW_CHANNEL;
+    peer_info.ifidx = ESPNOW_WIFI_IF;
+    peer_info.encrypt = true;
+    memcpy(peer_info.lmk, CONFIG_ESPNOW_LMK, ESP_NOW_KEY_LEN);
+    memcpy(peer_info.peer_addr, peer->mac_addr, ESP_NOW_ETH_ALEN);
+    err = esp_now_add_peer(&peer_info);
+    if (err == ESP_ERR_ESPNOW_FULL) {
+        ESP_LOGW(TAG, "Peer list full, "MACSTR" not added", MAC2STR(peer->mac_addr));
+        espnow_metrics_inc(ESPNOW_METRIC_PEER_ADD_FAIL);
+        return false;
+    }
+    if (err != ESP_ERR_ESPNOW_EXIST) {
+        ESP_ERROR_CHECK(err);
+    }
+    peer->in_peer_list = true;
+    return true;
+}
+
+/* Add peer to the devices owed an acknowledgement at the end of the batch, once. */
+static void example_espnow_ack_queue(espnow_peer_t **peers, int *num, espnow_peer_t *peer)
+{
+    for (int i = 0; i < *num; i++) {
+        if (peers[i] == peer) {
+            return;
+        }
+    }
+    peers[(*num)++] = peer;
+}
+
+/* Acknowledge the reliable data received from peers during one batch of events, one
+ * EXAMPLE_ESPNOW_DATA_ACK frame per device. An acknowledgement that cannot be sent is
+ * dropped: the sender's retransmission asks for it again. */
+static void example_espnow_send_acks(example_espnow_send_param_t *send_param, espnow_peer_t *const *peers, int num)
+{
+    uint8_t buffer[sizeof(example_espnow_data_t) + sizeof(espnow_reliable_ack_t)];
+    example_espnow_send_param_t frame = *send_param;
+    espnow_reliable_ack_t ack;
+    esp_err_t ret;
+
+    frame.buffer = buffer;
+    for (int i = 0; i < num; i++) {
+        if (!example_espnow_peer_list_add(peers[i])) {
+            continue;
+        }
+        espnow_reliable_rx_ack(&s_example_espnow_rx[peers[i]->id], &ack);
+        frame.len = sizeof(buffer);
+        example_espnow_data_prepare_raw(&frame, EXAMPLE_ESPNOW_DATA_ACK, (const uint8_t *)&ack, sizeof(ack));
+        ret = espnow_lanes_send(peers[i]->mac_addr, frame.buffer, frame.len);
+        if (ret != ESP_OK && ret != ESP_ERR_ESPNOW_NO_MEM) {
+            ESP_LOGW(TAG, "Send ACK to "MACSTR" fail: %s", MAC2STR(peers[i]->mac_addr), esp_err_to_name(ret));
+        }
+    }
+}
+
+/* Send the payload of a round trip time probe back to peer, untouched. An echo that
+ * cannot be sent is dropped: the prober counts the probe as lost. */
+static void example_espnow_probe_echo(example_espnow_send_param_t *send_param, espnow_peer_t *peer,
+                                      const uint8_t *payload, size_t len)
+{
+    uint8_t buffer[sizeof(example_espnow_data_t) + sizeof(espnow_rtt_probe_t)];
+    example_espnow_send_param_t frame = *send_param;
+    esp_err_t ret;
+
+    if (len > sizeof(espnow_rtt_probe_t) || !example_espnow_peer_list_add(peer)) {
+        return;
+    }
+    frame.buffer = buffer;
+    frame.len = sizeof(example_espnow_data_t) + len;
+    example_espnow_data_prepare_raw(&frame, EXAMPLE_ESPNOW_DATA_ECHO, payload, len);
+    ret = espnow_lanes_send(peer->mac_addr, frame.buffer, frame.len);
+    if (ret != ESP_OK && ret != ESP_ERR_ESPNOW_NO_MEM) {
+        ESP_LOGW(TAG, "Send echo to "MACSTR" fail: %s", MAC2STR(peer->mac_addr), esp_err_to_name(ret));
+    }
+}
+
+/* Handle a frame from the ESPNOW receiving callback and release its pool slot. Devices
+ * owed an acknowledgement are added to ack_peers, see example_espnow_ack_queue(). */
+static void example_espnow_handle_recv(example_espnow_send_param_t *send_param, example_espnow_event_recv_cb_t *recv_cb,
+                                       espnow_peer_t **ack_peers, int *ack_num)
+{
+    uint8_t *data = espnow_rx_pool_data(recv_cb->slot);
+    espnow_peer_t *peer = NULL;
+    espnow_replay_t *win = NULL;
+    espnow_frame_t frame = { 0 };
+    espnow_reliable_hdr_t reliable_hdr;
     int ret;
 
-    // vTaskDelay(5000 / portTICK_PERIOD_MS);
-    // ESP_LOGI(TAG, "Start sending broadcast data");
+    ret = example_espnow_data_header(data, recv_cb->data_len, &frame);
+    /* A device not in the table has sent nothing yet, so its frame cannot be a copy.
+     * It is added only once a frame of it passed its CRC, so corrupt or forged
+     * addresses do not fill the table. */
+    if (ret >= 0) {
+        peer = espnow_peer_table_lookup(recv_cb->mac_addr);
+        win = example_espnow_replay_win(peer, ret);
+    }
+    /* A copy of a frame already handled is dropped before its CRC is checked. Only a
+     * copy of reliable data needs an answer: its acknowledgement may have been lost. */
+    if (win != NULL && !espnow_replay_check(win, frame.magic, frame.seq)) {
+        if (ret == EXAMPLE_ESPNOW_DATA_RELIABLE) {
+            example_espnow_ack_queue(ack_peers, ack_num, peer);
+        }
+        example_espnow_replay_record();
+        espnow_rx_pool_release(recv_cb->slot);
+        return;
+    }
+    if (ret >= 0) {
+#if CONFIG_ESPNOW_BENCH_RECEIVER
+        int type = ret;
+#endif
+        ret = example_espnow_data_parse(data, recv_cb->data_len, &frame);
+#if CONFIG_ESPNOW_BENCH_RECEIVER
+        /* The header is sound, so a failed parse is a failed CRC. */
+        if (ret < 0 && type == EXAMPLE_ESPNOW_DATA_BENCH) {
+            espnow_bench_rx_crc_error(recv_cb->mac_addr);
+        }
+#endif
+    }
+    if (ret >= 0 && peer == NULL) {
+        peer = espnow_peer_table_get_or_add(recv_cb->mac_addr);
+        if (peer == NULL) {
+            ESP_LOGW(TAG, "Peer table full, "MACSTR" not tracked", MAC2STR(recv_cb->mac_addr));
+            espnow_metrics_inc(ESPNOW_METRIC_PEER_ADD_FAIL);
+        }
+        win = example_espnow_replay_win(peer, ret);
+    }
+    if (ret >= 0 && win != NULL) {
+        espnow_replay_update(win, frame.magic, frame.seq);
+    }
+    if (ret >= 0 && peer != NULL) {
+        espnow_peer_table_seen(peer, frame.seq, recv_cb->rssi, esp_timer_get_time());
+    }
+    if (ret == EXAMPLE_ESPNOW_DATA_BROADCAST) {
+        ESPNOW_DLOG(EXAMPLE_DLOG_RECV_BROADCAST, frame.seq, ESPNOW_DLOG_MAC(recv_cb->mac_addr), recv_cb->data_len);
 
-    /* Start sending broadcast ESPNOW data. */
-    example_espnow_send_param_t *send_param = (example_espnow_send_param_t *)pvParameter;
-    if (esp_now_send(send_param->dest_mac, send_param->buffer, send_param->len) != ESP_OK) {
-        ESP_LOGE(TAG, "Send error");
-        example_espnow_deinit(send_param);
-        vTaskDelete(NULL);
+        /* Unicast data can only be sent to a device in the peer list. */
+#if CONFIG_ESPNOW_RTT_PROBE || CONFIG_ESPNOW_BENCH_SENDER
+        /* Probes and benchmark frames only go to the master, which answers this broadcast
+         * with unicast data. Other slaves are kept out of the peer list so that there is room for it. */
+        bool listed = false;
+#else
+        bool listed = peer != NULL && example_espnow_peer_list_add(peer);
+#endif
+
+        if (espnow_handshake_on_broadcast(send_param, frame.state, frame.magic) == ESPNOW_HANDSHAKE_START_UNICAST &&
+            listed) {
+            ESP_LOGI(TAG, "Start sending unicast data");
+            ESP_LOGI(TAG, "send data to "MACSTR"", MAC2STR(recv_cb->mac_addr));
+
+            /* Start sending unicast ESPNOW data, keeping up to CONFIG_ESPNOW_SEND_WINDOW frames in flight. */
+            memcpy(send_param->dest_mac, recv_cb->mac_addr, ESP_NOW_ETH_ALEN);
+#if CONFIG_ESPNOW_SEND_WINDOW_BENCH
+            example_espnow_bench_start(send_param, 1);
+#else
+            espnow_tx_window_init(&s_example_espnow_window, CONFIG_ESPNOW_SEND_WINDOW);
+#endif
+#if CONFIG_ESPNOW_AGGR_ENABLE
+            espnow_aggr_init(&s_example_espnow_aggr, CONFIG_ESPNOW_AGGR_FLUSH_TIMEOUT * 1000,
+                             example_espnow_aggr_flush, send_param);
+            s_example_espnow_msg_next_us = esp_timer_get_time();
+#endif
+#if CONFIG_ESPNOW_FRAG_ENABLE
+            example_espnow_frag_start(send_param);
+#endif
+#if CONFIG_ESPNOW_RELIABLE
+            espnow_reliable_tx_init(&s_example_espnow_reliable, send_param->dest_mac, CONFIG_ESPNOW_SEND_WINDOW,
+                                    CONFIG_ESPNOW_RELIABLE_MAX_TRIES, CONFIG_ESPNOW_RELIABLE_RTO_MARGIN,
+                                    example_espnow_reliable_xmit, example_espnow_reliable_done, send_param);
+            s_example_espnow_reliable_left = send_param->count;
+            s_example_espnow_reliable_next_us = esp_timer_get_time();
+            s_example_espnow_reliable_start_us = s_example_espnow_reliable_next_us;
+#endif
+            if (example_espnow_window_fill(send_param) != ESP_OK) {
+                ESP_LOGE(TAG, "Send error");
+                example_espnow_deinit(send_param);
+                vTaskDelete(NULL);
+            }
+            else {
+                espnow_handshake_unicast_started(send_param);
+                s_example_espnow_rebroadcast_at = -1;
+            }
+        }
+    }
+    else if (ret == EXAMPLE_ESPNOW_DATA_UNICAST) {
+        //ESP_LOGE(TAG, "Receive %dth unicast data from: "MACSTR", len: %d", frame.seq, MAC2STR(recv_cb->mac_addr), recv_cb->data_len);
+        ESPNOW_DLOG(EXAMPLE_DLOG_RECV_UNICAST, frame.seq, ESPNOW_DLOG_MAC(recv_cb->mac_addr), frame.state, frame.magic,
+                    recv_cb->data_len);
+        ESP_LOGD(TAG, "Message: %.*s", frame.payload_len, (const char *)frame.payload);
+#if CONFIG_ESPNOW_RTT_PROBE || CONFIG_ESPNOW_BENCH_SENDER
+        /* The master's answer to the discovery broadcast names the device to probe or flood. */
+        if (!send_param->unicast && peer != NULL && example_espnow_peer_list_add(peer)) {
+            memcpy(send_param->dest_mac, recv_cb->mac_addr, ESP_NOW_ETH_ALEN);
+#if CONFIG_ESPNOW_RTT_PROBE
+            ESP_LOGI(TAG, "Start sending probes to "MACSTR"", MAC2STR(recv_cb->mac_addr));
+            s_example_espnow_probe_left = send_param->count;
+            s_example_espnow_probe_next_us = esp_timer_get_time();
+#else
+            ESP_LOGI(TAG, "Start benchmark to "MACSTR"", MAC2STR(recv_cb->mac_addr));
+            espnow_bench_tx_start(&s_example_espnow_bench, recv_cb->mac_addr,
+                                  CONFIG_ESPNOW_SEND_LEN - sizeof(example_espnow_data_t), CONFIG_ESPNOW_BENCH_RATE,
+                                  CONFIG_ESPNOW_BENCH_DURATION * 1000, example_espnow_bench_xmit, send_param,
+                                  esp_timer_get_time());
+#endif
+            espnow_handshake_unicast_started(send_param);
+        }
+#endif
+#if CONFIG_ESPNOW_BULK_RX_ENABLE
+        /* The master answers the discovery broadcast with the magic number it carried.
+         * Only images from this device are accepted. */
+        if (!s_example_espnow_master_paired && frame.magic == send_param->magic) {
+            memcpy(s_example_espnow_master_mac, recv_cb->mac_addr, ESP_NOW_ETH_ALEN);
+            s_example_espnow_master_paired = true;
+            ESP_LOGI(TAG, "Paired with master "MACSTR"", MAC2STR(recv_cb->mac_addr));
+        }
+#endif
+        /* If receive unicast ESPNOW data, also stop sending broadcast ESPNOW data. */
+        espnow_handshake_on_unicast(send_param);
+        s_example_espnow_rebroadcast_at = -1;
+    }
+    else if (ret == EXAMPLE_ESPNOW_DATA_RELIABLE && espnow_frame_read(&frame, 0, &reliable_hdr, sizeof(reliable_hdr))) {
+        espnow_handshake_on_unicast(send_param);
+        s_example_espnow_rebroadcast_at = -1;
+#if CONFIG_ESPNOW_RELIABLE
+        if (send_param->unicast && memcmp(recv_cb->mac_addr, send_param->dest_mac, ESP_NOW_ETH_ALEN) == 0) {
+            espnow_reliable_on_ack(&s_example_espnow_reliable, &reliable_hdr.ack, esp_timer_get_time());
+        }
+#endif
+        if (peer != NULL) {
+            if (espnow_reliable_rx_accept(&s_example_espnow_rx[peer->id], reliable_hdr.base, frame.seq)) {
+                ESP_LOGD(TAG, "Reliable data seq %u from "MACSTR": %.*s", frame.seq, MAC2STR(recv_cb->mac_addr),
+                         (int)(frame.payload_len - sizeof(reliable_hdr)), (const char *)frame.payload + sizeof(reliable_hdr));
+            }
+            example_espnow_ack_queue(ack_peers, ack_num, peer);
+        }
+    }
+    else if (ret == EXAMPLE_ESPNOW_DATA_ACK && frame.payload_len >= sizeof(espnow_reliable_ack_t)) {
+#if CONFIG_ESPNOW_RELIABLE
+        espnow_reliable_ack_t ack;
+
+        espnow_frame_read(&frame, 0, &ack, sizeof(ack));
+        if (send_param->unicast && memcmp(recv_cb->mac_addr, send_param->dest_mac, ESP_NOW_ETH_ALEN) == 0) {
+            espnow_reliable_on_ack(&s_example_espnow_reliable, &ack, esp_timer_get_time());
+        }
+#endif
+    }
+    else if (ret == EXAMPLE_ESPNOW_DATA_PROBE) {
+        if (peer != NULL) {
+            example_espnow_probe_echo(send_param, peer, frame.payload, frame.payload_len);
+        }
+        espnow_handshake_on_unicast(send_param);
+        s_example_espnow_rebroadcast_at = -1;
+    }
+    else if (ret == EXAMPLE_ESPNOW_DATA_ECHO) {
+#if CONFIG_ESPNOW_RTT_PROBE
+        if (espnow_rtt_on_echo(recv_cb->mac_addr, frame.payload, frame.payload_len, esp_timer_get_time()) == ESP_ERR_INVALID_ARG) {
+            ESP_LOGI(TAG, "Receive malformed echo from: "MACSTR", len: %d", MAC2STR(recv_cb->mac_addr), recv_cb->data_len);
+        }
+#endif
+        espnow_handshake_on_unicast(send_param);
+        s_example_espnow_rebroadcast_at = -1;
+    }
+    else if (ret == EXAMPLE_ESPNOW_DATA_BENCH) {
+#if CONFIG_ESPNOW_BENCH_RECEIVER
+        if (espnow_bench_rx(recv_cb->mac_addr, frame.payload, frame.payload_len, esp_timer_get_time()) == ESP_ERR_INVALID_ARG) {
+            ESP_LOGI(TAG, "Receive malformed benchmark data from: "MACSTR", len: %d", MAC2STR(recv_cb->mac_addr), recv_cb->data_len);
+        }
+#endif
+        espnow_handshake_on_unicast(send_param);
+        s_example_espnow_rebroadcast_at = -1;
+    }
+    else if (ret == EXAMPLE_ESPNOW_DATA_FRAGMENT) {
+        if (espnow_frag_rx(recv_cb->mac_addr, frame.payload, frame.payload_len, esp_timer_get_time()) == ESP_ERR_INVALID_ARG) {
+            ESP_LOGI(TAG, "Receive malformed fragment from: "MACSTR", len: %d", MAC2STR(recv_cb->mac_addr), recv_cb->data_len);
+        }
+        espnow_handshake_on_unicast(send_param);
+        s_example_espnow_rebroadcast_at = -1;
+    }
+    else if (ret == EXAMPLE_ESPNOW_DATA_BULK) {
+#if CONFIG_ESPNOW_BULK_RX_ENABLE
+        /* Statuses go back to the master, which must be in the peer list. */
+        if (example_espnow_from_master(recv_cb->mac_addr) && peer != NULL &&
+            example_espnow_peer_list_add(peer) &&
+            espnow_bulk_rx(&s_example_espnow_bulk, recv_cb->mac_addr, frame.payload, frame.payload_len,
+                           esp_timer_get_time()) == ESP_ERR_INVALID_ARG) {
+            ESP_LOGI(TAG, "Receive malformed bulk data from: "MACSTR", len: %d", MAC2STR(recv_cb->mac_addr), recv_cb->data_len);
+        }
+#endif
+        espnow_handshake_on_unicast(send_param);
+        s_example_espnow_rebroadcast_at = -1;
+    }
+    else if (ret == EXAMPLE_ESPNOW_DATA_MCAST) {
+#if CONFIG_ESPNOW_BULK_RX_ENABLE
+        espnow_mcast_state_t state = s_example_espnow_mcast.state;
+
+        if (example_espnow_from_master(recv_cb->mac_addr) &&
+            espnow_mcast_rx(&s_example_espnow_mcast, recv_cb->mac_addr, frame.payload, frame.payload_len,
+                            esp_timer_get_time()) == ESP_ERR_INVALID_ARG) {
+            ESP_LOGI(TAG, "Receive malformed multicast data from: "MACSTR", len: %d", MAC2STR(recv_cb->mac_addr), recv_cb->data_len);
+        }
+        if (state == ESPNOW_MCAST_RUNNING && s_example_espnow_mcast.state != ESPNOW_MCAST_RUNNING) {
+            example_espnow_mcast_log_stats();
+        }
+#endif
     }
+    else if (ret == EXAMPLE_ESPNOW_DATA_METRICS) {
+        /* Snapshots of other slaves are for the master. */
+    }
+    else {
+        ESPNOW_DLOG(EXAMPLE_DLOG_RECV_ERROR, ESPNOW_DLOG_MAC(recv_cb->mac_addr));
+    }
+    espnow_rx_pool_release(recv_cb->slot);
+}
+
+/* Handle a batch of events from the ESPNOW callbacks, then acknowledge the reliable data
+ * received. */
+static void example_espnow_handle_events(example_espnow_send_param_t *send_param, example_espnow_event_t *evts, int evt_num)
+{
+    espnow_peer_t *ack_peers[ESPNOW_EVENT_BATCH_SIZE];
+    int ack_num = 0;
 
-    while (xQueueReceive(s_example_espnow_queue, &evt, portMAX_DELAY) == pdTRUE) {
-        switch (evt.id) {
+    for (int i = 0; i < evt_num; i++) {
+        example_espnow_event_t *evt = &evts[i];
+        switch (evt->id) {
             case EXAMPLE_ESPNOW_SEND_CB:
             {
-                example_espnow_event_send_cb_t *send_cb = &evt.info.send_cb;
-                is_broadcast = IS_BROADCAST_ADDR(send_cb->mac_addr);
+                example_espnow_event_send_cb_t *send_cb = &evt->info.send_cb;
+                bool is_broadcast = IS_BROADCAST_ADDR(send_cb->mac_addr);
 
                 ESP_LOGD(TAG, "Send data to "MACSTR", status1: %d", MAC2STR(send_cb->mac_addr), send_cb->status);
 
-                if (is_broadcast && (send_param->broadcast == false)) {
+                if (is_broadcast) {
+                    /* Nobody has answered yet: schedule the next discovery broadcast, if any. */
+                    int32_t delay_ms = espnow_handshake_rebroadcast_delay(send_param, s_example_espnow_broadcasts,
+                                                                          CONFIG_ESPNOW_DISCOVERY_RETRIES,
+                                                                          CONFIG_ESPNOW_DISCOVERY_BACKOFF, esp_random());
+                    if (delay_ms != ESPNOW_HANDSHAKE_NO_REBROADCAST) {
+                        s_example_espnow_rebroadcast_at = esp_timer_get_time() + (int64_t)delay_ms * 1000;
+                    }
+                    break;
+                }
+#if CONFIG_ESPNOW_RELIABLE
+                /* Reliable frames are retired by acknowledgements, not by sending callbacks. */
+#elif CONFIG_ESPNOW_RTT_PROBE
+                /* Probes are retired by their echoes; a sending callback only frees a transmit buffer. */
+                s_example_espnow_probe_stalled = false;
+#elif CONFIG_ESPNOW_BENCH_SENDER
+                espnow_bench_tx_on_sent(&s_example_espnow_bench, send_cb->mac_addr,
+                                        send_cb->status == ESP_NOW_SEND_SUCCESS, esp_timer_get_time());
+#else
+                /* Only data to the destination occupies the window, acknowledgements to other devices do not. */
+                if (memcmp(send_cb->mac_addr, send_param->dest_mac, ESP_NOW_ETH_ALEN) != 0) {
                     break;
                 }
 
-                if (!is_broadcast) {
-                    send_param->count--;
-                    if (send_param->count == 0) {
+                if (espnow_tx_window_complete(&s_example_espnow_window, send_cb->status) == NULL) {
+                    break;
+                }
+                send_param->count--;
+                if (send_param->count == 0) {
+#if CONFIG_ESPNOW_SEND_WINDOW_BENCH
+                    if (!example_espnow_bench_next(send_param))
+#endif
+                    {
+#if CONFIG_ESPNOW_AGGR_ENABLE
+                        espnow_aggr_log_stats(&s_example_espnow_aggr);
+#endif
+#if CONFIG_ESPNOW_FRAG_ENABLE
+                        example_espnow_frag_log_stats();
+#endif
                         ESP_LOGI(TAG, "Send done");
                         example_espnow_deinit(send_param);
                         vTaskDelete(NULL);
                     }
                 }
 
-                /* Delay a while before sending the next data. */
+                /* Delay a while before sending the next data. The task keeps receiving meanwhile. */
                 if (send_param->delay > 0) {
-                    vTaskDelay(send_param->delay/portTICK_PERIOD_MS);
+                    if (s_example_espnow_send_at < 0) {
+                        s_example_espnow_send_at = esp_timer_get_time() + (int64_t)send_param->delay * 1000;
+                    }
+                    break;
                 }
+
+                /* Refill the window slot that has just been freed. */
+                if (example_espnow_window_fill(send_param) != ESP_OK) {
+                    ESP_LOGE(TAG, "Send error");
+                    example_espnow_deinit(send_param);
+                    vTaskDelete(NULL);
+                }
+#endif
         ///////////////////////////////////GUI lan nua t
                 // ESP_LOGI(TAG, "send data to "MACSTR"", MAC2STR(send_cb->mac_addr));
                 // memcpy(send_param->dest_mac, send_cb->mac_addr, ESP_NOW_ETH_ALEN);
@@ -241,97 +1489,140 @@ static void example_espnow_task(void *pvParameter)
                 break;
             }
             case EXAMPLE_ESPNOW_RECV_CB:
-            {
-                example_espnow_event_recv_cb_t *recv_cb = &evt.info.recv_cb;
-
-                ret = example_espnow_data_parse(recv_cb->data, recv_cb->data_len, &recv_state, &recv_seq, &recv_magic, &payload, &payload_len);
-                free(recv_cb->data);
-                if (ret == EXAMPLE_ESPNOW_DATA_BROADCAST) {
-                    ESP_LOGI(TAG, "Receive %dth broadcast data from: "MACSTR", len: %d", recv_seq, MAC2STR(recv_cb->mac_addr), recv_cb->data_len);
-
-                    /* If MAC address does not exist in peer list, add it to peer list. */
-                    if (esp_now_is_peer_exist(recv_cb->mac_addr) == false) {
-                        esp_now_peer_info_t *peer = malloc(sizeof(esp_now_peer_info_t));
-                        if (peer == NULL) {
-                            ESP_LOGE(TAG, "Malloc peer information fail");
-                            example_espnow_deinit(send_param);
-                            vTaskDelete(NULL);
-                        }
-                        memset(peer, 0, sizeof(esp_now_peer_info_t));
-                        peer->channel = CONFIG_ESPNOW_CHANNEL;
-                        peer->ifidx = ESPNOW_WIFI_IF;
-                        peer->encrypt = true;
-                        memcpy(peer->lmk, CONFIG_ESPNOW_LMK, ESP_NOW_KEY_LEN);
-                        memcpy(peer->peer_addr, recv_cb->mac_addr, ESP_NOW_ETH_ALEN);
-                        ESP_ERROR_CHECK( esp_now_add_peer(peer) );
-                        free(peer);
-                    }
-
-                    /* Indicates that the device has received broadcast ESPNOW data. */
-                    if (send_param->state == 0) {
-                        send_param->state = 1;
-                    }
-
-                    /* If receive broadcast ESPNOW data which indicates that the other device has received
-                     * broadcast ESPNOW data and the local magic number is bigger than that in the received
-                     * broadcast ESPNOW data, stop sending broadcast ESPNOW data and start sending unicast
-                     * ESPNOW data.
-                     */
-                    if (recv_state == 1) {
-                        /* The device which has the bigger magic number sends ESPNOW data, the other one
-                         * receives ESPNOW data.
-                         */
-                        if (send_param->unicast == false && send_param->magic >= recv_magic) {
-                    	    ESP_LOGI(TAG, "Start sending unicast data");
-                    	    ESP_LOGI(TAG, "send data to "MACSTR"", MAC2STR(recv_cb->mac_addr));
-
-                    	    /* Start sending unicast ESPNOW data. */
-                            memcpy(send_param->dest_mac, recv_cb->mac_addr, ESP_NOW_ETH_ALEN);
-                            example_espnow_data_prepare(send_param, "hello");
-                            if (esp_now_send(send_param->dest_mac, send_param->buffer, send_param->len) != ESP_OK) {
-                                ESP_LOGE(TAG, "Send error");
-                                example_espnow_deinit(send_param);
-                                vTaskDelete(NULL);
-                            }
-                            else {
-                                send_param->broadcast = false;
-                                send_param->unicast = true;
-                            }
-                        }
-                    }
-                }
-                else if (ret == EXAMPLE_ESPNOW_DATA_UNICAST) {
-                    //ESP_LOGE(TAG, "Receive %dth unicast data from: "MACSTR", len: %d", recv_seq, MAC2STR(recv_cb->mac_addr), recv_cb->data_len);
-                    ESP_LOGE(TAG, "Received %dth unicast data from " MACSTR ", state: %d, seq: %d, magic: %lu, message: %s",recv_seq, MAC2STR(recv_cb->mac_addr), recv_state, recv_seq, recv_magic, (char *)payload);
-                    if (payload != NULL) {
-                        //ESP_LOGI(TAG, "Recv from MaSter Payload: %.*s", payload_len, payload);
-                    }
-                    ESP_LOGI(TAG, "DATA FULL RECV %s",(char *)recv_cb->data);
-                    /* If receive unicast ESPNOW data, also stop sending broadcast ESPNOW data. */
-                    send_param->broadcast = false;
-                }
-                else {
-                    ESP_LOGI(TAG, "Receive error data from: "MACSTR"", MAC2STR(recv_cb->mac_addr));
-                }
+                example_espnow_handle_recv(send_param, &evt->info.recv_cb, ack_peers, &ack_num);
                 break;
-            }
             default:
-                ESP_LOGE(TAG, "Callback type error: %d", evt.id);
+                ESP_LOGE(TAG, "Callback type error: %d", evt->id);
                 break;
         }
     }
+    example_espnow_send_acks(send_param, ack_peers, ack_num);
+}
+
+static void example_espnow_task(void *pvParameter)
+{
+    example_espnow_event_t evts[ESPNOW_EVENT_BATCH_SIZE];
+    int evt_num;
+
+#if CONFIG_ESPNOW_EVENT_TRANSPORT_RING
+    espnow_event_ring_set_consumer(xTaskGetCurrentTaskHandle());
+#endif
+
+    // vTaskDelay(5000 / portTICK_PERIOD_MS);
+    // ESP_LOGI(TAG, "Start sending broadcast data");
+
+#if CONFIG_ESPNOW_METRICS_PERIOD > 0
+    s_example_espnow_metrics_at = esp_timer_get_time() + (int64_t)CONFIG_ESPNOW_METRICS_PERIOD * 1000000;
+#endif
+
+    /* Start sending broadcast ESPNOW data. */
+    example_espnow_send_param_t *send_param = (example_espnow_send_param_t *)pvParameter;
+    if (example_espnow_broadcast(send_param) != ESP_OK) {
+        ESP_LOGE(TAG, "Send error");
+        example_espnow_deinit(send_param);
+        vTaskDelete(NULL);
+    }
+
+    for (;;) {
+        evt_num = example_espnow_event_wait_batch(evts, ESPNOW_EVENT_BATCH_SIZE, example_espnow_wait_ticks(send_param));
+        int64_t start_us = esp_timer_get_time();
+        example_espnow_handle_events(send_param, evts, evt_num);
+        if (evt_num > 0) {
+            example_espnow_batch_record(evt_num);
+        }
+        espnow_stage_batch(evts, evt_num, start_us);
+        if (s_example_espnow_rebroadcast_at >= 0 && esp_timer_get_time() >= s_example_espnow_rebroadcast_at) {
+            s_example_espnow_rebroadcast_at = -1;
+            if (send_param->broadcast && example_espnow_broadcast(send_param) != ESP_OK) {
+                ESP_LOGE(TAG, "Send error");
+                example_espnow_deinit(send_param);
+                vTaskDelete(NULL);
+            }
+        }
+        if (s_example_espnow_send_at >= 0 && esp_timer_get_time() >= s_example_espnow_send_at) {
+            s_example_espnow_send_at = -1;
+            if (example_espnow_window_fill(send_param) != ESP_OK) {
+                ESP_LOGE(TAG, "Send error");
+                example_espnow_deinit(send_param);
+                vTaskDelete(NULL);
+            }
+        }
+#if CONFIG_ESPNOW_AGGR_ENABLE || CONFIG_ESPNOW_RELIABLE || CONFIG_ESPNOW_RTT_PROBE || CONFIG_ESPNOW_BENCH_SENDER
+        if (send_param->unicast && example_espnow_window_fill(send_param) != ESP_OK) {
+            ESP_LOGE(TAG, "Send error");
+            example_espnow_deinit(send_param);
+            vTaskDelete(NULL);
+        }
+#endif
+#if CONFIG_ESPNOW_RELIABLE
+        if (send_param->unicast && send_param->count == 0) {
+            int64_t elapsed = esp_timer_get_time() - s_example_espnow_reliable_start_us;
+            espnow_reliable_log_stats(&s_example_espnow_reliable);
+            ESP_LOGI(TAG, "Send done in %lld ms", (long long)(elapsed / 1000));
+            example_espnow_deinit(send_param);
+            vTaskDelete(NULL);
+        }
+#endif
+#if CONFIG_ESPNOW_RTT_PROBE
+        if (s_example_espnow_rtt_dump) {
+            s_example_espnow_rtt_dump = false;
+            example_espnow_rtt_log(true);
+        }
+        if (send_param->unicast && s_example_espnow_probe_left == 0 && s_example_espnow_probe_end_us >= 0 &&
+            esp_timer_get_time() >= s_example_espnow_probe_end_us) {
+            example_espnow_rtt_log(false);
+            ESP_LOGI(TAG, "Send done");
+            example_espnow_deinit(send_param);
+            vTaskDelete(NULL);
+        }
+#endif
+#if CONFIG_ESPNOW_BENCH_SENDER
+        if (send_param->unicast && s_example_espnow_bench.state == ESPNOW_BENCH_DONE) {
+            espnow_bench_tx_log(&s_example_espnow_bench);
+            ESP_LOGI(TAG, "Send done");
+            example_espnow_deinit(send_param);
+            vTaskDelete(NULL);
+        }
+#endif
+#if CONFIG_ESPNOW_BENCH_RECEIVER
+        espnow_bench_rx_poll(esp_timer_get_time());
+#endif
+#if CONFIG_ESPNOW_METRICS_PERIOD > 0
+        example_espnow_metrics_poll(send_param);
+#endif
+        /* Frames waiting in the priority lanes go out as the sending callbacks make room. */
+        espnow_lanes_pump();
+    }
 }
 
 static esp_err_t example_espnow_init(void)
 {
+    uint8_t mac[ESP_NOW_ETH_ALEN];
     example_espnow_send_param_t *send_param;
 
-    s_example_espnow_queue = xQueueCreate(ESPNOW_QUEUE_SIZE, sizeof(example_espnow_event_t));
-    if (s_example_espnow_queue == NULL) {
-        ESP_LOGE(TAG, "Create mutex fail");
+    espnow_rx_pool_init();
+    espnow_lanes_init();
+    espnow_stage_reset();
+    espnow_peer_table_init();
+    for (int i = 0; i < ESPNOW_PEER_TABLE_MAX; i++) {
+        espnow_reliable_rx_init(&s_example_espnow_rx[i]);
+        for (int j = 0; j < EXAMPLE_REPLAY_MAX - 1; j++) {
+            espnow_replay_init(&s_example_espnow_replay[i][j]);
+        }
+    }
+    espnow_frag_rx_init(CONFIG_ESPNOW_FRAG_TIMEOUT, example_espnow_frag_deliver, NULL);
+    espnow_crc16_init();
+    ESP_ERROR_CHECK( espnow_dlog_init(TAG, s_example_dlog_fmts, EXAMPLE_DLOG_MAX) );
+    if (example_espnow_event_transport_init() != ESP_OK) {
         return ESP_FAIL;
     }
 
+    ESP_ERROR_CHECK( esp_wifi_get_mac(ESPNOW_WIFI_IF, mac) );
+    espnow_pcap_init(mac);
+#if CONFIG_ESPNOW_METRICS_PERIOD > 0
+    memcpy(s_example_espnow_metrics_mac, mac, ESP_NOW_ETH_ALEN);
+#endif
+
     /* Initialize ESPNOW and register sending and receiving callback function. */
     ESP_ERROR_CHECK( esp_now_init() );
     ESP_ERROR_CHECK( esp_now_register_send_cb(example_espnow_send_cb) );
@@ -347,7 +1638,8 @@ static esp_err_t example_espnow_init(void)
     esp_now_peer_info_t *peer = malloc(sizeof(esp_now_peer_info_t));
     if (peer == NULL) {
         ESP_LOGE(TAG, "Malloc peer information fail");
-        vSemaphoreDelete(s_example_espnow_queue);
+        espnow_metrics_inc(ESPNOW_METRIC_NO_MEM);
+        example_espnow_event_transport_deinit();
         esp_now_deinit();
         return ESP_FAIL;
     }
@@ -363,7 +1655,8 @@ static esp_err_t example_espnow_init(void)
     send_param = malloc(sizeof(example_espnow_send_param_t));
     if (send_param == NULL) {
         ESP_LOGE(TAG, "Malloc send parameter fail");
-        vSemaphoreDelete(s_example_espnow_queue);
+        espnow_metrics_inc(ESPNOW_METRIC_NO_MEM);
+        example_espnow_event_transport_deinit();
         esp_now_deinit();
         return ESP_FAIL;
     }
@@ -374,28 +1667,74 @@ static esp_err_t example_espnow_init(void)
     send_param->magic = esp_random();
     send_param->count = CONFIG_ESPNOW_SEND_COUNT;
     send_param->delay = CONFIG_ESPNOW_SEND_DELAY;
-    send_param->len = 100;
+    send_param->len = ESPNOW_BROADCAST_LEN;
     send_param->buffer = malloc(send_param->len + 1);
     if (send_param->buffer == NULL) {
         ESP_LOGE(TAG, "Malloc send buffer fail");
+        espnow_metrics_inc(ESPNOW_METRIC_NO_MEM);
         free(send_param);
-        vSemaphoreDelete(s_example_espnow_queue);
+        example_espnow_event_transport_deinit();
         esp_now_deinit();
         return ESP_FAIL;
     }
-    memcpy(send_param->dest_mac, s_example_broadcast_mac, 6);
-    example_espnow_data_prepare(send_param, "first broadcast");
 
-    xTaskCreate(example_espnow_task, "example_espnow_task", 4096, send_param, 4, NULL);
+#if CONFIG_ESPNOW_BULK_RX_ENABLE
+    espnow_fec_init();
+    espnow_bulk_rx_init(&s_example_espnow_bulk, example_espnow_image_begin, example_espnow_image_write,
+                        example_espnow_image_end, example_espnow_bulk_xmit, send_param);
+    espnow_mcast_rx_init(&s_example_espnow_mcast, example_espnow_image_begin, example_espnow_image_write,
+                         example_espnow_image_read, example_espnow_image_end, example_espnow_mcast_xmit, send_param);
+#endif
+#if CONFIG_ESPNOW_BENCH_RECEIVER
+    espnow_bench_rx_init();
+#endif
+#if CONFIG_ESPNOW_RTT_PROBE
+    espnow_rtt_init();
+    espnow_rtt_hist_reset(&s_example_espnow_probe_late);
+#if CONFIG_ESPNOW_RTT_DUMP_GPIO >= 0
+    gpio_config_t io_conf = {
+        .pin_bit_mask = 1ULL << CONFIG_ESPNOW_RTT_DUMP_GPIO,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = GPIO_INTR_NEGEDGE,
+    };
+    ESP_ERROR_CHECK( gpio_config(&io_conf) );
+    ESP_ERROR_CHECK( gpio_install_isr_service(0) );
+    ESP_ERROR_CHECK( gpio_isr_handler_add(CONFIG_ESPNOW_RTT_DUMP_GPIO, example_espnow_rtt_dump_isr, NULL) );
+#endif
+#endif
+
+    xTaskCreatePinnedToCore(example_espnow_task, "example_espnow_task", 4096, send_param, CONFIG_ESPNOW_TASK_PRIORITY,
+                            NULL, ESPNOW_TASK_CORE);
 
     return ESP_OK;
 }
 
+#if CONFIG_ESPNOW_METRICS_CONSOLE
+/* Console on the UART with the metrics command. */
+static void example_console_init(void)
+{
+    esp_console_repl_t *repl = NULL;
+    esp_console_repl_config_t repl_config = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+    esp_console_dev_uart_config_t uart_config = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
+
+    repl_config.prompt = "espnow>";
+    ESP_ERROR_CHECK( esp_console_new_repl_uart(&uart_config, &repl_config, &repl) );
+    ESP_ERROR_CHECK( esp_console_register_help_command() );
+    ESP_ERROR_CHECK( espnow_metrics_register_cmd() );
+    ESP_ERROR_CHECK( espnow_pcap_register_cmd() );
+    ESP_ERROR_CHECK( espnow_stage_register_cmd() );
+    ESP_ERROR_CHECK( espnow_lanes_register_cmd() );
+    ESP_ERROR_CHECK( esp_console_start_repl(repl) );
+}
+#endif
+
 static void example_espnow_deinit(example_espnow_send_param_t *send_param)
 {
     free(send_param->buffer);
     free(send_param);
-    vSemaphoreDelete(s_example_espnow_queue);
+    example_espnow_event_transport_deinit();
     esp_now_deinit();
 }
 
@@ -409,6 +1748,14 @@ void app_main(void)
     }
     ESP_ERROR_CHECK( ret );
 
+#if CONFIG_ESPNOW_CRC16_BENCH
+    espnow_crc16_init();
+    ESP_ERROR_CHECK(espnow_crc16_bench());
+#endif
+
     example_wifi_init();
     example_espnow_init();
+#if CONFIG_ESPNOW_METRICS_CONSOLE
+    example_console_init();
+#endif
 }
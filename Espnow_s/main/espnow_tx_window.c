@@ -0,0 +1,72 @@
+/* ESPNOW Example - sliding window unicast sender
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <string.h>
+#include <assert.h>
+#include "esp_log.h"
+#include "espnow_tx_window.h"
+#include "espnow_lanes.h"
+
+static const char *TAG = "espnow_tx_window";
+
+void espnow_tx_window_init(espnow_tx_window_t *win, uint8_t size)
+{
+    assert(size >= 1 && size <= ESPNOW_TX_WINDOW_MAX);
+    win->size = size;
+    win->head = 0;
+    win->in_flight = 0;
+    win->sent = 0;
+    win->succeeded = 0;
+    win->failed = 0;
+    win->bytes = 0;
+}
+
+espnow_tx_slot_t *espnow_tx_window_next(espnow_tx_window_t *win)
+{
+    if (espnow_tx_window_full(win)) {
+        return NULL;
+    }
+    return &win->slots[(win->head + win->in_flight) % win->size];
+}
+
+esp_err_t espnow_tx_window_send(espnow_tx_window_t *win, espnow_tx_slot_t *slot, const uint8_t *dest_mac, uint16_t seq, uint16_t len)
+{
+    esp_err_t ret;
+
+    assert(slot == espnow_tx_window_next(win));
+    slot->seq = seq;
+    slot->len = len;
+    ret = espnow_lanes_send(dest_mac, slot->buffer, len);
+    if (ret == ESP_OK) {
+        win->in_flight++;
+        win->sent++;
+    }
+    return ret;
+}
+
+espnow_tx_slot_t *espnow_tx_window_complete(espnow_tx_window_t *win, esp_now_send_status_t status)
+{
+    espnow_tx_slot_t *slot;
+
+    if (win->in_flight == 0) {
+        ESP_LOGW(TAG, "Send result without a frame in flight");
+        return NULL;
+    }
+    slot = &win->slots[win->head];
+    win->head = (win->head + 1) % win->size;
+    win->in_flight--;
+    if (status == ESP_NOW_SEND_SUCCESS) {
+        win->succeeded++;
+        win->bytes += slot->len;
+    } else {
+        win->failed++;
+    }
+    ESP_LOGD(TAG, "Frame seq %u retired, status %d, %u in flight", slot->seq, status, win->in_flight);
+    return slot;
+}
@@ -0,0 +1,62 @@
+/* ESPNOW Example - sliding window unicast sender
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESPNOW_TX_WINDOW_H
+#define ESPNOW_TX_WINDOW_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_now.h"
+
+/* Keeps up to `size` unicast frames in flight instead of waiting for the sending
+ * callback of each frame before sending the next one. Every frame owns a slot with
+ * its own buffer. ESPNOW reports sending results in the order the frames were
+ * handed to esp_now_send, so each result belongs to the oldest frame in flight.
+ * The callback carries no sequence number, so results are matched by submission
+ * order only; the sequence number kept in the slot is for logging. */
+#define ESPNOW_TX_WINDOW_MAX    16
+
+typedef struct {
+    uint16_t seq;                         //Sequence number of the frame held in this slot, for logging.
+    uint16_t len;                         //Length of the frame, unit: byte.
+    uint8_t buffer[ESP_NOW_MAX_DATA_LEN]; //The frame itself.
+} espnow_tx_slot_t;
+
+typedef struct {
+    espnow_tx_slot_t slots[ESPNOW_TX_WINDOW_MAX];
+    uint8_t size;                         //Number of frames allowed in flight, 1..ESPNOW_TX_WINDOW_MAX.
+    uint8_t head;                         //Slot of the oldest frame in flight.
+    uint8_t in_flight;                    //Number of frames handed to ESPNOW and not yet reported.
+    uint32_t sent;                        //Frames accepted by esp_now_send.
+    uint32_t succeeded;                   //Frames reported as ESP_NOW_SEND_SUCCESS.
+    uint32_t failed;                      //Frames reported as ESP_NOW_SEND_FAIL.
+    uint32_t bytes;                       //Bytes of successfully sent frames.
+} espnow_tx_window_t;
+
+/* Empty the window, clear its counters and allow `size` frames in flight. */
+void espnow_tx_window_init(espnow_tx_window_t *win, uint8_t size);
+
+/* Slot to build the next frame in, or NULL if the window is full. The slot stays
+ * free until espnow_tx_window_send succeeds. */
+espnow_tx_slot_t *espnow_tx_window_next(espnow_tx_window_t *win);
+
+/* Send the frame built in the slot returned by espnow_tx_window_next. */
+esp_err_t espnow_tx_window_send(espnow_tx_window_t *win, espnow_tx_slot_t *slot, const uint8_t *dest_mac, uint16_t seq, uint16_t len);
+
+/* Retire the oldest frame in flight with the status from the sending callback.
+ * Returns its slot, or NULL if nothing was in flight. */
+espnow_tx_slot_t *espnow_tx_window_complete(espnow_tx_window_t *win, esp_now_send_status_t status);
+
+static inline bool espnow_tx_window_full(const espnow_tx_window_t *win)
+{
+    return win->in_flight >= win->size;
+}
+
+#endif
@@ -0,0 +1,165 @@
+/* ESPNOW Example - message aggregation
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <string.h>
+#include "esp_log.h"
+#include "espnow_aggr.h"
+
+static const char *TAG = "espnow_aggr";
+
+static inline uint32_t aggr_airtime_us(size_t frame_len)
+{
+    return ESPNOW_AGGR_FRAME_OVERHEAD_US + (ESPNOW_AGGR_FRAME_OVERHEAD_BYTES + frame_len) * 8;
+}
+
+void espnow_aggr_init(espnow_aggr_t *aggr, uint32_t flush_timeout_us, espnow_aggr_flush_cb_t flush_cb, void *arg)
+{
+    memset(aggr, 0, sizeof(espnow_aggr_t));
+    aggr->flush_timeout_us = flush_timeout_us;
+    aggr->flush_cb = flush_cb;
+    aggr->arg = arg;
+}
+
+static esp_err_t aggr_flush(espnow_aggr_t *aggr, espnow_aggr_dest_t *dest)
+{
+    esp_err_t ret;
+
+    if (dest->count == 0) {
+        return ESP_OK;
+    }
+    ret = aggr->flush_cb(dest->dest_mac, dest->payload, dest->len, aggr->arg);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    aggr->stats.frames++;
+    aggr->stats.airtime_us += aggr_airtime_us(sizeof(example_espnow_data_t) + dest->len);
+    dest->used = false;
+    dest->len = 0;
+    dest->count = 0;
+    return ESP_OK;
+}
+
+static espnow_aggr_dest_t *aggr_find(espnow_aggr_t *aggr, const uint8_t *dest_mac)
+{
+    espnow_aggr_dest_t *free_dest = NULL;
+
+    for (int i = 0; i < ESPNOW_AGGR_MAX_DEST; i++) {
+        espnow_aggr_dest_t *dest = &aggr->dests[i];
+        if (!dest->used) {
+            if (free_dest == NULL) {
+                free_dest = dest;
+            }
+        } else if (memcmp(dest->dest_mac, dest_mac, ESP_NOW_ETH_ALEN) == 0) {
+            return dest;
+        }
+    }
+    if (free_dest != NULL) {
+        free_dest->used = true;
+        memcpy(free_dest->dest_mac, dest_mac, ESP_NOW_ETH_ALEN);
+    }
+    return free_dest;
+}
+
+esp_err_t espnow_aggr_add(espnow_aggr_t *aggr, const uint8_t *dest_mac, const uint8_t *msg, size_t len, int64_t now_us)
+{
+    espnow_aggr_dest_t *dest;
+
+    if (len > ESPNOW_AGGR_MAX_MSG_LEN) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    dest = aggr_find(aggr, dest_mac);
+    if (dest == NULL) {
+        aggr->stats.dropped++;
+        return ESP_ERR_NO_MEM;
+    }
+    if (dest->len + 1 + len > ESPNOW_AGGR_MAX_PAYLOAD) {
+        if (aggr_flush(aggr, dest) != ESP_OK) {
+            aggr->stats.dropped++;
+            return ESP_ERR_NO_MEM;
+        }
+        aggr->stats.flush_full++;
+        dest->used = true;
+    }
+    if (dest->count == 0) {
+        dest->deadline_us = now_us + aggr->flush_timeout_us;
+    }
+    dest->payload[dest->len++] = (uint8_t)len;
+    memcpy(&dest->payload[dest->len], msg, len);
+    dest->len += len;
+    dest->count++;
+    aggr->stats.messages++;
+    aggr->stats.airtime_unaggregated_us += aggr_airtime_us(sizeof(example_espnow_data_t) + len);
+    return ESP_OK;
+}
+
+void espnow_aggr_poll(espnow_aggr_t *aggr, int64_t now_us)
+{
+    for (int i = 0; i < ESPNOW_AGGR_MAX_DEST; i++) {
+        espnow_aggr_dest_t *dest = &aggr->dests[i];
+        if (dest->used && dest->count > 0 && now_us >= dest->deadline_us) {
+            if (aggr_flush(aggr, dest) == ESP_OK) {
+                aggr->stats.flush_timeout++;
+            }
+        }
+    }
+}
+
+void espnow_aggr_flush_all(espnow_aggr_t *aggr)
+{
+    for (int i = 0; i < ESPNOW_AGGR_MAX_DEST; i++) {
+        if (aggr->dests[i].used) {
+            aggr_flush(aggr, &aggr->dests[i]);
+        }
+    }
+}
+
+int64_t espnow_aggr_next_deadline(const espnow_aggr_t *aggr)
+{
+    int64_t next = -1;
+
+    for (int i = 0; i < ESPNOW_AGGR_MAX_DEST; i++) {
+        const espnow_aggr_dest_t *dest = &aggr->dests[i];
+        if (dest->used && dest->count > 0 && (next < 0 || dest->deadline_us < next)) {
+            next = dest->deadline_us;
+        }
+    }
+    return next;
+}
+
+int espnow_aggr_split(const uint8_t *payload, size_t len, espnow_aggr_msg_cb_t msg_cb, void *arg)
+{
+    size_t pos = 0;
+    int count = 0;
+
+    while (pos < len) {
+        size_t msg_len = payload[pos++];
+        if (msg_len > len - pos) {
+            return -1;
+        }
+        if (msg_cb != NULL) {
+            msg_cb(&payload[pos], msg_len, arg);
+        }
+        pos += msg_len;
+        count++;
+    }
+    return count;
+}
+
+void espnow_aggr_log_stats(const espnow_aggr_t *aggr)
+{
+    const espnow_aggr_stats_t *stats = &aggr->stats;
+    uint64_t saved = stats->airtime_unaggregated_us > stats->airtime_us ?
+                     stats->airtime_unaggregated_us - stats->airtime_us : 0;
+
+    ESP_LOGI(TAG, "%lu messages in %lu frames (%lu full, %lu timeout), %lu dropped, airtime %llu us, saved %llu us (%llu%%)",
+             (unsigned long)stats->messages, (unsigned long)stats->frames, (unsigned long)stats->flush_full,
+             (unsigned long)stats->flush_timeout, (unsigned long)stats->dropped,
+             (unsigned long long)stats->airtime_us, (unsigned long long)saved,
+             stats->airtime_unaggregated_us ? (unsigned long long)(saved * 100 / stats->airtime_unaggregated_us) : 0ULL);
+}
@@ -0,0 +1,97 @@
+/* ESPNOW Example - message aggregation
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESPNOW_AGGR_H
+#define ESPNOW_AGGR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_now.h"
+#include "espnow_example.h"
+
+/* Coalesces small application messages for the same destination into the payload
+ * of one EXAMPLE_ESPNOW_DATA_AGGREGATE frame. Every message is stored behind a
+ * one-byte length prefix. A destination is flushed when the next message does not
+ * fit, or once its oldest message has waited flush_timeout_us.
+ *
+ * Not thread-safe: add, poll and flush must all be called from the same task. */
+#define ESPNOW_AGGR_MAX_PAYLOAD     (ESP_NOW_MAX_DATA_LEN - sizeof(example_espnow_data_t))
+#define ESPNOW_AGGR_MAX_MSG_LEN     (ESPNOW_AGGR_MAX_PAYLOAD - 1)
+#ifdef CONFIG_ESPNOW_AGGR_MAX_DEST
+#define ESPNOW_AGGR_MAX_DEST        CONFIG_ESPNOW_AGGR_MAX_DEST
+#else
+/* Projects that only split received payloads do not configure destinations. */
+#define ESPNOW_AGGR_MAX_DEST        1
+#endif
+
+/* Rough airtime of an ESPNOW frame at the default 1 Mbps rate: long preamble and PLCP
+ * header, 802.11 MAC header, ESPNOW vendor specific element and FCS, then SIFS and the
+ * ACK of a unicast frame. Only used to estimate the airtime aggregation saves. */
+#define ESPNOW_AGGR_FRAME_OVERHEAD_BYTES    43
+#define ESPNOW_AGGR_FRAME_OVERHEAD_US       (192 + 10 + 304)
+
+/* Hand one aggregated payload to the radio. Returning anything but ESP_OK keeps the
+ * payload queued so that the flush is tried again on the next poll. */
+typedef esp_err_t (*espnow_aggr_flush_cb_t)(const uint8_t *dest_mac, const uint8_t *payload, size_t len, void *arg);
+
+/* Called by espnow_aggr_split for every message found in a payload. */
+typedef void (*espnow_aggr_msg_cb_t)(const uint8_t *msg, size_t len, void *arg);
+
+typedef struct {
+    bool used;
+    uint8_t dest_mac[ESP_NOW_ETH_ALEN];
+    uint16_t len;                         //Bytes of payload used so far.
+    uint16_t count;                       //Messages in the payload.
+    int64_t deadline_us;                  //Time by which the payload must be flushed.
+    uint8_t payload[ESPNOW_AGGR_MAX_PAYLOAD];
+} espnow_aggr_dest_t;
+
+typedef struct {
+    uint32_t messages;                    //Messages accepted.
+    uint32_t dropped;                     //Messages dropped because their destination could not be flushed.
+    uint32_t frames;                      //Aggregated frames flushed.
+    uint32_t flush_full;                  //Flushes because the next message did not fit.
+    uint32_t flush_timeout;               //Flushes because the flush timeout expired.
+    uint64_t airtime_us;                  //Estimated airtime of the aggregated frames.
+    uint64_t airtime_unaggregated_us;     //Estimated airtime had every message been sent alone.
+} espnow_aggr_stats_t;
+
+typedef struct {
+    espnow_aggr_dest_t dests[ESPNOW_AGGR_MAX_DEST];
+    uint32_t flush_timeout_us;
+    espnow_aggr_flush_cb_t flush_cb;
+    void *arg;
+    espnow_aggr_stats_t stats;
+} espnow_aggr_t;
+
+void espnow_aggr_init(espnow_aggr_t *aggr, uint32_t flush_timeout_us, espnow_aggr_flush_cb_t flush_cb, void *arg);
+
+/* Queue one message of at most ESPNOW_AGGR_MAX_MSG_LEN bytes for dest_mac. Returns
+ * ESP_ERR_INVALID_SIZE if the message is too long, or ESP_ERR_NO_MEM if the
+ * destination is full and could not be flushed, or no destination is free. */
+esp_err_t espnow_aggr_add(espnow_aggr_t *aggr, const uint8_t *dest_mac, const uint8_t *msg, size_t len, int64_t now_us);
+
+/* Flush every destination whose flush timeout has expired. */
+void espnow_aggr_poll(espnow_aggr_t *aggr, int64_t now_us);
+
+/* Flush every destination that has messages queued. */
+void espnow_aggr_flush_all(espnow_aggr_t *aggr);
+
+/* Earliest flush deadline, or -1 if nothing is queued. */
+int64_t espnow_aggr_next_deadline(const espnow_aggr_t *aggr);
+
+/* Split an aggregated payload back into messages. Returns the number of messages,
+ * or -1 if a length prefix runs past the end of the payload. */
+int espnow_aggr_split(const uint8_t *payload, size_t len, espnow_aggr_msg_cb_t msg_cb, void *arg);
+
+void espnow_aggr_log_stats(const espnow_aggr_t *aggr);
+
+#endif
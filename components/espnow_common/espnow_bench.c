@@ -0,0 +1,284 @@
+/* ESPNOW Example - throughput benchmark
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <string.h>
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "espnow_bench.h"
+
+/* A device sending to this one. */
+typedef struct {
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    bool used;
+    bool done;                            //The summary of the run has been logged.
+    uint32_t frames;
+    uint32_t bytes;
+    uint32_t lost;                        //Frames skipped in the numbering and not arrived since.
+    uint32_t late;                        //Frames that arrived after a later frame.
+    uint32_t crc_errors;
+    uint32_t next_seq;                    //One beyond the highest frame number received.
+    int64_t first_us;
+    int64_t last_us;
+} bench_peer_t;
+
+static const char *TAG = "espnow_bench";
+static uint8_t s_bench_payload[ESP_NOW_MAX_DATA_LEN];
+static bench_peer_t s_bench_peers[ESPNOW_BENCH_PEERS_MAX];
+
+void espnow_bench_tx_start(espnow_bench_tx_t *tx, const uint8_t *dest_mac, uint8_t len, uint32_t rate,
+                           uint32_t duration_ms, espnow_bench_xmit_cb_t xmit, void *arg, int64_t now_us)
+{
+    memset(tx, 0, sizeof(espnow_bench_tx_t));
+    memcpy(tx->dest_mac, dest_mac, ESP_NOW_ETH_ALEN);
+    tx->len = len < sizeof(espnow_bench_hdr_t) ? sizeof(espnow_bench_hdr_t) : len;
+    tx->rate = rate;
+    tx->state = ESPNOW_BENCH_RUNNING;
+    tx->start_us = now_us;
+    tx->stop_us = now_us + (int64_t)duration_ms * 1000;
+    tx->end_us = now_us;
+    tx->next_us = now_us;
+    tx->xmit = xmit;
+    tx->arg = arg;
+    for (size_t i = sizeof(espnow_bench_hdr_t); i < sizeof(s_bench_payload); i++) {
+        s_bench_payload[i] = (uint8_t)i;
+    }
+}
+
+static esp_err_t bench_tx_send(espnow_bench_tx_t *tx, uint8_t op, uint32_t seq, size_t len)
+{
+    espnow_bench_hdr_t hdr = { .op = op, .seq = seq };
+
+    memcpy(s_bench_payload, &hdr, sizeof(hdr));
+    return tx->xmit(tx->dest_mac, s_bench_payload, len, tx->arg);
+}
+
+esp_err_t espnow_bench_tx_poll(espnow_bench_tx_t *tx, int64_t now_us)
+{
+    esp_err_t ret;
+
+    while (tx->state == ESPNOW_BENCH_RUNNING && !tx->stalled && now_us < tx->stop_us &&
+           (tx->rate == 0 || now_us >= tx->next_us)) {
+        ret = bench_tx_send(tx, ESPNOW_BENCH_OP_DATA, tx->stats.sent, tx->len);
+        if (ret == ESP_ERR_ESPNOW_NO_MEM) {
+            tx->stats.no_mem++;
+            tx->stalled = true;
+            break;
+        }
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        tx->stats.sent++;
+        if (tx->rate > 0) {
+            /* Due times follow the start, so a late frame does not delay the ones after it. */
+            tx->next_us = tx->start_us + (int64_t)tx->stats.sent * 1000000 / tx->rate;
+        }
+    }
+    if (tx->state == ESPNOW_BENCH_RUNNING && now_us >= tx->stop_us) {
+        tx->state = ESPNOW_BENCH_ENDING;
+        tx->next_us = now_us + ESPNOW_BENCH_DRAIN_MS * 1000;
+    }
+    if (tx->state != ESPNOW_BENCH_ENDING) {
+        return ESP_OK;
+    }
+    /* The end frames wait for the sending callbacks of all data frames, or for the drain timeout. */
+    if (tx->ends == 0 && tx->stats.acked + tx->stats.failed < tx->stats.sent && now_us < tx->next_us) {
+        return ESP_OK;
+    }
+    if (tx->ends > 0 && now_us < tx->next_us) {
+        return ESP_OK;
+    }
+    ret = bench_tx_send(tx, ESPNOW_BENCH_OP_END, tx->stats.sent, sizeof(espnow_bench_hdr_t));
+    if (ret != ESP_OK && ret != ESP_ERR_ESPNOW_NO_MEM) {
+        return ret;
+    }
+    if (ret == ESP_OK && ++tx->ends == ESPNOW_BENCH_END_COUNT) {
+        tx->state = ESPNOW_BENCH_DONE;
+    }
+    tx->next_us = now_us + ESPNOW_BENCH_END_GAP_MS * 1000;
+    return ESP_OK;
+}
+
+void espnow_bench_tx_on_sent(espnow_bench_tx_t *tx, const uint8_t *mac, bool success, int64_t now_us)
+{
+    if ((tx->state != ESPNOW_BENCH_RUNNING && tx->state != ESPNOW_BENCH_ENDING) ||
+        memcmp(mac, tx->dest_mac, ESP_NOW_ETH_ALEN) != 0) {
+        return;
+    }
+    tx->stalled = false;
+    if (tx->ends > 0 || tx->stats.acked + tx->stats.failed == tx->stats.sent) {
+        return;
+    }
+    if (success) {
+        tx->stats.acked++;
+    } else {
+        tx->stats.failed++;
+    }
+    tx->end_us = now_us;
+}
+
+int64_t espnow_bench_tx_next_deadline(const espnow_bench_tx_t *tx)
+{
+    switch (tx->state) {
+        case ESPNOW_BENCH_RUNNING:
+            return tx->rate > 0 && !tx->stalled && tx->next_us < tx->stop_us ? tx->next_us : tx->stop_us;
+        case ESPNOW_BENCH_ENDING:
+            return tx->next_us;
+        default:
+            return -1;
+    }
+}
+
+void espnow_bench_tx_log(const espnow_bench_tx_t *tx)
+{
+    const espnow_bench_tx_stats_t *stats = &tx->stats;
+    int64_t elapsed = tx->end_us - tx->start_us + 1;
+    uint32_t loss = stats->sent > 0 ? (uint32_t)((uint64_t)stats->failed * 1000 / stats->sent) : 0;
+
+    ESP_LOGI(TAG, "Bench to "MACSTR": %lu frames of %u bytes in %lld ms, %llu frames/s sent, %llu frames/s and "
+             "%llu KB/s delivered, %lu failed (%lu.%lu%% loss), out of buffers %lu times", MAC2STR(tx->dest_mac),
+             (unsigned long)stats->sent, tx->len, (long long)(elapsed / 1000),
+             (unsigned long long)stats->sent * 1000000 / elapsed, (unsigned long long)stats->acked * 1000000 / elapsed,
+             (unsigned long long)stats->acked * tx->len * 1000000 / 1024 / elapsed, (unsigned long)stats->failed,
+             (unsigned long)(loss / 10), (unsigned long)(loss % 10), (unsigned long)stats->no_mem);
+}
+
+void espnow_bench_rx_init(void)
+{
+    memset(s_bench_peers, 0, sizeof(s_bench_peers));
+}
+
+static bench_peer_t *bench_peer_find(const uint8_t *mac)
+{
+    for (int i = 0; i < ESPNOW_BENCH_PEERS_MAX; i++) {
+        if (s_bench_peers[i].used && memcmp(s_bench_peers[i].mac, mac, ESP_NOW_ETH_ALEN) == 0) {
+            return &s_bench_peers[i];
+        }
+    }
+    return NULL;
+}
+
+/* The sender's entry, or a new one in a free entry or that of a finished run. */
+static bench_peer_t *bench_peer_get(const uint8_t *mac)
+{
+    bench_peer_t *peer = bench_peer_find(mac);
+
+    for (int i = 0; peer == NULL && i < ESPNOW_BENCH_PEERS_MAX; i++) {
+        if (!s_bench_peers[i].used) {
+            peer = &s_bench_peers[i];
+        }
+    }
+    for (int i = 0; peer == NULL && i < ESPNOW_BENCH_PEERS_MAX; i++) {
+        if (s_bench_peers[i].done) {
+            peer = &s_bench_peers[i];
+        }
+    }
+    if (peer != NULL && (!peer->used || peer->done || memcmp(peer->mac, mac, ESP_NOW_ETH_ALEN) != 0)) {
+        memset(peer, 0, sizeof(bench_peer_t));
+        memcpy(peer->mac, mac, ESP_NOW_ETH_ALEN);
+        peer->used = true;
+    }
+    return peer;
+}
+
+static void bench_rx_log(const bench_peer_t *peer, const char *reason)
+{
+    int64_t elapsed = peer->last_us - peer->first_us + 1;
+    uint32_t loss = (uint32_t)((uint64_t)peer->lost * 1000 / (peer->frames + peer->lost));
+
+    ESP_LOGI(TAG, "Bench from "MACSTR" %s: %lu frames, %lu bytes in %lld ms, %llu frames/s, %llu KB/s, %lu lost "
+             "(%lu.%lu%%), %lu late, %lu CRC errors", MAC2STR(peer->mac), reason, (unsigned long)peer->frames,
+             (unsigned long)peer->bytes, (long long)(elapsed / 1000),
+             (unsigned long long)peer->frames * 1000000 / elapsed,
+             (unsigned long long)peer->bytes * 1000000 / 1024 / elapsed, (unsigned long)peer->lost,
+             (unsigned long)(loss / 10), (unsigned long)(loss % 10), (unsigned long)peer->late,
+             (unsigned long)peer->crc_errors);
+}
+
+esp_err_t espnow_bench_rx(const uint8_t *mac, const uint8_t *payload, size_t len, int64_t now_us)
+{
+    espnow_bench_hdr_t hdr;
+    bench_peer_t *peer;
+
+    if (len < sizeof(hdr)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(&hdr, payload, sizeof(hdr));
+    if (hdr.op == ESPNOW_BENCH_OP_END) {
+        /* Only the first end frame of a run counts. */
+        peer = bench_peer_find(mac);
+        if (peer == NULL || peer->done || peer->frames == 0) {
+            return ESP_OK;
+        }
+        if (hdr.seq > peer->next_seq) {
+            peer->lost += hdr.seq - peer->next_seq;
+            peer->next_seq = hdr.seq;
+        }
+        bench_rx_log(peer, "done");
+        peer->done = true;
+        return ESP_OK;
+    }
+    if (hdr.op != ESPNOW_BENCH_OP_DATA) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    peer = bench_peer_get(mac);
+    if (peer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (hdr.seq >= peer->next_seq) {
+        peer->lost += hdr.seq - peer->next_seq;
+        peer->next_seq = hdr.seq + 1;
+    } else {
+        peer->late++;
+        if (peer->lost > 0) {
+            peer->lost--;
+        }
+    }
+    if (peer->frames++ == 0) {
+        peer->first_us = now_us;
+    }
+    peer->bytes += len;
+    peer->last_us = now_us;
+    return ESP_OK;
+}
+
+void espnow_bench_rx_crc_error(const uint8_t *mac)
+{
+    bench_peer_t *peer = bench_peer_get(mac);
+
+    if (peer != NULL) {
+        peer->crc_errors++;
+    }
+}
+
+void espnow_bench_rx_poll(int64_t now_us)
+{
+    for (int i = 0; i < ESPNOW_BENCH_PEERS_MAX; i++) {
+        bench_peer_t *peer = &s_bench_peers[i];
+        if (peer->used && !peer->done && peer->frames > 0 && now_us - peer->last_us >= ESPNOW_BENCH_IDLE_MS * 1000) {
+            bench_rx_log(peer, "silent, no end frame");
+            peer->done = true;
+        }
+    }
+}
+
+int64_t espnow_bench_rx_next_deadline(void)
+{
+    int64_t next = -1;
+
+    for (int i = 0; i < ESPNOW_BENCH_PEERS_MAX; i++) {
+        const bench_peer_t *peer = &s_bench_peers[i];
+        if (peer->used && !peer->done && peer->frames > 0) {
+            int64_t deadline = peer->last_us + ESPNOW_BENCH_IDLE_MS * 1000;
+            if (next < 0 || deadline < next) {
+                next = deadline;
+            }
+        }
+    }
+    return next;
+}
@@ -0,0 +1,117 @@
+/* ESPNOW Example - throughput benchmark
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESPNOW_BENCH_H
+#define ESPNOW_BENCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_now.h"
+
+/* Throughput benchmark. The sender floods one device with EXAMPLE_ESPNOW_DATA_BENCH
+ * frames for a fixed duration, either as fast as ESPNOW takes them or at a target
+ * rate. Every frame carries its number; the rest of the payload is filler. At full
+ * rate a frame is handed to ESPNOW until it reports that its transmit buffers are
+ * full, and sending resumes at the next sending callback. After the duration, and
+ * once every frame has had its sending callback, the sender announces the number of
+ * frames it sent with ESPNOW_BENCH_END_COUNT end frames.
+ *
+ * The receiver counts the frames and bytes of every sender, the frames skipped in
+ * the numbering, those arriving after a later frame, and frames whose CRC failed.
+ * Its summary is logged at the first end frame, which also counts the frames lost
+ * at the end of the run, or when nothing has arrived for ESPNOW_BENCH_IDLE_MS.
+ *
+ * Not thread-safe: all calls for one sender, and all receiver calls, must come from
+ * the same task. */
+#define ESPNOW_BENCH_PEERS_MAX      4
+#define ESPNOW_BENCH_END_COUNT      3
+#define ESPNOW_BENCH_END_GAP_MS     100
+#define ESPNOW_BENCH_DRAIN_MS       1000
+#define ESPNOW_BENCH_IDLE_MS        2000
+
+enum {
+    ESPNOW_BENCH_OP_DATA,
+    ESPNOW_BENCH_OP_END,
+};
+
+typedef enum {
+    ESPNOW_BENCH_IDLE,
+    ESPNOW_BENCH_RUNNING,
+    ESPNOW_BENCH_ENDING,                  //Duration over: waiting for sending callbacks, then sending end frames.
+    ESPNOW_BENCH_DONE,
+} espnow_bench_state_t;
+
+/* Payload of an EXAMPLE_ESPNOW_DATA_BENCH frame, followed by filler in data frames. */
+typedef struct {
+    uint8_t op;
+    uint32_t seq;                         //DATA: frames sent before this one. END: frames sent in the run.
+} __attribute__((packed)) espnow_bench_hdr_t;
+
+/* Transmit one frame carrying payload to mac. */
+typedef esp_err_t (*espnow_bench_xmit_cb_t)(const uint8_t *mac, const uint8_t *payload, size_t len, void *arg);
+
+typedef struct {
+    uint32_t sent;                        //Data frames handed to ESPNOW.
+    uint32_t acked;                       //Data frames whose sending callback reported success.
+    uint32_t failed;                      //Data frames whose sending callback reported failure.
+    uint32_t no_mem;                      //Times ESPNOW had no transmit buffer left.
+} espnow_bench_tx_stats_t;
+
+typedef struct {
+    uint8_t dest_mac[ESP_NOW_ETH_ALEN];
+    uint8_t len;                          //Payload length of every data frame.
+    uint8_t ends;                         //End frames sent.
+    bool stalled;                         //ESPNOW refused a frame since the last sending callback.
+    espnow_bench_state_t state;
+    uint32_t rate;                        //Frames per second, 0 for as fast as ESPNOW takes them.
+    int64_t start_us;
+    int64_t stop_us;                      //End of the duration.
+    int64_t end_us;                       //Time the last data frame had its sending callback.
+    int64_t next_us;                      //RUNNING: next frame due. ENDING: drain timeout or next end frame due.
+    espnow_bench_xmit_cb_t xmit;
+    void *arg;
+    espnow_bench_tx_stats_t stats;
+} espnow_bench_tx_t;
+
+/* Flood dest_mac with data frames of len bytes of payload, at least sizeof(espnow_bench_hdr_t),
+ * for duration_ms. The first frames are sent by the next poll. */
+void espnow_bench_tx_start(espnow_bench_tx_t *tx, const uint8_t *dest_mac, uint8_t len, uint32_t rate,
+                           uint32_t duration_ms, espnow_bench_xmit_cb_t xmit, void *arg, int64_t now_us);
+
+/* Send what is due. Returns an error other than ESP_ERR_ESPNOW_NO_MEM from xmit. */
+esp_err_t espnow_bench_tx_poll(espnow_bench_tx_t *tx, int64_t now_us);
+
+/* A sending callback for mac was called. */
+void espnow_bench_tx_on_sent(espnow_bench_tx_t *tx, const uint8_t *mac, bool success, int64_t now_us);
+
+/* Time the next poll is due, or -1 if nothing is before the next sending callback. */
+int64_t espnow_bench_tx_next_deadline(const espnow_bench_tx_t *tx);
+
+/* Log frames/s, goodput and loss of the run. */
+void espnow_bench_tx_log(const espnow_bench_tx_t *tx);
+
+void espnow_bench_rx_init(void);
+
+/* Handle the payload of a bench frame received from mac. Returns ESP_ERR_INVALID_ARG
+ * for a malformed frame and ESP_ERR_NO_MEM when ESPNOW_BENCH_PEERS_MAX other senders
+ * are counted already. */
+esp_err_t espnow_bench_rx(const uint8_t *mac, const uint8_t *payload, size_t len, int64_t now_us);
+
+/* A bench frame from mac failed its CRC check. */
+void espnow_bench_rx_crc_error(const uint8_t *mac);
+
+/* Log the summary of every sender silent for ESPNOW_BENCH_IDLE_MS. */
+void espnow_bench_rx_poll(int64_t now_us);
+
+/* Time the next poll is due, or -1 if no run is going on. */
+int64_t espnow_bench_rx_next_deadline(void);
+
+#endif
@@ -0,0 +1,369 @@
+/* ESPNOW Example - bulk transfer
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <string.h>
+#include "espnow_bulk.h"
+
+_Static_assert(ESPNOW_BULK_WINDOW_MAX == 64, "Bitmaps are 64 bits wide");
+
+static uint64_t bulk_shift(uint64_t bitmap, uint32_t n)
+{
+    return n >= 64 ? 0 : bitmap >> n;
+}
+
+/* Returns false if the frame could not be handed to ESPNOW and must be built again.
+ * After the first refusal nothing more is tried until the next poll. */
+static bool bulk_tx_xmit(espnow_bulk_tx_t *tx, const uint8_t *payload, size_t len)
+{
+    if (tx->stalled || tx->xmit(tx->dest_mac, payload, len, tx->arg) != ESP_OK) {
+        tx->stalled = true;
+        return false;
+    }
+    return true;
+}
+
+static bool bulk_tx_offer(espnow_bulk_tx_t *tx)
+{
+    uint8_t payload[sizeof(espnow_bulk_hdr_t) + sizeof(espnow_bulk_offer_t)];
+    espnow_bulk_hdr_t hdr = { .op = ESPNOW_BULK_OP_OFFER, .xfer_id = tx->xfer_id, .index = 0 };
+    espnow_bulk_offer_t offer = {
+        .size = tx->size,
+        .crc = tx->crc,
+        .ack_every = tx->window / 4 > 0 ? tx->window / 4 : 1,
+    };
+
+    memcpy(payload, &hdr, sizeof(hdr));
+    memcpy(payload + sizeof(hdr), &offer, sizeof(offer));
+    return bulk_tx_xmit(tx, payload, sizeof(payload));
+}
+
+static bool bulk_tx_chunk(espnow_bulk_tx_t *tx, uint32_t index, int64_t now_us)
+{
+    uint8_t payload[sizeof(espnow_bulk_hdr_t) + ESPNOW_BULK_CHUNK_LEN];
+    espnow_bulk_hdr_t hdr = { .op = ESPNOW_BULK_OP_DATA, .xfer_id = tx->xfer_id, .index = index };
+    uint32_t offset = index * (uint32_t)ESPNOW_BULK_CHUNK_LEN;
+    size_t len = tx->size - offset < ESPNOW_BULK_CHUNK_LEN ? tx->size - offset : ESPNOW_BULK_CHUNK_LEN;
+
+    if (tx->stalled) {
+        return false;
+    }
+    if (tx->read(offset, payload + sizeof(hdr), len, tx->arg) != ESP_OK) {
+        tx->state = ESPNOW_BULK_FAILED;
+        tx->end_us = now_us;
+        return false;
+    }
+    memcpy(payload, &hdr, sizeof(hdr));
+    if (!bulk_tx_xmit(tx, payload, sizeof(hdr) + len)) {
+        return false;
+    }
+    tx->sent_order[index % ESPNOW_BULK_WINDOW_MAX] = ++tx->order;
+    return true;
+}
+
+void espnow_bulk_tx_start(espnow_bulk_tx_t *tx, const uint8_t *dest_mac, uint8_t xfer_id, uint32_t size, uint32_t crc,
+                          uint8_t window, uint32_t timeout_ms, uint8_t max_tries,
+                          espnow_bulk_read_cb_t read, espnow_bulk_xmit_cb_t xmit, void *arg)
+{
+    memset(tx, 0, sizeof(espnow_bulk_tx_t));
+    memcpy(tx->dest_mac, dest_mac, ESP_NOW_ETH_ALEN);
+    tx->xfer_id = xfer_id;
+    tx->window = window < 1 ? 1 : (window > ESPNOW_BULK_WINDOW_MAX ? ESPNOW_BULK_WINDOW_MAX : window);
+    tx->max_tries = max_tries;
+    tx->state = ESPNOW_BULK_OFFERING;
+    tx->size = size;
+    tx->crc = crc;
+    tx->count = espnow_bulk_chunk_count(size);
+    tx->timeout_us = (int64_t)timeout_ms * 1000;
+    tx->progress_us = -1;
+    tx->read = read;
+    tx->xmit = xmit;
+    tx->arg = arg;
+}
+
+void espnow_bulk_tx_poll(espnow_bulk_tx_t *tx, int64_t now_us)
+{
+    tx->stalled = false;
+    if (tx->state == ESPNOW_BULK_OFFERING) {
+        if (tx->progress_us >= 0 && now_us < tx->progress_us + tx->timeout_us) {
+            return;
+        }
+        if (tx->tries >= tx->max_tries) {
+            tx->state = ESPNOW_BULK_FAILED;
+            tx->end_us = now_us;
+            return;
+        }
+        if (bulk_tx_offer(tx)) {
+            if (tx->progress_us >= 0) {
+                tx->stats.timeouts++;
+            }
+            tx->tries++;
+            tx->progress_us = now_us;
+        }
+        return;
+    }
+    if (tx->state != ESPNOW_BULK_RUNNING) {
+        return;
+    }
+
+    /* No status has made progress for a while: the first missing chunk asks for one. */
+    if (now_us >= tx->progress_us + tx->timeout_us) {
+        if (tx->tries >= tx->max_tries) {
+            tx->state = ESPNOW_BULK_FAILED;
+            tx->end_us = now_us;
+            return;
+        }
+        tx->lost |= 1;
+        tx->tries++;
+        tx->progress_us = now_us;
+        tx->stats.timeouts++;
+    }
+    while (tx->lost != 0) {
+        uint32_t bit = (uint32_t)__builtin_ctzll(tx->lost);
+        if (!bulk_tx_chunk(tx, tx->base + bit, now_us)) {
+            return;
+        }
+        tx->lost &= ~(1ULL << bit);
+    }
+    while (tx->next < tx->count && tx->next - tx->base < tx->window) {
+        if (!bulk_tx_chunk(tx, tx->next, now_us)) {
+            return;
+        }
+        tx->next++;
+        tx->stats.chunks++;
+    }
+}
+
+esp_err_t espnow_bulk_tx_on_status(espnow_bulk_tx_t *tx, const uint8_t *mac, const uint8_t *payload, size_t len,
+                                   int64_t now_us)
+{
+    espnow_bulk_hdr_t hdr;
+    espnow_bulk_status_t status;
+    uint64_t valid, fresh;
+
+    if (len < sizeof(hdr) + sizeof(status)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(&hdr, payload, sizeof(hdr));
+    memcpy(&status, payload + sizeof(hdr), sizeof(status));
+    if (hdr.op != ESPNOW_BULK_OP_STATUS || hdr.xfer_id != tx->xfer_id || !espnow_bulk_tx_active(tx) ||
+        memcmp(mac, tx->dest_mac, ESP_NOW_ETH_ALEN) != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    tx->stats.statuses++;
+
+    if (status.state == ESPNOW_BULK_DONE || status.state == ESPNOW_BULK_FAILED) {
+        tx->state = (espnow_bulk_state_t)status.state;
+        if (tx->state == ESPNOW_BULK_DONE) {
+            tx->base = tx->next = tx->count;
+        }
+        tx->end_us = now_us;
+        return ESP_OK;
+    }
+    if (tx->state == ESPNOW_BULK_OFFERING) {
+        /* The receiver accepted the offer. */
+        tx->state = ESPNOW_BULK_RUNNING;
+        tx->base = 0;
+        tx->next = 0;
+        tx->tries = 0;
+        tx->progress_us = now_us;
+        tx->start_us = now_us;
+        return ESP_OK;
+    }
+    if (hdr.index < tx->base || hdr.index > tx->next || hdr.index >= tx->count) {
+        /* Older than a status already handled, or about chunks never sent. */
+        return ESP_OK;
+    }
+
+    if (hdr.index > tx->base) {
+        tx->acked = bulk_shift(tx->acked, hdr.index - tx->base);
+        tx->lost = bulk_shift(tx->lost, hdr.index - tx->base);
+        tx->base = hdr.index;
+        tx->tries = 0;
+        tx->progress_us = now_us;
+    }
+    valid = tx->next - tx->base >= 64 ? UINT64_MAX : (1ULL << (tx->next - tx->base)) - 1;
+    fresh = status.bitmap & valid & ~tx->acked;
+    if (fresh != 0) {
+        tx->acked |= fresh;
+        tx->lost &= ~fresh;
+        tx->tries = 0;
+        tx->progress_us = now_us;
+    }
+
+    /* A chunk still missing that was sent before the last chunk to arrive is lost. */
+    if (tx->acked != 0) {
+        uint32_t top = 63 - (uint32_t)__builtin_clzll(tx->acked);
+        uint32_t top_order = tx->sent_order[(tx->base + top) % ESPNOW_BULK_WINDOW_MAX];
+        for (uint32_t bit = 0; bit < top; bit++) {
+            uint64_t mask = 1ULL << bit;
+            if ((tx->acked & mask) == 0 && (tx->lost & mask) == 0 &&
+                (int32_t)(tx->sent_order[(tx->base + bit) % ESPNOW_BULK_WINDOW_MAX] - top_order) < 0) {
+                tx->lost |= mask;
+                tx->stats.nacked++;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+int64_t espnow_bulk_tx_next_deadline(const espnow_bulk_tx_t *tx)
+{
+    if (!espnow_bulk_tx_active(tx) || tx->stalled) {
+        return -1;
+    }
+    if (tx->progress_us < 0) {
+        return 0;
+    }
+    if (tx->state == ESPNOW_BULK_RUNNING &&
+        (tx->lost != 0 || (tx->next < tx->count && tx->next - tx->base < tx->window))) {
+        return 0;
+    }
+    return tx->progress_us + tx->timeout_us;
+}
+
+void espnow_bulk_rx_init(espnow_bulk_rx_t *rx, espnow_bulk_begin_cb_t begin, espnow_bulk_write_cb_t write,
+                         espnow_bulk_end_cb_t end, espnow_bulk_xmit_cb_t xmit, void *arg)
+{
+    memset(rx, 0, sizeof(espnow_bulk_rx_t));
+    rx->state = ESPNOW_BULK_IDLE;
+    rx->begin = begin;
+    rx->write = write;
+    rx->end = end;
+    rx->xmit = xmit;
+    rx->arg = arg;
+}
+
+/* A status that cannot be sent is dropped: the sender's timeout asks for it again. */
+static void bulk_rx_status(espnow_bulk_rx_t *rx)
+{
+    uint8_t payload[sizeof(espnow_bulk_hdr_t) + sizeof(espnow_bulk_status_t)];
+    espnow_bulk_hdr_t hdr = { .op = ESPNOW_BULK_OP_STATUS, .xfer_id = rx->xfer_id, .index = rx->base };
+    espnow_bulk_status_t status = { .state = (uint8_t)rx->state, .bitmap = rx->bitmap };
+
+    memcpy(payload, &hdr, sizeof(hdr));
+    memcpy(payload + sizeof(hdr), &status, sizeof(status));
+    rx->unreported = 0;
+    rx->stats.statuses++;
+    rx->xmit(rx->src_mac, payload, sizeof(payload), rx->arg);
+}
+
+static esp_err_t bulk_rx_offer(espnow_bulk_rx_t *rx, const uint8_t *mac, const espnow_bulk_hdr_t *hdr,
+                               const uint8_t *body, size_t len, int64_t now_us)
+{
+    espnow_bulk_offer_t offer;
+
+    if (len < sizeof(offer)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(&offer, body, sizeof(offer));
+    if (offer.size == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (rx->state != ESPNOW_BULK_IDLE && hdr->xfer_id == rx->xfer_id && offer.size == rx->size &&
+        offer.crc == rx->crc && memcmp(mac, rx->src_mac, ESP_NOW_ETH_ALEN) == 0) {
+        /* The sender missed the answer to its offer. */
+        bulk_rx_status(rx);
+        return ESP_OK;
+    }
+    if (rx->state == ESPNOW_BULK_RUNNING) {
+        rx->stats.aborted++;
+    }
+    memcpy(rx->src_mac, mac, ESP_NOW_ETH_ALEN);
+    rx->xfer_id = hdr->xfer_id;
+    rx->ack_every = offer.ack_every > 0 ? offer.ack_every : 1;
+    rx->size = offer.size;
+    rx->crc = offer.crc;
+    rx->count = espnow_bulk_chunk_count(offer.size);
+    rx->base = 0;
+    rx->top = 0;
+    rx->bitmap = 0;
+    rx->start_us = now_us;
+    rx->end_us = 0;
+    rx->state = rx->begin(offer.size, rx->arg) == ESP_OK ? ESPNOW_BULK_RUNNING : ESPNOW_BULK_FAILED;
+    if (rx->state == ESPNOW_BULK_RUNNING) {
+        rx->stats.transfers++;
+    }
+    bulk_rx_status(rx);
+    return ESP_OK;
+}
+
+static esp_err_t bulk_rx_data(espnow_bulk_rx_t *rx, const espnow_bulk_hdr_t *hdr, const uint8_t *body, size_t len,
+                              int64_t now_us)
+{
+    uint32_t index = hdr->index;
+    bool gap;
+
+    if (rx->state != ESPNOW_BULK_RUNNING) {
+        /* The sender missed the final status. */
+        bulk_rx_status(rx);
+        return ESP_OK;
+    }
+    if (index >= rx->count || len != (index == rx->count - 1 ? rx->size - index * ESPNOW_BULK_CHUNK_LEN
+                                                           : ESPNOW_BULK_CHUNK_LEN)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (index < rx->base || (index - rx->base < 64 && (rx->bitmap & (1ULL << (index - rx->base))) != 0)) {
+        rx->stats.duplicates++;
+        bulk_rx_status(rx);
+        return ESP_OK;
+    }
+    if (index - rx->base >= ESPNOW_BULK_WINDOW_MAX) {
+        /* Beyond any window the sender can have: it has not seen a status for long. */
+        bulk_rx_status(rx);
+        return ESP_OK;
+    }
+    if (rx->write(index * (uint32_t)ESPNOW_BULK_CHUNK_LEN, body, len, rx->arg) != ESP_OK) {
+        rx->state = ESPNOW_BULK_FAILED;
+        rx->end_us = now_us;
+        bulk_rx_status(rx);
+        return ESP_OK;
+    }
+    rx->stats.chunks++;
+    rx->bitmap |= 1ULL << (index - rx->base);
+    /* A chunk after a gap shows the sender what is missing, and a chunk filling a gap
+     * may free the whole window: both are reported at once. */
+    gap = index != rx->top;
+    if (index >= rx->top) {
+        rx->top = index + 1;
+    }
+    while (rx->bitmap & 1) {
+        rx->bitmap >>= 1;
+        rx->base++;
+    }
+
+    if (rx->base == rx->count) {
+        rx->state = rx->end(rx->size, rx->crc, rx->arg) == ESP_OK ? ESPNOW_BULK_DONE : ESPNOW_BULK_FAILED;
+        rx->end_us = now_us;
+        bulk_rx_status(rx);
+    } else if (gap || ++rx->unreported >= rx->ack_every) {
+        bulk_rx_status(rx);
+    }
+    return ESP_OK;
+}
+
+esp_err_t espnow_bulk_rx(espnow_bulk_rx_t *rx, const uint8_t *mac, const uint8_t *payload, size_t len, int64_t now_us)
+{
+    espnow_bulk_hdr_t hdr;
+
+    if (len < sizeof(hdr)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(&hdr, payload, sizeof(hdr));
+    if (hdr.op == ESPNOW_BULK_OP_OFFER) {
+        return bulk_rx_offer(rx, mac, &hdr, payload + sizeof(hdr), len - sizeof(hdr), now_us);
+    }
+    if (hdr.op != ESPNOW_BULK_OP_DATA) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (rx->state == ESPNOW_BULK_IDLE || hdr.xfer_id != rx->xfer_id || memcmp(mac, rx->src_mac, ESP_NOW_ETH_ALEN) != 0) {
+        /* A chunk of a transfer replaced or never offered. */
+        return ESP_OK;
+    }
+    return bulk_rx_data(rx, &hdr, payload + sizeof(hdr), len - sizeof(hdr), now_us);
+}
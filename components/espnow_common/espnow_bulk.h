@@ -0,0 +1,196 @@
+/* ESPNOW Example - bulk transfer
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESPNOW_BULK_H
+#define ESPNOW_BULK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_now.h"
+#include "espnow_example.h"
+
+/* Transfer of an image of up to several megabytes, such as a firmware image, from one
+ * device to another in EXAMPLE_ESPNOW_DATA_BULK frames. The sender offers the image
+ * with its size and CRC32, then streams it in chunks of ESPNOW_BULK_CHUNK_LEN bytes,
+ * keeping at most `window` chunks from the first one not yet acknowledged in flight.
+ * The receiver writes every chunk at its offset as it arrives, in any order, so the
+ * image is never held in RAM. It answers with a status: the first chunk it misses and
+ * a bitmap of the chunks after it. A status is sent every ack_every chunks, at once
+ * when a chunk arrives beyond a gap or fills one, and for every chunk received again.
+ *
+ * A chunk the bitmap shows missing while a chunk sent after it has arrived is sent
+ * again at once. When no status makes progress for the timeout, the first missing
+ * chunk is sent again to ask for a status; after max_tries such timeouts in a row the
+ * transfer fails. Once every chunk has arrived, the receiver checks the CRC32 of what
+ * it wrote and reports the result.
+ *
+ * Not thread-safe: all calls for one sender or receiver must come from the same task. */
+#define ESPNOW_BULK_WINDOW_MAX      64
+
+enum {
+    ESPNOW_BULK_OP_OFFER,                 //Sender: espnow_bulk_offer_t follows.
+    ESPNOW_BULK_OP_DATA,                  //Sender: the chunk follows.
+    ESPNOW_BULK_OP_STATUS,                //Receiver: espnow_bulk_status_t follows.
+};
+
+typedef enum {
+    ESPNOW_BULK_IDLE,
+    ESPNOW_BULK_OFFERING,                 //Sender only: waiting for the first status.
+    ESPNOW_BULK_RUNNING,
+    ESPNOW_BULK_DONE,                     //Every chunk written and the CRC32 checked.
+    ESPNOW_BULK_FAILED,
+} espnow_bulk_state_t;
+
+/* Payload of an EXAMPLE_ESPNOW_DATA_BULK frame, in front of the body of its op. */
+typedef struct {
+    uint8_t op;
+    uint8_t xfer_id;                      //Transfer the frame belongs to, chosen by the sender.
+    uint32_t index;                       //DATA: index of the chunk. STATUS: first chunk missing.
+} __attribute__((packed)) espnow_bulk_hdr_t;
+
+typedef struct {
+    uint32_t size;                        //Image length, unit: byte.
+    uint32_t crc;                         //esp_crc32_le(0, image, size).
+    uint8_t ack_every;                    //Chunks the receiver may take before it sends a status.
+} __attribute__((packed)) espnow_bulk_offer_t;
+
+typedef struct {
+    uint8_t state;                        //espnow_bulk_state_t of the receiver.
+    uint64_t bitmap;                      //Bit i set: chunk index + i has arrived.
+} __attribute__((packed)) espnow_bulk_status_t;
+
+#define ESPNOW_BULK_CHUNK_LEN       (ESP_NOW_MAX_DATA_LEN - sizeof(example_espnow_data_t) - sizeof(espnow_bulk_hdr_t))
+
+/* Transmit one frame carrying payload to mac. Returning anything but ESP_OK leaves
+ * the frame to be built again at the next poll. */
+typedef esp_err_t (*espnow_bulk_xmit_cb_t)(const uint8_t *mac, const uint8_t *payload, size_t len, void *arg);
+
+/* Sender: read len bytes of the image at offset. */
+typedef esp_err_t (*espnow_bulk_read_cb_t)(uint32_t offset, uint8_t *data, size_t len, void *arg);
+
+/* Receiver: prepare to store an image of size bytes. */
+typedef esp_err_t (*espnow_bulk_begin_cb_t)(uint32_t size, void *arg);
+
+/* Receiver: store len bytes of the image at offset. */
+typedef esp_err_t (*espnow_bulk_write_cb_t)(uint32_t offset, const uint8_t *data, size_t len, void *arg);
+
+/* Receiver: every chunk has been stored. Check that the image has the given CRC32. */
+typedef esp_err_t (*espnow_bulk_end_cb_t)(uint32_t size, uint32_t crc, void *arg);
+
+typedef struct {
+    uint32_t chunks;                      //Chunks transmitted for the first time.
+    uint32_t nacked;                      //Chunks sent again because a status showed them missing.
+    uint32_t timeouts;                    //Offers and chunks sent again after the timeout.
+    uint32_t statuses;                    //Statuses received.
+} espnow_bulk_tx_stats_t;
+
+typedef struct {
+    uint8_t dest_mac[ESP_NOW_ETH_ALEN];
+    uint8_t xfer_id;
+    uint8_t window;                       //Chunks allowed in flight, 1..ESPNOW_BULK_WINDOW_MAX.
+    uint8_t max_tries;
+    uint8_t tries;                        //Timeouts since the last progress.
+    bool stalled;                         //The xmit callback refused a frame since the last poll.
+    espnow_bulk_state_t state;
+    uint32_t size;
+    uint32_t crc;
+    uint32_t count;                       //Chunks in the image.
+    uint32_t base;                        //First chunk not acknowledged.
+    uint32_t next;                        //First chunk never transmitted.
+    uint64_t acked;                       //Bit i set: chunk base + i acknowledged.
+    uint64_t lost;                        //Bit i set: chunk base + i must be sent again.
+    uint32_t order;                       //Chunk transmissions so far.
+    uint32_t sent_order[ESPNOW_BULK_WINDOW_MAX];    //Value of order at the last transmission of chunk i, at i % ESPNOW_BULK_WINDOW_MAX.
+    int64_t timeout_us;
+    int64_t progress_us;                  //Time of the last offer sent or status that made progress.
+    int64_t start_us;                     //Time the receiver accepted the offer.
+    int64_t end_us;
+    espnow_bulk_read_cb_t read;
+    espnow_bulk_xmit_cb_t xmit;
+    void *arg;
+    espnow_bulk_tx_stats_t stats;
+} espnow_bulk_tx_t;
+
+typedef struct {
+    uint32_t transfers;                   //Offers accepted.
+    uint32_t aborted;                     //Transfers replaced by another offer before they finished.
+    uint32_t chunks;                      //Chunks written.
+    uint32_t duplicates;                  //Chunks received again.
+    uint32_t statuses;                    //Statuses sent.
+} espnow_bulk_rx_stats_t;
+
+typedef struct {
+    uint8_t src_mac[ESP_NOW_ETH_ALEN];
+    uint8_t xfer_id;
+    uint8_t ack_every;
+    uint8_t unreported;                   //Chunks written since the last status.
+    espnow_bulk_state_t state;
+    uint32_t size;
+    uint32_t crc;
+    uint32_t count;                       //Chunks in the image.
+    uint32_t base;                        //First chunk missing.
+    uint32_t top;                         //One beyond the highest chunk received.
+    uint64_t bitmap;                      //Bit i set: chunk base + i has arrived.
+    int64_t start_us;
+    int64_t end_us;
+    espnow_bulk_begin_cb_t begin;
+    espnow_bulk_write_cb_t write;
+    espnow_bulk_end_cb_t end;
+    espnow_bulk_xmit_cb_t xmit;
+    void *arg;
+    espnow_bulk_rx_stats_t stats;
+} espnow_bulk_rx_t;
+
+static inline uint32_t espnow_bulk_chunk_count(uint32_t size)
+{
+    return (uint32_t)((size + ESPNOW_BULK_CHUNK_LEN - 1) / ESPNOW_BULK_CHUNK_LEN);
+}
+
+/* Offer an image of size bytes with the given CRC32 to dest_mac, as transfer xfer_id.
+ * The offer is sent by the next poll and again every timeout_ms until it is answered. */
+void espnow_bulk_tx_start(espnow_bulk_tx_t *tx, const uint8_t *dest_mac, uint8_t xfer_id, uint32_t size, uint32_t crc,
+                          uint8_t window, uint32_t timeout_ms, uint8_t max_tries,
+                          espnow_bulk_read_cb_t read, espnow_bulk_xmit_cb_t xmit, void *arg);
+
+/* Send what is due: the offer, chunks shown missing or timed out, and new chunks while
+ * the window has room. */
+void espnow_bulk_tx_poll(espnow_bulk_tx_t *tx, int64_t now_us);
+
+/* Handle the payload of a bulk frame received from mac. Returns ESP_ERR_INVALID_ARG if
+ * it is not a status of the current transfer. */
+esp_err_t espnow_bulk_tx_on_status(espnow_bulk_tx_t *tx, const uint8_t *mac, const uint8_t *payload, size_t len,
+                                   int64_t now_us);
+
+/* Time the next poll is due, or -1 if nothing is. Also -1 while the sender is stalled:
+ * poll again after the next sending callback. */
+int64_t espnow_bulk_tx_next_deadline(const espnow_bulk_tx_t *tx);
+
+static inline bool espnow_bulk_tx_active(const espnow_bulk_tx_t *tx)
+{
+    return tx->state == ESPNOW_BULK_OFFERING || tx->state == ESPNOW_BULK_RUNNING;
+}
+
+/* Bytes of the image acknowledged in order so far. */
+static inline uint32_t espnow_bulk_tx_acked_bytes(const espnow_bulk_tx_t *tx)
+{
+    uint64_t bytes = (uint64_t)tx->base * ESPNOW_BULK_CHUNK_LEN;
+    return bytes < tx->size ? (uint32_t)bytes : tx->size;
+}
+
+void espnow_bulk_rx_init(espnow_bulk_rx_t *rx, espnow_bulk_begin_cb_t begin, espnow_bulk_write_cb_t write,
+                         espnow_bulk_end_cb_t end, espnow_bulk_xmit_cb_t xmit, void *arg);
+
+/* Handle the payload of a bulk frame received from mac. An offer of another transfer
+ * replaces the current one, so pass only frames of the device trusted to send images.
+ * Returns ESP_ERR_INVALID_ARG for a malformed frame. */
+esp_err_t espnow_bulk_rx(espnow_bulk_rx_t *rx, const uint8_t *mac, const uint8_t *payload, size_t len, int64_t now_us);
+
+#endif
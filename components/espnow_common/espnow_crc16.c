@@ -0,0 +1,188 @@
+/* ESPNOW Example - CRC16 engine
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <string.h>
+#include "esp_log.h"
+#include "espnow_crc16.h"
+#ifdef ESP_PLATFORM
+#include "esp_crc.h"
+#include "esp_cpu.h"
+#else
+#include <time.h>
+#endif
+
+#define CRC16_POLY_REFLECTED 0x8408
+
+#if CONFIG_ESPNOW_CRC16_ENGINE_BYTE
+#define CRC16_ENGINE ESPNOW_CRC16_ENGINE_BYTE
+#elif CONFIG_ESPNOW_CRC16_ENGINE_SLICE4
+#define CRC16_ENGINE ESPNOW_CRC16_ENGINE_SLICE4
+#elif CONFIG_ESPNOW_CRC16_ENGINE_SLICE8
+#define CRC16_ENGINE ESPNOW_CRC16_ENGINE_SLICE8
+#else
+#define CRC16_ENGINE ESPNOW_CRC16_ENGINE_ROM
+#endif
+
+static const char *TAG = "espnow_crc16";
+
+/* s_crc16_table[k][b] is the CRC contribution of byte b followed by k zero bytes.
+ * Kept in RAM: a lookup per byte from flash would go through the cache. */
+static uint16_t s_crc16_table[8][256];
+
+void espnow_crc16_init(void)
+{
+    for (int b = 0; b < 256; b++) {
+        uint16_t crc = b;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC16_POLY_REFLECTED : crc >> 1;
+        }
+        s_crc16_table[0][b] = crc;
+    }
+    for (int k = 1; k < 8; k++) {
+        for (int b = 0; b < 256; b++) {
+            uint16_t prev = s_crc16_table[k - 1][b];
+            s_crc16_table[k][b] = (prev >> 8) ^ s_crc16_table[0][prev & 0xFF];
+        }
+    }
+}
+
+static inline uint32_t crc16_load32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* The engines below work on the inverted running value; the callers do the
+ * inversion on entry and exit. */
+static uint16_t crc16_byte(uint16_t crc, const uint8_t *buf, size_t len)
+{
+    while (len--) {
+        crc = s_crc16_table[0][(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+static uint16_t crc16_slice4(uint16_t crc, const uint8_t *buf, size_t len)
+{
+    while (len >= 4) {
+        uint32_t w = crc16_load32(buf) ^ crc;
+        crc = s_crc16_table[3][w & 0xFF] ^ s_crc16_table[2][(w >> 8) & 0xFF] ^
+              s_crc16_table[1][(w >> 16) & 0xFF] ^ s_crc16_table[0][w >> 24];
+        buf += 4;
+        len -= 4;
+    }
+    return crc16_byte(crc, buf, len);
+}
+
+static uint16_t crc16_slice8(uint16_t crc, const uint8_t *buf, size_t len)
+{
+    while (len >= 8) {
+        uint32_t lo = crc16_load32(buf) ^ crc;
+        uint32_t hi = crc16_load32(buf + 4);
+        crc = s_crc16_table[7][lo & 0xFF] ^ s_crc16_table[6][(lo >> 8) & 0xFF] ^
+              s_crc16_table[5][(lo >> 16) & 0xFF] ^ s_crc16_table[4][lo >> 24] ^
+              s_crc16_table[3][hi & 0xFF] ^ s_crc16_table[2][(hi >> 8) & 0xFF] ^
+              s_crc16_table[1][(hi >> 16) & 0xFF] ^ s_crc16_table[0][hi >> 24];
+        buf += 8;
+        len -= 8;
+    }
+    return crc16_slice4(crc, buf, len);
+}
+
+uint16_t espnow_crc16_update_with(espnow_crc16_engine_t engine, uint16_t crc, const uint8_t *buf, size_t len)
+{
+    switch (engine) {
+        case ESPNOW_CRC16_ENGINE_ROM:
+#ifdef ESP_PLATFORM
+            return esp_crc16_le(crc, buf, len);
+#else
+            return ~crc16_byte(~crc, buf, len);
+#endif
+        case ESPNOW_CRC16_ENGINE_SLICE4:
+            return ~crc16_slice4(~crc, buf, len);
+        case ESPNOW_CRC16_ENGINE_SLICE8:
+            return ~crc16_slice8(~crc, buf, len);
+        case ESPNOW_CRC16_ENGINE_BYTE:
+        default:
+            return ~crc16_byte(~crc, buf, len);
+    }
+}
+
+uint16_t espnow_crc16_update(uint16_t crc, const uint8_t *buf, size_t len)
+{
+    return espnow_crc16_update_with(CRC16_ENGINE, crc, buf, len);
+}
+
+uint16_t espnow_crc16_frame(const uint8_t *frame, size_t len, size_t crc_offset)
+{
+    static const uint8_t zero[2] = { 0, 0 };
+    uint16_t crc;
+
+    if (crc_offset + sizeof(zero) > len) {
+        return espnow_crc16_update(UINT16_MAX, frame, len);
+    }
+    crc = espnow_crc16_update(UINT16_MAX, frame, crc_offset);
+    crc = espnow_crc16_update(crc, zero, sizeof(zero));
+    return espnow_crc16_update(crc, frame + crc_offset + sizeof(zero), len - crc_offset - sizeof(zero));
+}
+
+const char *espnow_crc16_engine_name(espnow_crc16_engine_t engine)
+{
+    static const char *names[ESPNOW_CRC16_ENGINE_MAX] = { "rom", "byte", "slice4", "slice8" };
+    return engine < ESPNOW_CRC16_ENGINE_MAX ? names[engine] : "?";
+}
+
+static inline uint32_t crc16_bench_now(void)
+{
+#ifdef ESP_PLATFORM
+    return esp_cpu_get_cycle_count();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+#endif
+}
+
+esp_err_t espnow_crc16_bench(void)
+{
+    static const size_t lens[] = { 10, 16, 32, 64, 128, 250 };
+    const int iterations = 2000;
+    static uint8_t frame[250];
+    volatile uint16_t sink = 0;
+    esp_err_t ret = ESP_OK;
+
+    for (size_t i = 0; i < sizeof(frame); i++) {
+        frame[i] = (uint8_t)(i * 131 + 7);
+    }
+#ifdef ESP_PLATFORM
+    ESP_LOGI(TAG, "CRC16 cost per frame in CPU cycles");
+#else
+    ESP_LOGI(TAG, "CRC16 cost per frame in nanoseconds");
+#endif
+    for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+        uint32_t cost[ESPNOW_CRC16_ENGINE_MAX];
+        uint16_t ref = espnow_crc16_update_with(ESPNOW_CRC16_ENGINE_BYTE, UINT16_MAX, frame, lens[l]);
+
+        for (int e = 0; e < ESPNOW_CRC16_ENGINE_MAX; e++) {
+            if (espnow_crc16_update_with(e, UINT16_MAX, frame, lens[l]) != ref) {
+                ESP_LOGE(TAG, "Engine %s disagrees on %u bytes", espnow_crc16_engine_name(e), (unsigned)lens[l]);
+                ret = ESP_FAIL;
+            }
+            uint32_t start = crc16_bench_now();
+            for (int i = 0; i < iterations; i++) {
+                sink ^= espnow_crc16_update_with(e, UINT16_MAX, frame, lens[l]);
+            }
+            cost[e] = (crc16_bench_now() - start) / iterations;
+        }
+        ESP_LOGI(TAG, "%3u bytes: rom %5lu, byte %5lu, slice4 %5lu, slice8 %5lu", (unsigned)lens[l],
+                 (unsigned long)cost[ESPNOW_CRC16_ENGINE_ROM], (unsigned long)cost[ESPNOW_CRC16_ENGINE_BYTE],
+                 (unsigned long)cost[ESPNOW_CRC16_ENGINE_SLICE4], (unsigned long)cost[ESPNOW_CRC16_ENGINE_SLICE8]);
+    }
+    (void)sink;
+    return ret;
+}
@@ -0,0 +1,50 @@
+/* ESPNOW Example - CRC16 engine
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESPNOW_CRC16_H
+#define ESPNOW_CRC16_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+/* Portable CRC16 that is bit-compatible with esp_crc16_le(): reflected polynomial
+ * 0x1021 with the running value inverted on entry and exit. Like esp_crc16_le(),
+ * the result of one call can be passed as crc to the next call to continue over
+ * more data, and a frame CRC starts from UINT16_MAX. */
+typedef enum {
+    ESPNOW_CRC16_ENGINE_ROM,              //esp_crc16_le() from ROM; the byte table on other hosts.
+    ESPNOW_CRC16_ENGINE_BYTE,             //One 256-entry table lookup per byte.
+    ESPNOW_CRC16_ENGINE_SLICE4,           //Four tables, four bytes per step.
+    ESPNOW_CRC16_ENGINE_SLICE8,           //Eight tables, eight bytes per step.
+    ESPNOW_CRC16_ENGINE_MAX,
+} espnow_crc16_engine_t;
+
+/* Build the lookup tables. Must be called once before any other function. */
+void espnow_crc16_init(void);
+
+/* Continue crc over buf with the engine selected in menuconfig. */
+uint16_t espnow_crc16_update(uint16_t crc, const uint8_t *buf, size_t len);
+
+/* Continue crc over buf with a given engine. */
+uint16_t espnow_crc16_update_with(espnow_crc16_engine_t engine, uint16_t crc, const uint8_t *buf, size_t len);
+
+/* CRC of a whole frame, starting from UINT16_MAX, computed as if the two-byte CRC
+ * field at crc_offset were zero. The frame itself is not modified, so received
+ * data can be checked in place and stay read-only. */
+uint16_t espnow_crc16_frame(const uint8_t *frame, size_t len, size_t crc_offset);
+
+const char *espnow_crc16_engine_name(espnow_crc16_engine_t engine);
+
+/* Time every engine on 10 to 250 byte frames and log the cost per frame, in CPU
+ * cycles on the chip and in nanoseconds elsewhere. Also checks that all engines
+ * agree, and returns ESP_FAIL if one of them does not. */
+esp_err_t espnow_crc16_bench(void);
+
+#endif
@@ -0,0 +1,203 @@
+/* ESPNOW Example - deferred logging
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "espnow_dlog.h"
+
+#define DLOG_LINE_LEN   160
+
+static const char *s_dlog_tag;
+static const espnow_dlog_fmt_t *s_dlog_fmts;
+static uint16_t s_dlog_fmt_num;
+
+static _Atomic uint32_t s_dlog_written;
+static _Atomic uint32_t s_dlog_dropped;
+
+static void dlog_print(uint32_t time_ms, uint16_t fmt, const uint32_t *arg)
+{
+    static const char letter[] = { 'N', 'E', 'W', 'I', 'D', 'V' };
+    const espnow_dlog_fmt_t *f = &s_dlog_fmts[fmt];
+    char line[DLOG_LINE_LEN];
+
+    /* Extra arguments are ignored by snprintf, so every format takes all of them. */
+    snprintf(line, sizeof(line), f->format, (unsigned)arg[0], (unsigned)arg[1], (unsigned)arg[2], (unsigned)arg[3],
+             (unsigned)arg[4], (unsigned)arg[5], (unsigned)arg[6], (unsigned)arg[7], (unsigned)arg[8], (unsigned)arg[9]);
+    esp_log_write(f->level, s_dlog_tag, "%c (%lu) %s: %s\n", letter[f->level], (unsigned long)time_ms,
+                  s_dlog_tag, line);
+}
+
+#if CONFIG_ESPNOW_DLOG_DEFERRED
+_Static_assert((ESPNOW_DLOG_RING_SIZE & (ESPNOW_DLOG_RING_SIZE - 1)) == 0,
+               "CONFIG_ESPNOW_DLOG_RING_SIZE must be a power of two");
+
+#define DLOG_RING_MASK  (ESPNOW_DLOG_RING_SIZE - 1)
+
+/* seq tells who owns the record: it is the ring position the record may next be
+ * written at, or that position plus one once the record is written and may be read. */
+typedef struct {
+    _Atomic uint32_t seq;
+    uint32_t time_ms;
+    uint16_t fmt;
+    uint8_t nargs;
+    uint32_t arg[ESPNOW_DLOG_ARGS_MAX];
+} dlog_record_t;
+
+/* Any number of writers claim positions by moving head; only the task reads and
+ * moves tail. Both are free-running counters. */
+typedef struct {
+    _Atomic uint32_t head;
+    uint32_t tail;
+    dlog_record_t record[ESPNOW_DLOG_RING_SIZE];
+} dlog_ring_t;
+
+static dlog_ring_t s_dlog_rings[portNUM_PROCESSORS];
+static TaskHandle_t s_dlog_task;
+
+static dlog_record_t *dlog_ring_peek(dlog_ring_t *ring)
+{
+    dlog_record_t *rec = &ring->record[ring->tail & DLOG_RING_MASK];
+
+    if (atomic_load_explicit(&rec->seq, memory_order_acquire) != ring->tail + 1) {
+        return NULL;
+    }
+    return rec;
+}
+
+static void dlog_ring_pop(dlog_ring_t *ring, dlog_record_t *rec)
+{
+    atomic_store_explicit(&rec->seq, ring->tail + ESPNOW_DLOG_RING_SIZE, memory_order_release);
+    ring->tail++;
+}
+
+static void dlog_task(void *pvParameter)
+{
+    uint32_t dropped_logged = 0;
+
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_ESPNOW_DLOG_FLUSH_PERIOD));
+
+        uint32_t dropped = atomic_load_explicit(&s_dlog_dropped, memory_order_relaxed);
+        if (dropped != dropped_logged) {
+            ESP_LOGW(s_dlog_tag, "%lu log records dropped", (unsigned long)(dropped - dropped_logged));
+            dropped_logged = dropped;
+        }
+
+        /* Print the oldest record at the tail of either ring until both are empty, but no
+         * more than the rings hold, so that drops are reported while writers keep up. */
+        for (int n = 0; n < ESPNOW_DLOG_RING_SIZE * portNUM_PROCESSORS; n++) {
+            dlog_ring_t *oldest = NULL;
+            dlog_record_t *rec = NULL;
+
+            for (int core = 0; core < portNUM_PROCESSORS; core++) {
+                dlog_record_t *r = dlog_ring_peek(&s_dlog_rings[core]);
+                if (r != NULL && (rec == NULL || (int32_t)(r->time_ms - rec->time_ms) < 0)) {
+                    oldest = &s_dlog_rings[core];
+                    rec = r;
+                }
+            }
+            if (rec == NULL) {
+                break;
+            }
+
+            uint32_t arg[ESPNOW_DLOG_ARGS_MAX] = { 0 };
+            uint32_t time_ms = rec->time_ms;
+            uint16_t fmt = rec->fmt;
+            memcpy(arg, rec->arg, rec->nargs * sizeof(uint32_t));
+            dlog_ring_pop(oldest, rec);
+            dlog_print(time_ms, fmt, arg);
+        }
+    }
+}
+#endif
+
+esp_err_t espnow_dlog_init(const char *tag, const espnow_dlog_fmt_t *fmts, uint16_t num)
+{
+    s_dlog_tag = tag;
+    s_dlog_fmts = fmts;
+    s_dlog_fmt_num = num;
+
+#if CONFIG_ESPNOW_DLOG_DEFERRED
+    /* Called again: the task keeps printing the records written so far. */
+    if (s_dlog_task != NULL) {
+        return ESP_OK;
+    }
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        atomic_store_explicit(&s_dlog_rings[core].head, 0, memory_order_relaxed);
+        s_dlog_rings[core].tail = 0;
+        for (uint32_t i = 0; i < ESPNOW_DLOG_RING_SIZE; i++) {
+            atomic_store_explicit(&s_dlog_rings[core].record[i].seq, i, memory_order_relaxed);
+        }
+    }
+    if (xTaskCreate(dlog_task, "espnow_dlog", 3072, NULL, ESPNOW_DLOG_TASK_PRIORITY, &s_dlog_task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+    return ESP_OK;
+}
+
+bool espnow_dlog_write(uint16_t fmt, const uint32_t *args, uint8_t nargs)
+{
+    if (fmt >= s_dlog_fmt_num) {
+        return false;
+    }
+    /* Same compile time filter as ESP_LOG, so such records never take ring space. */
+    if (s_dlog_fmts[fmt].level > CONFIG_LOG_MAXIMUM_LEVEL) {
+        return true;
+    }
+    if (nargs > ESPNOW_DLOG_ARGS_MAX) {
+        nargs = ESPNOW_DLOG_ARGS_MAX;
+    }
+
+#if CONFIG_ESPNOW_DLOG_DEFERRED
+    dlog_ring_t *ring = &s_dlog_rings[xPortGetCoreID()];
+    uint32_t pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    dlog_record_t *rec;
+
+    for (;;) {
+        rec = &ring->record[pos & DLOG_RING_MASK];
+        int32_t diff = (int32_t)(atomic_load_explicit(&rec->seq, memory_order_acquire) - pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring->head, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            /* The task has not printed the record written a whole ring ago. */
+            atomic_fetch_add_explicit(&s_dlog_dropped, 1, memory_order_relaxed);
+            return false;
+        } else {
+            pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        }
+    }
+
+    rec->time_ms = esp_log_timestamp();
+    rec->fmt = fmt;
+    rec->nargs = nargs;
+    memcpy(rec->arg, args, nargs * sizeof(uint32_t));
+    atomic_store_explicit(&rec->seq, pos + 1, memory_order_release);
+#else
+    uint32_t arg[ESPNOW_DLOG_ARGS_MAX] = { 0 };
+
+    memcpy(arg, args, nargs * sizeof(uint32_t));
+    dlog_print(esp_log_timestamp(), fmt, arg);
+#endif
+    atomic_fetch_add_explicit(&s_dlog_written, 1, memory_order_relaxed);
+    return true;
+}
+
+void espnow_dlog_get_stats(espnow_dlog_stats_t *stats)
+{
+    stats->written = atomic_load_explicit(&s_dlog_written, memory_order_relaxed);
+    stats->dropped = atomic_load_explicit(&s_dlog_dropped, memory_order_relaxed);
+}
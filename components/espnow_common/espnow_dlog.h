@@ -0,0 +1,66 @@
+/* ESPNOW Example - deferred logging
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESPNOW_DLOG_H
+#define ESPNOW_DLOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_log.h"
+
+/* Logging for messages written once per frame, from the WiFi callbacks or the
+ * ESPNOW task. A message is a format id and up to ESPNOW_DLOG_ARGS_MAX unsigned int
+ * arguments. With CONFIG_ESPNOW_DLOG_DEFERRED the writer only copies them, with the
+ * log timestamp, into a fixed-size record in the ring of the core it runs on, and
+ * a task at priority ESPNOW_DLOG_TASK_PRIORITY formats and prints the records of
+ * both rings in time order every CONFIG_ESPNOW_DLOG_FLUSH_PERIOD ms. A record that
+ * finds the ring full is dropped and counted; the number dropped is logged with the
+ * next records printed. Without the option the message is printed at once, as
+ * ESP_LOG would.
+ *
+ * Formats are printf formats whose every conversion takes an unsigned int, such as
+ * %u, %d, %x or MACSTR. They are given as a table indexed by format id, so a record
+ * stays small and no string is copied.
+ *
+ * Thread-safe: the rings take any number of writers, from tasks or ISRs. */
+#define ESPNOW_DLOG_ARGS_MAX        10
+#define ESPNOW_DLOG_RING_SIZE       CONFIG_ESPNOW_DLOG_RING_SIZE
+#define ESPNOW_DLOG_TASK_PRIORITY   1
+
+/* The six arguments of a MAC address, for a MACSTR conversion. */
+#define ESPNOW_DLOG_MAC(mac)        (mac)[0], (mac)[1], (mac)[2], (mac)[3], (mac)[4], (mac)[5]
+
+/* Write the message of format id fmt. */
+#define ESPNOW_DLOG(fmt, ...) do {                                                          \
+        const uint32_t _dlog_args[] = { 0, ##__VA_ARGS__ };                                 \
+        espnow_dlog_write((fmt), _dlog_args + 1, sizeof(_dlog_args) / sizeof(uint32_t) - 1); \
+    } while (0)
+
+typedef struct {
+    esp_log_level_t level;
+    const char *format;
+} espnow_dlog_fmt_t;
+
+typedef struct {
+    uint32_t written;                     //Records written into the rings.
+    uint32_t dropped;                     //Records dropped because the ring of their core was full.
+} espnow_dlog_stats_t;
+
+/* Print messages under tag with the num formats of fmts, which must stay valid.
+ * Starts the task that prints deferred records, once: called again, it only
+ * replaces the formats. */
+esp_err_t espnow_dlog_init(const char *tag, const espnow_dlog_fmt_t *fmts, uint16_t num);
+
+/* Write the message of format id fmt with nargs arguments. Returns false if the
+ * record was dropped. */
+bool espnow_dlog_write(uint16_t fmt, const uint32_t *args, uint8_t nargs);
+
+void espnow_dlog_get_stats(espnow_dlog_stats_t *stats);
+
+#endif
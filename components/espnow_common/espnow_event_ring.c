@@ -0,0 +1,163 @@
+/* ESPNOW Example - callback to task event ring
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdatomic.h>
+#include <string.h>
+#include "espnow_rx_pool.h"
+#include "espnow_event_ring.h"
+
+#if CONFIG_ESPNOW_EVENT_TRANSPORT_RING
+_Static_assert((ESPNOW_EVENT_RING_SIZE & (ESPNOW_EVENT_RING_SIZE - 1)) == 0,
+               "CONFIG_ESPNOW_EVENT_RING_SIZE must be a power of two");
+
+#define EVENT_RING_MASK (ESPNOW_EVENT_RING_SIZE - 1)
+
+static example_espnow_event_t s_event_ring[ESPNOW_LANES][ESPNOW_EVENT_RING_SIZE];
+
+/* head is only written by the producer and tail only by the consumer. Both are
+ * free-running counters; the slot is the counter masked by the ring size. */
+static _Atomic uint32_t s_event_ring_head[ESPNOW_LANES];
+static _Atomic uint32_t s_event_ring_tail[ESPNOW_LANES];
+static _Atomic bool s_event_ring_sleeping;
+static TaskHandle_t s_event_ring_consumer;
+static espnow_lane_sched_t s_event_ring_sched;
+
+static espnow_event_ring_stats_t s_event_ring_stats;
+
+/* Events lane may hold, see espnow_event_ring.h. */
+static uint32_t event_ring_depth(int lane)
+{
+    int share = (ESPNOW_RX_POOL_SIZE - ESPNOW_EVENT_BATCH_SIZE) / ESPNOW_LANES;
+
+    if (ESPNOW_LANES == 1 || lane == ESPNOW_LANE_CONTROL || share >= ESPNOW_EVENT_RING_SIZE) {
+        return ESPNOW_EVENT_RING_SIZE;
+    }
+    return share > 0 ? share : 1;
+}
+
+void espnow_event_ring_init(void)
+{
+    for (int lane = 0; lane < ESPNOW_LANES; lane++) {
+        atomic_store(&s_event_ring_head[lane], 0);
+        atomic_store(&s_event_ring_tail[lane], 0);
+    }
+    atomic_store(&s_event_ring_sleeping, false);
+    s_event_ring_consumer = NULL;
+    memset(&s_event_ring_sched, 0, sizeof(s_event_ring_sched));
+    memset(&s_event_ring_stats, 0, sizeof(s_event_ring_stats));
+}
+
+void espnow_event_ring_set_consumer(TaskHandle_t task)
+{
+    s_event_ring_consumer = task;
+}
+
+bool espnow_event_ring_push(espnow_lane_t lane, const example_espnow_event_t *evt)
+{
+    espnow_event_ring_lane_stats_t *stats = &s_event_ring_stats.lane[lane];
+    uint32_t head = atomic_load_explicit(&s_event_ring_head[lane], memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&s_event_ring_tail[lane], memory_order_acquire);
+
+    if (head - tail >= event_ring_depth(lane)) {
+        stats->dropped++;
+        return false;
+    }
+    s_event_ring[lane][head & EVENT_RING_MASK] = *evt;
+    atomic_store_explicit(&s_event_ring_head[lane], head + 1, memory_order_seq_cst);
+    stats->pushed++;
+    if (head + 1 - tail > stats->high_water) {
+        stats->high_water = head + 1 - tail;
+    }
+
+    /* Only pay for a notification when the consumer has said it is going to sleep. */
+    if (atomic_exchange_explicit(&s_event_ring_sleeping, false, memory_order_seq_cst) &&
+        s_event_ring_consumer != NULL) {
+        s_event_ring_stats.wakeups++;
+        xTaskNotifyGive(s_event_ring_consumer);
+    }
+    return true;
+}
+
+bool espnow_event_ring_pop(example_espnow_event_t *evt)
+{
+    uint32_t ready = 0;
+    int lane;
+
+    for (lane = 0; lane < ESPNOW_LANES; lane++) {
+        if (atomic_load_explicit(&s_event_ring_head[lane], memory_order_acquire) !=
+            atomic_load_explicit(&s_event_ring_tail[lane], memory_order_relaxed)) {
+            ready |= 1U << lane;
+        }
+    }
+    lane = espnow_lane_sched_pick(&s_event_ring_sched, ready);
+    if (lane < 0) {
+        return false;
+    }
+    uint32_t tail = atomic_load_explicit(&s_event_ring_tail[lane], memory_order_relaxed);
+    *evt = s_event_ring[lane][tail & EVENT_RING_MASK];
+    atomic_store_explicit(&s_event_ring_tail[lane], tail + 1, memory_order_release);
+    return true;
+}
+
+bool espnow_event_ring_wait(example_espnow_event_t *evt, TickType_t ticks)
+{
+    TickType_t start = xTaskGetTickCount();
+
+    for (;;) {
+        if (espnow_event_ring_pop(evt)) {
+            return true;
+        }
+        /* Announce the sleep, then look again so that an event pushed between the
+         * first check and the announcement is not missed. */
+        atomic_store_explicit(&s_event_ring_sleeping, true, memory_order_seq_cst);
+        if (espnow_event_ring_pop(evt)) {
+            atomic_store_explicit(&s_event_ring_sleeping, false, memory_order_relaxed);
+            return true;
+        }
+        if (ticks == portMAX_DELAY) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= ticks || ulTaskNotifyTake(pdTRUE, ticks - elapsed) == 0) {
+            atomic_store_explicit(&s_event_ring_sleeping, false, memory_order_relaxed);
+            return espnow_event_ring_pop(evt);
+        }
+    }
+}
+
+uint32_t espnow_event_ring_count(void)
+{
+    uint32_t count = 0;
+
+    for (int lane = 0; lane < ESPNOW_LANES; lane++) {
+        count += atomic_load_explicit(&s_event_ring_head[lane], memory_order_acquire) -
+                 atomic_load_explicit(&s_event_ring_tail[lane], memory_order_acquire);
+    }
+    return count;
+}
+
+uint32_t espnow_event_ring_room(espnow_lane_t lane)
+{
+    uint32_t count = atomic_load_explicit(&s_event_ring_head[lane], memory_order_acquire) -
+                     atomic_load_explicit(&s_event_ring_tail[lane], memory_order_acquire);
+
+    return count < event_ring_depth(lane) ? event_ring_depth(lane) - count : 0;
+}
+#endif
+
+void espnow_event_ring_get_stats(espnow_event_ring_stats_t *stats)
+{
+#if CONFIG_ESPNOW_EVENT_TRANSPORT_RING
+    *stats = s_event_ring_stats;
+    stats->overrides = s_event_ring_sched.overrides;
+#else
+    memset(stats, 0, sizeof(*stats));
+#endif
+}
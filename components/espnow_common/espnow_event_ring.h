@@ -0,0 +1,70 @@
+/* ESPNOW Example - callback to task event ring
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESPNOW_EVENT_RING_H
+#define ESPNOW_EVENT_RING_H
+
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_now.h"
+#include "espnow_example.h"
+#include "espnow_lanes.h"
+
+/* Single-producer/single-consumer ring of example_espnow_event_t, carried by value.
+ * The producer is the WiFi task (both ESPNOW callbacks run there) and the consumer
+ * is the ESPNOW task. Pushing never blocks: when the ring is full the event is
+ * dropped and counted. The consumer sleeps on its task notification and is only
+ * woken when it has announced that it is about to block.
+ *
+ * There is one ring per priority lane of espnow_lanes.h, popped in the order of the
+ * lane scheduler. A lane below ESPNOW_LANE_CONTROL holds at most an equal share of
+ * the receive pool slots left over by a batch being handled, so that a flow of bulk
+ * data cannot take the slots a control frame needs.
+ *
+ * Only built with CONFIG_ESPNOW_EVENT_TRANSPORT_RING; otherwise only
+ * espnow_event_ring_get_stats() is there, and reports nothing. */
+#define ESPNOW_EVENT_RING_SIZE      CONFIG_ESPNOW_EVENT_RING_SIZE
+
+typedef struct {
+    uint32_t pushed;                      //Events accepted by the ring.
+    uint32_t dropped;                     //Events dropped because the ring was full.
+    uint32_t high_water;                  //Largest number of events waiting at the same time.
+} espnow_event_ring_lane_stats_t;
+
+typedef struct {
+    uint32_t wakeups;                     //Task notifications sent to the consumer.
+    uint32_t overrides;                   //See espnow_lane_sched_t.
+    espnow_event_ring_lane_stats_t lane[ESPNOW_LANES];
+} espnow_event_ring_stats_t;
+
+/* Empty the ring and clear the counters. Must be called before either side runs. */
+void espnow_event_ring_init(void);
+
+/* Register the task that consumes events. Called by the consumer task itself. */
+void espnow_event_ring_set_consumer(TaskHandle_t task);
+
+/* Producer side. Returns false if the ring of lane is full and the event was dropped. */
+bool espnow_event_ring_push(espnow_lane_t lane, const example_espnow_event_t *evt);
+
+/* Consumer side. Returns false if the ring is empty. */
+bool espnow_event_ring_pop(example_espnow_event_t *evt);
+
+/* Consumer side. Pop an event, sleeping up to ticks for one to arrive. */
+bool espnow_event_ring_wait(example_espnow_event_t *evt, TickType_t ticks);
+
+/* Number of events waiting in every lane. */
+uint32_t espnow_event_ring_count(void);
+
+/* Number of events lane can still take. */
+uint32_t espnow_event_ring_room(espnow_lane_t lane);
+
+void espnow_event_ring_get_stats(espnow_event_ring_stats_t *stats);
+
+#endif
@@ -20,6 +20,22 @@
 #endif
 
 #define ESPNOW_QUEUE_SIZE           6
+#define ESPNOW_EVENT_BATCH_SIZE     CONFIG_ESPNOW_EVENT_BATCH_SIZE
+
+/* The WiFi task, which runs the ESPNOW callbacks, is pinned to ESPNOW_WIFI_CORE. */
+#if CONFIG_ESP_WIFI_TASK_PINNED_TO_CORE_1
+#define ESPNOW_WIFI_CORE            1
+#else
+#define ESPNOW_WIFI_CORE            0
+#endif
+
+#if CONFIG_ESPNOW_TASK_CORE_WIFI
+#define ESPNOW_TASK_CORE            ESPNOW_WIFI_CORE
+#elif CONFIG_ESPNOW_TASK_CORE_OTHER
+#define ESPNOW_TASK_CORE            (1 - ESPNOW_WIFI_CORE)
+#else
+#define ESPNOW_TASK_CORE            tskNO_AFFINITY
+#endif
 
 #define IS_BROADCAST_ADDR(addr) (memcmp(addr, s_example_broadcast_mac, ESP_NOW_ETH_ALEN) == 0)
 
@@ -35,7 +51,8 @@ typedef struct {
 
 typedef struct {
     uint8_t mac_addr[ESP_NOW_ETH_ALEN];
-    uint8_t *data;
+    uint16_t slot;                        //Receive pool slot holding the data, see espnow_rx_pool.h.
+    int8_t rssi;                          //RSSI of the received frame, unit: dBm.
     int data_len;
 } example_espnow_event_recv_cb_t;
 
@@ -47,12 +64,23 @@ typedef union {
 /* When ESPNOW sending or receiving callback function is called, post event to ESPNOW task. */
 typedef struct {
     example_espnow_event_id_t id;
+    uint32_t time_us;                     //esp_timer_get_time() of the callback, low 32 bits, see espnow_stage.h.
     example_espnow_event_info_t info;
 } example_espnow_event_t;
 
 enum {
     EXAMPLE_ESPNOW_DATA_BROADCAST,
     EXAMPLE_ESPNOW_DATA_UNICAST,
+    EXAMPLE_ESPNOW_DATA_AGGREGATE,        //Unicast data carrying several length-prefixed messages, see espnow_aggr.h.
+    EXAMPLE_ESPNOW_DATA_RELIABLE,         //Unicast data delivered with selective repeat, see espnow_reliable.h.
+    EXAMPLE_ESPNOW_DATA_ACK,              //Acknowledgement of reliable data.
+    EXAMPLE_ESPNOW_DATA_FRAGMENT,         //Part of a message longer than one frame, see espnow_frag.h.
+    EXAMPLE_ESPNOW_DATA_BULK,             //Offer, chunk or status of a bulk transfer, see espnow_bulk.h.
+    EXAMPLE_ESPNOW_DATA_MCAST,            //Announcement, chunk or NACK of a multicast distribution, see espnow_mcast.h.
+    EXAMPLE_ESPNOW_DATA_PROBE,            //Round trip time probe, to be sent back untouched, see espnow_rtt.h.
+    EXAMPLE_ESPNOW_DATA_ECHO,             //Payload of a probe sent back to its sender.
+    EXAMPLE_ESPNOW_DATA_BENCH,            //Throughput benchmark frame, see espnow_bench.h.
+    EXAMPLE_ESPNOW_DATA_METRICS,          //Broadcast snapshot of the sender's metrics, see espnow_metrics.h.
     EXAMPLE_ESPNOW_DATA_MAX,
 };
 
@@ -79,5 +107,4 @@ typedef struct {
     uint8_t dest_mac[ESP_NOW_ETH_ALEN];   //MAC address of destination device.
 } example_espnow_send_param_t;
 
-
 #endif
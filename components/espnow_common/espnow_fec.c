@@ -0,0 +1,143 @@
+/* ESPNOW Example - erasure code
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <string.h>
+#include "espnow_fec.h"
+
+#define FEC_POLY                    0x11D   //x^8 + x^4 + x^3 + x^2 + 1.
+
+static uint8_t s_fec_exp[510];              //Twice the period, so that a sum of two logs needs no modulo.
+static uint8_t s_fec_log[256];
+
+void espnow_fec_init(void)
+{
+    unsigned x = 1;
+
+    for (int i = 0; i < 255; i++) {
+        s_fec_exp[i] = s_fec_exp[i + 255] = (uint8_t)x;
+        s_fec_log[x] = (uint8_t)i;
+        x <<= 1;
+        if (x & 0x100) {
+            x ^= FEC_POLY;
+        }
+    }
+}
+
+static uint8_t fec_mul(uint8_t a, uint8_t b)
+{
+    return a == 0 || b == 0 ? 0 : s_fec_exp[s_fec_log[a] + s_fec_log[b]];
+}
+
+static uint8_t fec_inv(uint8_t a)
+{
+    return s_fec_exp[255 - s_fec_log[a]];
+}
+
+/* Element of the Cauchy matrix at parity row j, data column i. */
+static uint8_t fec_coef(uint8_t j, int i)
+{
+    return fec_inv((uint8_t)((ESPNOW_FEC_K_MAX + j) ^ i));
+}
+
+/* dst += c * src. */
+static void fec_mul_add(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+    if (c == 0) {
+        return;
+    }
+    unsigned log_c = s_fec_log[c];
+    for (size_t b = 0; b < len; b++) {
+        if (src[b] != 0) {
+            dst[b] ^= s_fec_exp[s_fec_log[src[b]] + log_c];
+        }
+    }
+}
+
+/* dst *= c. */
+static void fec_scale(uint8_t *dst, uint8_t c, size_t len)
+{
+    unsigned log_c = s_fec_log[c];
+    for (size_t b = 0; b < len; b++) {
+        if (dst[b] != 0) {
+            dst[b] = s_fec_exp[s_fec_log[dst[b]] + log_c];
+        }
+    }
+}
+
+void espnow_fec_encode(const uint8_t *const *data, int k, uint8_t index, uint8_t *parity, size_t len)
+{
+    memset(parity, 0, len);
+    for (int i = 0; i < k; i++) {
+        fec_mul_add(parity, data[i], fec_coef(index, i), len);
+    }
+}
+
+esp_err_t espnow_fec_decode(uint8_t *const *data, const bool *present, int k, uint8_t *const *parity,
+                            const uint8_t *parity_index, int num, size_t len)
+{
+    uint8_t m[ESPNOW_FEC_K_MAX][ESPNOW_FEC_K_MAX];
+    int missing[ESPNOW_FEC_K_MAX];
+    int n = 0;
+
+    for (int i = 0; i < k; i++) {
+        if (!present[i]) {
+            missing[n++] = i;
+        }
+    }
+    if (n != num || k > ESPNOW_FEC_K_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int r = 0; r < num; r++) {
+        for (int s = 0; s < r; s++) {
+            if (parity_index[s] == parity_index[r]) {
+                return ESP_ERR_INVALID_ARG;
+            }
+        }
+        if (parity_index[r] >= ESPNOW_FEC_PARITY_MAX) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    /* Take the known data out of every parity block, leaving m * missing = parity. */
+    for (int r = 0; r < num; r++) {
+        for (int i = 0; i < k; i++) {
+            if (present[i]) {
+                fec_mul_add(parity[r], data[i], fec_coef(parity_index[r], i), len);
+            }
+        }
+        for (int c = 0; c < num; c++) {
+            m[r][c] = fec_coef(parity_index[r], missing[c]);
+        }
+    }
+
+    /* Gauss-Jordan elimination, applying every row operation to the parity blocks too.
+     * Every leading square part of a Cauchy matrix is itself a Cauchy matrix and can be
+     * inverted, so no pivot is ever zero and rows need no swapping. */
+    for (int c = 0; c < num; c++) {
+        uint8_t inv = fec_inv(m[c][c]);
+        for (int j = 0; j < num; j++) {
+            m[c][j] = fec_mul(m[c][j], inv);
+        }
+        fec_scale(parity[c], inv, len);
+        for (int r = 0; r < num; r++) {
+            uint8_t f = m[r][c];
+            if (r == c || f == 0) {
+                continue;
+            }
+            for (int j = 0; j < num; j++) {
+                m[r][j] ^= fec_mul(f, m[c][j]);
+            }
+            fec_mul_add(parity[r], parity[c], f, len);
+        }
+    }
+    for (int c = 0; c < num; c++) {
+        memcpy(data[missing[c]], parity[c], len);
+    }
+    return ESP_OK;
+}
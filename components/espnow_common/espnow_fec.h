@@ -0,0 +1,43 @@
+/* ESPNOW Example - erasure code
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESPNOW_FEC_H
+#define ESPNOW_FEC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+/* Systematic Reed-Solomon erasure code over GF(2^8). A group of up to
+ * ESPNOW_FEC_K_MAX data blocks of equal length is sent as is, followed by parity
+ * blocks. Parity block j is the sum of every data block i multiplied by the element
+ * at row j, column i of a Cauchy matrix, 1 / ((ESPNOW_FEC_K_MAX + j) + i). Every
+ * square part of a Cauchy matrix can be inverted, so a receiver missing m data blocks
+ * rebuilds them from any m parity blocks, whichever were lost. Parity indices run from
+ * 0 to ESPNOW_FEC_PARITY_MAX - 1.
+ *
+ * Not thread-safe: espnow_fec_init must return before the first encode or decode. */
+#define ESPNOW_FEC_K_MAX            16
+#define ESPNOW_FEC_PARITY_MAX       (256 - ESPNOW_FEC_K_MAX)
+
+/* Build the GF(2^8) tables. */
+void espnow_fec_init(void);
+
+/* Compute parity block `index` of the k data blocks of len bytes in data. */
+void espnow_fec_encode(const uint8_t *const *data, int k, uint8_t index, uint8_t *parity, size_t len);
+
+/* Rebuild the data blocks whose present flag is false from num parity blocks, num
+ * being the number of such blocks. data[i] of a missing block is where it is written.
+ * The parity blocks are overwritten. Returns ESP_ERR_INVALID_ARG if num does not
+ * match or two parity blocks have the same index. */
+esp_err_t espnow_fec_decode(uint8_t *const *data, const bool *present, int k, uint8_t *const *parity,
+                            const uint8_t *parity_index, int num, size_t len);
+
+#endif
@@ -0,0 +1,211 @@
+/* ESPNOW Example - fragmentation and reassembly
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <string.h>
+#include "espnow_frag.h"
+
+#define FRAG_BLOCKS                 (ESPNOW_FRAG_POOL_SIZE / ESPNOW_FRAG_DATA_MAX)
+#define FRAG_NO_BLOCK               0xFFFF
+
+_Static_assert(FRAG_BLOCKS >= 1 && FRAG_BLOCKS < FRAG_NO_BLOCK, "Reassembly pool size out of range");
+
+/* One message being reassembled into the run of blocks starting at first_block. */
+typedef struct {
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint16_t msg_id;
+    uint16_t count;
+    uint16_t received;
+    uint16_t first_block;                 //FRAG_NO_BLOCK while the slot is free.
+    uint16_t last_len;                    //Data length of the last fragment, once it has arrived.
+    int64_t start_us;
+    int64_t last_us;
+    uint32_t got[(ESPNOW_FRAG_COUNT_MAX + 31) / 32];
+} frag_rx_slot_t;
+
+static uint8_t s_frag_pool[FRAG_BLOCKS][ESPNOW_FRAG_DATA_MAX];
+static uint32_t s_frag_used[(FRAG_BLOCKS + 31) / 32];
+static frag_rx_slot_t s_frag_rx[ESPNOW_FRAG_RX_MAX];
+static int64_t s_frag_timeout_us;
+static espnow_frag_deliver_cb_t s_frag_deliver;
+static void *s_frag_arg;
+static espnow_frag_stats_t s_frag_stats;
+
+void espnow_frag_tx_start(espnow_frag_tx_t *tx, uint16_t msg_id, const uint8_t *data, size_t len)
+{
+    tx->data = data;
+    tx->len = len;
+    tx->msg_id = msg_id;
+    tx->next = 0;
+    tx->count = espnow_frag_count(len);
+}
+
+size_t espnow_frag_tx_next(espnow_frag_tx_t *tx, uint8_t *payload)
+{
+    espnow_frag_hdr_t hdr = { .msg_id = tx->msg_id, .index = tx->next, .count = tx->count };
+    size_t offset = (size_t)tx->next * ESPNOW_FRAG_DATA_MAX;
+    size_t len;
+
+    if (tx->next >= tx->count) {
+        return 0;
+    }
+    len = tx->len - offset < ESPNOW_FRAG_DATA_MAX ? tx->len - offset : ESPNOW_FRAG_DATA_MAX;
+    memcpy(payload, &hdr, sizeof(hdr));
+    memcpy(payload + sizeof(hdr), tx->data + offset, len);
+    tx->next++;
+    return sizeof(hdr) + len;
+}
+
+static bool frag_block_used(uint16_t block)
+{
+    return (s_frag_used[block / 32] & (1UL << (block % 32))) != 0;
+}
+
+static void frag_blocks_mark(uint16_t first, uint16_t count, bool used)
+{
+    for (uint16_t b = first; b < first + count; b++) {
+        if (used) {
+            s_frag_used[b / 32] |= 1UL << (b % 32);
+        } else {
+            s_frag_used[b / 32] &= ~(1UL << (b % 32));
+        }
+    }
+}
+
+/* First fit: the first run of count free blocks, or FRAG_NO_BLOCK. */
+static uint16_t frag_blocks_alloc(uint16_t count)
+{
+    uint16_t run = 0;
+
+    for (uint16_t b = 0; b < FRAG_BLOCKS; b++) {
+        run = frag_block_used(b) ? 0 : run + 1;
+        if (run == count) {
+            frag_blocks_mark(b + 1 - count, count, true);
+            return b + 1 - count;
+        }
+    }
+    return FRAG_NO_BLOCK;
+}
+
+static void frag_rx_free(frag_rx_slot_t *slot)
+{
+    frag_blocks_mark(slot->first_block, slot->count, false);
+    slot->first_block = FRAG_NO_BLOCK;
+}
+
+void espnow_frag_rx_init(uint32_t timeout_ms, espnow_frag_deliver_cb_t deliver, void *arg)
+{
+    memset(s_frag_used, 0, sizeof(s_frag_used));
+    for (int i = 0; i < ESPNOW_FRAG_RX_MAX; i++) {
+        s_frag_rx[i].first_block = FRAG_NO_BLOCK;
+    }
+    s_frag_timeout_us = (int64_t)timeout_ms * 1000;
+    s_frag_deliver = deliver;
+    s_frag_arg = arg;
+    memset(&s_frag_stats, 0, sizeof(s_frag_stats));
+}
+
+/* Slot of the message from mac, or NULL. *free_slot is set to a free slot, if any. */
+static frag_rx_slot_t *frag_rx_find(const uint8_t *mac, int64_t now_us, frag_rx_slot_t **free_slot)
+{
+    frag_rx_slot_t *found = NULL;
+
+    *free_slot = NULL;
+    for (int i = 0; i < ESPNOW_FRAG_RX_MAX; i++) {
+        frag_rx_slot_t *slot = &s_frag_rx[i];
+        if (slot->first_block != FRAG_NO_BLOCK && now_us - slot->last_us > s_frag_timeout_us) {
+            s_frag_stats.timeouts++;
+            frag_rx_free(slot);
+        }
+        if (slot->first_block == FRAG_NO_BLOCK) {
+            if (*free_slot == NULL) {
+                *free_slot = slot;
+            }
+        } else if (memcmp(slot->mac, mac, ESP_NOW_ETH_ALEN) == 0) {
+            found = slot;
+        }
+    }
+    return found;
+}
+
+esp_err_t espnow_frag_rx(const uint8_t *mac, const uint8_t *payload, size_t len, int64_t now_us)
+{
+    espnow_frag_hdr_t hdr;
+    frag_rx_slot_t *slot, *free_slot;
+    size_t data_len;
+
+    if (len <= sizeof(hdr)) {
+        s_frag_stats.malformed++;
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(&hdr, payload, sizeof(hdr));
+    data_len = len - sizeof(hdr);
+    if (hdr.index >= hdr.count || data_len > ESPNOW_FRAG_DATA_MAX ||
+        (hdr.index < hdr.count - 1 && data_len != ESPNOW_FRAG_DATA_MAX)) {
+        s_frag_stats.malformed++;
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    slot = frag_rx_find(mac, now_us, &free_slot);
+    if (slot != NULL && (int16_t)(hdr.msg_id - slot->msg_id) < 0) {
+        /* A late fragment of an earlier message, which has been given up already. */
+        s_frag_stats.stale++;
+        return ESP_OK;
+    }
+    if (slot != NULL && (slot->msg_id != hdr.msg_id || slot->count != hdr.count)) {
+        /* Fragments of one device arrive in order: the old message is not coming back. */
+        s_frag_stats.superseded++;
+        frag_rx_free(slot);
+        free_slot = slot;
+        slot = NULL;
+    }
+    if (slot == NULL) {
+        if (hdr.count > ESPNOW_FRAG_COUNT_MAX || free_slot == NULL ||
+            (free_slot->first_block = frag_blocks_alloc(hdr.count)) == FRAG_NO_BLOCK) {
+            s_frag_stats.no_mem++;
+            return ESP_ERR_NO_MEM;
+        }
+        slot = free_slot;
+        memcpy(slot->mac, mac, ESP_NOW_ETH_ALEN);
+        slot->msg_id = hdr.msg_id;
+        slot->count = hdr.count;
+        slot->received = 0;
+        slot->last_len = 0;
+        slot->start_us = now_us;
+        memset(slot->got, 0, sizeof(slot->got));
+    }
+
+    if (slot->got[hdr.index / 32] & (1UL << (hdr.index % 32))) {
+        s_frag_stats.duplicates++;
+        return ESP_OK;
+    }
+    slot->got[hdr.index / 32] |= 1UL << (hdr.index % 32);
+    memcpy(s_frag_pool[slot->first_block + hdr.index], payload + sizeof(hdr), data_len);
+    if (hdr.index == hdr.count - 1) {
+        slot->last_len = (uint16_t)data_len;
+    }
+    slot->last_us = now_us;
+    slot->received++;
+    s_frag_stats.fragments++;
+
+    if (slot->received == slot->count) {
+        size_t msg_len = (size_t)(slot->count - 1) * ESPNOW_FRAG_DATA_MAX + slot->last_len;
+        s_frag_stats.messages++;
+        s_frag_stats.bytes += msg_len;
+        if (s_frag_deliver != NULL) {
+            s_frag_deliver(slot->mac, s_frag_pool[slot->first_block], msg_len, now_us - slot->start_us, s_frag_arg);
+        }
+        frag_rx_free(slot);
+    }
+    return ESP_OK;
+}
+
+void espnow_frag_get_stats(espnow_frag_stats_t *stats)
+{
+    *stats = s_frag_stats;
+}
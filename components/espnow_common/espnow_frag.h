@@ -0,0 +1,97 @@
+/* ESPNOW Example - fragmentation and reassembly
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESPNOW_FRAG_H
+#define ESPNOW_FRAG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_now.h"
+#include "espnow_example.h"
+
+/* Messages longer than one ESPNOW frame are cut into EXAMPLE_ESPNOW_DATA_FRAGMENT
+ * frames. Every fragment carries the message id, its index and the number of
+ * fragments, and all but the last carry ESPNOW_FRAG_DATA_MAX bytes, so a fragment's
+ * place in the message is known whatever order fragments arrive in.
+ *
+ * The receiver reassembles up to ESPNOW_FRAG_RX_MAX messages at a time, one per
+ * device, in a pool of ESPNOW_FRAG_POOL_SIZE bytes. The first fragment of a message
+ * to arrive reserves a contiguous run of the pool large enough for all fragments, so
+ * a complete message is handed over in one piece without copying. A message that
+ * does not complete within the timeout of its last fragment, or that is replaced by a
+ * newer message from the same device, is dropped. Message ids are compared in serial
+ * number arithmetic, so a late fragment of an older message is dropped instead of the
+ * message being reassembled. Fragments are not retransmitted.
+ *
+ * Not thread-safe: all calls must come from the same task. */
+#define ESPNOW_FRAG_MAX_LEN         CONFIG_ESPNOW_FRAG_MAX_LEN
+#define ESPNOW_FRAG_POOL_SIZE       CONFIG_ESPNOW_FRAG_POOL_SIZE
+#define ESPNOW_FRAG_RX_MAX          CONFIG_ESPNOW_FRAG_RX_MAX
+
+/* Payload of an EXAMPLE_ESPNOW_DATA_FRAGMENT frame, in front of the data. */
+typedef struct {
+    uint16_t msg_id;                      //Message the fragment belongs to, per sender.
+    uint16_t index;                       //Position of the fragment in the message, from 0.
+    uint16_t count;                       //Number of fragments in the message.
+} __attribute__((packed)) espnow_frag_hdr_t;
+
+#define ESPNOW_FRAG_DATA_MAX        (ESP_NOW_MAX_DATA_LEN - sizeof(example_espnow_data_t) - sizeof(espnow_frag_hdr_t))
+#define ESPNOW_FRAG_COUNT_MAX       ((ESPNOW_FRAG_MAX_LEN + ESPNOW_FRAG_DATA_MAX - 1) / ESPNOW_FRAG_DATA_MAX)
+
+/* A message of len bytes arrived from mac, elapsed_us after its first fragment. */
+typedef void (*espnow_frag_deliver_cb_t)(const uint8_t *mac, const uint8_t *data, size_t len, int64_t elapsed_us, void *arg);
+
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+    uint16_t msg_id;
+    uint16_t next;                        //Index of the next fragment to write.
+    uint16_t count;
+} espnow_frag_tx_t;
+
+typedef struct {
+    uint32_t fragments;                   //Fragments accepted.
+    uint32_t messages;                    //Messages reassembled.
+    uint32_t bytes;                       //Bytes of the messages reassembled.
+    uint32_t duplicates;                  //Fragments that had already arrived.
+    uint32_t timeouts;                    //Messages dropped after the timeout.
+    uint32_t superseded;                  //Messages dropped for a newer message from the same device.
+    uint32_t stale;                       //Fragments of a message older than the one being reassembled.
+    uint32_t no_mem;                      //Messages dropped for lack of a reassembly slot or pool space.
+    uint32_t malformed;                   //Fragments with an inconsistent header or length.
+} espnow_frag_stats_t;
+
+static inline uint16_t espnow_frag_count(size_t len)
+{
+    return (uint16_t)((len + ESPNOW_FRAG_DATA_MAX - 1) / ESPNOW_FRAG_DATA_MAX);
+}
+
+/* Start cutting len bytes of data, which must stay valid until the last fragment has
+ * been written, into fragments of message msg_id. */
+void espnow_frag_tx_start(espnow_frag_tx_t *tx, uint16_t msg_id, const uint8_t *data, size_t len);
+
+/* Write the header and data of the next fragment to payload, which must hold
+ * sizeof(espnow_frag_hdr_t) + ESPNOW_FRAG_DATA_MAX bytes. Returns the length written,
+ * or 0 once every fragment has been written. */
+size_t espnow_frag_tx_next(espnow_frag_tx_t *tx, uint8_t *payload);
+
+/* Drop every partial message, clear the counters and deliver complete messages to
+ * deliver. Messages whose last fragment is older than timeout_ms are dropped. */
+void espnow_frag_rx_init(uint32_t timeout_ms, espnow_frag_deliver_cb_t deliver, void *arg);
+
+/* Handle the payload of a fragment received from mac. Expired messages are dropped
+ * first. Returns ESP_ERR_INVALID_ARG for a malformed fragment and ESP_ERR_NO_MEM if
+ * its message cannot be reassembled. */
+esp_err_t espnow_frag_rx(const uint8_t *mac, const uint8_t *payload, size_t len, int64_t now_us);
+
+void espnow_frag_get_stats(espnow_frag_stats_t *stats);
+
+#endif
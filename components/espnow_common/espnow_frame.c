@@ -0,0 +1,77 @@
+/* ESPNOW Example - received frame parsing
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <string.h>
+#include "espnow_crc16.h"
+#include "espnow_frame.h"
+
+int espnow_frame_header(const uint8_t *data, size_t len, espnow_frame_t *frame)
+{
+    example_espnow_data_t hdr;
+
+    if (len < sizeof(example_espnow_data_t)) {
+        return ESPNOW_FRAME_ERR_SHORT;
+    }
+    if (len > ESP_NOW_MAX_DATA_LEN) {
+        return ESPNOW_FRAME_ERR_LONG;
+    }
+    memcpy(&hdr, data, sizeof(hdr));
+    if (hdr.type >= EXAMPLE_ESPNOW_DATA_MAX) {
+        return ESPNOW_FRAME_ERR_TYPE;
+    }
+    frame->type = hdr.type;
+    frame->state = hdr.state;
+    frame->seq = hdr.seq_num;
+    frame->magic = hdr.magic;
+    frame->payload = data + sizeof(example_espnow_data_t);
+    frame->payload_len = (uint16_t)(len - sizeof(example_espnow_data_t));
+    return hdr.type;
+}
+
+int espnow_frame_parse(const uint8_t *data, size_t len, espnow_frame_t *frame)
+{
+    espnow_frame_t checked;
+    uint16_t crc;
+
+    int ret = espnow_frame_header(data, len, &checked);
+    if (ret < 0) {
+        return ret;
+    }
+    memcpy(&crc, data + offsetof(example_espnow_data_t, crc), sizeof(crc));
+    if (espnow_crc16_frame(data, len, offsetof(example_espnow_data_t, crc)) != crc) {
+        return ESPNOW_FRAME_ERR_CRC;
+    }
+    *frame = checked;
+    return ret;
+}
+
+bool espnow_frame_read(const espnow_frame_t *frame, size_t offset, void *out, size_t len)
+{
+    if (offset > frame->payload_len || len > frame->payload_len - offset) {
+        return false;
+    }
+    memcpy(out, frame->payload + offset, len);
+    return true;
+}
+
+const char *espnow_frame_err_name(int err)
+{
+    switch (err) {
+        case ESPNOW_FRAME_ERR_SHORT:
+            return "too short";
+        case ESPNOW_FRAME_ERR_LONG:
+            return "too long";
+        case ESPNOW_FRAME_ERR_TYPE:
+            return "unknown type";
+        case ESPNOW_FRAME_ERR_CRC:
+            return "bad CRC";
+        default:
+            return err >= 0 ? "ok" : "unknown error";
+    }
+}
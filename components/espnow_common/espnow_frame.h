@@ -0,0 +1,58 @@
+/* ESPNOW Example - received frame parsing
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESPNOW_FRAME_H
+#define ESPNOW_FRAME_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_now.h"
+#include "espnow_example.h"
+
+/* Checked view of received ESPNOW data. Parsing never trusts the radio: the length
+ * is checked against example_espnow_data_t and ESP_NOW_MAX_DATA_LEN, the type
+ * against EXAMPLE_ESPNOW_DATA_MAX, and the header is copied out rather than read in
+ * place. The payload stays in the received data and is bounded by payload_len; it
+ * is not NUL-terminated, so text is printed with "%.*s". The view is valid as long
+ * as the received data is.
+ *
+ * Thread-safe: nothing is shared. */
+typedef struct {
+    uint8_t type;                         //EXAMPLE_ESPNOW_DATA_BROADCAST to EXAMPLE_ESPNOW_DATA_MAX - 1.
+    uint8_t state;
+    uint16_t seq;
+    uint32_t magic;
+    const uint8_t *payload;               //payload_len bytes, right after the header.
+    uint16_t payload_len;
+} espnow_frame_t;
+
+/* Why received data was rejected, all negative so that they never match a type. */
+typedef enum {
+    ESPNOW_FRAME_ERR_SHORT = -1,          //Shorter than example_espnow_data_t.
+    ESPNOW_FRAME_ERR_LONG = -2,           //Longer than ESP_NOW_MAX_DATA_LEN.
+    ESPNOW_FRAME_ERR_TYPE = -3,           //Type not below EXAMPLE_ESPNOW_DATA_MAX.
+    ESPNOW_FRAME_ERR_CRC = -4,
+} espnow_frame_err_t;
+
+/* Check the length and type of len bytes of received data and fill frame, without
+ * computing the CRC. Returns the type, or an espnow_frame_err_t leaving frame
+ * untouched. */
+int espnow_frame_header(const uint8_t *data, size_t len, espnow_frame_t *frame);
+
+/* espnow_frame_header(), then check the CRC. */
+int espnow_frame_parse(const uint8_t *data, size_t len, espnow_frame_t *frame);
+
+/* Copy len bytes of the payload from offset to out, which needs no alignment.
+ * Returns false, leaving out untouched, if the payload is too short. */
+bool espnow_frame_read(const espnow_frame_t *frame, size_t offset, void *out, size_t len);
+
+const char *espnow_frame_err_name(int err);
+
+#endif
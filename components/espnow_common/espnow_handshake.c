@@ -0,0 +1,60 @@
+/* ESPNOW Example - discovery handshake
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include "espnow_handshake.h"
+
+espnow_handshake_action_t espnow_handshake_on_broadcast(example_espnow_send_param_t *send_param,
+                                                        uint8_t recv_state, uint32_t recv_magic)
+{
+    /* Indicates that the device has received broadcast ESPNOW data. */
+    if (send_param->state == 0) {
+        send_param->state = 1;
+    }
+
+    /* If receive broadcast ESPNOW data which indicates that the other device has received
+     * broadcast ESPNOW data and the local magic number is bigger than that in the received
+     * broadcast ESPNOW data, stop sending broadcast ESPNOW data and start sending unicast
+     * ESPNOW data. The device which has the bigger magic number sends ESPNOW data, the
+     * other one receives ESPNOW data.
+     */
+    if (recv_state == 1 && send_param->unicast == false && send_param->magic >= recv_magic) {
+        return ESPNOW_HANDSHAKE_START_UNICAST;
+    }
+    return ESPNOW_HANDSHAKE_NONE;
+}
+
+void espnow_handshake_on_unicast(example_espnow_send_param_t *send_param)
+{
+    send_param->broadcast = false;
+}
+
+void espnow_handshake_unicast_started(example_espnow_send_param_t *send_param)
+{
+    send_param->broadcast = false;
+    send_param->unicast = true;
+}
+
+espnow_handshake_action_t espnow_handshake_master_on_broadcast(uint8_t recv_state, uint32_t recv_magic)
+{
+    (void)recv_state;
+    (void)recv_magic;
+    return ESPNOW_HANDSHAKE_REPLY;
+}
+
+int32_t espnow_handshake_rebroadcast_delay(const example_espnow_send_param_t *send_param, uint32_t sent,
+                                           uint32_t retries, uint32_t backoff_ms, uint32_t random)
+{
+    if (send_param->broadcast == false || sent == 0 || sent > retries) {
+        return ESPNOW_HANDSHAKE_NO_REBROADCAST;
+    }
+
+    uint32_t shift = sent - 1 < ESPNOW_HANDSHAKE_BACKOFF_MAX_SHIFT ? sent - 1 : ESPNOW_HANDSHAKE_BACKOFF_MAX_SHIFT;
+    uint32_t window = backoff_ms << shift;
+    return (int32_t)(window / 2 + random % (window / 2 + 1));
+}
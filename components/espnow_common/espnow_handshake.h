@@ -0,0 +1,61 @@
+/* ESPNOW Example - discovery handshake
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESPNOW_HANDSHAKE_H
+#define ESPNOW_HANDSHAKE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_now.h"
+#include "espnow_example.h"
+
+/* Decisions of the broadcast/magic handshake, kept free of ESPNOW and FreeRTOS calls
+ * so that the same code drives the devices and the discrete-event simulator in
+ * host/des. The functions only read and update the unicast, broadcast, state and
+ * magic fields of the sending parameters; the caller performs the action returned.
+ *
+ * A device announces itself with broadcast data carrying state 0. A device that
+ * has heard a broadcast sets its own state to 1. When a device hears a broadcast
+ * with state 1 and its magic number is not smaller than the one received, it
+ * starts sending unicast data to that device. The master answers every broadcast
+ * with unicast data, which also ends the broadcasting of the device. */
+typedef enum {
+    ESPNOW_HANDSHAKE_NONE,                //Nothing to do.
+    ESPNOW_HANDSHAKE_REPLY,               //Add the sender to the peer list and answer with unicast data.
+    ESPNOW_HANDSHAKE_START_UNICAST,       //Start sending unicast data to the sender.
+} espnow_handshake_action_t;
+
+/* Returned by espnow_handshake_rebroadcast_delay when no broadcast follows. */
+#define ESPNOW_HANDSHAKE_NO_REBROADCAST     (-1)
+
+/* The interval between discovery broadcasts stops doubling after this many retries. */
+#define ESPNOW_HANDSHAKE_BACKOFF_MAX_SHIFT  6
+
+/* Broadcast data with recv_state and recv_magic was received. */
+espnow_handshake_action_t espnow_handshake_on_broadcast(example_espnow_send_param_t *send_param,
+                                                        uint8_t recv_state, uint32_t recv_magic);
+
+/* Unicast data was received: the device has been found, stop broadcasting. */
+void espnow_handshake_on_unicast(example_espnow_send_param_t *send_param);
+
+/* The first unicast data after ESPNOW_HANDSHAKE_START_UNICAST was handed to ESPNOW. */
+void espnow_handshake_unicast_started(example_espnow_send_param_t *send_param);
+
+/* The master's side: every broadcast is answered. */
+espnow_handshake_action_t espnow_handshake_master_on_broadcast(uint8_t recv_state, uint32_t recv_magic);
+
+/* Delay in ms before the discovery broadcast is sent again, after sent broadcasts
+ * without an answer, or ESPNOW_HANDSHAKE_NO_REBROADCAST once retries have been used
+ * up or broadcasting has stopped. The interval starts at backoff_ms and doubles with
+ * every retry; random picks a point in its upper half so that devices whose
+ * broadcasts collided spread out. */
+int32_t espnow_handshake_rebroadcast_delay(const example_espnow_send_param_t *send_param, uint32_t sent,
+                                           uint32_t retries, uint32_t backoff_ms, uint32_t random);
+
+#endif
@@ -0,0 +1,320 @@
+/* ESPNOW Example - priority lanes
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_now.h"
+#include "esp_console.h"
+#include "esp_timer.h"
+#include "espnow_example.h"
+#include "espnow_event_ring.h"
+#include "espnow_pcap.h"
+#include "espnow_lanes.h"
+
+static const char *const s_lane_names[ESPNOW_LANE_MAX] = {
+    "control", "data", "bulk",
+};
+
+#if CONFIG_ESPNOW_PRIORITY_LANES
+static const char *TAG = "espnow_lanes";
+
+static const uint8_t s_lane_of_type[EXAMPLE_ESPNOW_DATA_MAX] = {
+    [EXAMPLE_ESPNOW_DATA_BROADCAST] = ESPNOW_LANE_CONTROL,
+    [EXAMPLE_ESPNOW_DATA_UNICAST] = ESPNOW_LANE_DATA,
+    [EXAMPLE_ESPNOW_DATA_AGGREGATE] = ESPNOW_LANE_DATA,
+    [EXAMPLE_ESPNOW_DATA_RELIABLE] = ESPNOW_LANE_DATA,
+    [EXAMPLE_ESPNOW_DATA_ACK] = ESPNOW_LANE_CONTROL,
+    [EXAMPLE_ESPNOW_DATA_FRAGMENT] = ESPNOW_LANE_BULK,
+    [EXAMPLE_ESPNOW_DATA_BULK] = ESPNOW_LANE_BULK,
+    [EXAMPLE_ESPNOW_DATA_MCAST] = ESPNOW_LANE_BULK,
+    [EXAMPLE_ESPNOW_DATA_PROBE] = ESPNOW_LANE_CONTROL,
+    [EXAMPLE_ESPNOW_DATA_ECHO] = ESPNOW_LANE_CONTROL,
+    [EXAMPLE_ESPNOW_DATA_BENCH] = ESPNOW_LANE_BULK,
+    [EXAMPLE_ESPNOW_DATA_METRICS] = ESPNOW_LANE_DATA,
+};
+
+typedef struct {
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint8_t len;
+    uint8_t data[ESP_NOW_MAX_DATA_LEN];
+} lanes_frame_t;
+
+typedef struct {
+    lanes_frame_t frame[CONFIG_ESPNOW_LANE_TX_LEN];
+    uint16_t head;                        //Next frame to send.
+    uint16_t count;                       //Frames waiting.
+} lanes_ring_t;
+
+/* Destinations of queued frames ESPNOW refused, waiting to be reported as failed sends. */
+typedef struct {
+    uint8_t mac[ESPNOW_LANES * CONFIG_ESPNOW_LANE_TX_LEN][ESP_NOW_ETH_ALEN];
+    uint16_t head;                        //Next destination to report.
+    uint16_t count;                       //Destinations waiting.
+} lanes_dropped_t;
+
+static lanes_ring_t s_lanes_ring[ESPNOW_LANES];
+static lanes_dropped_t s_lanes_dropped;
+static espnow_lane_sched_t s_lanes_sched;
+static espnow_lanes_stats_t s_lanes_stats;
+/* Incremented before a frame is handed to ESPNOW, whose sending callback may come
+ * before esp_now_send() returns, and decremented by the sending callback. */
+static _Atomic uint32_t s_lanes_in_flight;
+#endif
+
+espnow_lane_t espnow_lane_of_frame(const uint8_t *data, size_t len)
+{
+#if CONFIG_ESPNOW_PRIORITY_LANES
+    /* The type is the first byte of example_espnow_data_t. */
+    if (len < sizeof(example_espnow_data_t) || data[0] >= EXAMPLE_ESPNOW_DATA_MAX) {
+        return ESPNOW_LANE_BULK;
+    }
+    return s_lane_of_type[data[0]];
+#else
+    return ESPNOW_LANE_CONTROL;
+#endif
+}
+
+espnow_lane_t espnow_lane_of_send_cb(void)
+{
+    /* There are at most CONFIG_ESPNOW_LANE_TX_INFLIGHT of them, and each lets the next frame out. */
+    return ESPNOW_LANE_CONTROL;
+}
+
+const char *espnow_lane_name(espnow_lane_t lane)
+{
+    return lane < ESPNOW_LANE_MAX ? s_lane_names[lane] : "?";
+}
+
+int espnow_lane_sched_pick(espnow_lane_sched_t *sched, uint32_t ready)
+{
+    int pick = -1;
+
+    if (ready == 0) {
+        return -1;
+    }
+#if CONFIG_ESPNOW_PRIORITY_LANES
+    /* The highest lane passed over too often, or else the highest lane ready. */
+    for (int lane = 0; lane < ESPNOW_LANES; lane++) {
+        if ((ready & (1U << lane)) && sched->passed[lane] >= CONFIG_ESPNOW_LANE_STARVE_LIMIT) {
+            pick = lane;
+            break;
+        }
+    }
+    if (pick < 0) {
+        pick = __builtin_ctz(ready);
+    } else if (pick != __builtin_ctz(ready)) {
+        sched->overrides++;
+    }
+    for (int lane = 0; lane < ESPNOW_LANES; lane++) {
+        if (lane != pick && (ready & (1U << lane))) {
+            if (sched->passed[lane] < UINT8_MAX) {
+                sched->passed[lane]++;
+            }
+        } else {
+            sched->passed[lane] = 0;
+        }
+    }
+#else
+    pick = 0;
+#endif
+    return pick;
+}
+
+void espnow_lanes_init(void)
+{
+#if CONFIG_ESPNOW_PRIORITY_LANES
+    memset(s_lanes_ring, 0, sizeof(s_lanes_ring));
+    memset(&s_lanes_dropped, 0, sizeof(s_lanes_dropped));
+    memset(&s_lanes_sched, 0, sizeof(s_lanes_sched));
+    memset(&s_lanes_stats, 0, sizeof(s_lanes_stats));
+    atomic_store(&s_lanes_in_flight, 0);
+#endif
+}
+
+#if CONFIG_ESPNOW_PRIORITY_LANES
+/* Hand a frame of lane to ESPNOW, counting it in flight if ESPNOW takes it. */
+static esp_err_t lanes_xmit(int lane, const uint8_t *peer_addr, const uint8_t *data, size_t len)
+{
+    esp_err_t ret;
+
+    atomic_fetch_add(&s_lanes_in_flight, 1);
+    ret = espnow_pcap_send(peer_addr, data, len);
+    if (ret != ESP_OK) {
+        atomic_fetch_sub(&s_lanes_in_flight, 1);
+        return ret;
+    }
+    s_lanes_stats.lane[lane].sent++;
+    return ESP_OK;
+}
+
+static uint32_t lanes_ready(void)
+{
+    uint32_t ready = 0;
+
+    for (int lane = 0; lane < ESPNOW_LANES; lane++) {
+        if (s_lanes_ring[lane].count > 0) {
+            ready |= 1U << lane;
+        }
+    }
+    return ready;
+}
+#endif
+
+esp_err_t espnow_lanes_send(const uint8_t *peer_addr, const uint8_t *data, size_t len)
+{
+#if CONFIG_ESPNOW_PRIORITY_LANES
+    if (peer_addr == NULL || data == NULL || len == 0 || len > ESP_NOW_MAX_DATA_LEN) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    espnow_lane_t lane = espnow_lane_of_frame(data, len);
+    lanes_ring_t *ring = &s_lanes_ring[lane];
+    espnow_lane_tx_stats_t *stats = &s_lanes_stats.lane[lane];
+
+    if (lanes_ready() == 0 && atomic_load(&s_lanes_in_flight) < CONFIG_ESPNOW_LANE_TX_INFLIGHT) {
+        return lanes_xmit(lane, peer_addr, data, len);
+    }
+    if (ring->count == CONFIG_ESPNOW_LANE_TX_LEN) {
+        stats->full++;
+        return ESP_ERR_ESPNOW_NO_MEM;
+    }
+    lanes_frame_t *frame = &ring->frame[(ring->head + ring->count) % CONFIG_ESPNOW_LANE_TX_LEN];
+    memcpy(frame->mac, peer_addr, ESP_NOW_ETH_ALEN);
+    memcpy(frame->data, data, len);
+    frame->len = len;
+    ring->count++;
+    stats->queued++;
+    if (ring->count > stats->high_water) {
+        stats->high_water = ring->count;
+    }
+    espnow_lanes_pump();
+    return ESP_OK;
+#else
+    return espnow_pcap_send(peer_addr, data, len);
+#endif
+}
+
+void espnow_lanes_sent(void)
+{
+#if CONFIG_ESPNOW_PRIORITY_LANES
+    uint32_t in_flight = atomic_load(&s_lanes_in_flight);
+
+    /* Never below zero, should a frame have been sent around the lanes. */
+    while (in_flight > 0 && !atomic_compare_exchange_weak(&s_lanes_in_flight, &in_flight, in_flight - 1)) {
+    }
+#endif
+}
+
+void espnow_lanes_pump(void)
+{
+#if CONFIG_ESPNOW_PRIORITY_LANES
+    const int dropped_len = sizeof(s_lanes_dropped.mac) / sizeof(s_lanes_dropped.mac[0]);
+
+    /* Only with room to report a refused frame, so that none goes missing. */
+    while (atomic_load(&s_lanes_in_flight) < CONFIG_ESPNOW_LANE_TX_INFLIGHT && s_lanes_dropped.count < dropped_len) {
+        int lane = espnow_lane_sched_pick(&s_lanes_sched, lanes_ready());
+        if (lane < 0) {
+            break;
+        }
+        lanes_ring_t *ring = &s_lanes_ring[lane];
+        lanes_frame_t *frame = &ring->frame[ring->head];
+        esp_err_t ret = lanes_xmit(lane, frame->mac, frame->data, frame->len);
+        if (ret == ESP_ERR_ESPNOW_NO_MEM) {
+            /* ESPNOW's queue is full of frames sent around the lanes; try again after a sending callback. */
+            break;
+        }
+        if (ret != ESP_OK) {
+            s_lanes_stats.lane[lane].failed++;
+            ESP_LOGW(TAG, "Send %s frame to "MACSTR" fail: %s", s_lane_names[lane], MAC2STR(frame->mac),
+                     esp_err_to_name(ret));
+            memcpy(s_lanes_dropped.mac[(s_lanes_dropped.head + s_lanes_dropped.count) % dropped_len], frame->mac,
+                   ESP_NOW_ETH_ALEN);
+            s_lanes_dropped.count++;
+        }
+        ring->head = (ring->head + 1) % CONFIG_ESPNOW_LANE_TX_LEN;
+        ring->count--;
+    }
+#endif
+}
+
+bool espnow_lanes_take_dropped(example_espnow_event_t *evt)
+{
+#if CONFIG_ESPNOW_PRIORITY_LANES
+    const int dropped_len = sizeof(s_lanes_dropped.mac) / sizeof(s_lanes_dropped.mac[0]);
+
+    if (s_lanes_dropped.count == 0) {
+        return false;
+    }
+    memset(evt, 0, sizeof(*evt));
+    evt->id = EXAMPLE_ESPNOW_SEND_CB;
+    evt->time_us = (uint32_t)esp_timer_get_time();
+    memcpy(evt->info.send_cb.mac_addr, s_lanes_dropped.mac[s_lanes_dropped.head], ESP_NOW_ETH_ALEN);
+    evt->info.send_cb.status = ESP_NOW_SEND_FAIL;
+    s_lanes_dropped.head = (s_lanes_dropped.head + 1) % dropped_len;
+    s_lanes_dropped.count--;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void espnow_lanes_get_stats(espnow_lanes_stats_t *stats)
+{
+#if CONFIG_ESPNOW_PRIORITY_LANES
+    *stats = s_lanes_stats;
+    stats->in_flight = atomic_load(&s_lanes_in_flight);
+    stats->overrides = s_lanes_sched.overrides;
+#else
+    memset(stats, 0, sizeof(espnow_lanes_stats_t));
+#endif
+}
+
+static int lanes_cmd(int argc, char **argv)
+{
+#if !CONFIG_ESPNOW_PRIORITY_LANES
+    printf("priority lanes disabled, see CONFIG_ESPNOW_PRIORITY_LANES\n");
+    return 0;
+#else
+    espnow_event_ring_stats_t rx;
+    espnow_lanes_stats_t tx;
+
+    espnow_event_ring_get_stats(&rx);
+    espnow_lanes_get_stats(&tx);
+    printf("%-8s %10s %10s %7s %10s %10s %8s %8s %7s\n", "lane", "rx_pushed", "rx_dropped", "rx_high", "tx_sent",
+           "tx_queued", "tx_full", "tx_fail", "tx_high");
+    for (int lane = 0; lane < ESPNOW_LANES; lane++) {
+        printf("%-8s %10lu %10lu %7lu %10lu %10lu %8lu %8lu %7lu\n", s_lane_names[lane],
+               (unsigned long)rx.lane[lane].pushed, (unsigned long)rx.lane[lane].dropped,
+               (unsigned long)rx.lane[lane].high_water, (unsigned long)tx.lane[lane].sent,
+               (unsigned long)tx.lane[lane].queued, (unsigned long)tx.lane[lane].full,
+               (unsigned long)tx.lane[lane].failed, (unsigned long)tx.lane[lane].high_water);
+    }
+#if !CONFIG_ESPNOW_EVENT_TRANSPORT_RING
+    printf("receive lanes need the lock-free ring transport\n");
+#endif
+    printf("starvation guard: %lu rx, %lu tx; %lu frames in flight\n", (unsigned long)rx.overrides,
+           (unsigned long)tx.overrides, (unsigned long)tx.in_flight);
+    return 0;
+#endif
+}
+
+esp_err_t espnow_lanes_register_cmd(void)
+{
+    const esp_console_cmd_t cmd = {
+        .command = "lanes",
+        .help = "Print the frames of every priority lane on the way from the ESPNOW callbacks and to ESPNOW",
+        .func = lanes_cmd,
+    };
+
+    return esp_console_cmd_register(&cmd);
+}
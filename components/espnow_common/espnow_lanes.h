@@ -0,0 +1,112 @@
+/* ESPNOW Example - priority lanes
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESPNOW_LANES_H
+#define ESPNOW_LANES_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_now.h"
+#include "espnow_example.h"
+
+/* Frames sorted by the type in their header into lanes of decreasing priority, so
+ * that the frames keeping devices in touch do not wait behind a flow of bulk data.
+ * ESPNOW_LANE_CONTROL carries discovery broadcasts, acknowledgements, probes and
+ * echoes, and the sending callbacks; ESPNOW_LANE_DATA unicast, aggregated and
+ * reliable data and metrics; ESPNOW_LANE_BULK fragments, bulk and multicast
+ * transfers, benchmark frames and anything too short to have a type.
+ *
+ * The callback to task event ring keeps a ring per lane (espnow_event_ring.h), and
+ * espnow_lanes_send() keeps one in front of ESPNOW. Each side has a scheduler that
+ * serves the highest lane with something waiting, except that a lane passed over
+ * CONFIG_ESPNOW_LANE_STARVE_LIMIT times in a row is served once anyway.
+ *
+ * At most CONFIG_ESPNOW_LANE_TX_INFLIGHT frames are handed to ESPNOW before their
+ * sending callback. Other frames wait in the ring of their lane, so a control frame
+ * waits behind that many frames rather than behind ESPNOW's whole transmit queue.
+ * A frame is handed to ESPNOW at once if nothing is waiting and there is room in
+ * flight; it then fails as it would without lanes. Otherwise it is copied into its
+ * ring and sent by espnow_lanes_pump(). A queued frame that ESPNOW refuses for any
+ * reason but a full queue is dropped and counted, and espnow_lanes_take_dropped()
+ * hands it back as a failed sending callback, so that it is retired like any other.
+ *
+ * Without CONFIG_ESPNOW_PRIORITY_LANES there is a single lane, and every frame is
+ * handed to ESPNOW at once.
+ *
+ * Not thread-safe: frames must be sent and pumped from one task. Only
+ * espnow_lanes_sent() may be called from another, the WiFi task. */
+typedef enum {
+    ESPNOW_LANE_CONTROL,
+    ESPNOW_LANE_DATA,
+    ESPNOW_LANE_BULK,
+    ESPNOW_LANE_MAX,
+} espnow_lane_t;
+
+#if CONFIG_ESPNOW_PRIORITY_LANES
+#define ESPNOW_LANES                ESPNOW_LANE_MAX
+#else
+#define ESPNOW_LANES                1
+#endif
+
+typedef struct {
+    uint8_t passed[ESPNOW_LANES];         //Times in a row the lane had something waiting and was passed over.
+    uint32_t overrides;                   //Lanes served by the starvation guard ahead of a higher one.
+} espnow_lane_sched_t;
+
+typedef struct {
+    uint32_t sent;                        //Frames handed to ESPNOW.
+    uint32_t queued;                      //Frames that waited in the ring.
+    uint32_t full;                        //Frames refused because the ring was full.
+    uint32_t failed;                      //Queued frames ESPNOW refused, dropped.
+    uint32_t high_water;                  //Most frames waiting in the ring at the same time.
+} espnow_lane_tx_stats_t;
+
+typedef struct {
+    uint32_t in_flight;                   //Frames handed to ESPNOW and waiting for their sending callback.
+    uint32_t overrides;                   //See espnow_lane_sched_t.
+    espnow_lane_tx_stats_t lane[ESPNOW_LANES];
+} espnow_lanes_stats_t;
+
+/* Lane of the ESPNOW data of len bytes, by its type. */
+espnow_lane_t espnow_lane_of_frame(const uint8_t *data, size_t len);
+
+/* Lane of the sending callbacks. */
+espnow_lane_t espnow_lane_of_send_cb(void);
+
+const char *espnow_lane_name(espnow_lane_t lane);
+
+/* Lane to serve next among those whose bit is set in ready, or -1 if ready is 0. */
+int espnow_lane_sched_pick(espnow_lane_sched_t *sched, uint32_t ready);
+
+/* Empty the rings and clear the counters. Called before anything is sent. */
+void espnow_lanes_init(void);
+
+/* Send data to peer_addr through the lane of the data, see above. Returns
+ * ESP_ERR_ESPNOW_NO_MEM if the ring of the lane is full. */
+esp_err_t espnow_lanes_send(const uint8_t *peer_addr, const uint8_t *data, size_t len);
+
+/* A frame handed to ESPNOW got its sending callback. */
+void espnow_lanes_sent(void);
+
+/* Hand waiting frames to ESPNOW while there is room in flight. */
+void espnow_lanes_pump(void);
+
+/* Take the sending callback, with ESP_NOW_SEND_FAIL, of the next queued frame that
+ * ESPNOW refused. Returns false if there is none. */
+bool espnow_lanes_take_dropped(example_espnow_event_t *evt);
+
+void espnow_lanes_get_stats(espnow_lanes_stats_t *stats);
+
+/* Register the "lanes" console command, which prints the frames of every lane on
+ * the way from the callbacks and to ESPNOW. */
+esp_err_t espnow_lanes_register_cmd(void);
+
+#endif
@@ -0,0 +1,510 @@
+/* ESPNOW Example - multicast distribution
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <string.h>
+#include "espnow_mcast.h"
+
+#define MCAST_NO_GROUP              UINT16_MAX
+
+_Static_assert(ESPNOW_MCAST_GROUPS_MAX <= MCAST_NO_GROUP, "Group numbers are 16 bits wide");
+
+static const uint8_t s_mcast_broadcast_mac[ESP_NOW_ETH_ALEN] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+/* Data chunks in group, all k but in the last group. */
+static uint8_t mcast_group_k(uint32_t count, uint8_t k, uint16_t group)
+{
+    uint32_t first = (uint32_t)group * k;
+    return count - first < k ? (uint8_t)(count - first) : k;
+}
+
+static size_t mcast_chunk_len(uint32_t size, uint32_t index)
+{
+    uint32_t offset = index * (uint32_t)ESPNOW_MCAST_CHUNK_LEN;
+    return size - offset < ESPNOW_MCAST_CHUNK_LEN ? size - offset : ESPNOW_MCAST_CHUNK_LEN;
+}
+
+/* Returns false if the frame could not be handed to ESPNOW and must be built again.
+ * After the first refusal nothing more is tried until the next poll. */
+static bool mcast_tx_xmit(espnow_mcast_tx_t *tx, const espnow_mcast_hdr_t *hdr, const uint8_t *body, size_t len)
+{
+    uint8_t payload[sizeof(espnow_mcast_hdr_t) + ESPNOW_MCAST_PAYLOAD_MAX];
+
+    memcpy(payload, hdr, sizeof(*hdr));
+    memcpy(payload + sizeof(*hdr), body, len);
+    if (tx->stalled || tx->xmit(s_mcast_broadcast_mac, payload, sizeof(*hdr) + len, tx->arg) != ESP_OK) {
+        tx->stalled = true;
+        return false;
+    }
+    return true;
+}
+
+/* Announce the image. Sent with round 0 before the first round, and as the poll for
+ * NACKs after every round. */
+static bool mcast_tx_announce(espnow_mcast_tx_t *tx, uint8_t round)
+{
+    espnow_mcast_hdr_t hdr = { .op = ESPNOW_MCAST_OP_ANNOUNCE, .xfer_id = tx->xfer_id };
+    espnow_mcast_announce_t announce = { .size = tx->size, .crc = tx->crc, .k = tx->k, .round = round };
+
+    if (!mcast_tx_xmit(tx, &hdr, (const uint8_t *)&announce, sizeof(announce))) {
+        return false;
+    }
+    tx->stats.polls++;
+    return true;
+}
+
+/* Read the data chunks of the group being sent, zero-padding the last one. */
+static bool mcast_tx_load(espnow_mcast_tx_t *tx, int64_t now_us)
+{
+    uint8_t k = mcast_group_k(tx->count, tx->k, tx->group);
+
+    for (uint8_t i = 0; i < k; i++) {
+        uint32_t index = (uint32_t)tx->group * tx->k + i;
+        size_t len = mcast_chunk_len(tx->size, index);
+        if (tx->read(index * (uint32_t)ESPNOW_MCAST_CHUNK_LEN, tx->chunk[i], len, tx->arg) != ESP_OK) {
+            tx->state = ESPNOW_MCAST_FAILED;
+            tx->end_us = now_us;
+            return false;
+        }
+        memset(tx->chunk[i] + len, 0, ESPNOW_MCAST_CHUNK_LEN - len);
+    }
+    tx->loaded = tx->group;
+    return true;
+}
+
+/* Send the next frame of the round. Returns false once the round is over or nothing
+ * more can be sent until the next poll. */
+static bool mcast_tx_next(espnow_mcast_tx_t *tx, int64_t now_us)
+{
+    espnow_mcast_hdr_t hdr = { .xfer_id = tx->xfer_id };
+    uint8_t parity[ESPNOW_MCAST_CHUNK_LEN];
+    const uint8_t *data[ESPNOW_MCAST_K_MAX];
+    uint8_t k, frames;
+
+    if (tx->stalled) {
+        return false;
+    }
+    /* Repair rounds only visit the groups some receiver asked for. */
+    while (tx->round > 0 && tx->group < tx->groups && tx->need[tx->group] == 0) {
+        tx->group++;
+    }
+    if (tx->group >= tx->groups) {
+        return false;
+    }
+    if (tx->loaded != tx->group && !mcast_tx_load(tx, now_us)) {
+        return false;
+    }
+    k = mcast_group_k(tx->count, tx->k, tx->group);
+    frames = tx->round == 0 ? k + tx->parity : tx->need[tx->group];
+    hdr.group = tx->group;
+
+    if (tx->round == 0 && tx->sent < k) {
+        hdr.op = ESPNOW_MCAST_OP_DATA;
+        hdr.index = tx->sent;
+        if (!mcast_tx_xmit(tx, &hdr, tx->chunk[tx->sent],
+                           mcast_chunk_len(tx->size, (uint32_t)tx->group * tx->k + tx->sent))) {
+            return false;
+        }
+        tx->stats.data++;
+    } else {
+        hdr.op = ESPNOW_MCAST_OP_PARITY;
+        hdr.index = tx->parity_next[tx->group];
+        for (uint8_t i = 0; i < k; i++) {
+            data[i] = tx->chunk[i];
+        }
+        espnow_fec_encode(data, k, hdr.index, parity, sizeof(parity));
+        if (!mcast_tx_xmit(tx, &hdr, parity, sizeof(parity))) {
+            return false;
+        }
+        tx->parity_next[tx->group] = (uint8_t)((hdr.index + 1) % ESPNOW_FEC_PARITY_MAX);
+        if (tx->round == 0) {
+            tx->stats.parity++;
+        } else {
+            tx->stats.repair++;
+        }
+    }
+    if (++tx->sent >= frames) {
+        tx->need[tx->group] = 0;
+        tx->group++;
+        tx->sent = 0;
+    }
+    return true;
+}
+
+esp_err_t espnow_mcast_tx_start(espnow_mcast_tx_t *tx, uint8_t xfer_id, uint32_t size, uint32_t crc, uint8_t k,
+                                uint8_t parity, uint8_t overhead, uint32_t nack_wait_ms, uint8_t max_rounds,
+                                espnow_mcast_read_cb_t read, espnow_mcast_xmit_cb_t xmit, void *arg)
+{
+    uint32_t count = espnow_mcast_chunk_count(size);
+
+    k = k < ESPNOW_MCAST_K_MIN ? ESPNOW_MCAST_K_MIN : (k > ESPNOW_MCAST_K_MAX ? ESPNOW_MCAST_K_MAX : k);
+    if (size == 0 || count > ESPNOW_MCAST_CHUNKS_MAX) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memset(tx, 0, sizeof(espnow_mcast_tx_t));
+    tx->xfer_id = xfer_id;
+    tx->k = k;
+    tx->parity = parity < ESPNOW_FEC_PARITY_MAX ? parity : ESPNOW_FEC_PARITY_MAX - 1;
+    tx->overhead = overhead < 100 ? overhead : 100;
+    tx->max_rounds = max_rounds > 0 ? max_rounds : 1;
+    tx->announces = ESPNOW_MCAST_ANNOUNCES;
+    tx->state = ESPNOW_MCAST_SENDING;
+    tx->size = size;
+    tx->crc = crc;
+    tx->count = count;
+    tx->groups = (uint16_t)((count + k - 1) / k);
+    tx->loaded = MCAST_NO_GROUP;
+    tx->poll_us = -1;
+    tx->nack_wait_us = (int64_t)nack_wait_ms * 1000;
+    tx->start_us = -1;
+    tx->read = read;
+    tx->xmit = xmit;
+    tx->arg = arg;
+    return ESP_OK;
+}
+
+void espnow_mcast_tx_poll(espnow_mcast_tx_t *tx, int64_t now_us)
+{
+    tx->stalled = false;
+    if (tx->start_us < 0) {
+        tx->start_us = now_us;
+    }
+    if (tx->state == ESPNOW_MCAST_POLLING && tx->poll_us >= 0) {
+        if (now_us < tx->poll_us + tx->nack_wait_us) {
+            return;
+        }
+        if (!tx->nacked) {
+            /* Polls get lost too: only several unanswered ones in a row mean every
+             * receiver is done. */
+            if (++tx->silent >= ESPNOW_MCAST_SILENT_POLLS) {
+                tx->state = ESPNOW_MCAST_DONE;
+                tx->end_us = now_us;
+                return;
+            }
+            tx->poll_us = -1;
+        } else if (tx->round + 1 >= tx->max_rounds) {
+            tx->state = ESPNOW_MCAST_FAILED;
+            tx->end_us = now_us;
+            return;
+        } else {
+            tx->round++;
+            tx->state = ESPNOW_MCAST_SENDING;
+            tx->group = 0;
+            tx->sent = 0;
+            tx->silent = 0;
+        }
+    }
+    if (tx->state == ESPNOW_MCAST_SENDING) {
+        while (tx->announces > 0) {
+            if (!mcast_tx_announce(tx, 0)) {
+                return;
+            }
+            tx->announces--;
+        }
+        while (mcast_tx_next(tx, now_us)) {
+        }
+        if (tx->state != ESPNOW_MCAST_SENDING || tx->group < tx->groups) {
+            return;
+        }
+        tx->state = ESPNOW_MCAST_POLLING;
+        tx->poll_us = -1;
+    }
+    if (tx->state == ESPNOW_MCAST_POLLING && tx->poll_us < 0 && mcast_tx_announce(tx, tx->round + 1)) {
+        tx->poll_us = now_us;
+        tx->nacked = false;
+    }
+}
+
+esp_err_t espnow_mcast_tx_on_nack(espnow_mcast_tx_t *tx, const uint8_t *payload, size_t len)
+{
+    espnow_mcast_hdr_t hdr;
+    espnow_mcast_nack_t nack;
+
+    if (len < sizeof(hdr) || (len - sizeof(hdr)) % sizeof(nack) != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(&hdr, payload, sizeof(hdr));
+    if (hdr.op != ESPNOW_MCAST_OP_NACK || hdr.xfer_id != tx->xfer_id || tx->state != ESPNOW_MCAST_POLLING ||
+        hdr.index != (uint8_t)(tx->round + 1)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    tx->stats.nacks++;
+    for (size_t off = sizeof(hdr); off < len; off += sizeof(nack)) {
+        memcpy(&nack, payload + off, sizeof(nack));
+        if (nack.group >= tx->groups || nack.need == 0) {
+            continue;
+        }
+        uint8_t k = mcast_group_k(tx->count, tx->k, nack.group);
+        uint8_t need = nack.need < k ? nack.need : k;
+        need += (uint8_t)((need * tx->overhead + 99) / 100);
+        if (need > tx->need[nack.group]) {
+            tx->need[nack.group] = need;
+        }
+        tx->nacked = true;
+    }
+    return ESP_OK;
+}
+
+int64_t espnow_mcast_tx_next_deadline(const espnow_mcast_tx_t *tx)
+{
+    if (!espnow_mcast_tx_active(tx) || tx->stalled) {
+        return -1;
+    }
+    if (tx->state == ESPNOW_MCAST_SENDING || tx->poll_us < 0) {
+        return 0;
+    }
+    return tx->poll_us + tx->nack_wait_us;
+}
+
+void espnow_mcast_rx_init(espnow_mcast_rx_t *rx, espnow_mcast_begin_cb_t begin, espnow_mcast_write_cb_t write,
+                          espnow_mcast_read_cb_t read, espnow_mcast_end_cb_t end, espnow_mcast_xmit_cb_t xmit,
+                          void *arg)
+{
+    memset(rx, 0, sizeof(espnow_mcast_rx_t));
+    rx->state = ESPNOW_MCAST_IDLE;
+    rx->group = MCAST_NO_GROUP;
+    rx->begin = begin;
+    rx->write = write;
+    rx->read = read;
+    rx->end = end;
+    rx->xmit = xmit;
+    rx->arg = arg;
+}
+
+static bool mcast_rx_got(const espnow_mcast_rx_t *rx, uint32_t index)
+{
+    return (rx->got[index / 32] & (1UL << (index % 32))) != 0;
+}
+
+static uint8_t mcast_rx_group_missing(const espnow_mcast_rx_t *rx, uint16_t group)
+{
+    uint32_t first = (uint32_t)group * rx->k;
+    uint8_t k = mcast_group_k(rx->count, rx->k, group);
+    uint8_t missing = 0;
+
+    for (uint8_t i = 0; i < k; i++) {
+        if (!mcast_rx_got(rx, first + i)) {
+            missing++;
+        }
+    }
+    return missing;
+}
+
+/* Ask for the chunks still missing, in as many frames as it takes. NACKs that cannot
+ * be sent are dropped: the next poll asks for them again. */
+static void mcast_rx_nack(espnow_mcast_rx_t *rx, uint8_t round)
+{
+    uint8_t payload[sizeof(espnow_mcast_hdr_t) + ESPNOW_MCAST_NACK_MAX * sizeof(espnow_mcast_nack_t)];
+    espnow_mcast_hdr_t hdr = { .op = ESPNOW_MCAST_OP_NACK, .xfer_id = rx->xfer_id, .index = round };
+    size_t len = sizeof(hdr);
+
+    memcpy(payload, &hdr, sizeof(hdr));
+    for (uint16_t group = 0; group < rx->groups; group++) {
+        espnow_mcast_nack_t nack = { .group = group, .need = mcast_rx_group_missing(rx, group) };
+        if (nack.need == 0) {
+            continue;
+        }
+        memcpy(payload + len, &nack, sizeof(nack));
+        len += sizeof(nack);
+        if (len == sizeof(payload)) {
+            if (rx->xmit(rx->src_mac, payload, len, rx->arg) != ESP_OK) {
+                return;
+            }
+            rx->stats.nacks++;
+            len = sizeof(hdr);
+        }
+    }
+    if (len > sizeof(hdr) && rx->xmit(rx->src_mac, payload, len, rx->arg) == ESP_OK) {
+        rx->stats.nacks++;
+    }
+}
+
+static esp_err_t mcast_rx_announce(espnow_mcast_rx_t *rx, const uint8_t *mac, const espnow_mcast_hdr_t *hdr,
+                                   const uint8_t *body, size_t len, int64_t now_us)
+{
+    espnow_mcast_announce_t announce;
+    uint32_t count;
+
+    if (len < sizeof(announce)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(&announce, body, sizeof(announce));
+    count = espnow_mcast_chunk_count(announce.size);
+    if (announce.size == 0 || announce.k < ESPNOW_MCAST_K_MIN || announce.k > ESPNOW_MCAST_K_MAX ||
+        count > ESPNOW_MCAST_CHUNKS_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (rx->state == ESPNOW_MCAST_IDLE || hdr->xfer_id != rx->xfer_id || announce.size != rx->size ||
+        announce.crc != rx->crc || announce.k != rx->k || memcmp(mac, rx->src_mac, ESP_NOW_ETH_ALEN) != 0) {
+        memcpy(rx->src_mac, mac, ESP_NOW_ETH_ALEN);
+        rx->xfer_id = hdr->xfer_id;
+        rx->k = announce.k;
+        rx->size = announce.size;
+        rx->crc = announce.crc;
+        rx->count = count;
+        rx->missing = count;
+        rx->groups = (uint16_t)((count + announce.k - 1) / announce.k);
+        rx->group = MCAST_NO_GROUP;
+        rx->parity_num = 0;
+        memset(rx->got, 0, sizeof(rx->got));
+        rx->start_us = now_us;
+        rx->end_us = 0;
+        rx->state = rx->begin(announce.size, rx->arg) == ESP_OK ? ESPNOW_MCAST_RUNNING : ESPNOW_MCAST_FAILED;
+        if (rx->state == ESPNOW_MCAST_RUNNING) {
+            rx->stats.transfers++;
+        }
+    }
+    if (announce.round > 0 && rx->state == ESPNOW_MCAST_RUNNING) {
+        mcast_rx_nack(rx, announce.round);
+    }
+    return ESP_OK;
+}
+
+static void mcast_rx_store(espnow_mcast_rx_t *rx, uint32_t index, const uint8_t *data, int64_t now_us)
+{
+    if (rx->write(index * (uint32_t)ESPNOW_MCAST_CHUNK_LEN, data, mcast_chunk_len(rx->size, index), rx->arg) != ESP_OK) {
+        rx->state = ESPNOW_MCAST_FAILED;
+        rx->end_us = now_us;
+        return;
+    }
+    rx->got[index / 32] |= 1UL << (index % 32);
+    rx->missing--;
+    if (rx->missing == 0) {
+        rx->state = rx->end(rx->size, rx->crc, rx->arg) == ESP_OK ? ESPNOW_MCAST_DONE : ESPNOW_MCAST_FAILED;
+        rx->end_us = now_us;
+    }
+}
+
+/* Rebuild the missing chunks of the group whose parity chunks are held, once there
+ * are as many parity chunks as missing chunks. The chunks already written are read
+ * back for that. */
+static void mcast_rx_decode(espnow_mcast_rx_t *rx, int64_t now_us)
+{
+    uint32_t first = (uint32_t)rx->group * rx->k;
+    uint8_t k = mcast_group_k(rx->count, rx->k, rx->group);
+    uint8_t missing = mcast_rx_group_missing(rx, rx->group);
+    uint8_t *data[ESPNOW_MCAST_K_MAX];
+    uint8_t *parity[ESPNOW_MCAST_K_MAX];
+    bool present[ESPNOW_MCAST_K_MAX];
+
+    if (missing == 0) {
+        rx->group = MCAST_NO_GROUP;
+        return;
+    }
+    if (rx->parity_num < missing) {
+        return;
+    }
+    for (uint8_t i = 0; i < k; i++) {
+        size_t len = mcast_chunk_len(rx->size, first + i);
+        data[i] = rx->chunk[i];
+        present[i] = mcast_rx_got(rx, first + i);
+        if (present[i] && rx->read((first + i) * (uint32_t)ESPNOW_MCAST_CHUNK_LEN, data[i], len, rx->arg) != ESP_OK) {
+            rx->state = ESPNOW_MCAST_FAILED;
+            rx->end_us = now_us;
+            return;
+        }
+        memset(data[i] + len, 0, ESPNOW_MCAST_CHUNK_LEN - len);
+    }
+    for (uint8_t j = 0; j < missing; j++) {
+        parity[j] = rx->parity[j];
+    }
+    rx->group = MCAST_NO_GROUP;
+    if (espnow_fec_decode(data, present, k, parity, rx->parity_index, missing, ESPNOW_MCAST_CHUNK_LEN) != ESP_OK) {
+        return;
+    }
+    for (uint8_t i = 0; i < k && rx->state == ESPNOW_MCAST_RUNNING; i++) {
+        if (!present[i]) {
+            mcast_rx_store(rx, first + i, data[i], now_us);
+            rx->stats.recovered++;
+        }
+    }
+}
+
+static esp_err_t mcast_rx_chunk(espnow_mcast_rx_t *rx, const espnow_mcast_hdr_t *hdr, const uint8_t *body,
+                                size_t len, int64_t now_us)
+{
+    uint8_t k;
+    uint32_t index;
+
+    if (hdr->group >= rx->groups) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    k = mcast_group_k(rx->count, rx->k, hdr->group);
+    if (hdr->op == ESPNOW_MCAST_OP_DATA) {
+        if (hdr->index >= k) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        index = (uint32_t)hdr->group * rx->k + hdr->index;
+        if (len != mcast_chunk_len(rx->size, index)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (mcast_rx_got(rx, index)) {
+            rx->stats.duplicates++;
+            return ESP_OK;
+        }
+        rx->stats.chunks++;
+        mcast_rx_store(rx, index, body, now_us);
+    } else {
+        if (len != ESPNOW_MCAST_CHUNK_LEN || hdr->index >= ESPNOW_FEC_PARITY_MAX) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (mcast_rx_group_missing(rx, hdr->group) == 0) {
+            rx->stats.unneeded++;
+            return ESP_OK;
+        }
+        /* Only the parity chunks of one group are held: groups are sent one after
+         * the other, so those of an earlier group will not be completed. */
+        if (rx->group != hdr->group) {
+            rx->group = hdr->group;
+            rx->parity_num = 0;
+        }
+        for (uint8_t j = 0; j < rx->parity_num; j++) {
+            if (rx->parity_index[j] == hdr->index) {
+                return ESP_OK;
+            }
+        }
+        if (rx->parity_num == ESPNOW_MCAST_K_MAX) {
+            return ESP_OK;
+        }
+        rx->parity_index[rx->parity_num] = hdr->index;
+        memcpy(rx->parity[rx->parity_num], body, len);
+        rx->parity_num++;
+    }
+    if (rx->state == ESPNOW_MCAST_RUNNING && rx->group == hdr->group) {
+        mcast_rx_decode(rx, now_us);
+    }
+    return ESP_OK;
+}
+
+esp_err_t espnow_mcast_rx(espnow_mcast_rx_t *rx, const uint8_t *mac, const uint8_t *payload, size_t len,
+                          int64_t now_us)
+{
+    espnow_mcast_hdr_t hdr;
+
+    if (len < sizeof(hdr)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(&hdr, payload, sizeof(hdr));
+    switch (hdr.op) {
+        case ESPNOW_MCAST_OP_ANNOUNCE:
+            return mcast_rx_announce(rx, mac, &hdr, payload + sizeof(hdr), len - sizeof(hdr), now_us);
+        case ESPNOW_MCAST_OP_DATA:
+        case ESPNOW_MCAST_OP_PARITY:
+            if (rx->state != ESPNOW_MCAST_RUNNING || hdr.xfer_id != rx->xfer_id ||
+                memcmp(mac, rx->src_mac, ESP_NOW_ETH_ALEN) != 0) {
+                /* Not announced yet, or already complete. */
+                return ESP_OK;
+            }
+            return mcast_rx_chunk(rx, &hdr, payload + sizeof(hdr), len - sizeof(hdr), now_us);
+        case ESPNOW_MCAST_OP_NACK:
+            /* Another receiver's NACK, broadcast because the sender was not in its peer list. */
+            return ESP_OK;
+        default:
+            return ESP_ERR_INVALID_ARG;
+    }
+}
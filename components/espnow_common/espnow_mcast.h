@@ -0,0 +1,221 @@
+/* ESPNOW Example - multicast distribution
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESPNOW_MCAST_H
+#define ESPNOW_MCAST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_now.h"
+#include "espnow_example.h"
+#include "espnow_fec.h"
+
+/* Distribution of an image, such as a firmware image, to any number of devices at
+ * once in broadcast EXAMPLE_ESPNOW_DATA_MCAST frames. The image is cut into chunks of
+ * ESPNOW_MCAST_CHUNK_LEN bytes, and every group of k chunks is followed by parity
+ * chunks of the erasure code in espnow_fec.h. A receiver missing no more chunks of a
+ * group than it received parity chunks rebuilds the missing ones itself.
+ *
+ * The sender announces the image before the first round. At the end of every round it
+ * polls the receivers with the announcement again, and every receiver still missing
+ * chunks answers with a NACK giving, for every incomplete group, the number of chunks
+ * it misses. The next round sends as many new parity chunks of each group as the
+ * receiver missing most asked for, so one repair chunk serves every receiver missing
+ * any one chunk of the group, and the airtime follows the worst receiver's loss
+ * rather than the number of receivers. The sender is done once ESPNOW_MCAST_SILENT_POLLS
+ * polls in a row go unanswered. A receiver that missed the announcement joins at the
+ * next poll. Receivers write chunks straight to their destination, in any order, and
+ * check the CRC32 of the image once every chunk is there.
+ *
+ * Not thread-safe: all calls for one sender or receiver must come from the same task. */
+#define ESPNOW_MCAST_K_MAX          ESPNOW_FEC_K_MAX
+#define ESPNOW_MCAST_K_MIN          4
+#define ESPNOW_MCAST_CHUNKS_MAX     16384
+#define ESPNOW_MCAST_GROUPS_MAX     (ESPNOW_MCAST_CHUNKS_MAX / ESPNOW_MCAST_K_MIN)
+#define ESPNOW_MCAST_ANNOUNCES      3
+#define ESPNOW_MCAST_SILENT_POLLS   3
+
+enum {
+    ESPNOW_MCAST_OP_ANNOUNCE,             //Sender: espnow_mcast_announce_t follows.
+    ESPNOW_MCAST_OP_DATA,                 //Sender: the chunk follows.
+    ESPNOW_MCAST_OP_PARITY,               //Sender: the parity chunk follows.
+    ESPNOW_MCAST_OP_NACK,                 //Receiver: espnow_mcast_nack_t entries follow.
+};
+
+typedef enum {
+    ESPNOW_MCAST_IDLE,
+    ESPNOW_MCAST_SENDING,                 //Sender only: a round is being sent.
+    ESPNOW_MCAST_POLLING,                 //Sender only: waiting for NACKs after a poll.
+    ESPNOW_MCAST_RUNNING,                 //Receiver only: chunks are missing.
+    ESPNOW_MCAST_DONE,
+    ESPNOW_MCAST_FAILED,
+} espnow_mcast_state_t;
+
+/* Payload of an EXAMPLE_ESPNOW_DATA_MCAST frame, in front of the body of its op. */
+typedef struct {
+    uint8_t op;
+    uint8_t xfer_id;                      //Transfer the frame belongs to, chosen by the sender.
+    uint16_t group;                       //DATA and PARITY: group of the chunk.
+    uint8_t index;                        //DATA: chunk in the group. PARITY: parity index. NACK: round polled.
+} __attribute__((packed)) espnow_mcast_hdr_t;
+
+typedef struct {
+    uint32_t size;                        //Image length, unit: byte.
+    uint32_t crc;                         //esp_crc32_le(0, image, size).
+    uint8_t k;                            //Chunks per group.
+    uint8_t round;                        //0 before the first round, then the round just ended.
+} __attribute__((packed)) espnow_mcast_announce_t;
+
+typedef struct {
+    uint16_t group;
+    uint8_t need;                         //Chunks of the group the receiver misses.
+} __attribute__((packed)) espnow_mcast_nack_t;
+
+#define ESPNOW_MCAST_PAYLOAD_MAX    (ESP_NOW_MAX_DATA_LEN - sizeof(example_espnow_data_t) - sizeof(espnow_mcast_hdr_t))
+#define ESPNOW_MCAST_CHUNK_LEN      ESPNOW_MCAST_PAYLOAD_MAX
+#define ESPNOW_MCAST_NACK_MAX       (ESPNOW_MCAST_PAYLOAD_MAX / sizeof(espnow_mcast_nack_t))
+
+/* Transmit one frame carrying payload to mac, the broadcast address for the sender.
+ * Returning anything but ESP_OK leaves the frame to be built again at the next poll. */
+typedef esp_err_t (*espnow_mcast_xmit_cb_t)(const uint8_t *mac, const uint8_t *payload, size_t len, void *arg);
+
+/* Read len bytes of the image at offset: the sender reads chunks to send, a receiver
+ * the chunks it wrote, to rebuild missing ones. */
+typedef esp_err_t (*espnow_mcast_read_cb_t)(uint32_t offset, uint8_t *data, size_t len, void *arg);
+
+/* Receiver: prepare to store an image of size bytes. */
+typedef esp_err_t (*espnow_mcast_begin_cb_t)(uint32_t size, void *arg);
+
+/* Receiver: store len bytes of the image at offset. */
+typedef esp_err_t (*espnow_mcast_write_cb_t)(uint32_t offset, const uint8_t *data, size_t len, void *arg);
+
+/* Receiver: every chunk has been stored. Check that the image has the given CRC32. */
+typedef esp_err_t (*espnow_mcast_end_cb_t)(uint32_t size, uint32_t crc, void *arg);
+
+typedef struct {
+    uint32_t data;                        //Data chunks sent.
+    uint32_t parity;                      //Parity chunks sent in the first round.
+    uint32_t repair;                      //Parity chunks sent in later rounds.
+    uint32_t polls;                       //Announcements and polls sent.
+    uint32_t nacks;                       //NACK frames received.
+} espnow_mcast_tx_stats_t;
+
+typedef struct {
+    uint8_t xfer_id;
+    uint8_t k;
+    uint8_t parity;                       //Parity chunks per group in the first round.
+    uint8_t overhead;                     //Repair chunks sent beyond those asked for, in percent, rounded up.
+    uint8_t round;                        //Round being sent or polled, from 0.
+    uint8_t max_rounds;
+    uint8_t silent;                       //Polls in a row with no NACK.
+    uint8_t announces;                    //Announcements still to send before the first round.
+    bool nacked;                          //A NACK arrived since the last poll.
+    bool stalled;                         //The xmit callback refused a frame since the last poll.
+    espnow_mcast_state_t state;
+    uint32_t size;
+    uint32_t crc;
+    uint32_t count;                       //Chunks in the image.
+    uint16_t groups;
+    uint16_t group;                       //Group being sent.
+    uint8_t sent;                         //Frames of the group sent this round.
+    uint16_t loaded;                      //Group whose data chunks are in chunk, or UINT16_MAX.
+    uint8_t need[ESPNOW_MCAST_GROUPS_MAX];          //Parity chunks of each group to send next round.
+    uint8_t parity_next[ESPNOW_MCAST_GROUPS_MAX];   //Index of the next new parity chunk of each group.
+    uint8_t chunk[ESPNOW_MCAST_K_MAX][ESPNOW_MCAST_CHUNK_LEN];
+    int64_t poll_us;
+    int64_t nack_wait_us;
+    int64_t start_us;
+    int64_t end_us;
+    espnow_mcast_read_cb_t read;
+    espnow_mcast_xmit_cb_t xmit;
+    void *arg;
+    espnow_mcast_tx_stats_t stats;
+} espnow_mcast_tx_t;
+
+typedef struct {
+    uint32_t transfers;                   //Announcements accepted.
+    uint32_t chunks;                      //Data chunks written as received.
+    uint32_t recovered;                   //Data chunks rebuilt from parity chunks.
+    uint32_t duplicates;                  //Data chunks received again.
+    uint32_t unneeded;                    //Parity chunks of groups already complete.
+    uint32_t nacks;                       //NACK frames sent.
+} espnow_mcast_rx_stats_t;
+
+typedef struct {
+    uint8_t src_mac[ESP_NOW_ETH_ALEN];
+    uint8_t xfer_id;
+    uint8_t k;
+    espnow_mcast_state_t state;
+    uint32_t size;
+    uint32_t crc;
+    uint32_t count;                       //Chunks in the image.
+    uint32_t missing;                     //Chunks not written yet.
+    uint16_t groups;
+    uint16_t group;                       //Group of the parity chunks held, or UINT16_MAX.
+    uint8_t parity_num;
+    uint8_t parity_index[ESPNOW_MCAST_K_MAX];
+    uint8_t parity[ESPNOW_MCAST_K_MAX][ESPNOW_MCAST_CHUNK_LEN];
+    uint8_t chunk[ESPNOW_MCAST_K_MAX][ESPNOW_MCAST_CHUNK_LEN];
+    uint32_t got[ESPNOW_MCAST_CHUNKS_MAX / 32];     //Bit i set: chunk i written.
+    int64_t start_us;
+    int64_t end_us;
+    espnow_mcast_begin_cb_t begin;
+    espnow_mcast_write_cb_t write;
+    espnow_mcast_read_cb_t read;
+    espnow_mcast_end_cb_t end;
+    espnow_mcast_xmit_cb_t xmit;
+    void *arg;
+    espnow_mcast_rx_stats_t stats;
+} espnow_mcast_rx_t;
+
+static inline uint32_t espnow_mcast_chunk_count(uint32_t size)
+{
+    return (uint32_t)((size + ESPNOW_MCAST_CHUNK_LEN - 1) / ESPNOW_MCAST_CHUNK_LEN);
+}
+
+/* Start distributing an image of size bytes with the given CRC32 as transfer xfer_id:
+ * k chunks per group, followed by parity chunks in the first round. After every
+ * round the sender waits nack_wait_ms for NACKs. Repair rounds send overhead percent
+ * more parity chunks than asked for, so that the repair chunks lost in turn do not
+ * always cost another round. The transfer fails if chunks are still asked for after
+ * max_rounds rounds. Returns ESP_ERR_INVALID_SIZE if the image has more than
+ * ESPNOW_MCAST_CHUNKS_MAX chunks. */
+esp_err_t espnow_mcast_tx_start(espnow_mcast_tx_t *tx, uint8_t xfer_id, uint32_t size, uint32_t crc, uint8_t k,
+                                uint8_t parity, uint8_t overhead, uint32_t nack_wait_ms, uint8_t max_rounds,
+                                espnow_mcast_read_cb_t read, espnow_mcast_xmit_cb_t xmit, void *arg);
+
+/* Send what is due: announcements, chunks of the round, and polls. */
+void espnow_mcast_tx_poll(espnow_mcast_tx_t *tx, int64_t now_us);
+
+/* Handle the payload of a multicast frame received from a receiver. Returns
+ * ESP_ERR_INVALID_ARG if it is not a NACK of the current poll. */
+esp_err_t espnow_mcast_tx_on_nack(espnow_mcast_tx_t *tx, const uint8_t *payload, size_t len);
+
+/* Time the next poll is due, or -1 if nothing is. Also -1 while the sender is stalled:
+ * poll again after the next sending callback. */
+int64_t espnow_mcast_tx_next_deadline(const espnow_mcast_tx_t *tx);
+
+static inline bool espnow_mcast_tx_active(const espnow_mcast_tx_t *tx)
+{
+    return tx->state == ESPNOW_MCAST_SENDING || tx->state == ESPNOW_MCAST_POLLING;
+}
+
+void espnow_mcast_rx_init(espnow_mcast_rx_t *rx, espnow_mcast_begin_cb_t begin, espnow_mcast_write_cb_t write,
+                          espnow_mcast_read_cb_t read, espnow_mcast_end_cb_t end, espnow_mcast_xmit_cb_t xmit,
+                          void *arg);
+
+/* Handle the payload of a multicast frame received from mac. An announcement of
+ * another transfer replaces the current one, so pass only frames of the device
+ * trusted to send images. Returns ESP_ERR_INVALID_ARG for a malformed frame. */
+esp_err_t espnow_mcast_rx(espnow_mcast_rx_t *rx, const uint8_t *mac, const uint8_t *payload, size_t len,
+                          int64_t now_us);
+
+#endif
@@ -0,0 +1,149 @@
+/* ESPNOW Example - runtime metrics
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_console.h"
+#include "esp_mac.h"
+#include "esp_timer.h"
+#include "espnow_metrics.h"
+
+static _Atomic uint32_t s_metrics_counter[portNUM_PROCESSORS][ESPNOW_METRIC_COUNTER_MAX];
+static _Atomic uint32_t s_metrics_gauge[portNUM_PROCESSORS][ESPNOW_METRIC_GAUGE_MAX];
+
+static const char *const s_metrics_counter_names[ESPNOW_METRIC_COUNTER_MAX] = {
+    "rx_frames", "tx_frames", "send_fail", "queue_full", "crc_fail", "no_mem", "peer_add_fail",
+};
+static const char *const s_metrics_gauge_names[ESPNOW_METRIC_GAUGE_MAX] = {
+    "queue_high_water", "batch_high_water",
+};
+
+void espnow_metrics_inc(espnow_metric_counter_t counter)
+{
+    atomic_fetch_add_explicit(&s_metrics_counter[xPortGetCoreID()][counter], 1, memory_order_relaxed);
+}
+
+void espnow_metrics_max(espnow_metric_gauge_t gauge, uint32_t value)
+{
+    _Atomic uint32_t *slot = &s_metrics_gauge[xPortGetCoreID()][gauge];
+    uint32_t cur = atomic_load_explicit(slot, memory_order_relaxed);
+
+    /* Only a task or ISR preempting this one on the same core can change the slot meanwhile. */
+    while (value > cur && !atomic_compare_exchange_weak_explicit(slot, &cur, value, memory_order_relaxed,
+                                                                 memory_order_relaxed)) {
+    }
+}
+
+uint32_t espnow_metrics_counter(espnow_metric_counter_t counter)
+{
+    uint32_t total = 0;
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        total += atomic_load_explicit(&s_metrics_counter[core][counter], memory_order_relaxed);
+    }
+    return total;
+}
+
+uint32_t espnow_metrics_gauge(espnow_metric_gauge_t gauge)
+{
+    uint32_t max = 0;
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        uint32_t value = atomic_load_explicit(&s_metrics_gauge[core][gauge], memory_order_relaxed);
+        if (value > max) {
+            max = value;
+        }
+    }
+    return max;
+}
+
+void espnow_metrics_reset(void)
+{
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        for (int i = 0; i < ESPNOW_METRIC_COUNTER_MAX; i++) {
+            atomic_store_explicit(&s_metrics_counter[core][i], 0, memory_order_relaxed);
+        }
+        for (int i = 0; i < ESPNOW_METRIC_GAUGE_MAX; i++) {
+            atomic_store_explicit(&s_metrics_gauge[core][i], 0, memory_order_relaxed);
+        }
+    }
+}
+
+void espnow_metrics_snapshot(espnow_metrics_snapshot_t *snap)
+{
+    memset(snap, 0, sizeof(espnow_metrics_snapshot_t));
+    snap->version = ESPNOW_METRICS_VERSION;
+    snap->counters = ESPNOW_METRIC_COUNTER_MAX;
+    snap->gauges = ESPNOW_METRIC_GAUGE_MAX;
+    snap->uptime_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    for (int i = 0; i < ESPNOW_METRIC_COUNTER_MAX; i++) {
+        snap->value[i] = espnow_metrics_counter(i);
+    }
+    for (int i = 0; i < ESPNOW_METRIC_GAUGE_MAX; i++) {
+        snap->value[ESPNOW_METRIC_COUNTER_MAX + i] = espnow_metrics_gauge(i);
+    }
+}
+
+void espnow_metrics_print(const uint8_t *mac, const uint8_t *snap, size_t len)
+{
+    char hex[2 * ESP_NOW_MAX_DATA_LEN + 1];
+    size_t pos = 0;
+
+    for (size_t i = 0; i < len && pos + 2 < sizeof(hex); i++) {
+        pos += snprintf(hex + pos, sizeof(hex) - pos, "%02x", snap[i]);
+    }
+    hex[pos] = '\0';
+    printf(ESPNOW_METRICS_LINE " "MACSTR" %s\n", MAC2STR(mac), hex);
+}
+
+static int metrics_cmd(int argc, char **argv)
+{
+    if (argc == 2 && strcmp(argv[1], "reset") == 0) {
+        espnow_metrics_reset();
+        return 0;
+    }
+    if (argc != 1) {
+        printf("usage: metrics [reset]\n");
+        return 1;
+    }
+    printf("%-18s", "metric");
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        printf("      core%d", core);
+    }
+    printf("      total\n");
+    for (int i = 0; i < ESPNOW_METRIC_COUNTER_MAX; i++) {
+        printf("%-18s", s_metrics_counter_names[i]);
+        for (int core = 0; core < portNUM_PROCESSORS; core++) {
+            printf(" %10lu", (unsigned long)atomic_load_explicit(&s_metrics_counter[core][i], memory_order_relaxed));
+        }
+        printf(" %10lu\n", (unsigned long)espnow_metrics_counter(i));
+    }
+    for (int i = 0; i < ESPNOW_METRIC_GAUGE_MAX; i++) {
+        printf("%-18s", s_metrics_gauge_names[i]);
+        for (int core = 0; core < portNUM_PROCESSORS; core++) {
+            printf(" %10lu", (unsigned long)atomic_load_explicit(&s_metrics_gauge[core][i], memory_order_relaxed));
+        }
+        printf(" %10lu\n", (unsigned long)espnow_metrics_gauge(i));
+    }
+    return 0;
+}
+
+esp_err_t espnow_metrics_register_cmd(void)
+{
+    const esp_console_cmd_t cmd = {
+        .command = "metrics",
+        .help = "Print the ESPNOW counters and gauges of every core, or clear them with 'metrics reset'",
+        .hint = "[reset]",
+        .func = metrics_cmd,
+    };
+
+    return esp_console_cmd_register(&cmd);
+}
@@ -0,0 +1,83 @@
+/* ESPNOW Example - runtime metrics
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESPNOW_METRICS_H
+#define ESPNOW_METRICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_now.h"
+
+/* Process-wide counters and gauges. Every core updates its own copy of each value
+ * with a relaxed atomic, so updating never takes a lock, never contends with the
+ * other core and may be done from the WiFi task, the ESPNOW task or an ISR alike.
+ * Readers add the counters of all cores up and take the largest gauge.
+ *
+ * Gauges are high-water marks: a gauge only ever grows until it is reset.
+ *
+ * A snapshot is the compact binary form of all values, meant to be collected from
+ * many devices: it is printed as one ESPNOW_METRICS_LINE line of hex and slaves
+ * broadcast it to the master in EXAMPLE_ESPNOW_DATA_METRICS frames.
+ *
+ * Thread-safe. */
+#define ESPNOW_METRICS_VERSION      1
+#define ESPNOW_METRICS_LINE         "ESPNOW_METRICS"
+
+typedef enum {
+    ESPNOW_METRIC_RX_FRAMES,              //Frames passed to the receiving callback.
+    ESPNOW_METRIC_TX_FRAMES,              //Sending callbacks, whatever their status.
+    ESPNOW_METRIC_SEND_FAIL,              //Sending callbacks that reported failure.
+    ESPNOW_METRIC_QUEUE_FULL,             //Callback events dropped because the event queue or ring was full.
+    ESPNOW_METRIC_CRC_FAIL,               //Received frames whose CRC did not match.
+    ESPNOW_METRIC_NO_MEM,                 //Received frames dropped for want of a receive buffer, and failed allocations.
+    ESPNOW_METRIC_PEER_ADD_FAIL,          //Devices that could not be added to the peer table or the ESPNOW peer list.
+    ESPNOW_METRIC_COUNTER_MAX,
+} espnow_metric_counter_t;
+
+typedef enum {
+    ESPNOW_METRIC_QUEUE_HIGH_WATER,       //Most callback events waiting for the ESPNOW task at the same time.
+    ESPNOW_METRIC_BATCH_HIGH_WATER,       //Most events handled by the ESPNOW task in one wakeup.
+    ESPNOW_METRIC_GAUGE_MAX,
+} espnow_metric_gauge_t;
+
+/* Compact binary form of the metrics, little endian. The counts of counters and
+ * gauges let a decoder read snapshots of devices running other versions. */
+typedef struct {
+    uint8_t version;                      //ESPNOW_METRICS_VERSION.
+    uint8_t counters;                     //ESPNOW_METRIC_COUNTER_MAX.
+    uint8_t gauges;                       //ESPNOW_METRIC_GAUGE_MAX.
+    uint8_t reserved;
+    uint32_t uptime_ms;
+    uint32_t value[ESPNOW_METRIC_COUNTER_MAX + ESPNOW_METRIC_GAUGE_MAX];  //Counters, then gauges.
+} __attribute__((packed)) espnow_metrics_snapshot_t;
+
+void espnow_metrics_inc(espnow_metric_counter_t counter);
+
+/* Raise gauge to value if it is lower. */
+void espnow_metrics_max(espnow_metric_gauge_t gauge, uint32_t value);
+
+uint32_t espnow_metrics_counter(espnow_metric_counter_t counter);
+
+uint32_t espnow_metrics_gauge(espnow_metric_gauge_t gauge);
+
+/* Clear every counter and gauge of every core. */
+void espnow_metrics_reset(void);
+
+void espnow_metrics_snapshot(espnow_metrics_snapshot_t *snap);
+
+/* Print one line with the ESPNOW_METRICS_LINE prefix, the MAC of the device the
+ * snapshot comes from and the len bytes of the snapshot in hex. */
+void espnow_metrics_print(const uint8_t *mac, const uint8_t *snap, size_t len);
+
+/* Register the "metrics" console command, which prints every value per core, or
+ * with "metrics reset" clears them. */
+esp_err_t espnow_metrics_register_cmd(void);
+
+#endif
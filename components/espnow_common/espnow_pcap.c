@@ -0,0 +1,257 @@
+/* ESPNOW Example - packet capture
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_console.h"
+#include "esp_timer.h"
+#include "espnow_pcap.h"
+
+#define PCAP_MAGIC          0xa1b2c3d4
+#define PCAP_SNAPLEN        (sizeof(espnow_pcap_hdr_t) + ESP_NOW_MAX_DATA_LEN)
+
+/* pcap global header and record header, see the pcap file format. */
+typedef struct {
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t linktype;
+} __attribute__((packed)) pcap_file_hdr_t;
+
+typedef struct {
+    uint32_t ts_sec;
+    uint32_t ts_usec;
+    uint32_t incl_len;
+    uint32_t orig_len;
+} __attribute__((packed)) pcap_rec_hdr_t;
+
+typedef struct {
+    uint32_t seq;                         //Index + 1 of the frame held, 0 while none is complete.
+    bool busy;                            //A capture is copying into the slot.
+    int64_t time_us;
+    espnow_pcap_hdr_t hdr;
+    uint16_t len;
+    uint8_t data[ESP_NOW_MAX_DATA_LEN];
+} pcap_frame_t;
+
+static bool s_pcap_running;
+
+#if CONFIG_ESPNOW_PCAP_ENABLE
+static portMUX_TYPE s_pcap_lock = portMUX_INITIALIZER_UNLOCKED;
+static pcap_frame_t s_pcap_ring[CONFIG_ESPNOW_PCAP_FRAMES];
+static uint32_t s_pcap_captured;          //Free-running; the next frame goes to slot captured % CONFIG_ESPNOW_PCAP_FRAMES.
+static uint32_t s_pcap_dropped;
+static uint8_t s_pcap_mac[ESP_NOW_ETH_ALEN];
+
+static void pcap_capture(uint8_t dir, int8_t rssi, const uint8_t *src, const uint8_t *dst, const uint8_t *data,
+                         size_t len)
+{
+    if (len > ESP_NOW_MAX_DATA_LEN) {
+        len = ESP_NOW_MAX_DATA_LEN;
+    }
+    int64_t now = esp_timer_get_time();
+
+    /* Only the slot is taken under the lock, the frame is copied outside it. Checked
+     * under the lock, so that no slot is taken once a dump has stopped the capture. */
+    taskENTER_CRITICAL(&s_pcap_lock);
+    if (!s_pcap_running) {
+        taskEXIT_CRITICAL(&s_pcap_lock);
+        return;
+    }
+    pcap_frame_t *frame = &s_pcap_ring[s_pcap_captured % CONFIG_ESPNOW_PCAP_FRAMES];
+    if (frame->busy) {
+        /* The ring went round while another capture still copies into this slot. */
+        s_pcap_dropped++;
+        taskEXIT_CRITICAL(&s_pcap_lock);
+        return;
+    }
+    uint32_t seq = ++s_pcap_captured;
+    frame->busy = true;
+    frame->seq = 0;
+    taskEXIT_CRITICAL(&s_pcap_lock);
+
+    frame->time_us = now;
+    frame->hdr.version = ESPNOW_PCAP_VERSION;
+    frame->hdr.dir = dir;
+    frame->hdr.rssi = rssi;
+    frame->hdr.reserved = 0;
+    memcpy(frame->hdr.src, src, ESP_NOW_ETH_ALEN);
+    memcpy(frame->hdr.dst, dst, ESP_NOW_ETH_ALEN);
+    frame->len = len;
+    memcpy(frame->data, data, len);
+
+    taskENTER_CRITICAL(&s_pcap_lock);
+    frame->busy = false;
+    frame->seq = seq;
+    taskEXIT_CRITICAL(&s_pcap_lock);
+}
+#endif
+
+void espnow_pcap_init(const uint8_t *mac)
+{
+#if CONFIG_ESPNOW_PCAP_ENABLE
+    memcpy(s_pcap_mac, mac, ESP_NOW_ETH_ALEN);
+    s_pcap_running = true;
+#endif
+}
+
+void espnow_pcap_rx(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len)
+{
+#if CONFIG_ESPNOW_PCAP_ENABLE
+    pcap_capture(ESPNOW_PCAP_RX, recv_info->rx_ctrl->rssi, recv_info->src_addr, recv_info->des_addr, data, len);
+#endif
+}
+
+esp_err_t espnow_pcap_send(const uint8_t *peer_addr, const uint8_t *data, size_t len)
+{
+#if CONFIG_ESPNOW_PCAP_ENABLE
+    static const uint8_t all_peers[ESP_NOW_ETH_ALEN] = { 0 };
+
+    esp_err_t ret = esp_now_send(peer_addr, data, len);
+
+    /* Only frames handed to WiFi are captured. A NULL peer address sends to every peer in the list. */
+    if (ret == ESP_OK) {
+        pcap_capture(ESPNOW_PCAP_TX, 0, s_pcap_mac, peer_addr != NULL ? peer_addr : all_peers, data, len);
+    }
+    return ret;
+#else
+    return esp_now_send(peer_addr, data, len);
+#endif
+}
+
+void espnow_pcap_set_running(bool running)
+{
+#if CONFIG_ESPNOW_PCAP_ENABLE
+    s_pcap_running = running;
+#endif
+}
+
+void espnow_pcap_clear(void)
+{
+#if CONFIG_ESPNOW_PCAP_ENABLE
+    taskENTER_CRITICAL(&s_pcap_lock);
+    s_pcap_captured = 0;
+    s_pcap_dropped = 0;
+    for (int i = 0; i < CONFIG_ESPNOW_PCAP_FRAMES; i++) {
+        s_pcap_ring[i].seq = 0;
+    }
+    taskEXIT_CRITICAL(&s_pcap_lock);
+#endif
+}
+
+void espnow_pcap_get_stats(espnow_pcap_stats_t *stats)
+{
+    memset(stats, 0, sizeof(espnow_pcap_stats_t));
+#if CONFIG_ESPNOW_PCAP_ENABLE
+    taskENTER_CRITICAL(&s_pcap_lock);
+    stats->captured = s_pcap_captured;
+    stats->dropped = s_pcap_dropped;
+    taskEXIT_CRITICAL(&s_pcap_lock);
+    if (stats->captured > CONFIG_ESPNOW_PCAP_FRAMES) {
+        stats->overwritten = stats->captured - CONFIG_ESPNOW_PCAP_FRAMES;
+    }
+#endif
+}
+
+static void pcap_print_hex(const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+
+    for (size_t i = 0; i < len; i++) {
+        printf("%02x", p[i]);
+    }
+}
+
+void espnow_pcap_dump(void)
+{
+    const pcap_file_hdr_t file_hdr = {
+        .magic = PCAP_MAGIC,
+        .version_major = 2,
+        .version_minor = 4,
+        .snaplen = PCAP_SNAPLEN,
+        .linktype = ESPNOW_PCAP_LINKTYPE,
+    };
+
+    printf(ESPNOW_PCAP_LINE " ");
+    pcap_print_hex(&file_hdr, sizeof(file_hdr));
+    printf("\n");
+#if CONFIG_ESPNOW_PCAP_ENABLE
+    bool running = s_pcap_running;
+    espnow_pcap_stats_t stats;
+
+    /* Once the lock has been taken in espnow_pcap_get_stats(), no slot is taken. A
+     * capture still copying leaves its slot out of the dump. */
+    s_pcap_running = false;
+    espnow_pcap_get_stats(&stats);
+    for (uint32_t i = stats.overwritten; i < stats.captured; i++) {
+        const pcap_frame_t *frame = &s_pcap_ring[i % CONFIG_ESPNOW_PCAP_FRAMES];
+
+        taskENTER_CRITICAL(&s_pcap_lock);
+        bool complete = frame->seq == i + 1;
+        taskEXIT_CRITICAL(&s_pcap_lock);
+        if (!complete) {
+            continue;
+        }
+        pcap_rec_hdr_t rec_hdr = {
+            .ts_sec = frame->time_us / 1000000,
+            .ts_usec = frame->time_us % 1000000,
+            .incl_len = sizeof(espnow_pcap_hdr_t) + frame->len,
+            .orig_len = sizeof(espnow_pcap_hdr_t) + frame->len,
+        };
+        printf(ESPNOW_PCAP_LINE " ");
+        pcap_print_hex(&rec_hdr, sizeof(rec_hdr));
+        pcap_print_hex(&frame->hdr, sizeof(espnow_pcap_hdr_t));
+        pcap_print_hex(frame->data, frame->len);
+        printf("\n");
+    }
+    s_pcap_running = running;
+#endif
+    printf(ESPNOW_PCAP_LINE " end\n");
+    fflush(stdout);
+}
+
+static int pcap_cmd(int argc, char **argv)
+{
+    if (argc == 1) {
+        espnow_pcap_stats_t stats;
+        espnow_pcap_get_stats(&stats);
+        printf("%s, %lu frames captured, %lu overwritten, %lu dropped\n", s_pcap_running ? "running" : "stopped",
+               (unsigned long)stats.captured, (unsigned long)stats.overwritten, (unsigned long)stats.dropped);
+    } else if (argc == 2 && strcmp(argv[1], "dump") == 0) {
+        espnow_pcap_dump();
+    } else if (argc == 2 && strcmp(argv[1], "start") == 0) {
+        espnow_pcap_set_running(true);
+    } else if (argc == 2 && strcmp(argv[1], "stop") == 0) {
+        espnow_pcap_set_running(false);
+    } else if (argc == 2 && strcmp(argv[1], "clear") == 0) {
+        espnow_pcap_clear();
+    } else {
+        printf("usage: pcap [dump|start|stop|clear]\n");
+        return 1;
+    }
+    return 0;
+}
+
+esp_err_t espnow_pcap_register_cmd(void)
+{
+    const esp_console_cmd_t cmd = {
+        .command = "pcap",
+        .help = "Print the ESPNOW frames captured as pcap with 'pcap dump', start, stop or clear the capture, "
+                "or print how many frames were captured",
+        .hint = "[dump|start|stop|clear]",
+        .func = pcap_cmd,
+    };
+
+    return esp_console_cmd_register(&cmd);
+}
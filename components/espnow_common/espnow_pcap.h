@@ -0,0 +1,83 @@
+/* ESPNOW Example - packet capture
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESPNOW_PCAP_H
+#define ESPNOW_PCAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_now.h"
+
+/* Capture of the raw ESPNOW data received and sent, for offline analysis. With
+ * CONFIG_ESPNOW_PCAP_ENABLE the last CONFIG_ESPNOW_PCAP_FRAMES frames are kept in
+ * a RAM ring, the oldest being overwritten, each with its time, direction, source
+ * and destination MAC and RSSI.
+ *
+ * The ring is dumped as a pcap file of link type ESPNOW_PCAP_LINKTYPE, one
+ * ESPNOW_PCAP_LINE line of hex per pcap block, so it survives the console UART:
+ * the global header, then one line per frame, then an ESPNOW_PCAP_LINE "end" line.
+ * The data of every frame starts with espnow_pcap_hdr_t, followed by the ESPNOW
+ * data. Timestamps are the time since boot. espnow_pcap_decode of the host build
+ * turns the lines back into a pcap file and decodes example_espnow_data_t.
+ *
+ * Thread-safe: capturing takes a slot of the ring in a short critical section
+ * and copies the frame outside it. */
+#define ESPNOW_PCAP_VERSION         1
+#define ESPNOW_PCAP_LINKTYPE        147   //LINKTYPE_USER0.
+#define ESPNOW_PCAP_LINE            "ESPNOW_PCAP"
+
+typedef enum {
+    ESPNOW_PCAP_RX,
+    ESPNOW_PCAP_TX,
+} espnow_pcap_dir_t;
+
+/* Pseudo header in front of the data of every captured frame, little endian. */
+typedef struct {
+    uint8_t version;                      //ESPNOW_PCAP_VERSION.
+    uint8_t dir;                          //espnow_pcap_dir_t.
+    int8_t rssi;                          //RSSI of received frames, 0 for sent ones.
+    uint8_t reserved;
+    uint8_t src[ESP_NOW_ETH_ALEN];
+    uint8_t dst[ESP_NOW_ETH_ALEN];
+} __attribute__((packed)) espnow_pcap_hdr_t;
+
+typedef struct {
+    uint32_t captured;                    //Frames captured since the last clear.
+    uint32_t overwritten;                 //Captured frames overwritten before being dumped.
+    uint32_t dropped;                     //Frames not captured because their slot was still being copied into.
+} espnow_pcap_stats_t;
+
+/* mac is the address of this device, the source of sent frames. Capture starts. */
+void espnow_pcap_init(const uint8_t *mac);
+
+/* Capture a received frame. */
+void espnow_pcap_rx(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len);
+
+/* Send the frame with esp_now_send() and capture it if that returns ESP_OK.
+ * Frames that fail to send are not captured. */
+esp_err_t espnow_pcap_send(const uint8_t *peer_addr, const uint8_t *data, size_t len);
+
+/* Start or stop capturing. Frames already captured are kept. */
+void espnow_pcap_set_running(bool running);
+
+/* Forget every captured frame. */
+void espnow_pcap_clear(void);
+
+/* Print the captured frames, oldest first, as described above. Capture stops
+ * while the frames are printed. */
+void espnow_pcap_dump(void);
+
+void espnow_pcap_get_stats(espnow_pcap_stats_t *stats);
+
+/* Register the "pcap" console command: "pcap dump", "pcap start", "pcap stop",
+ * "pcap clear", or the statistics without an argument. */
+esp_err_t espnow_pcap_register_cmd(void);
+
+#endif
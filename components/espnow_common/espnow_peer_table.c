@@ -0,0 +1,100 @@
+/* ESPNOW Example - peer table
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <string.h>
+#include "espnow_peer_table.h"
+
+_Static_assert((ESPNOW_PEER_TABLE_SIZE & (ESPNOW_PEER_TABLE_SIZE - 1)) == 0, "Peer table size must be a power of two");
+_Static_assert(ESPNOW_PEER_TABLE_SIZE < ESPNOW_PEER_INVALID_ID, "Peer table too large");
+
+/* Hash slots hold a peer id, or ESPNOW_PEER_INVALID_ID when empty. */
+static uint16_t s_peer_slots[ESPNOW_PEER_TABLE_SIZE];
+static espnow_peer_t s_peers[ESPNOW_PEER_TABLE_MAX];
+static uint16_t s_peer_count;
+static espnow_peer_table_stats_t s_peer_stats;
+
+static uint32_t peer_table_hash(const uint8_t *mac_addr)
+{
+    /* The vendor OUI is shared by most devices, so mix every byte: FNV-1a. */
+    uint32_t hash = 2166136261u;
+
+    for (int i = 0; i < ESP_NOW_ETH_ALEN; i++) {
+        hash = (hash ^ mac_addr[i]) * 16777619u;
+    }
+    return hash ^ (hash >> 16);
+}
+
+/* Slot holding mac_addr, or the empty slot where it belongs. */
+static uint32_t peer_table_find(const uint8_t *mac_addr)
+{
+    uint32_t slot = peer_table_hash(mac_addr) & (ESPNOW_PEER_TABLE_SIZE - 1);
+
+    s_peer_stats.lookups++;
+    for (;;) {
+        uint16_t id = s_peer_slots[slot];
+        s_peer_stats.probes++;
+        if (id == ESPNOW_PEER_INVALID_ID || memcmp(s_peers[id].mac_addr, mac_addr, ESP_NOW_ETH_ALEN) == 0) {
+            return slot;
+        }
+        slot = (slot + 1) & (ESPNOW_PEER_TABLE_SIZE - 1);
+    }
+}
+
+void espnow_peer_table_init(void)
+{
+    memset(s_peer_slots, 0xFF, sizeof(s_peer_slots));
+    memset(s_peers, 0, sizeof(s_peers));
+    memset(&s_peer_stats, 0, sizeof(s_peer_stats));
+    s_peer_count = 0;
+}
+
+espnow_peer_t *espnow_peer_table_lookup(const uint8_t *mac_addr)
+{
+    uint16_t id = s_peer_slots[peer_table_find(mac_addr)];
+
+    return id == ESPNOW_PEER_INVALID_ID ? NULL : &s_peers[id];
+}
+
+espnow_peer_t *espnow_peer_table_get_or_add(const uint8_t *mac_addr)
+{
+    uint32_t slot = peer_table_find(mac_addr);
+    espnow_peer_t *peer;
+
+    if (s_peer_slots[slot] != ESPNOW_PEER_INVALID_ID) {
+        return &s_peers[s_peer_slots[slot]];
+    }
+    if (s_peer_count == ESPNOW_PEER_TABLE_MAX) {
+        s_peer_stats.full++;
+        return NULL;
+    }
+    peer = &s_peers[s_peer_count];
+    memcpy(peer->mac_addr, mac_addr, ESP_NOW_ETH_ALEN);
+    peer->id = s_peer_count;
+    s_peer_slots[slot] = s_peer_count;
+    s_peer_count++;
+    return peer;
+}
+
+espnow_peer_t *espnow_peer_table_get(uint16_t id)
+{
+    return id < s_peer_count ? &s_peers[id] : NULL;
+}
+
+void espnow_peer_table_seen(espnow_peer_t *peer, uint16_t seq, int8_t rssi, int64_t now_us)
+{
+    peer->last_seq = seq;
+    peer->rssi = rssi;
+    peer->last_seen_us = now_us;
+}
+
+void espnow_peer_table_get_stats(espnow_peer_table_stats_t *stats)
+{
+    *stats = s_peer_stats;
+    stats->count = s_peer_count;
+}
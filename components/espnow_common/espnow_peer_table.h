@@ -0,0 +1,66 @@
+/* ESPNOW Example - peer table
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESPNOW_PEER_TABLE_H
+#define ESPNOW_PEER_TABLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_now.h"
+
+/* Application-side table of every device heard, independent of the ESPNOW peer
+ * list, which holds at most ESP_NOW_MAX_TOTAL_PEER_NUM entries. Devices are found
+ * by MAC address in an open-addressing hash with linear probing, kept at most 3/4
+ * full so that a lookup usually needs one probe. Entries live in a static array
+ * and are never removed; the index of an entry is its peer id.
+ *
+ * Not thread-safe: all calls must come from the same task. */
+#define ESPNOW_PEER_TABLE_SIZE      CONFIG_ESPNOW_PEER_TABLE_SIZE
+#define ESPNOW_PEER_TABLE_MAX       (ESPNOW_PEER_TABLE_SIZE / 4 * 3)
+#define ESPNOW_PEER_INVALID_ID      0xFFFF
+
+typedef struct {
+    uint8_t mac_addr[ESP_NOW_ETH_ALEN];
+    uint16_t id;                          //Index of the entry, stable for the lifetime of the table.
+    uint16_t last_seq;                    //Sequence number of the last data received from the device.
+    int8_t rssi;                          //RSSI of the last data received, unit: dBm.
+    bool in_peer_list;                    //The device has been added to the ESPNOW peer list.
+    uint8_t in_flight;                    //Data sent to the device whose send callback is pending.
+    uint16_t lru_prev;                    //Neighbours in the least recently used list of espnow_peer_slots.h.
+    uint16_t lru_next;
+    uint32_t acquired;                    //Last espnow_peer_slots_acquire call that needed the device.
+    int64_t last_seen_us;                 //esp_timer time of the last data received.
+} espnow_peer_t;
+
+typedef struct {
+    uint32_t lookups;                     //Calls to espnow_peer_table_lookup and espnow_peer_table_get_or_add.
+    uint32_t probes;                      //Slots compared by those calls.
+    uint32_t full;                        //New devices not stored because the table was full.
+    uint16_t count;                       //Devices stored.
+} espnow_peer_table_stats_t;
+
+/* Forget every device and clear the counters. */
+void espnow_peer_table_init(void);
+
+/* Entry of mac_addr, or NULL if the device has not been added. */
+espnow_peer_t *espnow_peer_table_lookup(const uint8_t *mac_addr);
+
+/* Entry of mac_addr, added with the next free id if the device is new. Returns NULL
+ * if the device is new and the table already holds ESPNOW_PEER_TABLE_MAX devices. */
+espnow_peer_t *espnow_peer_table_get_or_add(const uint8_t *mac_addr);
+
+/* Entry with the given peer id, or NULL. */
+espnow_peer_t *espnow_peer_table_get(uint16_t id);
+
+/* Record data received from peer. */
+void espnow_peer_table_seen(espnow_peer_t *peer, uint16_t seq, int8_t rssi, int64_t now_us);
+
+void espnow_peer_table_get_stats(espnow_peer_table_stats_t *stats);
+
+#endif
@@ -0,0 +1,285 @@
+/* ESPNOW Example - selective repeat reliable unicast
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <string.h>
+#include <assert.h>
+#include "esp_log.h"
+#include "espnow_reliable.h"
+
+static const char *TAG = "espnow_reliable";
+
+_Static_assert((ESPNOW_RELIABLE_WINDOW_MAX & (ESPNOW_RELIABLE_WINDOW_MAX - 1)) == 0, "Window must be a power of two");
+_Static_assert(ESPNOW_RELIABLE_WINDOW_MAX <= 32, "The acknowledgement bitmap covers 32 frames");
+
+static espnow_reliable_slot_t *reliable_slot(espnow_reliable_tx_t *tx, uint16_t seq)
+{
+    return &tx->slots[seq & (ESPNOW_RELIABLE_WINDOW_MAX - 1)];
+}
+
+static bool reliable_acked(const espnow_reliable_ack_t *ack, uint16_t seq)
+{
+    int16_t d = (int16_t)(seq - ack->next);
+
+    if (d < 0) {
+        return true;
+    }
+    return d >= 1 && d <= 32 && (ack->bitmap & (1UL << (d - 1))) != 0;
+}
+
+/* Retransmission timeout, doubled for every timeout since the last acknowledgement. */
+static int64_t reliable_rto(const espnow_reliable_tx_t *tx)
+{
+    int64_t rto_us = tx->rto_us << tx->backoff;
+
+    return rto_us > ESPNOW_RELIABLE_MAX_RTO_US ? ESPNOW_RELIABLE_MAX_RTO_US : rto_us;
+}
+
+/* Returns false if the frame could not be handed to ESPNOW and must be tried again.
+ * After the first refusal nothing more is tried until the next poll. */
+static bool reliable_transmit(espnow_reliable_tx_t *tx, espnow_reliable_slot_t *slot, int64_t now_us)
+{
+    if (tx->stalled || tx->xmit(tx->dest_mac, slot->seq, slot->data, slot->len, tx->arg) != ESP_OK) {
+        tx->stalled = true;
+        return false;
+    }
+    slot->tries++;
+    slot->sent_us = now_us;
+    tx->stats.transmissions++;
+    return true;
+}
+
+/* RFC 6298: SRTT and RTTVAR with gains 1/8 and 1/4, RTO = SRTT + max(G, 4 * RTTVAR)
+ * with the margin as G, so that a steady round trip time does not leave the timeout
+ * right at its edge. */
+static void reliable_rtt_sample(espnow_reliable_tx_t *tx, int64_t rtt_us)
+{
+    if (tx->srtt_us == 0) {
+        tx->srtt_us = rtt_us;
+        tx->rttvar_us = rtt_us / 2;
+    } else {
+        int64_t err = tx->srtt_us - rtt_us;
+        tx->rttvar_us += ((err < 0 ? -err : err) - tx->rttvar_us) / 4;
+        tx->srtt_us += (rtt_us - tx->srtt_us) / 8;
+    }
+    tx->rto_us = tx->srtt_us + (4 * tx->rttvar_us > tx->margin_us ? 4 * tx->rttvar_us : tx->margin_us);
+    if (tx->rto_us > ESPNOW_RELIABLE_MAX_RTO_US) {
+        tx->rto_us = ESPNOW_RELIABLE_MAX_RTO_US;
+    }
+}
+
+/* Retire the frame in slot and move base past every retired frame. */
+static void reliable_retire(espnow_reliable_tx_t *tx, espnow_reliable_slot_t *slot, bool delivered)
+{
+    uint16_t seq = slot->seq;
+
+    slot->used = false;
+    if (delivered) {
+        tx->stats.delivered++;
+    } else {
+        tx->stats.failed++;
+    }
+    while (tx->base != tx->next && !reliable_slot(tx, tx->base)->used) {
+        tx->base++;
+    }
+    if (tx->done != NULL) {
+        tx->done(seq, delivered, tx->arg);
+    }
+}
+
+void espnow_reliable_tx_init(espnow_reliable_tx_t *tx, const uint8_t *dest_mac, uint8_t window, uint8_t max_tries,
+                             uint32_t margin_ms, espnow_reliable_xmit_cb_t xmit, espnow_reliable_done_cb_t done, void *arg)
+{
+    assert(window >= 1 && window <= ESPNOW_RELIABLE_WINDOW_MAX && max_tries >= 1);
+    memset(tx, 0, sizeof(espnow_reliable_tx_t));
+    memcpy(tx->dest_mac, dest_mac, ESP_NOW_ETH_ALEN);
+    tx->window = window;
+    tx->max_tries = max_tries;
+    tx->rto_us = ESPNOW_RELIABLE_INITIAL_RTO_US;
+    tx->margin_us = (int64_t)margin_ms * 1000;
+    tx->xmit = xmit;
+    tx->done = done;
+    tx->arg = arg;
+}
+
+esp_err_t espnow_reliable_send(espnow_reliable_tx_t *tx, const uint8_t *data, size_t len, int64_t now_us)
+{
+    espnow_reliable_slot_t *slot;
+
+    if (len > ESPNOW_RELIABLE_MAX_DATA) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (espnow_reliable_full(tx)) {
+        return ESP_ERR_NO_MEM;
+    }
+    slot = reliable_slot(tx, tx->next);
+    slot->used = true;
+    slot->tries = 0;
+    slot->seq = tx->next++;
+    slot->len = len;
+    slot->sent_us = -1;
+    memcpy(slot->data, data, len);
+    tx->stats.sent++;
+    reliable_transmit(tx, slot, now_us);
+    return ESP_OK;
+}
+
+void espnow_reliable_on_ack(espnow_reliable_tx_t *tx, const espnow_reliable_ack_t *ack, int64_t now_us)
+{
+    int64_t newest_acked_us = -1;
+
+    /* ack->next beyond tx->next cannot come from this sender's frames. */
+    if ((int16_t)(ack->next - tx->next) > 0) {
+        return;
+    }
+    for (uint16_t seq = tx->base; seq != tx->next; seq++) {
+        espnow_reliable_slot_t *slot = reliable_slot(tx, seq);
+        if (!slot->used || !reliable_acked(ack, seq)) {
+            continue;
+        }
+        if (slot->sent_us > newest_acked_us) {
+            newest_acked_us = slot->sent_us;
+        }
+        /* Karn's rule: a retransmitted frame's round trip time is ambiguous. */
+        if (slot->tries == 1) {
+            reliable_rtt_sample(tx, now_us - slot->sent_us);
+        }
+        reliable_retire(tx, slot, true);
+    }
+    /* Frames get through again: stop backing off. */
+    if (newest_acked_us >= 0) {
+        tx->backoff = 0;
+    }
+
+    /* ESPNOW keeps the order of the frames to one peer, so a frame sent before one
+     * that has been acknowledged, and still missing, was lost. */
+    for (uint16_t seq = tx->base; seq != tx->next; seq++) {
+        espnow_reliable_slot_t *slot = reliable_slot(tx, seq);
+        if (slot->used && slot->sent_us >= 0 && slot->sent_us < newest_acked_us) {
+            if (slot->tries >= tx->max_tries) {
+                reliable_retire(tx, slot, false);
+                continue;
+            }
+            if (reliable_transmit(tx, slot, now_us)) {
+                tx->stats.fast_retransmits++;
+            }
+        }
+    }
+}
+
+void espnow_reliable_poll(espnow_reliable_tx_t *tx, int64_t now_us)
+{
+    bool expired = false;
+
+    tx->stalled = false;
+    for (uint16_t seq = tx->base; seq != tx->next; seq++) {
+        espnow_reliable_slot_t *slot = reliable_slot(tx, seq);
+        if (!slot->used) {
+            continue;
+        }
+        if (slot->sent_us < 0) {
+            reliable_transmit(tx, slot, now_us);
+            continue;
+        }
+        if (now_us - slot->sent_us < reliable_rto(tx)) {
+            continue;
+        }
+        if (slot->tries >= tx->max_tries) {
+            reliable_retire(tx, slot, false);
+            continue;
+        }
+        if (reliable_transmit(tx, slot, now_us)) {
+            expired = true;
+            tx->stats.timeouts++;
+        }
+    }
+    /* Back off until an acknowledgement arrives. */
+    if (expired && reliable_rto(tx) < ESPNOW_RELIABLE_MAX_RTO_US) {
+        tx->backoff++;
+    }
+}
+
+int64_t espnow_reliable_next_deadline(const espnow_reliable_tx_t *tx)
+{
+    int64_t deadline = -1;
+
+    if (tx->stalled) {
+        return -1;
+    }
+    for (uint16_t seq = tx->base; seq != tx->next; seq++) {
+        const espnow_reliable_slot_t *slot = &tx->slots[seq & (ESPNOW_RELIABLE_WINDOW_MAX - 1)];
+        if (!slot->used) {
+            continue;
+        }
+        int64_t due = slot->sent_us < 0 ? 0 : slot->sent_us + reliable_rto(tx);
+        if (deadline < 0 || due < deadline) {
+            deadline = due;
+        }
+    }
+    return deadline;
+}
+
+void espnow_reliable_log_stats(const espnow_reliable_tx_t *tx)
+{
+    const espnow_reliable_stats_t *stats = &tx->stats;
+
+    ESP_LOGI(TAG, "%lu frames: %lu delivered, %lu failed, %lu transmissions (%lu fast, %lu timeout retransmissions), "
+             "srtt %lld us, rto %lld us",
+             (unsigned long)stats->sent, (unsigned long)stats->delivered, (unsigned long)stats->failed,
+             (unsigned long)stats->transmissions, (unsigned long)stats->fast_retransmits,
+             (unsigned long)stats->timeouts, (long long)tx->srtt_us, (long long)reliable_rto(tx));
+}
+
+void espnow_reliable_rx_init(espnow_reliable_rx_t *rx)
+{
+    memset(rx, 0, sizeof(espnow_reliable_rx_t));
+}
+
+/* next has been received: move it past every frame received in a row. */
+static void reliable_rx_consume(espnow_reliable_rx_t *rx)
+{
+    rx->next++;
+    while (rx->bitmap & 1) {
+        rx->next++;
+        rx->bitmap >>= 1;
+    }
+    rx->bitmap >>= 1;
+}
+
+bool espnow_reliable_rx_accept(espnow_reliable_rx_t *rx, uint16_t base, uint16_t seq)
+{
+    int16_t d;
+
+    /* A sender never has more than a window of frames in flight past what the
+     * receiver expects, so a base this far behind means the sender started over. */
+    if ((int16_t)(rx->next - base) > ESPNOW_RELIABLE_WINDOW_MAX) {
+        rx->next = base;
+        rx->bitmap = 0;
+    }
+    /* The sender has given up everything before base: stop waiting for it. */
+    while ((int16_t)(base - rx->next) > 0) {
+        reliable_rx_consume(rx);
+    }
+    d = (int16_t)(seq - rx->next);
+    if (d == 0) {
+        reliable_rx_consume(rx);
+    } else if (d > 0 && d <= 32 && (rx->bitmap & (1UL << (d - 1))) == 0) {
+        rx->bitmap |= 1UL << (d - 1);
+    } else {
+        rx->duplicates++;
+        return false;
+    }
+    rx->received++;
+    return true;
+}
+
+void espnow_reliable_rx_ack(const espnow_reliable_rx_t *rx, espnow_reliable_ack_t *ack)
+{
+    ack->next = rx->next;
+    ack->bitmap = rx->bitmap;
+}
@@ -0,0 +1,143 @@
+/* ESPNOW Example - selective repeat reliable unicast
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESPNOW_RELIABLE_H
+#define ESPNOW_RELIABLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_now.h"
+#include "espnow_example.h"
+
+/* Reliable delivery of unicast data with selective repeat. Every sender numbers its
+ * EXAMPLE_ESPNOW_DATA_RELIABLE frames to one destination in seq_num and keeps up to
+ * `window` of them until they are acknowledged. The receiver keeps, per sender, the
+ * next sequence number it expects and a bitmap of the 32 after it, and returns both
+ * in an espnow_reliable_ack_t: in front of the data of every reliable frame it sends
+ * to that device, or alone in an EXAMPLE_ESPNOW_DATA_ACK frame. Only the frames the
+ * bitmap shows missing are sent again: at once when a later frame has been
+ * acknowledged, otherwise when the retransmission timeout derived from the measured
+ * round trip time (RFC 6298) expires, doubled for every timeout since the last
+ * acknowledgement. A frame that still is not acknowledged after max_tries
+ * transmissions is given up, and the sender's frames tell the receiver to stop
+ * waiting for it.
+ *
+ * Data is delivered exactly once but not necessarily in order: the receiver hands it
+ * over on arrival, and the sequence number tells the order.
+ *
+ * Not thread-safe: all calls for one sender or receiver must come from the same task. */
+#define ESPNOW_RELIABLE_WINDOW_MAX      32
+#define ESPNOW_RELIABLE_INITIAL_RTO_US  200000
+#define ESPNOW_RELIABLE_MAX_RTO_US      2000000
+
+/* Acknowledgement of everything before next, and of next + 1 + i for every bit i set. */
+typedef struct {
+    uint16_t next;
+    uint32_t bitmap;
+} __attribute__((packed)) espnow_reliable_ack_t;
+
+/* Payload of an EXAMPLE_ESPNOW_DATA_RELIABLE frame, in front of the data. */
+typedef struct {
+    uint16_t base;                        //Oldest sequence number the sender still tries to deliver.
+    espnow_reliable_ack_t ack;            //The sender's acknowledgement of data from the receiver.
+} __attribute__((packed)) espnow_reliable_hdr_t;
+
+#define ESPNOW_RELIABLE_MAX_DATA        (ESP_NOW_MAX_DATA_LEN - sizeof(example_espnow_data_t) - sizeof(espnow_reliable_hdr_t))
+
+/* Transmit one reliable frame carrying data with sequence number seq to dest_mac.
+ * Returning anything but ESP_OK leaves the frame waiting for the next poll. */
+typedef esp_err_t (*espnow_reliable_xmit_cb_t)(const uint8_t *dest_mac, uint16_t seq, const uint8_t *data, size_t len, void *arg);
+
+/* The frame with sequence number seq was acknowledged, or given up if delivered is false. */
+typedef void (*espnow_reliable_done_cb_t)(uint16_t seq, bool delivered, void *arg);
+
+typedef struct {
+    bool used;
+    uint8_t tries;                        //Transmissions so far.
+    uint16_t seq;
+    uint16_t len;
+    int64_t sent_us;                      //Time of the last transmission, -1 while waiting for the first one.
+    uint8_t data[ESPNOW_RELIABLE_MAX_DATA];
+} espnow_reliable_slot_t;
+
+typedef struct {
+    uint32_t sent;                        //Frames handed to espnow_reliable_send.
+    uint32_t transmissions;               //Transmissions, including retransmissions.
+    uint32_t fast_retransmits;            //Retransmissions of frames a later acknowledgement showed missing.
+    uint32_t timeouts;                    //Retransmissions after the timeout expired.
+    uint32_t delivered;                   //Frames acknowledged.
+    uint32_t failed;                      //Frames given up.
+} espnow_reliable_stats_t;
+
+typedef struct {
+    espnow_reliable_slot_t slots[ESPNOW_RELIABLE_WINDOW_MAX];
+    uint8_t dest_mac[ESP_NOW_ETH_ALEN];
+    uint8_t window;                       //Frames allowed in flight, 1..ESPNOW_RELIABLE_WINDOW_MAX.
+    uint8_t max_tries;
+    uint16_t base;                        //Oldest sequence number not yet acknowledged or given up.
+    uint16_t next;                        //Sequence number of the next new frame.
+    int64_t srtt_us;                      //Smoothed round trip time, 0 before the first sample.
+    int64_t rttvar_us;
+    int64_t rto_us;                       //Retransmission timeout derived from the round trip time.
+    int64_t margin_us;                    //Least time the timeout allows beyond the smoothed round trip time.
+    uint8_t backoff;                      //Timeouts since the last acknowledgement: rto_us is doubled this often.
+    bool stalled;                         //The xmit callback refused a frame since the last poll.
+    espnow_reliable_xmit_cb_t xmit;
+    espnow_reliable_done_cb_t done;
+    void *arg;
+    espnow_reliable_stats_t stats;
+} espnow_reliable_tx_t;
+
+typedef struct {
+    uint16_t next;                        //Next sequence number expected in order.
+    uint32_t bitmap;                      //Bit i set: next + 1 + i has been received.
+    uint32_t received;                    //Frames accepted.
+    uint32_t duplicates;                  //Frames received again, or too far ahead of next.
+} espnow_reliable_rx_t;
+
+void espnow_reliable_tx_init(espnow_reliable_tx_t *tx, const uint8_t *dest_mac, uint8_t window, uint8_t max_tries,
+                             uint32_t margin_ms, espnow_reliable_xmit_cb_t xmit, espnow_reliable_done_cb_t done, void *arg);
+
+/* Queue data for reliable delivery and transmit it. Returns ESP_ERR_NO_MEM if window
+ * frames are already in flight, ESP_ERR_INVALID_SIZE if data is too long. */
+esp_err_t espnow_reliable_send(espnow_reliable_tx_t *tx, const uint8_t *data, size_t len, int64_t now_us);
+
+/* Handle an acknowledgement received from the destination. */
+void espnow_reliable_on_ack(espnow_reliable_tx_t *tx, const espnow_reliable_ack_t *ack, int64_t now_us);
+
+/* Retransmit frames whose timeout expired and transmit frames still waiting. */
+void espnow_reliable_poll(espnow_reliable_tx_t *tx, int64_t now_us);
+
+/* Time of the next retransmission timeout, or -1 if nothing is in flight. Also -1
+ * while the sender is stalled: poll again after the next sending callback. */
+int64_t espnow_reliable_next_deadline(const espnow_reliable_tx_t *tx);
+
+static inline uint8_t espnow_reliable_in_flight(const espnow_reliable_tx_t *tx)
+{
+    return (uint8_t)(uint16_t)(tx->next - tx->base);
+}
+
+static inline bool espnow_reliable_full(const espnow_reliable_tx_t *tx)
+{
+    return espnow_reliable_in_flight(tx) >= tx->window;
+}
+
+void espnow_reliable_log_stats(const espnow_reliable_tx_t *tx);
+
+void espnow_reliable_rx_init(espnow_reliable_rx_t *rx);
+
+/* A reliable frame with sequence number seq and the sender's base arrived. Returns
+ * true if its data is new and must be delivered. */
+bool espnow_reliable_rx_accept(espnow_reliable_rx_t *rx, uint16_t base, uint16_t seq);
+
+void espnow_reliable_rx_ack(const espnow_reliable_rx_t *rx, espnow_reliable_ack_t *ack);
+
+#endif
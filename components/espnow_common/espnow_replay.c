@@ -0,0 +1,57 @@
+/* ESPNOW Example - duplicate suppression
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <string.h>
+#include "espnow_replay.h"
+
+static espnow_replay_stats_t s_replay_stats;
+
+void espnow_replay_init(espnow_replay_t *win)
+{
+    memset(win, 0, sizeof(espnow_replay_t));
+}
+
+bool espnow_replay_check(espnow_replay_t *win, uint32_t magic, uint16_t seq)
+{
+    int16_t d = (int16_t)(seq - win->top);
+
+    s_replay_stats.checked++;
+    if (win->bitmap == 0 || magic != win->magic || d > 0 || d <= -ESPNOW_REPLAY_WINDOW) {
+        return true;
+    }
+    if ((win->bitmap & (1ULL << -d)) == 0) {
+        return true;
+    }
+    s_replay_stats.duplicates++;
+    return false;
+}
+
+void espnow_replay_update(espnow_replay_t *win, uint32_t magic, uint16_t seq)
+{
+    int16_t d = (int16_t)(seq - win->top);
+
+    if (win->bitmap != 0 && magic != win->magic) {
+        s_replay_stats.restarts++;
+    }
+    if (win->bitmap == 0 || magic != win->magic || d <= -ESPNOW_REPLAY_WINDOW) {
+        win->bitmap = 1;
+        win->magic = magic;
+        win->top = seq;
+    } else if (d > 0) {
+        win->bitmap = d >= ESPNOW_REPLAY_WINDOW ? 1 : (win->bitmap << d) | 1;
+        win->top = seq;
+    } else {
+        win->bitmap |= 1ULL << -d;
+    }
+}
+
+void espnow_replay_get_stats(espnow_replay_stats_t *stats)
+{
+    *stats = s_replay_stats;
+}
@@ -0,0 +1,52 @@
+/* ESPNOW Example - duplicate suppression
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESPNOW_REPLAY_H
+#define ESPNOW_REPLAY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Sliding window over the sequence numbers of one stream of frames, such as the
+ * unicast data of one device. It remembers the highest sequence number seen and which
+ * of the 63 before it have been seen, so a copy of a recent frame, from a MAC-layer
+ * retry or a retransmission, is recognised from the header alone, before its CRC is
+ * checked or its payload parsed. A frame with another magic comes from a sender that
+ * restarted and starts the window over. A sequence number more than the window behind
+ * cannot be told apart from a new one and is accepted.
+ *
+ * Check a frame first and update the window only once the frame has been found intact,
+ * so that a corrupted copy cannot mark its sequence number as seen (RFC 4303 3.4.3).
+ *
+ * Not thread-safe: all calls must come from the same task. */
+#define ESPNOW_REPLAY_WINDOW        64
+
+typedef struct {
+    uint64_t bitmap;                      //Bit i set: top - i has been seen. 0 before the first frame.
+    uint32_t magic;                       //Magic of the frames seen.
+    uint16_t top;                         //Highest sequence number seen.
+} espnow_replay_t;
+
+typedef struct {
+    uint32_t checked;                     //Frames passed to espnow_replay_check.
+    uint32_t duplicates;                  //Frames found to be copies.
+    uint32_t restarts;                    //Windows started over for a new magic.
+} espnow_replay_stats_t;
+
+void espnow_replay_init(espnow_replay_t *win);
+
+/* Returns false if the frame with magic and seq has been seen already. */
+bool espnow_replay_check(espnow_replay_t *win, uint32_t magic, uint16_t seq);
+
+/* Record the frame with magic and seq, found intact, as seen. */
+void espnow_replay_update(espnow_replay_t *win, uint32_t magic, uint16_t seq);
+
+void espnow_replay_get_stats(espnow_replay_stats_t *stats);
+
+#endif
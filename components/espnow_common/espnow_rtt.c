@@ -0,0 +1,189 @@
+/* ESPNOW Example - round trip time probes
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <string.h>
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_timer.h"
+#include "espnow_rtt.h"
+
+#define RTT_SUB_COUNT               (1U << ESPNOW_RTT_SUB_BITS)
+
+/* A probed device. */
+typedef struct {
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    bool used;
+    uint32_t sent;                        //Probes sent.
+    uint32_t echoed;                      //Echoes received.
+    uint32_t invalid;                     //Echoes of probes never sent to the device.
+    espnow_rtt_hist_t hist;
+} rtt_peer_t;
+
+static const char *TAG = "espnow_rtt";
+static rtt_peer_t s_rtt_peers[ESPNOW_RTT_PEERS_MAX];
+
+static uint32_t rtt_bucket_index(uint32_t value)
+{
+    if (value < RTT_SUB_COUNT) {
+        return value;
+    }
+    uint32_t exp = 31 - __builtin_clz(value);
+    return ((exp - ESPNOW_RTT_SUB_BITS + 1) << ESPNOW_RTT_SUB_BITS) +
+           ((value >> (exp - ESPNOW_RTT_SUB_BITS)) & (RTT_SUB_COUNT - 1));
+}
+
+static uint32_t rtt_bucket_low(uint32_t index)
+{
+    if (index < RTT_SUB_COUNT) {
+        return index;
+    }
+    uint32_t exp = (index >> ESPNOW_RTT_SUB_BITS) + ESPNOW_RTT_SUB_BITS - 1;
+    return (RTT_SUB_COUNT + (index & (RTT_SUB_COUNT - 1))) << (exp - ESPNOW_RTT_SUB_BITS);
+}
+
+static uint32_t rtt_bucket_high(uint32_t index)
+{
+    return index + 1 < ESPNOW_RTT_BUCKETS ? rtt_bucket_low(index + 1) - 1 : UINT32_MAX;
+}
+
+void espnow_rtt_hist_reset(espnow_rtt_hist_t *hist)
+{
+    memset(hist, 0, sizeof(espnow_rtt_hist_t));
+    hist->min_us = UINT32_MAX;
+}
+
+void espnow_rtt_hist_record(espnow_rtt_hist_t *hist, uint32_t value_us)
+{
+    hist->bucket[rtt_bucket_index(value_us)]++;
+    hist->count++;
+    hist->sum_us += value_us;
+    if (value_us < hist->min_us) {
+        hist->min_us = value_us;
+    }
+    if (value_us > hist->max_us) {
+        hist->max_us = value_us;
+    }
+}
+
+uint32_t espnow_rtt_hist_percentile(const espnow_rtt_hist_t *hist, uint32_t per_mille)
+{
+    uint64_t rank = ((uint64_t)hist->count * per_mille + 999) / 1000;
+    uint64_t seen = 0;
+
+    if (hist->count == 0) {
+        return 0;
+    }
+    if (rank == 0) {
+        rank = 1;
+    }
+    for (uint32_t i = 0; i < ESPNOW_RTT_BUCKETS; i++) {
+        seen += hist->bucket[i];
+        if (seen >= rank) {
+            uint32_t high = rtt_bucket_high(i);
+            return high < hist->max_us ? high : hist->max_us;
+        }
+    }
+    return hist->max_us;
+}
+
+void espnow_rtt_hist_log(const char *name, const espnow_rtt_hist_t *hist, bool buckets)
+{
+    if (hist->count == 0) {
+        ESP_LOGI(TAG, "%s: no samples", name);
+        return;
+    }
+    ESP_LOGI(TAG, "%s: %lu samples, min %lu us, mean %lu us, p50 %lu us, p99 %lu us, p999 %lu us, max %lu us",
+             name, (unsigned long)hist->count, (unsigned long)hist->min_us,
+             (unsigned long)(hist->sum_us / hist->count), (unsigned long)espnow_rtt_hist_percentile(hist, 500),
+             (unsigned long)espnow_rtt_hist_percentile(hist, 990), (unsigned long)espnow_rtt_hist_percentile(hist, 999),
+             (unsigned long)hist->max_us);
+    for (uint32_t i = 0; buckets && i < ESPNOW_RTT_BUCKETS; i++) {
+        if (hist->bucket[i] > 0) {
+            ESP_LOGI(TAG, "%s: %lu..%lu us: %lu", name, (unsigned long)rtt_bucket_low(i),
+                     (unsigned long)rtt_bucket_high(i), (unsigned long)hist->bucket[i]);
+        }
+    }
+}
+
+void espnow_rtt_init(void)
+{
+    memset(s_rtt_peers, 0, sizeof(s_rtt_peers));
+}
+
+static rtt_peer_t *rtt_peer_find(const uint8_t *mac)
+{
+    for (int i = 0; i < ESPNOW_RTT_PEERS_MAX; i++) {
+        if (s_rtt_peers[i].used && memcmp(s_rtt_peers[i].mac, mac, ESP_NOW_ETH_ALEN) == 0) {
+            return &s_rtt_peers[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t espnow_rtt_probe(const uint8_t *mac, espnow_rtt_xmit_cb_t xmit, void *arg)
+{
+    rtt_peer_t *peer = rtt_peer_find(mac);
+    espnow_rtt_probe_t probe;
+    esp_err_t ret;
+
+    for (int i = 0; peer == NULL && i < ESPNOW_RTT_PEERS_MAX; i++) {
+        if (!s_rtt_peers[i].used) {
+            peer = &s_rtt_peers[i];
+            memset(peer, 0, sizeof(rtt_peer_t));
+            memcpy(peer->mac, mac, ESP_NOW_ETH_ALEN);
+            peer->used = true;
+            espnow_rtt_hist_reset(&peer->hist);
+        }
+    }
+    if (peer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    probe.id = peer->sent;
+    probe.sent_us = esp_timer_get_time();
+    ret = xmit(mac, (const uint8_t *)&probe, sizeof(probe), arg);
+    if (ret == ESP_OK) {
+        peer->sent++;
+    }
+    return ret;
+}
+
+esp_err_t espnow_rtt_on_echo(const uint8_t *mac, const uint8_t *payload, size_t len, int64_t now_us)
+{
+    rtt_peer_t *peer = rtt_peer_find(mac);
+    espnow_rtt_probe_t probe;
+
+    if (peer == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (len != sizeof(probe)) {
+        peer->invalid++;
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(&probe, payload, sizeof(probe));
+    if (probe.id >= peer->sent || probe.sent_us > now_us || now_us - probe.sent_us > UINT32_MAX) {
+        peer->invalid++;
+        return ESP_ERR_INVALID_ARG;
+    }
+    peer->echoed++;
+    espnow_rtt_hist_record(&peer->hist, (uint32_t)(now_us - probe.sent_us));
+    return ESP_OK;
+}
+
+void espnow_rtt_dump(bool buckets)
+{
+    for (int i = 0; i < ESPNOW_RTT_PEERS_MAX; i++) {
+        const rtt_peer_t *peer = &s_rtt_peers[i];
+        if (!peer->used) {
+            continue;
+        }
+        ESP_LOGI(TAG, "RTT to "MACSTR": %lu probes, %lu echoed, %lu invalid", MAC2STR(peer->mac),
+                 (unsigned long)peer->sent, (unsigned long)peer->echoed, (unsigned long)peer->invalid);
+        espnow_rtt_hist_log("Round trip", &peer->hist, buckets);
+    }
+}
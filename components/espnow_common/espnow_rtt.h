@@ -0,0 +1,79 @@
+/* ESPNOW Example - round trip time probes
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESPNOW_RTT_H
+#define ESPNOW_RTT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_now.h"
+
+/* Round trip time measurement. A device sends EXAMPLE_ESPNOW_DATA_PROBE frames
+ * carrying espnow_rtt_probe_t, stamped with esp_timer_get_time() right before they
+ * are handed to ESPNOW, and the probed device sends the payload back untouched in an
+ * EXAMPLE_ESPNOW_DATA_ECHO frame. The time from the stamp to the handling of the echo
+ * by the ESPNOW task is recorded in a histogram per probed device, so it includes the
+ * airtime both ways and the time both frames spend in event queues and waiting for
+ * the ESPNOW tasks.
+ *
+ * Histograms are log-linear: values below 2^ESPNOW_RTT_SUB_BITS have a bucket each,
+ * and every power of two above is split into 2^ESPNOW_RTT_SUB_BITS buckets, so 240
+ * counters cover the whole uint32_t range and a percentile is known to within 12.5%.
+ *
+ * Not thread-safe: all calls must come from the same task. */
+#define ESPNOW_RTT_SUB_BITS         3
+#define ESPNOW_RTT_BUCKETS          ((32 - ESPNOW_RTT_SUB_BITS + 1) << ESPNOW_RTT_SUB_BITS)
+#define ESPNOW_RTT_PEERS_MAX        4
+
+/* Payload of EXAMPLE_ESPNOW_DATA_PROBE and EXAMPLE_ESPNOW_DATA_ECHO frames. */
+typedef struct {
+    uint32_t id;                          //Probes sent to the device before this one.
+    int64_t sent_us;                      //esp_timer_get_time() of the prober when it sent the probe.
+} __attribute__((packed)) espnow_rtt_probe_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t sum_us;
+    uint32_t bucket[ESPNOW_RTT_BUCKETS];
+} espnow_rtt_hist_t;
+
+/* Transmit a probe carrying payload to mac. */
+typedef esp_err_t (*espnow_rtt_xmit_cb_t)(const uint8_t *mac, const uint8_t *payload, size_t len, void *arg);
+
+void espnow_rtt_hist_reset(espnow_rtt_hist_t *hist);
+
+void espnow_rtt_hist_record(espnow_rtt_hist_t *hist, uint32_t value_us);
+
+/* Upper bound of the bucket holding the given fraction of the values, in thousandths,
+ * but not above the largest value. 0 if the histogram is empty. */
+uint32_t espnow_rtt_hist_percentile(const espnow_rtt_hist_t *hist, uint32_t per_mille);
+
+/* Log the count, minimum, mean, p50, p99, p999 and maximum under name, and with
+ * buckets also the range and count of every bucket that is not empty. */
+void espnow_rtt_hist_log(const char *name, const espnow_rtt_hist_t *hist, bool buckets);
+
+void espnow_rtt_init(void);
+
+/* Stamp a probe for mac and transmit it. Returns ESP_ERR_NO_MEM when
+ * ESPNOW_RTT_PEERS_MAX other devices are probed already, or what xmit returned. */
+esp_err_t espnow_rtt_probe(const uint8_t *mac, espnow_rtt_xmit_cb_t xmit, void *arg);
+
+/* Record the round trip of the echo payload received from mac. Returns
+ * ESP_ERR_NOT_FOUND if mac was never probed and ESP_ERR_INVALID_ARG if the payload
+ * is not a probe sent to it. */
+esp_err_t espnow_rtt_on_echo(const uint8_t *mac, const uint8_t *payload, size_t len, int64_t now_us);
+
+/* Log the probes sent to and echoed by every device, and its histogram. */
+void espnow_rtt_dump(bool buckets);
+
+#endif
@@ -0,0 +1,99 @@
+/* ESPNOW Example - receive buffer pool
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdatomic.h>
+#include <assert.h>
+#include "espnow_rx_pool.h"
+
+/* The free list is a Treiber stack of slot indexes. The head word packs the
+ * index of the first free slot in the low 16 bits and a generation tag in the
+ * high 16 bits, so a slot that is claimed and released again between a load
+ * and the compare-exchange cannot be mistaken for the old head (ABA). */
+#define RX_POOL_HEAD(tag, idx) (((uint32_t)(tag) << 16) | (idx))
+#define RX_POOL_HEAD_IDX(head) ((uint16_t)((head) & 0xFFFF))
+#define RX_POOL_HEAD_TAG(head) ((uint16_t)((head) >> 16))
+
+_Static_assert(ESPNOW_RX_POOL_SIZE < ESPNOW_RX_POOL_INVALID_SLOT, "Receive pool too large");
+
+static uint8_t s_rx_pool_data[ESPNOW_RX_POOL_SIZE][ESPNOW_RX_POOL_SLOT_LEN];
+static _Atomic uint16_t s_rx_pool_next[ESPNOW_RX_POOL_SIZE];
+static _Atomic uint32_t s_rx_pool_head;
+
+static _Atomic uint32_t s_rx_pool_claimed;
+static _Atomic uint32_t s_rx_pool_released;
+static _Atomic uint32_t s_rx_pool_exhausted;
+static _Atomic uint32_t s_rx_pool_high_water;
+
+void espnow_rx_pool_init(void)
+{
+    for (uint16_t i = 0; i < ESPNOW_RX_POOL_SIZE; i++) {
+        atomic_store_explicit(&s_rx_pool_next[i],
+                              (i + 1 < ESPNOW_RX_POOL_SIZE) ? i + 1 : ESPNOW_RX_POOL_INVALID_SLOT,
+                              memory_order_relaxed);
+    }
+    atomic_store(&s_rx_pool_claimed, 0);
+    atomic_store(&s_rx_pool_released, 0);
+    atomic_store(&s_rx_pool_exhausted, 0);
+    atomic_store(&s_rx_pool_high_water, 0);
+    atomic_store(&s_rx_pool_head, RX_POOL_HEAD(0, 0));
+}
+
+uint16_t espnow_rx_pool_claim(void)
+{
+    uint32_t head = atomic_load_explicit(&s_rx_pool_head, memory_order_acquire);
+    uint32_t new_head;
+    uint16_t slot;
+
+    do {
+        slot = RX_POOL_HEAD_IDX(head);
+        if (slot == ESPNOW_RX_POOL_INVALID_SLOT) {
+            atomic_fetch_add_explicit(&s_rx_pool_exhausted, 1, memory_order_relaxed);
+            return ESPNOW_RX_POOL_INVALID_SLOT;
+        }
+        new_head = RX_POOL_HEAD(RX_POOL_HEAD_TAG(head) + 1,
+                                atomic_load_explicit(&s_rx_pool_next[slot], memory_order_relaxed));
+    } while (!atomic_compare_exchange_weak_explicit(&s_rx_pool_head, &head, new_head,
+                                                    memory_order_acquire, memory_order_acquire));
+
+    uint32_t claimed = atomic_fetch_add_explicit(&s_rx_pool_claimed, 1, memory_order_relaxed) + 1;
+    uint32_t in_use = claimed - atomic_load_explicit(&s_rx_pool_released, memory_order_relaxed);
+    uint32_t high_water = atomic_load_explicit(&s_rx_pool_high_water, memory_order_relaxed);
+    while (in_use > high_water && in_use <= ESPNOW_RX_POOL_SIZE &&
+           !atomic_compare_exchange_weak_explicit(&s_rx_pool_high_water, &high_water, in_use,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+    return slot;
+}
+
+uint8_t *espnow_rx_pool_data(uint16_t slot)
+{
+    assert(slot < ESPNOW_RX_POOL_SIZE);
+    return s_rx_pool_data[slot];
+}
+
+void espnow_rx_pool_release(uint16_t slot)
+{
+    assert(slot < ESPNOW_RX_POOL_SIZE);
+    uint32_t head = atomic_load_explicit(&s_rx_pool_head, memory_order_relaxed);
+
+    do {
+        atomic_store_explicit(&s_rx_pool_next[slot], RX_POOL_HEAD_IDX(head), memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak_explicit(&s_rx_pool_head, &head,
+                                                    RX_POOL_HEAD(RX_POOL_HEAD_TAG(head) + 1, slot),
+                                                    memory_order_release, memory_order_relaxed));
+    atomic_fetch_add_explicit(&s_rx_pool_released, 1, memory_order_relaxed);
+}
+
+void espnow_rx_pool_get_stats(espnow_rx_pool_stats_t *stats)
+{
+    stats->claimed = atomic_load_explicit(&s_rx_pool_claimed, memory_order_relaxed);
+    stats->released = atomic_load_explicit(&s_rx_pool_released, memory_order_relaxed);
+    stats->exhausted = atomic_load_explicit(&s_rx_pool_exhausted, memory_order_relaxed);
+    stats->high_water = atomic_load_explicit(&s_rx_pool_high_water, memory_order_relaxed);
+}
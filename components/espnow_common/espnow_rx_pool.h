@@ -0,0 +1,46 @@
+/* ESPNOW Example - receive buffer pool
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESPNOW_RX_POOL_H
+#define ESPNOW_RX_POOL_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_now.h"
+
+/* Received ESPNOW frames are copied into one of these preallocated slots in the
+ * WiFi task and handed to the ESPNOW task by slot index, so the receive path
+ * never calls malloc/free. Claim and release are lock-free and O(1), and may be
+ * called from any task. */
+#define ESPNOW_RX_POOL_SIZE         CONFIG_ESPNOW_RX_POOL_SIZE
+#define ESPNOW_RX_POOL_SLOT_LEN     ESP_NOW_MAX_DATA_LEN
+#define ESPNOW_RX_POOL_INVALID_SLOT 0xFFFF
+
+typedef struct {
+    uint32_t claimed;                     //Total number of slots handed out.
+    uint32_t released;                    //Total number of slots given back.
+    uint32_t exhausted;                   //Frames dropped because no slot was free.
+    uint32_t high_water;                  //Largest number of slots in use at the same time.
+} espnow_rx_pool_stats_t;
+
+/* Put every slot back on the free list and clear the counters. */
+void espnow_rx_pool_init(void);
+
+/* Take a free slot. Returns ESPNOW_RX_POOL_INVALID_SLOT if the pool is exhausted. */
+uint16_t espnow_rx_pool_claim(void);
+
+/* Data area of a claimed slot, ESPNOW_RX_POOL_SLOT_LEN bytes long. */
+uint8_t *espnow_rx_pool_data(uint16_t slot);
+
+/* Give a claimed slot back to the pool. */
+void espnow_rx_pool_release(uint16_t slot);
+
+void espnow_rx_pool_get_stats(espnow_rx_pool_stats_t *stats);
+
+#endif
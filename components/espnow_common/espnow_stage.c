@@ -0,0 +1,158 @@
+/* ESPNOW Example - receive pipeline stages
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_console.h"
+#include "esp_timer.h"
+#include "espnow_stage.h"
+
+#if CONFIG_ESPNOW_STAGE_STATS
+static const char *const s_stage_names[ESPNOW_STAGE_MAX] = {
+    "ingest", "handle",
+};
+
+static portMUX_TYPE s_stage_lock = portMUX_INITIALIZER_UNLOCKED;
+static espnow_stage_report_t s_stage;
+static int64_t s_stage_since_us;
+
+/* Called with the lock held. */
+static void stage_add(espnow_stage_t stage, int64_t start_us, int64_t end_us)
+{
+    espnow_stage_stats_t *stats = &s_stage.stage[stage];
+    uint32_t run_us = (uint32_t)(end_us - start_us);
+
+    stats->runs++;
+    stats->busy_us += run_us;
+    if (run_us > stats->max_us) {
+        stats->max_us = run_us;
+    }
+    stats->cores |= 1U << xPortGetCoreID();
+}
+#endif
+
+void espnow_stage_reset(void)
+{
+#if CONFIG_ESPNOW_STAGE_STATS
+    taskENTER_CRITICAL(&s_stage_lock);
+    memset(s_stage.stage, 0, sizeof(s_stage.stage));
+    espnow_rtt_hist_reset(&s_stage.handoff);
+    espnow_rtt_hist_reset(&s_stage.end_to_end);
+    s_stage_since_us = esp_timer_get_time();
+    taskEXIT_CRITICAL(&s_stage_lock);
+#endif
+}
+
+void espnow_stage_end(espnow_stage_t stage, int64_t start_us)
+{
+#if CONFIG_ESPNOW_STAGE_STATS
+    int64_t now = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&s_stage_lock);
+    stage_add(stage, start_us, now);
+    taskEXIT_CRITICAL(&s_stage_lock);
+#endif
+}
+
+void espnow_stage_batch(const example_espnow_event_t *evts, int num, int64_t start_us)
+{
+#if CONFIG_ESPNOW_STAGE_STATS
+    int64_t now = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&s_stage_lock);
+    stage_add(ESPNOW_STAGE_HANDLE, start_us, now);
+    for (int i = 0; i < num; i++) {
+        espnow_rtt_hist_record(&s_stage.handoff, (uint32_t)start_us - evts[i].time_us);
+        espnow_rtt_hist_record(&s_stage.end_to_end, (uint32_t)now - evts[i].time_us);
+    }
+    taskEXIT_CRITICAL(&s_stage_lock);
+#endif
+}
+
+void espnow_stage_get_report(espnow_stage_report_t *report)
+{
+#if CONFIG_ESPNOW_STAGE_STATS
+    int64_t now = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&s_stage_lock);
+    *report = s_stage;
+    report->elapsed_us = now - s_stage_since_us;
+    taskEXIT_CRITICAL(&s_stage_lock);
+#else
+    memset(report, 0, sizeof(espnow_stage_report_t));
+#endif
+}
+
+#if CONFIG_ESPNOW_STAGE_STATS
+static void stage_print_latency(const char *name, const espnow_rtt_hist_t *hist)
+{
+    if (hist->count == 0) {
+        printf("%-10s no events\n", name);
+        return;
+    }
+    printf("%-10s %lu events, mean %lu us, p50 %lu us, p99 %lu us, p999 %lu us, max %lu us\n", name,
+           (unsigned long)hist->count, (unsigned long)(hist->sum_us / hist->count),
+           (unsigned long)espnow_rtt_hist_percentile(hist, 500), (unsigned long)espnow_rtt_hist_percentile(hist, 990),
+           (unsigned long)espnow_rtt_hist_percentile(hist, 999), (unsigned long)hist->max_us);
+}
+#endif
+
+static int stage_cmd(int argc, char **argv)
+{
+    if (argc == 2 && strcmp(argv[1], "reset") == 0) {
+        espnow_stage_reset();
+        return 0;
+    }
+    if (argc != 1) {
+        printf("usage: stages [reset]\n");
+        return 1;
+    }
+#if !CONFIG_ESPNOW_STAGE_STATS
+    printf("stage statistics disabled, see CONFIG_ESPNOW_STAGE_STATS\n");
+    return 0;
+#else
+    /* Too large for the stack of the console task; only that task runs the command. */
+    static espnow_stage_report_t report;
+
+    espnow_stage_get_report(&report);
+    printf("%-10s %-6s %10s %9s %9s %7s\n", "stage", "cores", "runs", "mean_us", "max_us", "busy");
+    for (int i = 0; i < ESPNOW_STAGE_MAX; i++) {
+        const espnow_stage_stats_t *stats = &report.stage[i];
+        char cores[2 * portNUM_PROCESSORS + 1] = "-";
+        int pos = 0;
+
+        for (int core = 0; core < portNUM_PROCESSORS; core++) {
+            if (stats->cores & (1U << core)) {
+                pos += snprintf(cores + pos, sizeof(cores) - pos, "%s%d", pos > 0 ? "," : "", core);
+            }
+        }
+        printf("%-10s %-6s %10lu %9.1f %9lu %6.1f%%\n", s_stage_names[i], cores, (unsigned long)stats->runs,
+               stats->runs > 0 ? (double)stats->busy_us / stats->runs : 0.0, (unsigned long)stats->max_us,
+               report.elapsed_us > 0 ? 100.0 * stats->busy_us / report.elapsed_us : 0.0);
+    }
+    stage_print_latency("handoff", &report.handoff);
+    stage_print_latency("end2end", &report.end_to_end);
+    return 0;
+#endif
+}
+
+esp_err_t espnow_stage_register_cmd(void)
+{
+    const esp_console_cmd_t cmd = {
+        .command = "stages",
+        .help = "Print the time spent in each stage of the ESPNOW receive pipeline, the cores it ran on and the "
+                "latency of events through it, or clear them with 'stages reset'",
+        .hint = "[reset]",
+        .func = stage_cmd,
+    };
+
+    return esp_console_cmd_register(&cmd);
+}
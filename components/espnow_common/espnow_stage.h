@@ -0,0 +1,70 @@
+/* ESPNOW Example - receive pipeline stages
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESPNOW_STAGE_H
+#define ESPNOW_STAGE_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_now.h"
+#include "espnow_example.h"
+#include "espnow_rtt.h"
+
+/* Time spent in each stage of the receive pipeline, and the latency of events
+ * through it. The ESPNOW callbacks ingest frames in the WiFi task: they copy the
+ * data and hand an event over to the ESPNOW task, which parses and handles a batch
+ * of events, runs the application and sends the replies. CONFIG_ESPNOW_TASK_CORE
+ * decides whether both stages share the WiFi core.
+ *
+ * Every run of a stage adds the time from its start to its end, blocking on a full
+ * event queue included, and marks the core it ended on; its busy time over the time
+ * since the last reset is the share of one core it took. Every event handled also
+ * records, in espnow_rtt histograms, its handoff latency from the callback to the
+ * start of its batch, and its end-to-end latency to the end of the batch, once the
+ * replies are sent. Times come from esp_timer_get_time(), whose microsecond steps
+ * average out over many runs. Without CONFIG_ESPNOW_STAGE_STATS nothing is recorded.
+ *
+ * Thread-safe: every update takes a short critical section. */
+typedef enum {
+    ESPNOW_STAGE_INGEST,                  //ESPNOW callbacks in the WiFi task.
+    ESPNOW_STAGE_HANDLE,                  //ESPNOW task: parse, dispatch, application and replies.
+    ESPNOW_STAGE_MAX,
+} espnow_stage_t;
+
+typedef struct {
+    uint32_t runs;                        //Callbacks, or wakeups of the ESPNOW task.
+    uint32_t max_us;                      //Longest run.
+    uint64_t busy_us;
+    uint32_t cores;                       //Bit n is set once a run has ended on core n.
+} espnow_stage_stats_t;
+
+typedef struct {
+    int64_t elapsed_us;                   //Time since the last reset.
+    espnow_stage_stats_t stage[ESPNOW_STAGE_MAX];
+    espnow_rtt_hist_t handoff;            //From the callback to the start of the batch.
+    espnow_rtt_hist_t end_to_end;         //From the callback to the end of the batch.
+} espnow_stage_report_t;
+
+/* Clear the statistics; the busy share is relative to the time since. */
+void espnow_stage_reset(void);
+
+/* End of a run of stage that started at start_us, from esp_timer_get_time(). */
+void espnow_stage_end(espnow_stage_t stage, int64_t start_us);
+
+/* End of a wakeup of the ESPNOW task that started at start_us and handled the num
+ * events evts: a run of ESPNOW_STAGE_HANDLE, and the latencies of the events. */
+void espnow_stage_batch(const example_espnow_event_t *evts, int num, int64_t start_us);
+
+void espnow_stage_get_report(espnow_stage_report_t *report);
+
+/* Register the "stages" console command, which prints the statistics, or with
+ * "stages reset" clears them. */
+esp_err_t espnow_stage_register_cmd(void);
+
+#endif
@@ -0,0 +1,59 @@
+#!/bin/sh
+# Benchmark bulk transfers of an image over a lossy link.
+#
+# usage: bench_bulk.sh WORK_DIR [SIZE_KB] [LOSSES] [WINDOWS] [DURATION_S]
+#
+# Builds the examples once per window with CONFIG_ESPNOW_BULK_ENABLE on the
+# master and CONFIG_ESPNOW_BULK_RX_ENABLE on the slave, writes a random image
+# of SIZE_KB to the master's "bulk" partition, then lets the master push it to
+# one slave's "ota_0" partition for every loss percentage. Frames are not
+# retried by the simulated MAC unless ESPNOW_SIM_RETRIES says otherwise, so
+# every loss reaches the bulk transfer. Prints the master's throughput and
+# checks that the slave's partition holds the image.
+set -e
+
+WORK_DIR=${1:?usage: bench_bulk.sh WORK_DIR [SIZE_KB] [LOSSES] [WINDOWS] [DURATION_S]}
+SIZE_KB=${2:-4096}
+LOSSES=${3:-"0 5 10 20"}
+WINDOWS=${4:-"8 32"}
+DURATION=${5:-300}
+HOST_DIR=$(cd "$(dirname "$0")" && pwd)
+
+mkdir -p "$WORK_DIR"
+WORK_DIR=$(cd "$WORK_DIR" && pwd)
+IMAGE=$WORK_DIR/image.bin
+head -c $((SIZE_KB * 1024)) /dev/urandom > "$IMAGE"
+
+for window in $WINDOWS; do
+    build=$WORK_DIR/window$window
+    cat > "$WORK_DIR/window$window.defaults" <<EOF
+CONFIG_ESPNOW_BULK_ENABLE=y
+CONFIG_ESPNOW_BULK_WINDOW=$window
+CONFIG_ESPNOW_BULK_RX_ENABLE=y
+CONFIG_ESPNOW_SEND_COUNT=65535
+CONFIG_ESPNOW_DISCOVERY_RETRIES=5
+EOF
+    cmake -S "$HOST_DIR" -B "$build" -DESPNOW_HOST_SDKCONFIG_DEFAULTS="$WORK_DIR/window$window.defaults" > /dev/null
+    cmake --build "$build" --target espnow_m espnow_s > /dev/null 2>&1
+
+    for loss in $LOSSES; do
+        run=$build/loss$loss
+        mkdir -p "$run/flash/node0" "$run/flash/node1"
+        cp "$IMAGE" "$run/flash/node0/bulk.bin"
+        head -c $(((SIZE_KB + 1023) / 1024 * 1024 * 1024)) /dev/zero > "$run/flash/node1/ota_0.bin"
+
+        export ESPNOW_SIM_NODES=2 ESPNOW_SIM_DURATION=$DURATION ESPNOW_SIM_LOSS=$loss
+        export ESPNOW_SIM_RETRIES=${ESPNOW_SIM_RETRIES:-0} ESPNOW_SIM_FLASH_DIR=$run/flash
+        ESPNOW_SIM_NODE=0 "$build/espnow_m" > "$run/node0.log" 2>&1 &
+        ESPNOW_SIM_NODE=1 "$build/espnow_s" > "$run/node1.log" 2>&1
+        wait
+
+        pushed=$(grep -h "Pushed " "$run/node0.log" | sed 's/.*Pushed //' | head -n 1)
+        if head -c $((SIZE_KB * 1024)) "$run/flash/node1/ota_0.bin" | cmp -s - "$IMAGE"; then
+            check="image intact"
+        else
+            check="image differs"
+        fi
+        echo "window $window, loss $loss%: ${pushed:-not done}; $check"
+    done
+done
@@ -0,0 +1,49 @@
+#!/bin/sh
+# Benchmark fragmented messages of several sizes.
+#
+# usage: bench_frag.sh WORK_DIR [COUNT] [SIZES_KB] [WINDOWS] [DURATION_S]
+#
+# Builds the examples once per message size and send window with
+# CONFIG_ESPNOW_FRAG_ENABLE, then lets two slaves find each other and one of
+# them send COUNT messages to the other. Any ESPNOW_SIM_* variable set in the
+# environment applies to both nodes. Prints the sender's throughput and the
+# number of messages reassembled by the receiver for every size and window.
+set -e
+
+WORK_DIR=${1:?usage: bench_frag.sh WORK_DIR [COUNT] [SIZES_KB] [WINDOWS] [DURATION_S]}
+COUNT=${2:-10}
+SIZES=${3:-"1 2 4 8 16 32 64"}
+WINDOWS=${4:-"1 16"}
+DURATION=${5:-20}
+HOST_DIR=$(cd "$(dirname "$0")" && pwd)
+
+mkdir -p "$WORK_DIR"
+WORK_DIR=$(cd "$WORK_DIR" && pwd)
+
+for size in $SIZES; do
+    for window in $WINDOWS; do
+        name=size${size}k_window$window
+        build=$WORK_DIR/$name
+        cat > "$WORK_DIR/$name.defaults" <<EOF
+CONFIG_ESPNOW_FRAG_ENABLE=y
+CONFIG_ESPNOW_FRAG_MSG_LEN=$((size * 1024))
+CONFIG_ESPNOW_FRAG_MAX_LEN=65536
+CONFIG_ESPNOW_FRAG_POOL_SIZE=131072
+CONFIG_ESPNOW_SEND_WINDOW=$window
+CONFIG_ESPNOW_SEND_COUNT=$COUNT
+CONFIG_ESPNOW_SEND_DELAY=0
+CONFIG_ESPNOW_DISCOVERY_RETRIES=5
+EOF
+        cmake -S "$HOST_DIR" -B "$build" -DESPNOW_HOST_SDKCONFIG_DEFAULTS="$WORK_DIR/$name.defaults" > /dev/null
+        cmake --build "$build" --target espnow_s > /dev/null
+
+        export ESPNOW_SIM_NODES=2 ESPNOW_SIM_DURATION=$DURATION
+        ESPNOW_SIM_NODE=0 "$build/espnow_s" > "$build/node0.log" 2>&1 &
+        ESPNOW_SIM_NODE=1 "$build/espnow_s" > "$build/node1.log" 2>&1
+        wait
+
+        sent=$(grep -h "Sent .* messages of" "$build"/node*.log | sed 's/.*Sent //' | head -n 1)
+        received=$(grep -h "Reassembled" "$build"/node*.log | wc -l)
+        echo "${size} KB, window $window: ${sent:-not done}; $received reassembled"
+    done
+done
@@ -0,0 +1,48 @@
+#!/bin/sh
+# Deferred logging benchmark: send window throughput with a slow UART console.
+#
+# usage: bench_log.sh WORK_DIR [BAUDS] [COUNT]
+#
+# Builds the slave with CONFIG_ESPNOW_SEND_WINDOW_BENCH, once with
+# CONFIG_ESPNOW_DLOG_DEFERRED and once without, and runs two slaves, one of
+# which sends COUNT frames for every window size to the other. Every frame is
+# logged by the sender and by the receiver. For every console baud rate (0 for
+# none) prints frames/s for every window size and the log records dropped.
+# Any other ESPNOW_SIM_* variable set in the environment applies to both nodes.
+set -e
+
+WORK_DIR=${1:?usage: bench_log.sh WORK_DIR [BAUDS] [COUNT]}
+BAUDS=${2:-"115200 0"}
+COUNT=${3:-500}
+HOST_DIR=$(cd "$(dirname "$0")" && pwd)
+
+mkdir -p "$WORK_DIR"
+WORK_DIR=$(cd "$WORK_DIR" && pwd)
+
+for deferred in y n; do
+    build=$WORK_DIR/deferred_$deferred
+    cat > "$build.defaults" <<EOF2
+CONFIG_ESPNOW_SEND_WINDOW_BENCH=y
+CONFIG_ESPNOW_SEND_COUNT=$COUNT
+CONFIG_ESPNOW_DISCOVERY_RETRIES=5
+CONFIG_ESPNOW_DLOG_DEFERRED=$deferred
+EOF2
+    cmake -S "$HOST_DIR" -B "$build" -DESPNOW_HOST_SDKCONFIG_DEFAULTS="$build.defaults" > /dev/null
+    cmake --build "$build" --target espnow_s > /dev/null 2>&1
+done
+
+for baud in $BAUDS; do
+    for deferred in y n; do
+        log_dir=$WORK_DIR/baud${baud}_deferred_$deferred
+        mkdir -p "$log_dir"
+        # Sixteen windows of COUNT frames at no less than 100 frames/s, and the discovery.
+        export ESPNOW_SIM_NODES=2 ESPNOW_SIM_DURATION=$((COUNT * 16 / 100 + 10)) ESPNOW_SIM_UART_BAUD=$baud
+        ESPNOW_SIM_NODE=1 "$WORK_DIR/deferred_$deferred/espnow_s" > "$log_dir/node1.log" 2>&1 &
+        ESPNOW_SIM_NODE=0 "$WORK_DIR/deferred_$deferred/espnow_s" > "$log_dir/node0.log" 2>&1
+        wait
+
+        echo "baud $baud, deferred $deferred:"
+        echo "    frames/s:" $(grep -h "Window" "$log_dir"/node*.log | sed 's/.* \([0-9]*\) frames\/s.*/\1/')
+        echo "    dropped:" $(grep -h "log records dropped" "$log_dir"/node*.log | awk '{ n += $4 } END { print n + 0 }')
+    done
+done
@@ -0,0 +1,72 @@
+#!/bin/sh
+# Benchmark multicast distribution of an image to many slaves over a lossy link.
+#
+# usage: bench_mcast.sh WORK_DIR [SIZE_KB] [NODES] [LOSSES] [DURATION_S]
+#
+# Builds the examples once with CONFIG_ESPNOW_MCAST_ENABLE on the master and
+# CONFIG_ESPNOW_BULK_RX_ENABLE on the slaves, writes a random image of SIZE_KB
+# to the master's "bulk" partition, then for every node count and loss
+# percentage runs the master as node 0 and the other nodes as slaves, each
+# receiving the image into its "ota_0" partition. Any other ESPNOW_SIM_*
+# variable set in the environment applies to every node. Prints the master's
+# result line and the number of slaves whose partition holds the image.
+set -e
+
+WORK_DIR=${1:?usage: bench_mcast.sh WORK_DIR [SIZE_KB] [NODES] [LOSSES] [DURATION_S]}
+SIZE_KB=${2:-256}
+NODES=${3:-"2 10 50"}
+LOSSES=${4:-"5 10 20"}
+DURATION=${5:-60}
+HOST_DIR=$(cd "$(dirname "$0")" && pwd)
+
+mkdir -p "$WORK_DIR"
+WORK_DIR=$(cd "$WORK_DIR" && pwd)
+IMAGE=$WORK_DIR/image.bin
+head -c $((SIZE_KB * 1024)) /dev/urandom > "$IMAGE"
+
+build=$WORK_DIR/build
+cat > "$WORK_DIR/mcast.defaults" <<EOF
+CONFIG_ESPNOW_MCAST_ENABLE=y
+CONFIG_ESPNOW_MCAST_START_DELAY=10000
+CONFIG_ESPNOW_BULK_RX_ENABLE=y
+CONFIG_ESPNOW_SEND_COUNT=65535
+CONFIG_ESPNOW_DISCOVERY_RETRIES=5
+CONFIG_ESPNOW_RX_POOL_SIZE=64
+EOF
+cmake -S "$HOST_DIR" -B "$build" -DESPNOW_HOST_SDKCONFIG_DEFAULTS="$WORK_DIR/mcast.defaults" > /dev/null
+cmake --build "$build" --target espnow_m espnow_s > /dev/null 2>&1
+
+for nodes in $NODES; do
+    for loss in $LOSSES; do
+        run=$WORK_DIR/nodes${nodes}_loss$loss
+        mkdir -p "$run/flash/node0"
+        cp "$IMAGE" "$run/flash/node0/bulk.bin"
+        node=1
+        while [ $node -lt "$nodes" ]; do
+            mkdir -p "$run/flash/node$node"
+            head -c $(((SIZE_KB + 1023) / 1024 * 1024 * 1024)) /dev/zero > "$run/flash/node$node/ota_0.bin"
+            node=$((node + 1))
+        done
+
+        export ESPNOW_SIM_NODES=$nodes ESPNOW_SIM_DURATION=$DURATION ESPNOW_SIM_LOSS=$loss
+        export ESPNOW_SIM_FLASH_DIR=$run/flash
+        node=1
+        while [ $node -lt "$nodes" ]; do
+            ESPNOW_SIM_NODE=$node "$build/espnow_s" > "$run/node$node.log" 2>&1 &
+            node=$((node + 1))
+        done
+        ESPNOW_SIM_NODE=0 "$build/espnow_m" > "$run/node0.log" 2>&1
+        wait
+
+        result=$(grep -h "Multicast .* ms and" "$run/node0.log" | sed 's/.*Multicast //' | head -n 1)
+        intact=0
+        node=1
+        while [ $node -lt "$nodes" ]; do
+            if head -c $((SIZE_KB * 1024)) "$run/flash/node$node/ota_0.bin" | cmp -s - "$IMAGE"; then
+                intact=$((intact + 1))
+            fi
+            node=$((node + 1))
+        done
+        echo "$nodes nodes, loss $loss%: ${result:-not done}; $intact of $((nodes - 1)) slaves intact"
+    done
+done
@@ -0,0 +1,47 @@
+#!/bin/sh
+# Benchmark reliable unicast under simulated frame loss.
+#
+# usage: bench_reliable.sh WORK_DIR [COUNT] [LOSSES] [WINDOWS] [DURATION_S]
+#
+# Builds the examples once per send window with CONFIG_ESPNOW_RELIABLE, then,
+# for every loss rate, lets two slaves find each other and one of them send
+# COUNT frames to the other. The driver's own retransmissions are disabled
+# (ESPNOW_SIM_RETRIES=0) so every loss has to be repaired by the reliable
+# layer. Every run lasts DURATION_S. Prints one line per window and loss rate.
+set -e
+
+WORK_DIR=${1:?usage: bench_reliable.sh WORK_DIR [COUNT] [LOSSES] [WINDOWS] [DURATION_S]}
+COUNT=${2:-500}
+LOSSES=${3:-"1 5 10 20 30"}
+WINDOWS=${4:-"1 16"}
+DURATION=${5:-20}
+HOST_DIR=$(cd "$(dirname "$0")" && pwd)
+
+mkdir -p "$WORK_DIR"
+WORK_DIR=$(cd "$WORK_DIR" && pwd)
+
+for window in $WINDOWS; do
+    build=$WORK_DIR/window$window
+    cat > "$WORK_DIR/window$window.defaults" <<EOF
+CONFIG_ESPNOW_RELIABLE=y
+CONFIG_ESPNOW_SEND_WINDOW=$window
+CONFIG_ESPNOW_SEND_COUNT=$COUNT
+CONFIG_ESPNOW_SEND_DELAY=0
+CONFIG_ESPNOW_DISCOVERY_RETRIES=5
+EOF
+    cmake -S "$HOST_DIR" -B "$build" -DESPNOW_HOST_SDKCONFIG_DEFAULTS="$WORK_DIR/window$window.defaults" > /dev/null
+    cmake --build "$build" --target espnow_s > /dev/null
+
+    for loss in $LOSSES; do
+        log_dir=$build/loss$loss
+        mkdir -p "$log_dir"
+        export ESPNOW_SIM_NODES=2 ESPNOW_SIM_DURATION=$DURATION ESPNOW_SIM_LOSS=$loss ESPNOW_SIM_RETRIES=0
+        ESPNOW_SIM_NODE=0 "$build/espnow_s" > "$log_dir/node0.log" 2>&1 &
+        ESPNOW_SIM_NODE=1 "$build/espnow_s" > "$log_dir/node1.log" 2>&1
+        wait
+
+        stats=$(grep -h "espnow_reliable:" "$log_dir"/node*.log | sed 's/.*espnow_reliable: //')
+        elapsed=$(grep -h "Send done in" "$log_dir"/node*.log | sed 's/.*Send done in //')
+        echo "window $window, loss $loss%: ${elapsed:-not done}: $stats"
+    done
+done
@@ -0,0 +1,53 @@
+#!/bin/sh
+# Benchmark the round trip time of probes echoed by the master.
+#
+# usage: bench_rtt.sh WORK_DIR [TICK_RATES] [SLAVES] [COUNT] [DELAY_MS]
+#
+# Builds the examples once per FreeRTOS tick rate with CONFIG_ESPNOW_RTT_PROBE
+# on the slaves, then for every slave count runs the master as node 0 and the
+# slaves as the other nodes, each sending COUNT probes DELAY_MS apart to the
+# master. More slaves mean more frames queued ahead of every echo. Any other
+# ESPNOW_SIM_* variable set in the environment applies to every node. Prints
+# the round trip and probe lateness histograms of every slave.
+set -e
+
+WORK_DIR=${1:?usage: bench_rtt.sh WORK_DIR [TICK_RATES] [SLAVES] [COUNT] [DELAY_MS]}
+TICK_RATES=${2:-"100 1000"}
+SLAVES=${3:-"1 8"}
+COUNT=${4:-1000}
+DELAY=${5:-15}
+HOST_DIR=$(cd "$(dirname "$0")" && pwd)
+DURATION=$((COUNT * DELAY / 1000 + 10))
+
+mkdir -p "$WORK_DIR"
+WORK_DIR=$(cd "$WORK_DIR" && pwd)
+
+for hz in $TICK_RATES; do
+    build=$WORK_DIR/hz$hz
+    cat > "$WORK_DIR/hz$hz.defaults" <<EOF
+CONFIG_FREERTOS_HZ=$hz
+CONFIG_ESPNOW_RTT_PROBE=y
+CONFIG_ESPNOW_RTT_DUMP_GPIO=-1
+CONFIG_ESPNOW_SEND_COUNT=$COUNT
+CONFIG_ESPNOW_SEND_DELAY=$DELAY
+CONFIG_ESPNOW_DISCOVERY_RETRIES=5
+EOF
+    cmake -S "$HOST_DIR" -B "$build" -DESPNOW_HOST_SDKCONFIG_DEFAULTS="$WORK_DIR/hz$hz.defaults" > /dev/null
+    cmake --build "$build" --target espnow_m espnow_s > /dev/null 2>&1
+
+    for slaves in $SLAVES; do
+        log_dir=$build/slaves$slaves
+        mkdir -p "$log_dir"
+        export ESPNOW_SIM_NODES=$((slaves + 1)) ESPNOW_SIM_DURATION=$DURATION
+        node=1
+        while [ $node -le "$slaves" ]; do
+            ESPNOW_SIM_NODE=$node "$build/espnow_s" > "$log_dir/node$node.log" 2>&1 &
+            node=$((node + 1))
+        done
+        ESPNOW_SIM_NODE=0 "$build/espnow_m" > "$log_dir/node0.log" 2>&1
+        wait
+
+        echo "tick $hz Hz, $slaves slaves:"
+        grep -h "espnow_rtt: \(RTT to\|Round trip:\|Probe lateness:\)" "$log_dir"/node*.log | sed 's/.*espnow_rtt: /    /'
+    done
+done
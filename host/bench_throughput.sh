@@ -0,0 +1,54 @@
+#!/bin/sh
+# Throughput benchmark: the acceptance test for builds and radio settings.
+#
+# usage: bench_throughput.sh WORK_DIR [LEN] [RATES] [BITRATES] [LOSSES] [DURATION_S]
+#
+# Builds the slave as benchmark sender and the master as benchmark receiver,
+# with frames of LEN bytes. For every rate in frames/s (0 for as fast as
+# ESPNOW takes them), PHY bit rate and loss percentage, runs the master as
+# node 0 and the slave as node 1, which floods the master for DURATION_S once
+# it has answered. A bit rate of 250000 stands in for long range. Any other
+# ESPNOW_SIM_* variable set in the environment applies to both nodes. Prints
+# the summary of the sender and of the receiver.
+set -e
+
+WORK_DIR=${1:?usage: bench_throughput.sh WORK_DIR [LEN] [RATES] [BITRATES] [LOSSES] [DURATION_S]}
+LEN=${2:-250}
+RATES=${3:-"0 100"}
+BITRATES=${4:-"1000000 250000"}
+LOSSES=${5:-"0 10"}
+DURATION=${6:-10}
+HOST_DIR=$(cd "$(dirname "$0")" && pwd)
+
+mkdir -p "$WORK_DIR"
+WORK_DIR=$(cd "$WORK_DIR" && pwd)
+
+for rate in $RATES; do
+    for role in sender receiver; do
+        build=$WORK_DIR/rate${rate}_$role
+        role_config=$(echo $role | tr a-z A-Z)
+        cat > "$build.defaults" <<EOF
+CONFIG_ESPNOW_BENCH_$role_config=y
+CONFIG_ESPNOW_BENCH_RATE=$rate
+CONFIG_ESPNOW_BENCH_DURATION=$DURATION
+CONFIG_ESPNOW_SEND_LEN=$LEN
+CONFIG_ESPNOW_DISCOVERY_RETRIES=5
+EOF
+        cmake -S "$HOST_DIR" -B "$build" -DESPNOW_HOST_SDKCONFIG_DEFAULTS="$build.defaults" > /dev/null
+        cmake --build "$build" --target espnow_m espnow_s > /dev/null 2>&1
+    done
+
+    for bitrate in $BITRATES; do
+        for loss in $LOSSES; do
+            log_dir=$WORK_DIR/rate${rate}_bitrate${bitrate}_loss$loss
+            mkdir -p "$log_dir"
+            export ESPNOW_SIM_NODES=2 ESPNOW_SIM_DURATION=$((DURATION + 10)) ESPNOW_SIM_BITRATE=$bitrate ESPNOW_SIM_LOSS=$loss
+            ESPNOW_SIM_NODE=1 "$WORK_DIR/rate${rate}_sender/espnow_s" > "$log_dir/node1.log" 2>&1 &
+            ESPNOW_SIM_NODE=0 "$WORK_DIR/rate${rate}_receiver/espnow_m" > "$log_dir/node0.log" 2>&1
+            wait
+
+            echo "rate $rate, $bitrate bit/s, loss $loss%:"
+            grep -h "espnow_bench: Bench" "$log_dir/node1.log" "$log_dir/node0.log" | sed 's/.*espnow_bench: /    /'
+        done
+    done
+done
@@ -0,0 +1,1016 @@
+/* ESPNOW discovery handshake - discrete-event RF simulator
+
+   Runs the handshake decisions of espnow_handshake.c for one master and N slaves
+   on a single shared channel and reports, for every N, how long discovery takes,
+   how many transmissions collide and the unicast goodput of every node.
+
+   Model:
+     * Channel access follows 802.11 DCF: DIFS, a random backoff of [0, CW] slots
+       that freezes while the medium is busy, binary exponential CW growth on
+       unicast retries. Transmissions that start within one slot of each other
+       cannot sense each other and collide; collided frames are lost for every
+       receiver (no capture). Every node hears every other node.
+     * Airtime uses the PHY timing of the selected rate: DSSS/CCK with the long
+       preamble for 1 to 11 Mbps, OFDM for 6 to 54 Mbps. The LR rates use DSSS
+       timing with the long preamble, which is an assumption.
+     * Unicast frames are acknowledged after SIFS and retried up to the retry
+       limit. Broadcast frames are sent once.
+     * Each node runs the example's task model: callbacks post events into a
+       queue of ESPNOW_QUEUE_SIZE entries that the ESPNOW task handles one at a
+       time. When the queue is full the Wi-Fi task blocks for up to
+       ESPNOW_MAXDELAY ticks and the node drops everything it receives meanwhile.
+       The master's task starts after its initial 5 s delay.
+     * Peers are added as the examples do. The master shares its peer list among
+       any number of devices (espnow_peer_slots.c) and answers every device. A
+       slave adds every device it hears, encrypted, and a device that does not
+       fit into its peer list gets no unicast session. --peer-full abort models
+       the older examples, which stopped in ESP_ERROR_CHECK on a full list.
+
+   A slave counts as discovered when it receives the master's unicast reply.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "espnow_handshake.h"
+
+#define DES_MAX_NODES           1024
+#define DES_TX_QUEUE_LEN        16
+#define DES_TASK_QUEUE_LEN      ESPNOW_QUEUE_SIZE
+#define DES_WIFI_BLOCK_NS       (512 * 10 * 1000000LL)      //ESPNOW_MAXDELAY at 100 Hz.
+#define DES_FRAME_OVERHEAD      43                          //MAC header, ESPNOW vendor element and FCS.
+#define DES_ACK_BYTES           14
+#define DES_HDR_LEN             ((int)sizeof(example_espnow_data_t))
+#define DES_BROADCAST_LEN       (DES_HDR_LEN + (int)sizeof("first broadcast"))
+#define DES_REPLY_LEN           (DES_HDR_LEN + (int)sizeof("hello_master"))
+#define DES_UNICAST_LEN         (DES_HDR_LEN + (int)sizeof("hello"))
+#define DES_MASTER              0
+#define DES_BROADCAST           (-1)
+#define DES_MAX_PEERS           ESP_NOW_MAX_TOTAL_PEER_NUM
+
+#define US(x)                   ((int64_t)(x) * 1000)
+#define MS(x)                   ((int64_t)(x) * 1000000)
+
+typedef struct {
+    const char *name;
+    uint32_t rate_kbps;
+    bool ofdm;
+    uint32_t preamble_us;
+    uint32_t slot_us;
+    uint32_t sifs_us;
+    uint32_t cw_min;
+    uint32_t cw_max;
+    uint32_t ack_rate_kbps;
+} des_phy_t;
+
+static const des_phy_t s_phys[] = {
+    { "1m",     1000,  false, 192, 20, 10, 31, 1023, 1000 },
+    { "2m",     2000,  false, 192, 20, 10, 31, 1023, 2000 },
+    { "5.5m",   5500,  false, 192, 20, 10, 31, 1023, 2000 },
+    { "11m",    11000, false, 192, 20, 10, 31, 1023, 2000 },
+    { "6m",     6000,  true,  20,  9,  10, 15, 1023, 6000 },
+    { "12m",    12000, true,  20,  9,  10, 15, 1023, 12000 },
+    { "24m",    24000, true,  20,  9,  10, 15, 1023, 24000 },
+    { "54m",    54000, true,  20,  9,  10, 15, 1023, 24000 },
+    { "lr512k", 512,   false, 192, 20, 10, 31, 1023, 512 },
+    { "lr256k", 256,   false, 192, 20, 10, 31, 1023, 256 },
+};
+
+typedef struct {
+    const des_phy_t *phy;
+    int64_t duration_ns;
+    uint64_t seed;
+    int64_t boot_spread_ns;
+    int64_t master_start_ns;
+    int64_t master_service_ns;
+    int64_t slave_service_ns;
+    uint32_t retries;                     //Discovery broadcast retries.
+    uint32_t backoff_ms;
+    uint32_t retry_limit;                 //Unicast retransmissions.
+    uint32_t send_count;
+    int64_t send_delay_ns;
+    int64_t report_interval_ns;
+    int report_len;
+    double loss;
+    bool abort_on_full;
+    bool csv;
+} des_config_t;
+
+typedef enum {
+    DES_FRAME_HANDSHAKE,                  //Discovery broadcast or the master's reply.
+    DES_FRAME_UNICAST,                    //Unicast data of a handshake session.
+    DES_FRAME_REPORT,                     //Periodic report to the master, see --report-interval.
+} des_frame_kind_t;
+
+typedef struct {
+    int src;
+    int dst;                              //Node index or DES_BROADCAST.
+    uint8_t type;                         //EXAMPLE_ESPNOW_DATA_*.
+    uint8_t state;
+    uint32_t magic;
+    int len;
+    des_frame_kind_t kind;
+} des_frame_t;
+
+typedef enum {
+    DES_APP_RECV,
+    DES_APP_SEND_CB,
+} des_app_event_id_t;
+
+typedef struct {
+    des_app_event_id_t id;
+    des_frame_t frame;
+    bool success;
+} des_app_event_t;
+
+typedef enum {
+    DES_MAC_IDLE,
+    DES_MAC_BACKOFF,                      //Counting down, an access event is scheduled.
+    DES_MAC_FROZEN,                       //Waiting for the medium to become idle.
+    DES_MAC_TX,
+} des_mac_state_t;
+
+typedef struct {
+    bool booted;
+    bool dead;                            //Aborted or finished (deinit) node.
+    int64_t boot_ns;
+
+    /* MAC layer. */
+    des_frame_t txq[DES_TX_QUEUE_LEN];
+    int txq_head;
+    int txq_count;
+    des_mac_state_t mac;
+    uint32_t cw;
+    uint32_t tx_retries;
+    int64_t backoff_slots;
+    int64_t backoff_begin_ns;
+    uint32_t gen;
+    int64_t tx_start_ns;
+    int64_t tx_data_end_ns;
+    bool tx_collided;
+
+    /* ESPNOW task. */
+    des_app_event_t taskq[DES_TASK_QUEUE_LEN];
+    int taskq_head;
+    int taskq_count;
+    bool task_running;
+    int64_t task_busy_until_ns;
+    bool wifi_blocked;
+    des_app_event_t wifi_pending;
+    uint32_t wifi_gen;
+
+    /* Application. */
+    example_espnow_send_param_t sp;
+    int peers[DES_MAX_PEERS];
+    bool peer_encrypt[DES_MAX_PEERS];
+    int peer_num;
+    uint32_t broadcasts;
+    uint32_t rebroadcast_gen;
+    int unicast_dest;
+    uint32_t unicast_left;
+    bool discovered;
+    int64_t discovered_ns;
+
+    /* Statistics. */
+    uint64_t goodput_bytes;
+    uint32_t rx_dropped;
+    uint32_t tx_no_mem;
+} des_node_t;
+
+typedef enum {
+    DES_EV_BOOT,
+    DES_EV_ACCESS,
+    DES_EV_TX_END,
+    DES_EV_TASK,
+    DES_EV_WIFI_TIMEOUT,
+    DES_EV_REBROADCAST,
+    DES_EV_REPORT,
+} des_event_type_t;
+
+typedef struct {
+    int64_t t;
+    uint64_t seq;
+    des_event_type_t type;
+    int node;
+    uint32_t gen;
+} des_event_t;
+
+typedef struct {
+    uint32_t slaves;
+    uint32_t discovered;
+    int64_t t50_ns;
+    int64_t t100_ns;
+    uint64_t tx_started;
+    uint64_t tx_collided;
+    uint64_t unicast_sessions;
+    uint64_t slave_sessions;              //Unicast sessions between two slaves.
+    uint64_t rx_dropped;
+    uint64_t tx_no_mem;
+    uint32_t aborts;
+    int64_t busy_ns;
+    double goodput_mean;
+    double goodput_min;
+} des_result_t;
+
+static des_config_t s_cfg;
+static des_node_t *s_nodes;
+static int s_node_num;
+static des_event_t *s_heap;
+static size_t s_heap_len;
+static size_t s_heap_cap;
+static uint64_t s_seq;
+static uint64_t s_rng;
+static int s_on_air[DES_MAX_NODES];
+static int s_on_air_num;
+static int64_t s_idle_since_ns;
+static int64_t s_busy_since_ns;
+static des_result_t s_res;
+
+static uint64_t des_rand(void)
+{
+    /* xorshift64*: deterministic for a given seed on every host. */
+    s_rng ^= s_rng >> 12;
+    s_rng ^= s_rng << 25;
+    s_rng ^= s_rng >> 27;
+    return s_rng * 0x2545F4914F6CDD1DULL;
+}
+
+static double des_rand_unit(void)
+{
+    return (des_rand() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void des_push(int64_t t, des_event_type_t type, int node, uint32_t gen)
+{
+    if (s_heap_len == s_heap_cap) {
+        s_heap_cap = s_heap_cap ? s_heap_cap * 2 : 1024;
+        s_heap = realloc(s_heap, s_heap_cap * sizeof(*s_heap));
+        if (s_heap == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    des_event_t ev = { .t = t, .seq = s_seq++, .type = type, .node = node, .gen = gen };
+    size_t i = s_heap_len++;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        des_event_t *p = &s_heap[parent];
+        if (p->t < ev.t || (p->t == ev.t && p->seq < ev.seq)) {
+            break;
+        }
+        s_heap[i] = *p;
+        i = parent;
+    }
+    s_heap[i] = ev;
+}
+
+static des_event_t des_pop(void)
+{
+    des_event_t top = s_heap[0];
+    des_event_t last = s_heap[--s_heap_len];
+    size_t i = 0;
+
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= s_heap_len) {
+            break;
+        }
+        if (child + 1 < s_heap_len &&
+            (s_heap[child + 1].t < s_heap[child].t ||
+             (s_heap[child + 1].t == s_heap[child].t && s_heap[child + 1].seq < s_heap[child].seq))) {
+            child++;
+        }
+        if (last.t < s_heap[child].t || (last.t == s_heap[child].t && last.seq < s_heap[child].seq)) {
+            break;
+        }
+        s_heap[i] = s_heap[child];
+        i = child;
+    }
+    s_heap[i] = last;
+    return top;
+}
+
+static int64_t des_airtime_ns(int bytes, uint32_t rate_kbps)
+{
+    const des_phy_t *phy = s_cfg.phy;
+    int64_t bits = (int64_t)bytes * 8;
+
+    if (phy->ofdm) {
+        int64_t bits_per_symbol = (int64_t)rate_kbps * 4 / 1000;
+        int64_t symbols = (16 + 6 + bits + bits_per_symbol - 1) / bits_per_symbol;
+        return US(phy->preamble_us) + US(4) * symbols;
+    }
+    return US(phy->preamble_us) + (bits * 1000000 + rate_kbps - 1) / rate_kbps;
+}
+
+static int64_t des_slot_ns(void)
+{
+    return US(s_cfg.phy->slot_us);
+}
+
+static int64_t des_difs_ns(void)
+{
+    return US(s_cfg.phy->sifs_us) + 2 * des_slot_ns();
+}
+
+static bool des_medium_busy(int64_t t)
+{
+    /* A transmission is sensed one slot after it started. */
+    for (int i = 0; i < s_on_air_num; i++) {
+        if (s_nodes[s_on_air[i]].tx_start_ns <= t - des_slot_ns()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Start or resume the countdown of node's backoff at time t. */
+static void des_mac_access(int node, int64_t t)
+{
+    des_node_t *n = &s_nodes[node];
+
+    if (s_on_air_num > 0 && des_medium_busy(t)) {
+        n->mac = DES_MAC_FROZEN;
+        return;
+    }
+    int64_t begin = s_idle_since_ns + des_difs_ns();
+    if (begin < t) {
+        begin = t;
+    }
+    n->mac = DES_MAC_BACKOFF;
+    n->backoff_begin_ns = begin;
+    des_push(begin + n->backoff_slots * des_slot_ns(), DES_EV_ACCESS, node, ++n->gen);
+}
+
+static void des_mac_kick(int node, int64_t t)
+{
+    des_node_t *n = &s_nodes[node];
+
+    if (n->mac != DES_MAC_IDLE || n->txq_count == 0 || n->dead) {
+        return;
+    }
+    n->backoff_slots = (int64_t)(des_rand() % (n->cw + 1));
+    des_mac_access(node, t);
+}
+
+static bool des_mac_send(int node, const des_frame_t *frame, int64_t t)
+{
+    des_node_t *n = &s_nodes[node];
+
+    if (n->txq_count == DES_TX_QUEUE_LEN) {
+        n->tx_no_mem++;
+        return false;
+    }
+    n->txq[(n->txq_head + n->txq_count) % DES_TX_QUEUE_LEN] = *frame;
+    n->txq_count++;
+    des_mac_kick(node, t);
+    return true;
+}
+
+static void des_task_post(int node, const des_app_event_t *evt, int64_t t);
+
+static void des_on_air_start(int node, int64_t t)
+{
+    des_node_t *n = &s_nodes[node];
+    const des_frame_t *frame = &n->txq[n->txq_head];
+    int64_t data_ns = des_airtime_ns(frame->len + DES_FRAME_OVERHEAD, s_cfg.phy->rate_kbps);
+    int64_t end = t + data_ns;
+
+    if (frame->dst != DES_BROADCAST) {
+        end += US(s_cfg.phy->sifs_us) + des_airtime_ns(DES_ACK_BYTES, s_cfg.phy->ack_rate_kbps);
+    }
+    n->mac = DES_MAC_TX;
+    n->tx_start_ns = t;
+    n->tx_data_end_ns = t + data_ns;
+    n->tx_collided = false;
+    for (int i = 0; i < s_on_air_num; i++) {
+        des_node_t *other = &s_nodes[s_on_air[i]];
+        if (other->tx_data_end_ns > t) {
+            other->tx_collided = true;
+            n->tx_collided = true;
+        }
+    }
+    if (s_on_air_num == 0) {
+        s_busy_since_ns = t;
+    }
+    s_on_air[s_on_air_num++] = node;
+    s_res.tx_started++;
+
+    /* Everybody else counting down freezes, except those whose slot ends before
+     * they can sense this transmission: they transmit too and collide. */
+    for (int i = 0; i < s_node_num; i++) {
+        des_node_t *other = &s_nodes[i];
+        if (i == node || other->mac != DES_MAC_BACKOFF) {
+            continue;
+        }
+        int64_t fire = other->backoff_begin_ns + other->backoff_slots * des_slot_ns();
+        if (fire < t + des_slot_ns()) {
+            continue;
+        }
+        if (t > other->backoff_begin_ns) {
+            other->backoff_slots -= (t - other->backoff_begin_ns) / des_slot_ns();
+        }
+        other->mac = DES_MAC_FROZEN;
+        other->gen++;
+    }
+    des_push(end, DES_EV_TX_END, node, n->gen);
+}
+
+static bool des_received(int rx, int tx)
+{
+    des_node_t *r = &s_nodes[rx];
+    des_node_t *t = &s_nodes[tx];
+
+    if (!r->booted || r->dead) {
+        return false;
+    }
+    /* Half duplex: a node cannot hear while it is sending. */
+    if (r->mac == DES_MAC_TX && r->tx_start_ns < t->tx_data_end_ns && r->tx_data_end_ns > t->tx_start_ns) {
+        return false;
+    }
+    return !(s_cfg.loss > 0 && des_rand_unit() < s_cfg.loss);
+}
+
+static void des_on_air_end(int node, int64_t t)
+{
+    des_node_t *n = &s_nodes[node];
+    des_frame_t frame = n->txq[n->txq_head];
+    bool success = false;
+
+    if (n->tx_collided) {
+        s_res.tx_collided++;
+    }
+    if (frame.dst == DES_BROADCAST) {
+        if (!n->tx_collided) {
+            for (int i = 0; i < s_node_num; i++) {
+                if (i != node && des_received(i, node)) {
+                    des_app_event_t evt = { .id = DES_APP_RECV, .frame = frame };
+                    des_task_post(i, &evt, t);
+                }
+            }
+        }
+        success = true;
+    } else if (!n->tx_collided && des_received(frame.dst, node)) {
+        des_app_event_t evt = { .id = DES_APP_RECV, .frame = frame };
+        des_task_post(frame.dst, &evt, t);
+        success = true;
+    }
+
+    for (int i = 0; i < s_on_air_num; i++) {
+        if (s_on_air[i] == node) {
+            s_on_air[i] = s_on_air[--s_on_air_num];
+            break;
+        }
+    }
+    if (s_on_air_num == 0) {
+        s_idle_since_ns = t;
+        s_res.busy_ns += t - s_busy_since_ns;
+    }
+
+    n->mac = DES_MAC_IDLE;
+    if (!success && n->tx_retries < s_cfg.retry_limit) {
+        n->tx_retries++;
+        n->cw = n->cw * 2 + 1 > s_cfg.phy->cw_max ? s_cfg.phy->cw_max : n->cw * 2 + 1;
+        des_mac_kick(node, t);
+    } else {
+        if (success && frame.dst != DES_BROADCAST && frame.kind != DES_FRAME_HANDSHAKE) {
+            n->goodput_bytes += frame.len - DES_HDR_LEN;
+        }
+        n->txq_head = (n->txq_head + 1) % DES_TX_QUEUE_LEN;
+        n->txq_count--;
+        n->tx_retries = 0;
+        n->cw = s_cfg.phy->cw_min;
+        if (frame.kind != DES_FRAME_REPORT) {
+            des_app_event_t evt = { .id = DES_APP_SEND_CB, .frame = frame, .success = success };
+            des_task_post(node, &evt, t);
+        }
+        des_mac_kick(node, t);
+    }
+
+    /* The medium is idle again: frozen countdowns resume after DIFS. */
+    if (s_on_air_num == 0) {
+        for (int i = 0; i < s_node_num; i++) {
+            if (s_nodes[i].mac == DES_MAC_FROZEN && !s_nodes[i].dead) {
+                des_mac_access(i, t);
+            }
+        }
+    }
+}
+
+static void des_task_schedule(int node, int64_t t)
+{
+    des_node_t *n = &s_nodes[node];
+
+    if (!n->task_running && n->taskq_count > 0 && !n->dead) {
+        n->task_running = true;
+        des_push(t > n->task_busy_until_ns ? t : n->task_busy_until_ns, DES_EV_TASK, node, 0);
+    }
+}
+
+/* Called in the Wi-Fi task's place: queue evt for the ESPNOW task, as
+ * xQueueSend(..., ESPNOW_MAXDELAY) does. */
+static void des_task_post(int node, const des_app_event_t *evt, int64_t t)
+{
+    des_node_t *n = &s_nodes[node];
+
+    if (n->dead) {
+        return;
+    }
+    if (n->wifi_blocked) {
+        if (evt->id == DES_APP_RECV) {
+            n->rx_dropped++;
+        }
+        return;
+    }
+    if (n->taskq_count == DES_TASK_QUEUE_LEN) {
+        n->wifi_blocked = true;
+        n->wifi_pending = *evt;
+        des_push(t + DES_WIFI_BLOCK_NS, DES_EV_WIFI_TIMEOUT, node, ++n->wifi_gen);
+        return;
+    }
+    n->taskq[(n->taskq_head + n->taskq_count) % DES_TASK_QUEUE_LEN] = *evt;
+    n->taskq_count++;
+    des_task_schedule(node, t);
+}
+
+static void des_node_abort(int node, int64_t t)
+{
+    (void)t;
+    s_nodes[node].dead = true;
+    s_res.aborts++;
+}
+
+static int des_peer_find(des_node_t *n, int peer)
+{
+    for (int i = 0; i < n->peer_num; i++) {
+        if (n->peers[i] == peer) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Add peer to node's peer list. Returns false if it is not in the list afterwards. */
+static bool des_peer_add(int node, int peer, bool encrypt, int64_t t)
+{
+    des_node_t *n = &s_nodes[node];
+    int encrypted = 0;
+
+    if (des_peer_find(n, peer) >= 0) {
+        return true;
+    }
+    for (int i = 0; i < n->peer_num; i++) {
+        encrypted += n->peer_encrypt[i];
+    }
+    if (n->peer_num == DES_MAX_PEERS || (encrypt && encrypted >= CONFIG_ESP_WIFI_ESPNOW_MAX_ENCRYPT_NUM)) {
+        if (s_cfg.abort_on_full) {
+            des_node_abort(node, t);
+        }
+        return false;
+    }
+    n->peers[n->peer_num] = peer;
+    n->peer_encrypt[n->peer_num] = encrypt;
+    n->peer_num++;
+    return true;
+}
+
+static void des_send_broadcast(int node, int64_t t)
+{
+    des_node_t *n = &s_nodes[node];
+    des_frame_t frame = {
+        .src = node,
+        .dst = DES_BROADCAST,
+        .type = EXAMPLE_ESPNOW_DATA_BROADCAST,
+        .state = n->sp.state,
+        .magic = n->sp.magic,
+        .len = DES_BROADCAST_LEN,
+        .kind = DES_FRAME_HANDSHAKE,
+    };
+    n->broadcasts++;
+    des_mac_send(node, &frame, t);
+}
+
+static void des_send_unicast(int node, int dst, int len, des_frame_kind_t kind, int64_t t)
+{
+    des_node_t *n = &s_nodes[node];
+    des_frame_t frame = {
+        .src = node,
+        .dst = dst,
+        .type = EXAMPLE_ESPNOW_DATA_UNICAST,
+        .state = n->sp.state,
+        .magic = n->sp.magic,
+        .len = len,
+        .kind = kind,
+    };
+    des_mac_send(node, &frame, t);
+}
+
+/* The master's ESPNOW task. Returns the time the event kept the task busy. */
+static int64_t des_master_handle(int node, const des_app_event_t *evt, int64_t t)
+{
+    const des_frame_t *frame = &evt->frame;
+
+    if (evt->id != DES_APP_RECV) {
+        return US(50);
+    }
+    if (frame->type == EXAMPLE_ESPNOW_DATA_BROADCAST) {
+        if (s_cfg.abort_on_full && !des_peer_add(node, frame->src, false, t)) {
+            return 0;
+        }
+        if (espnow_handshake_master_on_broadcast(frame->state, frame->magic) == ESPNOW_HANDSHAKE_REPLY) {
+            des_send_unicast(node, frame->src, DES_REPLY_LEN, DES_FRAME_HANDSHAKE, t);
+        }
+    }
+    return s_cfg.master_service_ns;
+}
+
+/* A slave's ESPNOW task. Returns the time the event kept the task busy. */
+static int64_t des_slave_handle(int node, const des_app_event_t *evt, int64_t t)
+{
+    des_node_t *n = &s_nodes[node];
+    const des_frame_t *frame = &evt->frame;
+
+    if (evt->id == DES_APP_SEND_CB) {
+        if (frame->dst == DES_BROADCAST) {
+            int32_t delay_ms = espnow_handshake_rebroadcast_delay(&n->sp, n->broadcasts, s_cfg.retries,
+                                                                  s_cfg.backoff_ms, (uint32_t)des_rand());
+            if (delay_ms != ESPNOW_HANDSHAKE_NO_REBROADCAST) {
+                des_push(t + MS(delay_ms), DES_EV_REBROADCAST, node, ++n->rebroadcast_gen);
+            }
+            return US(50);
+        }
+        if (frame->kind != DES_FRAME_UNICAST) {
+            return US(50);
+        }
+        if (--n->unicast_left == 0) {
+            /* "Send done": the example deinitialises ESPNOW and deletes its task. */
+            n->dead = true;
+            return 0;
+        }
+        des_send_unicast(node, n->unicast_dest, DES_UNICAST_LEN, DES_FRAME_UNICAST, t + s_cfg.send_delay_ns);
+        return s_cfg.send_delay_ns;
+    }
+
+    if (frame->type == EXAMPLE_ESPNOW_DATA_BROADCAST) {
+        bool listed = des_peer_add(node, frame->src, true, t);
+
+        if (n->dead) {
+            return 0;
+        }
+        if (espnow_handshake_on_broadcast(&n->sp, frame->state, frame->magic) == ESPNOW_HANDSHAKE_START_UNICAST &&
+            listed) {
+            n->unicast_dest = frame->src;
+            n->unicast_left = s_cfg.send_count;
+            s_res.unicast_sessions++;
+            if (frame->src != DES_MASTER) {
+                s_res.slave_sessions++;
+            }
+            des_send_unicast(node, frame->src, DES_UNICAST_LEN, DES_FRAME_UNICAST, t);
+            espnow_handshake_unicast_started(&n->sp);
+            n->rebroadcast_gen++;
+        }
+    } else if (frame->type == EXAMPLE_ESPNOW_DATA_UNICAST) {
+        espnow_handshake_on_unicast(&n->sp);
+        n->rebroadcast_gen++;
+        if (frame->src == DES_MASTER && !n->discovered) {
+            n->discovered = true;
+            n->discovered_ns = t;
+            if (s_cfg.report_interval_ns > 0) {
+                des_push(t + s_cfg.report_interval_ns, DES_EV_REPORT, node, 0);
+            }
+        }
+    }
+    return s_cfg.slave_service_ns;
+}
+
+static void des_task_run(int node, int64_t t)
+{
+    des_node_t *n = &s_nodes[node];
+
+    n->task_running = false;
+    if (n->dead || n->taskq_count == 0) {
+        return;
+    }
+    des_app_event_t evt = n->taskq[n->taskq_head];
+    n->taskq_head = (n->taskq_head + 1) % DES_TASK_QUEUE_LEN;
+    n->taskq_count--;
+    if (n->wifi_blocked) {
+        /* The blocked xQueueSend completes as soon as there is room. */
+        n->wifi_blocked = false;
+        n->wifi_gen++;
+        n->taskq[(n->taskq_head + n->taskq_count) % DES_TASK_QUEUE_LEN] = n->wifi_pending;
+        n->taskq_count++;
+    }
+
+    int64_t busy = node == DES_MASTER ? des_master_handle(node, &evt, t) : des_slave_handle(node, &evt, t);
+    n->task_busy_until_ns = t + busy;
+    des_task_schedule(node, t);
+}
+
+static void des_boot(int node, int64_t t)
+{
+    des_node_t *n = &s_nodes[node];
+
+    n->booted = true;
+    n->cw = s_cfg.phy->cw_min;
+    n->sp.broadcast = true;
+    n->sp.magic = (uint32_t)des_rand();
+    /* Both examples add the broadcast peer during init. */
+    n->peers[n->peer_num++] = DES_BROADCAST;
+    if (node == DES_MASTER) {
+        /* vTaskDelay(5000 / portTICK_PERIOD_MS) at the start of the master's task. */
+        n->task_busy_until_ns = t + s_cfg.master_start_ns;
+        return;
+    }
+    des_send_broadcast(node, t);
+}
+
+static void des_run(uint32_t slaves)
+{
+    memset(&s_res, 0, sizeof(s_res));
+    s_res.slaves = slaves;
+    s_node_num = (int)slaves + 1;
+    s_nodes = calloc(s_node_num, sizeof(*s_nodes));
+    s_heap_len = 0;
+    s_seq = 0;
+    s_rng = s_cfg.seed * 0x9E3779B97F4A7C15ULL + slaves;
+    if (s_rng == 0) {
+        s_rng = 1;
+    }
+    s_on_air_num = 0;
+    s_idle_since_ns = -MS(1);
+
+    des_push(0, DES_EV_BOOT, DES_MASTER, 0);
+    for (int i = 1; i < s_node_num; i++) {
+        int64_t boot = s_cfg.boot_spread_ns > 0 ? (int64_t)(des_rand() % (uint64_t)s_cfg.boot_spread_ns) : 0;
+        s_nodes[i].boot_ns = boot;
+        des_push(boot, DES_EV_BOOT, i, 0);
+    }
+
+    while (s_heap_len > 0) {
+        des_event_t ev = des_pop();
+        des_node_t *n = &s_nodes[ev.node];
+        if (ev.t > s_cfg.duration_ns) {
+            break;
+        }
+        switch (ev.type) {
+        case DES_EV_BOOT:
+            des_boot(ev.node, ev.t);
+            break;
+        case DES_EV_ACCESS:
+            if (ev.gen == n->gen && n->mac == DES_MAC_BACKOFF && !n->dead) {
+                des_on_air_start(ev.node, ev.t);
+            }
+            break;
+        case DES_EV_TX_END:
+            des_on_air_end(ev.node, ev.t);
+            break;
+        case DES_EV_TASK:
+            des_task_run(ev.node, ev.t);
+            break;
+        case DES_EV_WIFI_TIMEOUT:
+            if (ev.gen == n->wifi_gen && n->wifi_blocked) {
+                n->wifi_blocked = false;
+                if (n->wifi_pending.id == DES_APP_RECV) {
+                    n->rx_dropped++;
+                }
+            }
+            break;
+        case DES_EV_REBROADCAST:
+            if (ev.gen == n->rebroadcast_gen && n->sp.broadcast && !n->dead) {
+                des_send_broadcast(ev.node, ev.t);
+            }
+            break;
+        case DES_EV_REPORT:
+            if (!n->dead) {
+                des_send_unicast(ev.node, DES_MASTER, s_cfg.report_len, DES_FRAME_REPORT, ev.t);
+                des_push(ev.t + s_cfg.report_interval_ns, DES_EV_REPORT, ev.node, 0);
+            }
+            break;
+        }
+    }
+    if (s_on_air_num > 0) {
+        s_res.busy_ns += s_cfg.duration_ns - s_busy_since_ns;
+    }
+
+    int64_t *times = calloc(slaves, sizeof(*times));
+    double goodput_sum = 0;
+    s_res.goodput_min = -1;
+    for (int i = 1; i < s_node_num; i++) {
+        des_node_t *n = &s_nodes[i];
+        if (n->discovered) {
+            times[s_res.discovered++] = n->discovered_ns;
+        }
+        int64_t alive = s_cfg.duration_ns - n->boot_ns;
+        double goodput = alive > 0 ? n->goodput_bytes * 1e9 / alive : 0;
+        goodput_sum += goodput;
+        if (s_res.goodput_min < 0 || goodput < s_res.goodput_min) {
+            s_res.goodput_min = goodput;
+        }
+        s_res.rx_dropped += n->rx_dropped;
+        s_res.tx_no_mem += n->tx_no_mem;
+    }
+    s_res.rx_dropped += s_nodes[DES_MASTER].rx_dropped;
+    s_res.tx_no_mem += s_nodes[DES_MASTER].tx_no_mem;
+    s_res.goodput_mean = goodput_sum / slaves;
+
+    /* Insertion sort is plenty for a few hundred nodes. */
+    for (uint32_t i = 1; i < s_res.discovered; i++) {
+        int64_t v = times[i];
+        uint32_t j = i;
+        while (j > 0 && times[j - 1] > v) {
+            times[j] = times[j - 1];
+            j--;
+        }
+        times[j] = v;
+    }
+    s_res.t50_ns = s_res.discovered * 2 >= slaves ? times[(slaves + 1) / 2 - 1] : -1;
+    s_res.t100_ns = s_res.discovered == slaves ? times[slaves - 1] : -1;
+    free(times);
+    free(s_nodes);
+}
+
+static void des_print_header(void)
+{
+    if (s_cfg.csv) {
+        printf("slaves,discovered,t50_ms,t100_ms,tx,collided,collision_pct,busy_pct,sessions,slave_sessions,"
+               "rx_dropped,tx_no_mem,aborts,goodput_mean_Bps,goodput_min_Bps\n");
+        return;
+    }
+    printf("%7s %10s %9s %9s %8s %8s %6s %6s %8s %8s %8s %6s %11s %11s\n",
+           "slaves", "discovered", "t50 ms", "t100 ms", "tx", "collided", "coll%", "busy%",
+           "sessions", "s2s", "rx_drop", "aborts", "goodput B/s", "min B/s");
+}
+
+static void des_print_result(void)
+{
+    const des_result_t *r = &s_res;
+    double coll = r->tx_started ? 100.0 * r->tx_collided / r->tx_started : 0;
+    double busy = 100.0 * r->busy_ns / s_cfg.duration_ns;
+    char t50[16], t100[16];
+
+    if (r->t50_ns >= 0) {
+        snprintf(t50, sizeof(t50), "%.1f", r->t50_ns / 1e6);
+    } else {
+        snprintf(t50, sizeof(t50), "-");
+    }
+    if (r->t100_ns >= 0) {
+        snprintf(t100, sizeof(t100), "%.1f", r->t100_ns / 1e6);
+    } else {
+        snprintf(t100, sizeof(t100), "-");
+    }
+    if (s_cfg.csv) {
+        printf("%" PRIu32 ",%" PRIu32 ",%s,%s,%" PRIu64 ",%" PRIu64 ",%.2f,%.2f,%" PRIu64 ",%" PRIu64 ",%" PRIu64
+               ",%" PRIu64 ",%" PRIu32 ",%.1f,%.1f\n",
+               r->slaves, r->discovered, t50, t100, r->tx_started, r->tx_collided, coll, busy,
+               r->unicast_sessions, r->slave_sessions, r->rx_dropped, r->tx_no_mem, r->aborts,
+               r->goodput_mean, r->goodput_min);
+        return;
+    }
+    printf("%7" PRIu32 " %5" PRIu32 "/%-4" PRIu32 " %9s %9s %8" PRIu64 " %8" PRIu64 " %6.2f %6.2f %8" PRIu64
+           " %8" PRIu64 " %8" PRIu64 " %6" PRIu32 " %11.1f %11.1f\n",
+           r->slaves, r->discovered, r->slaves, t50, t100, r->tx_started, r->tx_collided, coll, busy,
+           r->unicast_sessions, r->slave_sessions, r->rx_dropped, r->aborts, r->goodput_mean, r->goodput_min);
+}
+
+static void des_usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --slaves LIST            slave counts to simulate (2,5,10,20,50,100,200)\n"
+            "  --rate NAME              PHY rate: 1m 2m 5.5m 11m 6m 12m 24m 54m lr512k lr256k (1m)\n"
+            "  --duration MS            simulated time per run (30000)\n"
+            "  --seed N                 random seed (1)\n"
+            "  --boot-spread MS         slaves boot uniformly within this time (1000)\n"
+            "  --retries N              discovery broadcast retries, CONFIG_ESPNOW_DISCOVERY_RETRIES (0)\n"
+            "  --backoff MS             CONFIG_ESPNOW_DISCOVERY_BACKOFF (100)\n"
+            "  --master-start MS        initial delay of the master's task (5000)\n"
+            "  --master-service US      master task time per received frame (2000)\n"
+            "  --slave-service US       slave task time per received frame (500)\n"
+            "  --retry-limit N          unicast retransmissions (7)\n"
+            "  --send-count N           CONFIG_ESPNOW_SEND_COUNT (100)\n"
+            "  --send-delay MS          CONFIG_ESPNOW_SEND_DELAY (1000)\n"
+            "  --report-interval MS     discovered slaves report to the master this often, 0 for never (0)\n"
+            "  --report-len BYTES       length of a report (200)\n"
+            "  --loss PERCENT           random frame loss per receiver (0)\n"
+            "  --peer-full skip|abort   a full peer list skips the device, or aborts as older examples did (skip)\n"
+            "  --csv                    print CSV\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] = {
+        { "slaves", required_argument, NULL, 'n' },
+        { "rate", required_argument, NULL, 'r' },
+        { "duration", required_argument, NULL, 'd' },
+        { "seed", required_argument, NULL, 's' },
+        { "boot-spread", required_argument, NULL, 'b' },
+        { "retries", required_argument, NULL, 'R' },
+        { "backoff", required_argument, NULL, 'B' },
+        { "master-start", required_argument, NULL, 'M' },
+        { "master-service", required_argument, NULL, 'm' },
+        { "slave-service", required_argument, NULL, 'S' },
+        { "retry-limit", required_argument, NULL, 'L' },
+        { "send-count", required_argument, NULL, 'c' },
+        { "send-delay", required_argument, NULL, 'D' },
+        { "report-interval", required_argument, NULL, 'i' },
+        { "report-len", required_argument, NULL, 'l' },
+        { "loss", required_argument, NULL, 'p' },
+        { "peer-full", required_argument, NULL, 'f' },
+        { "csv", no_argument, NULL, 'C' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+    char slaves_list[256] = "2,5,10,20,50,100,200";
+    int opt;
+
+    s_cfg = (des_config_t) {
+        .phy = &s_phys[0],
+        .duration_ns = MS(30000),
+        .seed = 1,
+        .boot_spread_ns = MS(1000),
+        .retries = 0,
+        .backoff_ms = 100,
+        .master_start_ns = MS(5000),
+        .master_service_ns = US(2000),
+        .slave_service_ns = US(500),
+        .retry_limit = 7,
+        .send_count = 100,
+        .send_delay_ns = MS(1000),
+        .report_interval_ns = 0,
+        .report_len = 200,
+        .abort_on_full = false,
+    };
+
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (opt) {
+        case 'n':
+            snprintf(slaves_list, sizeof(slaves_list), "%s", optarg);
+            break;
+        case 'r':
+            s_cfg.phy = NULL;
+            for (size_t i = 0; i < sizeof(s_phys) / sizeof(s_phys[0]); i++) {
+                if (strcmp(s_phys[i].name, optarg) == 0) {
+                    s_cfg.phy = &s_phys[i];
+                }
+            }
+            if (s_cfg.phy == NULL) {
+                fprintf(stderr, "unknown rate %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'd': s_cfg.duration_ns = MS(atoll(optarg)); break;
+        case 's': s_cfg.seed = strtoull(optarg, NULL, 0); break;
+        case 'b': s_cfg.boot_spread_ns = MS(atoll(optarg)); break;
+        case 'R': s_cfg.retries = (uint32_t)atoi(optarg); break;
+        case 'B': s_cfg.backoff_ms = (uint32_t)atoi(optarg); break;
+        case 'M': s_cfg.master_start_ns = MS(atoll(optarg)); break;
+        case 'm': s_cfg.master_service_ns = US(atoll(optarg)); break;
+        case 'S': s_cfg.slave_service_ns = US(atoll(optarg)); break;
+        case 'L': s_cfg.retry_limit = (uint32_t)atoi(optarg); break;
+        case 'c': s_cfg.send_count = (uint32_t)atoi(optarg); break;
+        case 'D': s_cfg.send_delay_ns = MS(atoll(optarg)); break;
+        case 'i': s_cfg.report_interval_ns = MS(atoll(optarg)); break;
+        case 'l': s_cfg.report_len = atoi(optarg); break;
+        case 'p': s_cfg.loss = atof(optarg) / 100.0; break;
+        case 'f': s_cfg.abort_on_full = strcmp(optarg, "abort") == 0; break;
+        case 'C': s_cfg.csv = true; break;
+        default:
+            des_usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (s_cfg.report_len < DES_HDR_LEN || s_cfg.report_len > ESP_NOW_MAX_DATA_LEN || s_cfg.send_count == 0) {
+        des_usage(argv[0]);
+        return 1;
+    }
+
+    if (!s_cfg.csv) {
+        printf("rate %s, %.0f ms per run, seed %" PRIu64 ", discovery retries %" PRIu32 ", peer list full: %s\n",
+               s_cfg.phy->name, s_cfg.duration_ns / 1e6, s_cfg.seed, s_cfg.retries,
+               s_cfg.abort_on_full ? "abort" : "skip");
+    }
+    des_print_header();
+    for (char *tok = strtok(slaves_list, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        long slaves = strtol(tok, NULL, 10);
+        if (slaves < 1 || slaves >= DES_MAX_NODES) {
+            fprintf(stderr, "slave count %s out of range\n", tok);
+            return 1;
+        }
+        des_run((uint32_t)slaves);
+        des_print_result();
+    }
+    free(s_heap);
+    return 0;
+}
@@ -0,0 +1,31 @@
+/* ESPNOW fuzz harnesses - input format
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESPNOW_FUZZ_H
+#define ESPNOW_FUZZ_H
+
+#include <stdint.h>
+
+/* An input of espnow_fuzz_master or espnow_fuzz_slave is a sequence of records,
+ * each an espnow_fuzz_rec_t followed by len bytes of ESPNOW data, the last one cut
+ * short by the end of the input. Random bytes hardly ever carry a valid CRC, so a
+ * record can ask for the CRC to be fixed before the frame is received. */
+#define ESPNOW_FUZZ_FIX_CRC         0x01  //Overwrite the CRC of the data with the right one.
+#define ESPNOW_FUZZ_BROADCAST       0x02  //Send to the broadcast address rather than the device fuzzed.
+
+#define ESPNOW_FUZZ_SENDERS         8     //Senders are 02:5e:00:00:00:01 to 02:5e:00:00:00:08.
+#define ESPNOW_FUZZ_MAX_FRAMES      64    //Frames of an input; the rest is ignored.
+
+typedef struct {
+    uint8_t flags;                        //ESPNOW_FUZZ_FIX_CRC, ESPNOW_FUZZ_BROADCAST.
+    uint8_t sender;                       //Sender, modulo ESPNOW_FUZZ_SENDERS.
+    uint8_t len;                          //Bytes of data following the record.
+} __attribute__((packed)) espnow_fuzz_rec_t;
+
+#endif
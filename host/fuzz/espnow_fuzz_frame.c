@@ -0,0 +1,107 @@
+/* ESPNOW fuzz harness - frame parsing
+
+   Feeds every input to espnow_frame_header() and espnow_frame_parse() as received
+   ESPNOW data, then checks that the view they return stays within the input, that
+   espnow_frame_read() refuses to read past the payload, and that every message
+   espnow_aggr_split() finds in the payload lies within it. Any broken invariant
+   aborts. The input is only ever read where it was allocated, so AddressSanitizer
+   catches a parser reading past it.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "espnow_aggr.h"
+#include "espnow_frame.h"
+
+#define FUZZ_CHECK(cond)                                                        \
+    do {                                                                        \
+        if (!(cond)) {                                                          \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            abort();                                                            \
+        }                                                                       \
+    } while (0)
+
+typedef struct {
+    const uint8_t *payload;
+    size_t len;
+    size_t total;
+} fuzz_aggr_t;
+
+static void fuzz_aggr_msg(const uint8_t *msg, size_t len, void *arg)
+{
+    fuzz_aggr_t *aggr = arg;
+    volatile uint8_t sum = 0;
+
+    FUZZ_CHECK(msg >= aggr->payload && len <= aggr->len && msg + len <= aggr->payload + aggr->len);
+    for (size_t i = 0; i < len; i++) {
+        sum += msg[i];
+    }
+    aggr->total += len;
+}
+
+/* Field by field, as the padding of a copied view is undefined. */
+static bool fuzz_frame_equal(const espnow_frame_t *a, const espnow_frame_t *b)
+{
+    return a->type == b->type && a->state == b->state && a->seq == b->seq && a->magic == b->magic &&
+           a->payload == b->payload && a->payload_len == b->payload_len;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    espnow_frame_t header, frame;
+    uint8_t out[ESP_NOW_MAX_DATA_LEN];
+
+    memset(&header, 0xa5, sizeof(header));
+    memset(&frame, 0xa5, sizeof(frame));
+    int type = espnow_frame_header(data, size, &header);
+    int ret = espnow_frame_parse(data, size, &frame);
+
+    if (type < 0) {
+        espnow_frame_t untouched;
+
+        memset(&untouched, 0xa5, sizeof(untouched));
+        FUZZ_CHECK(ret == type);
+        FUZZ_CHECK(fuzz_frame_equal(&header, &untouched));
+        FUZZ_CHECK(fuzz_frame_equal(&frame, &untouched));
+        FUZZ_CHECK(espnow_frame_err_name(type) != NULL);
+        return 0;
+    }
+    FUZZ_CHECK(type < EXAMPLE_ESPNOW_DATA_MAX && header.type == type);
+    FUZZ_CHECK(size >= sizeof(example_espnow_data_t) && size <= ESP_NOW_MAX_DATA_LEN);
+    FUZZ_CHECK(header.payload == data + sizeof(example_espnow_data_t));
+    FUZZ_CHECK(header.payload + header.payload_len == data + size);
+    FUZZ_CHECK(ret == type || ret == ESPNOW_FRAME_ERR_CRC);
+    if (ret == type) {
+        FUZZ_CHECK(fuzz_frame_equal(&header, &frame));
+    }
+
+    /* Reads within the payload succeed and copy it, anything past it fails. */
+    FUZZ_CHECK(espnow_frame_read(&header, 0, out, header.payload_len));
+    FUZZ_CHECK(memcmp(out, header.payload, header.payload_len) == 0);
+    FUZZ_CHECK(espnow_frame_read(&header, header.payload_len, out, 0));
+    FUZZ_CHECK(!espnow_frame_read(&header, header.payload_len, out, 1));
+    FUZZ_CHECK(!espnow_frame_read(&header, header.payload_len + 1, out, 0));
+    FUZZ_CHECK(!espnow_frame_read(&header, 0, out, (size_t)header.payload_len + 1));
+    FUZZ_CHECK(!espnow_frame_read(&header, 1, out, SIZE_MAX));
+    if (header.payload_len > 0) {
+        size_t offset = data[0] % header.payload_len;
+        FUZZ_CHECK(espnow_frame_read(&header, offset, out, header.payload_len - offset));
+        FUZZ_CHECK(!espnow_frame_read(&header, offset, out, header.payload_len - offset + 1));
+    }
+
+    fuzz_aggr_t aggr = {
+        .payload = header.payload,
+        .len = header.payload_len,
+    };
+    if (espnow_aggr_split(header.payload, header.payload_len, fuzz_aggr_msg, &aggr) >= 0) {
+        FUZZ_CHECK(aggr.total <= header.payload_len);
+    }
+    return 0;
+}
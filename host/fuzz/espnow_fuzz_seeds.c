@@ -0,0 +1,218 @@
+/* ESPNOW fuzz harnesses - seed corpus
+
+   Writes the seed corpus of both harnesses:
+
+     espnow_fuzz_seeds OUT_DIR
+
+   OUT_DIR/frame holds one valid frame of every type, OUT_DIR/master the same
+   frames as espnow_fuzz_master records, plus sessions of several frames from
+   several senders: the discovery handshake followed by data of every kind. The
+   frames are built with the example's own structures and encoders, so the seeds
+   follow the sources as they change.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "esp_now.h"
+#include "espnow_example.h"
+#include "espnow_crc16.h"
+#include "espnow_aggr.h"
+#include "espnow_frag.h"
+#include "espnow_reliable.h"
+#include "espnow_rtt.h"
+#include "espnow_fuzz.h"
+
+#define SEED_MAGIC      0x2545f491
+
+typedef struct {
+    uint8_t data[ESP_NOW_MAX_DATA_LEN];
+    size_t len;
+} seed_frame_t;
+
+/* A session being written as espnow_fuzz_master records. */
+typedef struct {
+    uint8_t data[ESPNOW_FUZZ_MAX_FRAMES * (sizeof(espnow_fuzz_rec_t) + ESP_NOW_MAX_DATA_LEN)];
+    size_t len;
+} seed_session_t;
+
+static const char *s_out_dir;
+
+static void seed_frame(seed_frame_t *frame, uint8_t type, uint8_t state, uint16_t seq, const void *payload, size_t len)
+{
+    example_espnow_data_t hdr = {
+        .type = type,
+        .state = state,
+        .seq_num = seq,
+        .magic = SEED_MAGIC,
+    };
+
+    memcpy(frame->data, &hdr, sizeof(hdr));
+    if (len > 0) {
+        memcpy(frame->data + sizeof(hdr), payload, len);
+    }
+    frame->len = sizeof(hdr) + len;
+    uint16_t crc = espnow_crc16_frame(frame->data, frame->len, offsetof(example_espnow_data_t, crc));
+    memcpy(frame->data + offsetof(example_espnow_data_t, crc), &crc, sizeof(crc));
+}
+
+static void seed_write(const char *dir, const char *name, const uint8_t *data, size_t len)
+{
+    char path[4096];
+
+    snprintf(path, sizeof(path), "%s/%s/%s", s_out_dir, dir, name);
+    FILE *file = fopen(path, "wb");
+    if (file == NULL || fwrite(data, 1, len, file) != len || fclose(file) != 0) {
+        perror(path);
+        exit(1);
+    }
+}
+
+static void seed_session_add(seed_session_t *session, uint8_t sender, bool broadcast, const seed_frame_t *frame)
+{
+    espnow_fuzz_rec_t rec = {
+        .flags = ESPNOW_FUZZ_FIX_CRC | (broadcast ? ESPNOW_FUZZ_BROADCAST : 0),
+        .sender = sender,
+        .len = frame->len,
+    };
+
+    memcpy(session->data + session->len, &rec, sizeof(rec));
+    memcpy(session->data + session->len + sizeof(rec), frame->data, frame->len);
+    session->len += sizeof(rec) + frame->len;
+}
+
+/* The frame alone, to both harnesses. */
+static void seed_single(const char *name, uint8_t sender, bool broadcast, const seed_frame_t *frame)
+{
+    seed_session_t session = { .len = 0 };
+
+    seed_write("frame", name, frame->data, frame->len);
+    seed_session_add(&session, sender, broadcast, frame);
+    seed_write("master", name, session.data, session.len);
+}
+
+static esp_err_t seed_aggr_flush(const uint8_t *dest_mac, const uint8_t *payload, size_t len, void *arg)
+{
+    (void)dest_mac;
+    seed_frame_t *frame = arg;
+
+    seed_frame(frame, EXAMPLE_ESPNOW_DATA_AGGREGATE, 0, 7, payload, len);
+    return ESP_OK;
+}
+
+int main(int argc, char **argv)
+{
+    static const uint8_t master[ESP_NOW_ETH_ALEN] = { 0x02, 0x5e, 0x00, 0x00, 0x00, 0x00 };
+    static const char text[] = "Hello from the fuzz seeds";
+    seed_frame_t broadcast_start, broadcast_ack, unicast, aggregate, reliable[3], probe, frags[4];
+    int frag_num = 0;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s OUT_DIR\n", argv[0]);
+        return 1;
+    }
+    s_out_dir = argv[1];
+    char path[4096];
+    mkdir(s_out_dir, 0755);
+    snprintf(path, sizeof(path), "%s/frame", s_out_dir);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/master", s_out_dir);
+    mkdir(path, 0755);
+
+    /* The handshake: broadcasts before and after the master's unicast reply. */
+    seed_frame(&broadcast_start, EXAMPLE_ESPNOW_DATA_BROADCAST, 0, 0, text, sizeof(text));
+    seed_frame(&broadcast_ack, EXAMPLE_ESPNOW_DATA_BROADCAST, 1, 1, text, sizeof(text));
+    seed_frame(&unicast, EXAMPLE_ESPNOW_DATA_UNICAST, 0, 0, text, sizeof(text));
+
+    espnow_aggr_t aggr;
+    espnow_aggr_init(&aggr, 1000, seed_aggr_flush, &aggregate);
+    for (int i = 0; i < 4; i++) {
+        espnow_aggr_add(&aggr, master, (const uint8_t *)text, 5 + 5 * i, 0);
+    }
+    espnow_aggr_flush_all(&aggr);
+
+    for (int i = 0; i < 3; i++) {
+        uint8_t payload[sizeof(espnow_reliable_hdr_t) + sizeof(text)];
+        espnow_reliable_hdr_t hdr = {
+            .base = 0,
+        };
+        memcpy(payload, &hdr, sizeof(hdr));
+        memcpy(payload + sizeof(hdr), text, sizeof(text));
+        seed_frame(&reliable[i], EXAMPLE_ESPNOW_DATA_RELIABLE, 0, i, payload, sizeof(payload));
+    }
+
+    espnow_rtt_probe_t rtt_probe = {
+        .id = 3,
+        .sent_us = 1000000,
+    };
+    seed_frame(&probe, EXAMPLE_ESPNOW_DATA_PROBE, 0, 3, &rtt_probe, sizeof(rtt_probe));
+
+    uint8_t message[3 * ESPNOW_FRAG_DATA_MAX / 2];
+    for (size_t i = 0; i < sizeof(message); i++) {
+        message[i] = text[i % (sizeof(text) - 1)];
+    }
+    espnow_frag_tx_t frag_tx;
+    uint8_t frag_payload[sizeof(espnow_frag_hdr_t) + ESPNOW_FRAG_DATA_MAX];
+    espnow_frag_tx_start(&frag_tx, 1, message, sizeof(message));
+    for (size_t len; frag_num < 4 && (len = espnow_frag_tx_next(&frag_tx, frag_payload)) > 0; frag_num++) {
+        seed_frame(&frags[frag_num], EXAMPLE_ESPNOW_DATA_FRAGMENT, 0, frag_num, frag_payload, len);
+    }
+
+    seed_single("broadcast", 0, true, &broadcast_start);
+    seed_single("broadcast_ack", 0, true, &broadcast_ack);
+    seed_single("unicast", 0, false, &unicast);
+    seed_single("aggregate", 0, false, &aggregate);
+    seed_single("reliable", 0, false, &reliable[0]);
+    seed_single("probe", 0, false, &probe);
+    seed_single("fragment", 0, false, &frags[0]);
+    /* The other types with an empty payload, or text. */
+    for (int type = EXAMPLE_ESPNOW_DATA_ACK; type < EXAMPLE_ESPNOW_DATA_MAX; type++) {
+        seed_frame_t frame;
+        char name[32];
+        snprintf(name, sizeof(name), "type%d_empty", type);
+        seed_frame(&frame, type, 0, 0, NULL, 0);
+        seed_single(name, 0, false, &frame);
+        snprintf(name, sizeof(name), "type%d_text", type);
+        seed_frame(&frame, type, 0, 0, text, sizeof(text));
+        seed_single(name, 0, false, &frame);
+    }
+
+    /* One slave going through discovery, then sending data of every kind. */
+    seed_session_t session = { .len = 0 };
+    seed_session_add(&session, 1, true, &broadcast_start);
+    seed_session_add(&session, 1, true, &broadcast_ack);
+    seed_session_add(&session, 1, false, &unicast);
+    for (int i = 0; i < 3; i++) {
+        seed_session_add(&session, 1, false, &reliable[i]);
+    }
+    seed_session_add(&session, 1, false, &probe);
+    seed_session_add(&session, 1, false, &aggregate);
+    for (int i = 0; i < frag_num; i++) {
+        seed_session_add(&session, 1, false, &frags[i]);
+    }
+    seed_write("master", "session_one", session.data, session.len);
+
+    /* Every sender at once, frames interleaved. */
+    session.len = 0;
+    for (int sender = 0; sender < ESPNOW_FUZZ_SENDERS; sender++) {
+        seed_session_add(&session, sender, true, &broadcast_start);
+    }
+    for (int sender = 0; sender < ESPNOW_FUZZ_SENDERS; sender++) {
+        seed_session_add(&session, sender, true, &broadcast_ack);
+    }
+    for (int i = 0; i < 3; i++) {
+        for (int sender = 0; sender < ESPNOW_FUZZ_SENDERS; sender++) {
+            seed_session_add(&session, sender, false, &reliable[i]);
+        }
+    }
+    seed_write("master", "session_all", session.data, session.len);
+    return 0;
+}
@@ -0,0 +1,89 @@
+/* ESPNOW fuzz harness - the slave's receive path
+
+   Turns every input into up to ESPNOW_FUZZ_MAX_FRAMES frames, see espnow_fuzz.h,
+   and runs them through the slave with host_replay_run() of
+   host_replay_slave.c: the receive callback, the event transport, the dispatch
+   of every frame type to example_espnow_handle_recv(), the acknowledgements,
+   echoes and bulk or multicast statuses sent back, and the sending callbacks of
+   every frame the slave sent. The slave is initialised once and has sent its
+   first discovery broadcast, so the handshake, peers, replay windows and image
+   transfers carry over from one input to the next, as they would on the device.
+
+   Every frame is copied to a buffer of its own length, so AddressSanitizer
+   catches the receive callback reading past the data the radio handed it.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_now.h"
+#include "espnow_example.h"
+#include "espnow_crc16.h"
+#include "host_replay.h"
+#include "espnow_fuzz.h"
+
+int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+    (void)argc;
+    (void)argv;
+    setenv("ESPNOW_SIM_LOG_LEVEL", "0", 0);
+    /* Metrics frames are printed whatever the log level. */
+    if (freopen("/dev/null", "w", stdout) == NULL) {
+        perror("/dev/null");
+        exit(1);
+    }
+    host_replay_init();
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    /* The slave runs at the address of simulated node 0, see host_replay_stubs.c. */
+    static const uint8_t slave[ESP_NOW_ETH_ALEN] = { 0x02, 0x5e, 0x00, 0x00, 0x00, 0x00 };
+    static const uint8_t broadcast[ESP_NOW_ETH_ALEN] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+    host_replay_frame_t frames[ESPNOW_FUZZ_MAX_FRAMES] = { 0 };
+    uint8_t *bufs[ESPNOW_FUZZ_MAX_FRAMES];
+    espnow_fuzz_rec_t rec;
+    size_t pos = 0;
+    int num = 0;
+
+    while (num < ESPNOW_FUZZ_MAX_FRAMES && size - pos >= sizeof(rec)) {
+        memcpy(&rec, data + pos, sizeof(rec));
+        pos += sizeof(rec);
+        size_t len = rec.len < size - pos ? rec.len : size - pos;
+
+        /* Empty data still gets a buffer, as the radio never hands over NULL. */
+        bufs[num] = malloc(len > 0 ? len : 1);
+        if (bufs[num] == NULL) {
+            abort();
+        }
+        memcpy(bufs[num], data + pos, len);
+        pos += len;
+        if ((rec.flags & ESPNOW_FUZZ_FIX_CRC) && len >= sizeof(example_espnow_data_t)) {
+            uint16_t crc = espnow_crc16_frame(bufs[num], len, offsetof(example_espnow_data_t, crc));
+            memcpy(bufs[num] + offsetof(example_espnow_data_t, crc), &crc, sizeof(crc));
+        }
+
+        host_replay_frame_t *frame = &frames[num];
+        memcpy(frame->src, slave, ESP_NOW_ETH_ALEN);
+        frame->src[ESP_NOW_ETH_ALEN - 1] = rec.sender % ESPNOW_FUZZ_SENDERS + 1;
+        memcpy(frame->dst, (rec.flags & ESPNOW_FUZZ_BROADCAST) ? broadcast : slave, ESP_NOW_ETH_ALEN);
+        frame->rssi = -40 - rec.sender / ESPNOW_FUZZ_SENDERS % 50;
+        frame->len = len;
+        frame->data = bufs[num];
+        num++;
+    }
+
+    host_replay_run(frames, num);
+    for (int i = 0; i < num; i++) {
+        free(bufs[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,280 @@
+/* ESPNOW fuzz harnesses - standalone driver
+
+   libFuzzer needs Clang. With any other compiler the harnesses are linked with
+   this driver instead, which takes libFuzzer's command line in part:
+
+     espnow_fuzz_xxx [-runs=N] [-seed=N] [-max_len=N] [FILE|DIR...]
+
+   Every file given, and every file of every directory given, is run once. With
+   -runs, N more inputs are then made by randomly mutating those files, or an
+   empty input if there is none, and run. The mutations are blind: unlike
+   libFuzzer, the driver does not know which inputs reach new code. It prints the
+   inputs run per second. An input that crashes is written to crash-<run>.
+
+   As it runs the files given once, the driver also serves AFL and other fuzzers
+   that pass inputs as files: afl-fuzz -i SEEDS -o OUT -- ./espnow_fuzz_xxx @@
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sanitizer/common_interface_defs.h>
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+__attribute__((weak)) int LLVMFuzzerInitialize(int *argc, char ***argv);
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+} fuzz_input_t;
+
+static fuzz_input_t *s_corpus;
+static size_t s_corpus_num;
+static size_t s_corpus_cap;
+
+/* The input being run, written out if it crashes. */
+static const uint8_t *s_current;
+static size_t s_current_size;
+static unsigned long long s_run;
+
+static void fuzz_save_current(void)
+{
+    char path[64];
+
+    snprintf(path, sizeof(path), "crash-%llu", s_run);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        if (write(fd, s_current, s_current_size) < 0) {
+            /* Nothing more to do while crashing. */
+        }
+        close(fd);
+        fprintf(stderr, "fuzz_main: input written to %s\n", path);
+    }
+}
+
+static void fuzz_crash_signal(int sig)
+{
+    fuzz_save_current();
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+/* Run a copy of the input in a buffer of its own length, so that AddressSanitizer
+ * catches reads past it. */
+static void fuzz_run(const uint8_t *data, size_t size)
+{
+    uint8_t *copy = malloc(size > 0 ? size : 1);
+    if (copy == NULL) {
+        abort();
+    }
+    memcpy(copy, data, size);
+    s_current = copy;
+    s_current_size = size;
+    LLVMFuzzerTestOneInput(copy, size);
+    free(copy);
+    s_run++;
+}
+
+static void fuzz_add(uint8_t *data, size_t size)
+{
+    if (s_corpus_num == s_corpus_cap) {
+        s_corpus_cap = s_corpus_cap ? 2 * s_corpus_cap : 64;
+        s_corpus = realloc(s_corpus, s_corpus_cap * sizeof(fuzz_input_t));
+        if (s_corpus == NULL) {
+            abort();
+        }
+    }
+    s_corpus[s_corpus_num].data = data;
+    s_corpus[s_corpus_num].size = size;
+    s_corpus_num++;
+}
+
+static int fuzz_load_file(const char *path, size_t max_len)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+    uint8_t *data = malloc(max_len > 0 ? max_len : 1);
+    if (data == NULL) {
+        abort();
+    }
+    size_t size = fread(data, 1, max_len, file);
+    fclose(file);
+    fuzz_add(data, size);
+    return 0;
+}
+
+static int fuzz_load(const char *path, size_t max_len)
+{
+    struct stat st;
+
+    if (stat(path, &st) != 0) {
+        perror(path);
+        return -1;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        return fuzz_load_file(path, max_len);
+    }
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        perror(path);
+        return -1;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        char file_path[4096];
+        snprintf(file_path, sizeof(file_path), "%s/%s", path, entry->d_name);
+        if (entry->d_name[0] != '.' && stat(file_path, &st) == 0 && S_ISREG(st.st_mode)) {
+            fuzz_load_file(file_path, max_len);
+        }
+    }
+    closedir(dir);
+    return 0;
+}
+
+/* Mutate data of *size bytes in place, within max_len bytes. */
+static void fuzz_mutate(uint8_t *data, size_t *size, size_t max_len)
+{
+    static const uint8_t interesting[] = { 0x00, 0x01, 0x7f, 0x80, 0xfe, 0xff };
+    int mutations = 1 + rand() % 4;
+
+    for (int i = 0; i < mutations; i++) {
+        size_t pos = *size > 0 ? (size_t)rand() % *size : 0;
+
+        switch (rand() % 6) {
+            case 0:
+                if (*size > 0) {
+                    data[pos] ^= 1 << (rand() % 8);
+                }
+                break;
+            case 1:
+                if (*size > 0) {
+                    data[pos] = rand();
+                }
+                break;
+            case 2:
+                if (*size > 0) {
+                    data[pos] = interesting[rand() % sizeof(interesting)];
+                }
+                break;
+            case 3:
+                if (*size < max_len) {
+                    memmove(data + pos + 1, data + pos, *size - pos);
+                    data[pos] = rand();
+                    (*size)++;
+                }
+                break;
+            case 4:
+                if (*size > 0) {
+                    size_t len = 1 + rand() % (*size - pos);
+                    memmove(data + pos, data + pos + len, *size - pos - len);
+                    *size -= len;
+                }
+                break;
+            default: {
+                /* Splice in a piece of another input. */
+                const fuzz_input_t *other = &s_corpus[rand() % s_corpus_num];
+                if (other->size == 0) {
+                    break;
+                }
+                size_t from = rand() % other->size;
+                size_t len = 1 + rand() % (other->size - from);
+                if (pos + len > max_len) {
+                    len = max_len - pos;
+                }
+                memcpy(data + pos, other->data + from, len);
+                if (pos + len > *size) {
+                    *size = pos + len;
+                }
+                break;
+            }
+        }
+    }
+}
+
+static double fuzz_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long long runs = 0;
+    unsigned int seed = (unsigned int)time(NULL);
+    size_t max_len = 4096;
+    int files = 0;
+
+    if (LLVMFuzzerInitialize != NULL) {
+        LLVMFuzzerInitialize(&argc, &argv);
+    }
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "-runs=", 6) == 0) {
+            runs = strtoull(argv[i] + 6, NULL, 0);
+        } else if (strncmp(argv[i], "-seed=", 6) == 0) {
+            seed = strtoul(argv[i] + 6, NULL, 0);
+        } else if (strncmp(argv[i], "-max_len=", 9) == 0) {
+            max_len = strtoul(argv[i] + 9, NULL, 0);
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "usage: %s [-runs=N] [-seed=N] [-max_len=N] [FILE|DIR...]\n", argv[0]);
+            return 1;
+        }
+    }
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-') {
+            if (fuzz_load(argv[i], max_len) != 0) {
+                return 1;
+            }
+            files++;
+        }
+    }
+
+    signal(SIGABRT, fuzz_crash_signal);
+    signal(SIGSEGV, fuzz_crash_signal);
+    signal(SIGFPE, fuzz_crash_signal);
+    __sanitizer_set_death_callback(fuzz_save_current);
+
+    double start = fuzz_now();
+    for (size_t i = 0; i < s_corpus_num; i++) {
+        fuzz_run(s_corpus[i].data, s_corpus[i].size);
+    }
+    if (runs > 0) {
+        uint8_t *data = malloc(max_len > 0 ? max_len : 1);
+        if (data == NULL) {
+            abort();
+        }
+        if (s_corpus_num == 0) {
+            fuzz_add(calloc(1, 1), 0);
+        }
+        srand(seed);
+        for (unsigned long long i = 0; i < runs; i++) {
+            const fuzz_input_t *base = &s_corpus[rand() % s_corpus_num];
+            size_t size = base->size;
+            memcpy(data, base->data, size);
+            fuzz_mutate(data, &size, max_len);
+            fuzz_run(data, size);
+        }
+        free(data);
+    }
+    double elapsed = fuzz_now() - start;
+    fprintf(stderr, "fuzz_main: %llu inputs from %d paths, %llu mutated, seed %u, in %.2f s: %.0f execs/s\n",
+            s_run - runs, files, runs, seed, elapsed, s_run / (elapsed > 0 ? elapsed : 1e-9));
+    return 0;
+}
@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+"""Generate sdkconfig.h for the host build of an ESPNOW example project.
+
+Values come, in increasing order of precedence, from the defaults in the
+project's main/Kconfig.projbuild, from the project's sdkconfig and from any
+sdkconfig.defaults style files given with --defaults. Options whose
+"depends on" is not met are left out, as Kconfig leaves them out.
+"""
+
+import argparse
+import re
+
+
+def kconfig_defaults(path, depends):
+    values = {}
+    name = None
+    kind = None
+    choice_default = None
+    for line in open(path, encoding='utf-8'):
+        m = re.match(r'\s*choice\b', line)
+        if m:
+            name, kind = None, 'choice'
+            continue
+        m = re.match(r'\s*endchoice\b', line)
+        if m:
+            if choice_default:
+                values[choice_default] = 'y'
+            name, kind, choice_default = None, None, None
+            continue
+        m = re.match(r'\s*(?:menu)?config\s+(\w+)', line)
+        if m:
+            name = 'CONFIG_' + m.group(1)
+            if kind != 'choice' and kind != 'choice-item':
+                kind = None
+            else:
+                kind = 'choice-item'
+            continue
+        m = re.match(r'\s*(bool|int|string|hex)\b', line)
+        if m and name and kind != 'choice-item':
+            kind = m.group(1)
+            continue
+        m = re.match(r'\s*depends\s+on\s+(.+?)\s*$', line)
+        if m:
+            if name:
+                depends[name] = m.group(1)
+            continue
+        m = re.match(r'\s*default\s+(.+?)(\s+if\s+.*)?$', line)
+        if not m:
+            continue
+        value = m.group(1).strip()
+        if kind == 'choice' and name is None:
+            choice_default = 'CONFIG_' + value
+        elif name and name not in values and kind in ('bool', 'int', 'hex', 'string'):
+            if kind == 'bool':
+                value = value.strip('"')
+                if value == 'y':
+                    values[name] = 'y'
+            else:
+                values[name] = value
+    return values
+
+
+def sdkconfig_values(path, values):
+    for line in open(path, encoding='utf-8'):
+        line = line.strip()
+        m = re.match(r'# (CONFIG_\w+) is not set', line)
+        if m:
+            values.pop(m.group(1), None)
+            continue
+        m = re.match(r'(CONFIG_\w+)=(.*)', line)
+        if m:
+            values[m.group(1)] = m.group(2)
+    return values
+
+
+def depends_met(expr, values):
+    expr = expr.replace('&&', ' and ').replace('||', ' or ')
+    expr = re.sub(r'!(?!=)', ' not ', expr)
+    expr = re.sub(r'\b([A-Z_][A-Z0-9_]*)\b', lambda m: str(values.get('CONFIG_' + m.group(1), 'n') not in ('n', '')), expr)
+    return eval(expr)
+
+
+def drop_unmet(values, depends):
+    changed = True
+    while changed:
+        changed = False
+        for name, expr in depends.items():
+            if name in values and not depends_met(expr, values):
+                del values[name]
+                changed = True
+    return values
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('--kconfig', required=True)
+    parser.add_argument('--sdkconfig', required=True)
+    parser.add_argument('--defaults', action='append', default=[])
+    parser.add_argument('--output', required=True)
+    args = parser.parse_args()
+
+    depends = {}
+    values = kconfig_defaults(args.kconfig, depends)
+    values = sdkconfig_values(args.sdkconfig, values)
+    for path in args.defaults:
+        if path:
+            values = sdkconfig_values(path, values)
+    values = drop_unmet(values, depends)
+
+    lines = ['/* Automatically generated for the host build. Do not edit. */', '#pragma once']
+    for name in sorted(values):
+        value = values[name]
+        if value == 'y':
+            value = '1'
+        elif value == 'n':
+            continue
+        lines.append('#define {} {}'.format(name, value))
+    with open(args.output, 'w', encoding='utf-8') as f:
+        f.write('\n'.join(lines) + '\n')
+
+
+if __name__ == '__main__':
+    main()
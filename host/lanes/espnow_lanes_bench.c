@@ -0,0 +1,481 @@
+/* ESPNOW priority lanes - control latency under a bulk flow
+
+   Runs espnow_event_ring.c and espnow_lanes.c of espnow_common, built with
+   CONFIG_ESPNOW_PRIORITY_LANES, between a "wifi" task and an "espnow" task and
+   reports how long control frames wait while a bulk flow saturates both ways.
+
+   The wifi task stands in for the WiFi task. It receives bulk frames every
+   1/--bulk-rate s and acknowledgements at random times, a Poisson process of
+   --control-rate per second, copies each into a receive pool slot and pushes it
+   into the event ring, as the receive callback does. It also plays the driver:
+   frames handed to esp_now_send() wait in a queue of --driver-queue frames and
+   leave one after the other, each taking its airtime at --bitrate, after which
+   the sending callback runs.
+
+   The espnow task handles every received frame for --service-us, and sends bulk
+   frames at --bulk-rate and acknowledgements at --control-rate. Frames the ring,
+   the receive pool, the lanes or the driver refuse are dropped and counted. The
+   receive latency of a frame counts from its arrival until the task takes it, and
+   the transmit latency from the call sending it until its airtime is over.
+
+   With --fifo every event goes into a single ring and every frame straight to
+   esp_now_send(), as without priority lanes.
+
+   With --send-error, esp_now_send() refuses that share of the frames with
+   ESP_ERR_ESPNOW_IF, as it does for a peer on another interface. Every frame
+   the sender was told was accepted must still get exactly one sending callback,
+   a failed one if the lanes dropped it later; the exit status is 1 otherwise.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_now.h"
+#include "host_shim.h"
+#include "espnow_example.h"
+#include "espnow_rx_pool.h"
+#include "espnow_event_ring.h"
+#include "espnow_pcap.h"
+#include "espnow_lanes.h"
+#include "espnow_rtt.h"
+
+#define BENCH_DRIVER_QUEUE_MAX  64
+#define BENCH_BULK_LEN          ESP_NOW_MAX_DATA_LEN
+#define BENCH_PREAMBLE_US       192
+#define BENCH_OVERHEAD_BYTES    43
+#define BENCH_POLL_US           100
+
+_Static_assert(ESPNOW_LANES > 1, "the benchmark needs CONFIG_ESPNOW_PRIORITY_LANES");
+
+typedef struct {
+    bool fifo;
+    uint32_t bulk_rate;                   //Bulk frames per second, each way.
+    uint32_t control_rate;                //Mean acknowledgements per second, each way.
+    uint32_t service_us;
+    double send_error;                    //Share of the frames esp_now_send() refuses.
+    uint32_t bitrate;
+    int driver_queue;
+    uint32_t seconds;
+    unsigned int seed;
+} bench_config_t;
+
+/* A frame: the header of example_espnow_data_t followed by the time it is due from. */
+typedef struct {
+    example_espnow_data_t hdr;
+    uint32_t time_us;
+} __attribute__((packed)) bench_frame_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t len;
+    uint32_t time_us;                     //Of the call sending the frame.
+    int64_t queued_us;                    //When the driver took the frame.
+} bench_tx_t;
+
+typedef struct {
+    espnow_rtt_hist_t latency;
+    uint32_t offered;
+    uint32_t dropped;
+} bench_flow_t;
+
+static bench_config_t s_cfg;
+static portMUX_TYPE s_bench_lock = portMUX_INITIALIZER_UNLOCKED;
+static bench_tx_t s_bench_driver[BENCH_DRIVER_QUEUE_MAX];          //Frames handed to esp_now_send().
+static int s_bench_driver_head;
+static int s_bench_driver_count;
+static bench_flow_t s_bench_rx_control;
+static bench_flow_t s_bench_rx_bulk;
+static bench_flow_t s_bench_tx_control;                            //Written by the wifi task, with the lock held.
+static bench_flow_t s_bench_tx_bulk;
+static volatile bool s_bench_running;
+static volatile bool s_bench_done[2];
+static unsigned short s_bench_seed[2][3];                          //Of the wifi and the espnow task.
+static uint32_t s_bench_accepted;                                  //Frames sent with ESP_OK.
+static uint32_t s_bench_reported;                                  //Sending callbacks handled.
+static uint32_t s_bench_reported_failed;
+
+static const uint8_t s_bench_peer[ESP_NOW_ETH_ALEN] = { 0x02, 0x5e, 0x00, 0x00, 0x00, 0x01 };
+
+/* The driver. */
+esp_err_t esp_now_send(const uint8_t *peer_addr, const uint8_t *data, size_t len)
+{
+    const bench_frame_t *frame = (const bench_frame_t *)data;
+    esp_err_t ret = ESP_OK;
+
+    /* Only the espnow task sends, so its random numbers can be used here. */
+    if (s_cfg.send_error > 0 && erand48(s_bench_seed[1]) < s_cfg.send_error) {
+        return ESP_ERR_ESPNOW_IF;
+    }
+    taskENTER_CRITICAL(&s_bench_lock);
+    if (s_bench_driver_count == s_cfg.driver_queue) {
+        ret = ESP_ERR_ESPNOW_NO_MEM;
+    } else {
+        bench_tx_t *tx = &s_bench_driver[(s_bench_driver_head + s_bench_driver_count) % BENCH_DRIVER_QUEUE_MAX];
+        tx->type = frame->hdr.type;
+        tx->len = len;
+        tx->time_us = frame->time_us;
+        tx->queued_us = esp_timer_get_time();
+        s_bench_driver_count++;
+    }
+    taskEXIT_CRITICAL(&s_bench_lock);
+    return ret;
+}
+
+/* esp_restart() prints the medium statistics; there is no medium. */
+void espnow_sim_log_stats(void)
+{
+}
+
+static uint32_t bench_airtime_us(size_t len)
+{
+    return BENCH_PREAMBLE_US + (uint32_t)((uint64_t)(len + BENCH_OVERHEAD_BYTES) * 8 * 1000000 / s_cfg.bitrate);
+}
+
+/* Exponentially distributed time to the next acknowledgement. */
+static int64_t bench_next_control_us(unsigned short *seed)
+{
+    if (s_cfg.control_rate == 0) {
+        return INT64_MAX / 2;
+    }
+    return (int64_t)(-log(1.0 - erand48(seed)) * 1e6 / s_cfg.control_rate);
+}
+
+static void bench_post(const example_espnow_event_t *evt, const uint8_t *data, size_t len)
+{
+    espnow_lane_t lane = ESPNOW_LANE_CONTROL;
+
+    if (!s_cfg.fifo) {
+        lane = evt->id == EXAMPLE_ESPNOW_SEND_CB ? espnow_lane_of_send_cb() : espnow_lane_of_frame(data, len);
+    }
+    if (!espnow_event_ring_push(lane, evt) && evt->id == EXAMPLE_ESPNOW_RECV_CB) {
+        espnow_rx_pool_release(evt->info.recv_cb.slot);
+        (data[0] == EXAMPLE_ESPNOW_DATA_ACK ? &s_bench_rx_control : &s_bench_rx_bulk)->dropped++;
+    }
+}
+
+/* A frame arrives, as in the receive callback. */
+static void bench_receive(uint8_t type, size_t len, int64_t due_us)
+{
+    bench_flow_t *flow = type == EXAMPLE_ESPNOW_DATA_ACK ? &s_bench_rx_control : &s_bench_rx_bulk;
+    uint16_t slot = espnow_rx_pool_claim();
+
+    flow->offered++;
+    if (slot == ESPNOW_RX_POOL_INVALID_SLOT) {
+        flow->dropped++;
+        return;
+    }
+    bench_frame_t *frame = (bench_frame_t *)espnow_rx_pool_data(slot);
+    memset(frame, 0, sizeof(*frame));
+    frame->hdr.type = type;
+    frame->time_us = (uint32_t)due_us;
+
+    example_espnow_event_t evt = {
+        .id = EXAMPLE_ESPNOW_RECV_CB,
+        .time_us = (uint32_t)due_us,
+    };
+    memcpy(evt.info.recv_cb.mac_addr, s_bench_peer, ESP_NOW_ETH_ALEN);
+    evt.info.recv_cb.slot = slot;
+    evt.info.recv_cb.data_len = len;
+    bench_post(&evt, (const uint8_t *)frame, len);
+}
+
+/* Put the frame at the head of the driver queue on the air, from free_us or from
+ * the time the driver took it. Returns false if the queue is empty, or else sets
+ * done_us to the end of its airtime. */
+static bool bench_driver_start(int64_t free_us, int64_t *done_us)
+{
+    bool busy;
+
+    taskENTER_CRITICAL(&s_bench_lock);
+    busy = s_bench_driver_count > 0;
+    if (busy) {
+        const bench_tx_t *tx = &s_bench_driver[s_bench_driver_head];
+        *done_us = (tx->queued_us > free_us ? tx->queued_us : free_us) + bench_airtime_us(tx->len);
+    }
+    taskEXIT_CRITICAL(&s_bench_lock);
+    return busy;
+}
+
+/* The frame at the head of the driver queue is sent, as in the sending callback. */
+static void bench_complete(int64_t now)
+{
+    bench_tx_t tx;
+
+    taskENTER_CRITICAL(&s_bench_lock);
+    tx = s_bench_driver[s_bench_driver_head];
+    s_bench_driver_head = (s_bench_driver_head + 1) % BENCH_DRIVER_QUEUE_MAX;
+    s_bench_driver_count--;
+    espnow_rtt_hist_record(tx.type == EXAMPLE_ESPNOW_DATA_ACK ? &s_bench_tx_control.latency : &s_bench_tx_bulk.latency,
+                           (uint32_t)now - tx.time_us);
+    taskEXIT_CRITICAL(&s_bench_lock);
+
+    espnow_lanes_sent();
+    example_espnow_event_t evt = {
+        .id = EXAMPLE_ESPNOW_SEND_CB,
+        .time_us = (uint32_t)now,
+    };
+    memcpy(evt.info.send_cb.mac_addr, s_bench_peer, ESP_NOW_ETH_ALEN);
+    evt.info.send_cb.status = ESP_NOW_SEND_SUCCESS;
+    bench_post(&evt, NULL, 0);
+}
+
+static void bench_wifi_task(void *arg)
+{
+    int64_t start_us = esp_timer_get_time();
+    int64_t end_us = start_us + (int64_t)s_cfg.seconds * 1000000;
+    int64_t bulk_us = s_cfg.bulk_rate > 0 ? start_us : INT64_MAX / 2;
+    int64_t control_us = start_us + bench_next_control_us(s_bench_seed[0]);
+    int64_t sent_us = 0;
+    bool sending = false;
+
+    (void)arg;
+    while (s_bench_running) {
+        int64_t now = esp_timer_get_time();
+
+        if (sending && now >= sent_us) {
+            bench_complete(sent_us);
+            /* The next frame goes on the air as this one is done. */
+            sending = bench_driver_start(sent_us, &sent_us);
+        } else if (!sending) {
+            sending = bench_driver_start(now, &sent_us);
+        }
+        if (sending && now >= sent_us) {
+            continue;
+        }
+        /* Frames arrive until the end; the driver runs until the espnow task is done. */
+        if (now < end_us && now >= bulk_us) {
+            bench_receive(EXAMPLE_ESPNOW_DATA_BULK, BENCH_BULK_LEN, bulk_us);
+            bulk_us += 1000000 / s_cfg.bulk_rate;
+            continue;
+        }
+        if (now < end_us && now >= control_us) {
+            bench_receive(EXAMPLE_ESPNOW_DATA_ACK, sizeof(bench_frame_t), control_us);
+            control_us += bench_next_control_us(s_bench_seed[0]);
+            continue;
+        }
+
+        /* Look at the driver queue now and then, for frames sent meanwhile. */
+        int64_t next = sending ? sent_us : now + BENCH_POLL_US;
+        if (bulk_us < next && now < end_us) {
+            next = bulk_us;
+        }
+        if (control_us < next && now < end_us) {
+            next = control_us;
+        }
+        if (next > now) {
+            host_sleep_us(next - now);
+        }
+    }
+    s_bench_done[0] = true;
+    vTaskDelete(NULL);
+}
+
+/* Send a frame due from due_us, through the lanes unless --fifo. */
+static esp_err_t bench_send(uint8_t type, size_t len, int64_t due_us)
+{
+    uint8_t data[ESP_NOW_MAX_DATA_LEN] = { 0 };
+    bench_frame_t *frame = (bench_frame_t *)data;
+    esp_err_t ret;
+
+    frame->hdr.type = type;
+    frame->time_us = (uint32_t)due_us;
+    ret = s_cfg.fifo ? espnow_pcap_send(s_bench_peer, data, len) : espnow_lanes_send(s_bench_peer, data, len);
+    if (ret == ESP_OK) {
+        s_bench_accepted++;
+    }
+    return ret;
+}
+
+static void bench_espnow_task(void *arg)
+{
+    int64_t start_us = esp_timer_get_time();
+    int64_t end_us = start_us + (int64_t)s_cfg.seconds * 1000000;
+    int64_t bulk_us = s_cfg.bulk_rate > 0 ? start_us : INT64_MAX / 2;
+    int64_t control_us = start_us + bench_next_control_us(s_bench_seed[1]);
+    example_espnow_event_t evt;
+
+    (void)arg;
+    espnow_event_ring_set_consumer(xTaskGetCurrentTaskHandle());
+    /* Once nothing is offered any more, take what is left in the ring and wait for the
+     * sending callback of every frame accepted, for at most a second. */
+    for (;;) {
+        int64_t now = esp_timer_get_time();
+        if (now >= end_us && ((s_bench_reported == s_bench_accepted && espnow_event_ring_count() == 0) ||
+                              now >= end_us + 1000000)) {
+            break;
+        }
+        /* Dropped frames first, as in example_espnow_event_wait_batch(). */
+        if (!espnow_lanes_take_dropped(&evt) && !espnow_event_ring_wait(&evt, 1)) {
+            evt.id = -1;
+        }
+        if (evt.id == EXAMPLE_ESPNOW_SEND_CB) {
+            s_bench_reported++;
+            if (evt.info.send_cb.status != ESP_NOW_SEND_SUCCESS) {
+                s_bench_reported_failed++;
+            }
+        } else if (evt.id == EXAMPLE_ESPNOW_RECV_CB) {
+            const bench_frame_t *frame = (const bench_frame_t *)espnow_rx_pool_data(evt.info.recv_cb.slot);
+            bench_flow_t *flow = frame->hdr.type == EXAMPLE_ESPNOW_DATA_ACK ? &s_bench_rx_control : &s_bench_rx_bulk;
+
+            espnow_rtt_hist_record(&flow->latency, (uint32_t)esp_timer_get_time() - frame->time_us);
+            if (s_cfg.service_us > 0) {
+                host_sleep_us(s_cfg.service_us);
+            }
+            espnow_rx_pool_release(evt.info.recv_cb.slot);
+        }
+
+        now = esp_timer_get_time();
+        while (control_us <= now && control_us < end_us) {
+            s_bench_tx_control.offered++;
+            if (bench_send(EXAMPLE_ESPNOW_DATA_ACK, sizeof(bench_frame_t), now) != ESP_OK) {
+                s_bench_tx_control.dropped++;
+            }
+            control_us += bench_next_control_us(s_bench_seed[1]);
+        }
+        while (bulk_us <= now && bulk_us < end_us) {
+            s_bench_tx_bulk.offered++;
+            if (bench_send(EXAMPLE_ESPNOW_DATA_BULK, BENCH_BULK_LEN, now) != ESP_OK) {
+                s_bench_tx_bulk.dropped++;
+            }
+            bulk_us += 1000000 / s_cfg.bulk_rate;
+        }
+        espnow_lanes_pump();
+    }
+    s_bench_done[1] = true;
+    vTaskDelete(NULL);
+}
+
+static void bench_print_flow(const char *name, const bench_flow_t *flow)
+{
+    const espnow_rtt_hist_t *hist = &flow->latency;
+
+    if (hist->count == 0) {
+        printf("  %-12s no frames\n", name);
+        return;
+    }
+    printf("  %-12s %7lu frames, p50 %7lu us, p99 %7lu us, max %7lu us, %lu of %lu dropped\n", name,
+           (unsigned long)hist->count, (unsigned long)espnow_rtt_hist_percentile(hist, 500),
+           (unsigned long)espnow_rtt_hist_percentile(hist, 990), (unsigned long)hist->max_us,
+           (unsigned long)flow->dropped, (unsigned long)flow->offered);
+}
+
+static void bench_usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --fifo                   one ring and straight to esp_now_send(), as without lanes\n"
+            "  --bulk-rate N            bulk frames per second, each way (1500)\n"
+            "  --control-rate N         mean acknowledgements per second, each way (50)\n"
+            "  --service-us N           time the espnow task spends on a received frame (1000)\n"
+            "  --send-error PCT         frames esp_now_send() refuses with ESP_ERR_ESPNOW_IF, in percent (0)\n"
+            "  --bitrate N              PHY rate of the airtime, in bit/s (1000000)\n"
+            "  --driver-queue N         frames the driver buffers, at most %d (16)\n"
+            "  --seconds N              time frames are offered for (5)\n"
+            "  --seed N                 random seed (1)\n",
+            prog, BENCH_DRIVER_QUEUE_MAX);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] = {
+        { "fifo", no_argument, NULL, 'f' },
+        { "bulk-rate", required_argument, NULL, 'b' },
+        { "control-rate", required_argument, NULL, 'c' },
+        { "service-us", required_argument, NULL, 'u' },
+        { "send-error", required_argument, NULL, 'e' },
+        { "bitrate", required_argument, NULL, 'r' },
+        { "driver-queue", required_argument, NULL, 'q' },
+        { "seconds", required_argument, NULL, 'd' },
+        { "seed", required_argument, NULL, 'S' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+    espnow_event_ring_stats_t rx;
+    espnow_lanes_stats_t tx;
+    int opt;
+
+    s_cfg = (bench_config_t) {
+        .bulk_rate = 1500,
+        .control_rate = 50,
+        .service_us = 1000,
+        .bitrate = 1000000,
+        .driver_queue = 16,
+        .seconds = 5,
+        .seed = 1,
+    };
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (opt) {
+        case 'f': s_cfg.fifo = true; break;
+        case 'b': s_cfg.bulk_rate = strtoul(optarg, NULL, 0); break;
+        case 'c': s_cfg.control_rate = strtoul(optarg, NULL, 0); break;
+        case 'u': s_cfg.service_us = strtoul(optarg, NULL, 0); break;
+        case 'e': s_cfg.send_error = atof(optarg) / 100; break;
+        case 'r': s_cfg.bitrate = strtoul(optarg, NULL, 0); break;
+        case 'q': s_cfg.driver_queue = atoi(optarg); break;
+        case 'd': s_cfg.seconds = strtoul(optarg, NULL, 0); break;
+        case 'S': s_cfg.seed = strtoul(optarg, NULL, 0); break;
+        default:
+            bench_usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (s_cfg.bulk_rate > 1000000 || s_cfg.bitrate == 0 || s_cfg.driver_queue < 1
+        || s_cfg.driver_queue > BENCH_DRIVER_QUEUE_MAX || s_cfg.seconds == 0) {
+        bench_usage(argv[0]);
+        return 1;
+    }
+
+    host_log_init();
+    for (int i = 0; i < 2; i++) {
+        s_bench_seed[i][0] = s_cfg.seed;
+        s_bench_seed[i][1] = s_cfg.seed >> 16;
+        s_bench_seed[i][2] = i;
+    }
+    espnow_rx_pool_init();
+    espnow_event_ring_init();
+    espnow_lanes_init();
+    espnow_rtt_hist_reset(&s_bench_rx_control.latency);
+    espnow_rtt_hist_reset(&s_bench_rx_bulk.latency);
+    espnow_rtt_hist_reset(&s_bench_tx_control.latency);
+    espnow_rtt_hist_reset(&s_bench_tx_bulk.latency);
+
+    s_bench_running = true;
+    if (xTaskCreate(bench_espnow_task, "espnow", 4096, NULL, 4, NULL) != pdPASS ||
+        xTaskCreate(bench_wifi_task, "wifi", 4096, NULL, 23, NULL) != pdPASS) {
+        return 1;
+    }
+    while (!s_bench_done[1]) {
+        host_sleep_us(10000);
+    }
+    s_bench_running = false;
+    while (!s_bench_done[0]) {
+        host_sleep_us(1000);
+    }
+
+    espnow_event_ring_get_stats(&rx);
+    espnow_lanes_get_stats(&tx);
+    printf("%s, %lu bulk frames/s and %lu acknowledgements/s each way, %lu us per frame received, "
+           "%lu frames in the driver\n", s_cfg.fifo ? "fifo" : "lanes", (unsigned long)s_cfg.bulk_rate,
+           (unsigned long)s_cfg.control_rate, (unsigned long)s_cfg.service_us, (unsigned long)s_cfg.driver_queue);
+    bench_print_flow("rx control", &s_bench_rx_control);
+    bench_print_flow("rx bulk", &s_bench_rx_bulk);
+    bench_print_flow("tx control", &s_bench_tx_control);
+    bench_print_flow("tx bulk", &s_bench_tx_bulk);
+    if (!s_cfg.fifo) {
+        printf("  starvation guard: %lu rx, %lu tx\n", (unsigned long)rx.overrides, (unsigned long)tx.overrides);
+    }
+    printf("  sending callbacks: %lu of %lu frames accepted, %lu failed\n", (unsigned long)s_bench_reported,
+           (unsigned long)s_bench_accepted, (unsigned long)s_bench_reported_failed);
+    return s_bench_reported == s_bench_accepted ? 0 : 1;
+}
@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+"""Decode the ESPNOW_METRICS lines printed by the ESPNOW examples.
+
+Reads node logs or a serial capture, from the files given or standard input,
+and prints the latest snapshot of every device as one table row. With
+--all every snapshot is printed in the order it was read.
+
+The snapshot layout is espnow_metrics_snapshot_t in espnow_metrics.h.
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+COUNTERS = ['rx_frames', 'tx_frames', 'send_fail', 'queue_full', 'crc_fail', 'no_mem', 'peer_add_fail']
+GAUGES = ['queue_high_water', 'batch_high_water']
+
+LINE = re.compile(r'ESPNOW_METRICS ((?:[0-9a-f]{2}:){5}[0-9a-f]{2}) ([0-9a-f]+)')
+
+
+def decode(data):
+    if len(data) < 8:
+        return None
+    version, counters, gauges, _, uptime_ms = struct.unpack_from('<BBBBI', data)
+    if version != 1 or len(data) < 8 + 4 * (counters + gauges):
+        return None
+    values = struct.unpack_from('<%dI' % (counters + gauges), data, 8)
+    snap = {'uptime_s': uptime_ms // 1000}
+    # Values this decoder does not know are skipped, missing ones are left out.
+    for name, value in zip(COUNTERS, values[:counters]):
+        snap[name] = value
+    for name, value in zip(GAUGES, values[counters:]):
+        snap[name] = value
+    return snap
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('logs', nargs='*', help='files to read, standard input if none')
+    parser.add_argument('--all', action='store_true', help='print every snapshot, not only the latest per device')
+    args = parser.parse_args()
+
+    columns = ['mac', 'uptime_s'] + COUNTERS + GAUGES
+    print(' '.join('%-17s' % c if c == 'mac' else '%*s' % (max(len(c), 8), c) for c in columns))
+
+    def row(mac, snap):
+        print(' '.join('%-17s' % mac if c == 'mac' else '%*s' % (max(len(c), 8), snap.get(c, '-')) for c in columns))
+
+    latest = {}
+    files = [open(path, encoding='utf-8', errors='replace') for path in args.logs] or [sys.stdin]
+    for f in files:
+        for line in f:
+            m = LINE.search(line)
+            if not m:
+                continue
+            snap = decode(bytes.fromhex(m.group(2)))
+            if snap is None:
+                continue
+            if args.all:
+                row(m.group(1), snap)
+            else:
+                latest[m.group(1)] = snap
+    for mac in sorted(latest):
+        row(mac, latest[mac])
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,228 @@
+/* ESPNOW capture decoder
+
+   Reads the frames captured by espnow_pcap.c, either as the ESPNOW_PCAP lines of
+   "pcap dump" in node logs or serial captures, or as a pcap file written by this
+   tool, and decodes the example_espnow_data_t header of every frame.
+
+   For every flow, that is every direction, source, destination and frame type, it
+   prints the frames and bytes, the CRC failures, the sequence numbers skipped and
+   the longest run of them, duplicates and late frames, and the mean and longest
+   gap between frames. A sender numbers each frame type with one counter whatever
+   the destination, so skipped numbers are losses only when the sender sends that
+   type to this destination alone. When the captures of the sender and of the
+   receiver are both read, every received flow also shows how many of the frames
+   sent were received.
+
+   Several dumps of one capture overlap; frames that are not newer than the last
+   frame of the previous dump in the same input are skipped.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <getopt.h>
+#include <algorithm>
+#include <array>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "espnow_pcap_file.hpp"
+
+namespace {
+
+using espnow_pcap::Frame;
+using espnow_pcap::frame_crc;
+
+const char *const TYPE_NAMES[EXAMPLE_ESPNOW_DATA_MAX] = {
+    "broadcast", "unicast", "aggregate", "reliable", "ack", "fragment", "bulk", "mcast", "probe", "echo",
+    "bench", "metrics",
+};
+
+using Mac = std::array<uint8_t, ESP_NOW_ETH_ALEN>;
+using FlowKey = std::tuple<uint8_t, Mac, Mac, int>;   // Direction, source, destination, type or -1 if too short.
+
+struct Flow {
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    uint64_t crc_fail = 0;
+    uint64_t skipped = 0;
+    uint64_t longest_skip = 0;
+    uint64_t duplicates = 0;
+    uint64_t late = 0;
+    uint64_t first_us = 0;
+    uint64_t last_us = 0;
+    uint64_t longest_gap_us = 0;
+    bool have_seq = false;
+    uint16_t last_seq = 0;
+};
+
+std::string mac_str(const uint8_t *mac)
+{
+    char buf[18];
+    snprintf(buf, sizeof(buf), "%02x:%02x:%02x:%02x:%02x:%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    return buf;
+}
+
+std::string type_str(int type)
+{
+    if (type < 0) {
+        return "short";
+    }
+    if (type < EXAMPLE_ESPNOW_DATA_MAX) {
+        return TYPE_NAMES[type];
+    }
+    return "type" + std::to_string(type);
+}
+
+void print_frame(const Frame &f)
+{
+    printf("%10.6f %s %s > %s %4d %3zu", f.time_us / 1e6, f.hdr.dir == ESPNOW_PCAP_TX ? "tx" : "rx",
+           mac_str(f.hdr.src).c_str(), mac_str(f.hdr.dst).c_str(), f.hdr.rssi, f.data.size());
+    if (f.data.size() < sizeof(example_espnow_data_t)) {
+        printf(" short\n");
+        return;
+    }
+    example_espnow_data_t hdr;
+    memcpy(&hdr, f.data.data(), sizeof(hdr));
+    printf(" %-9s state %u seq %5u magic %10" PRIu32 " crc %s\n", type_str(hdr.type).c_str(), hdr.state,
+           hdr.seq_num, hdr.magic, frame_crc(f.data) == hdr.crc ? "ok" : "BAD");
+}
+
+void add_to_flow(Flow &flow, const Frame &f, const example_espnow_data_t *hdr)
+{
+    if (flow.frames == 0) {
+        flow.first_us = f.time_us;
+    } else {
+        flow.longest_gap_us = std::max(flow.longest_gap_us, f.time_us - flow.last_us);
+    }
+    flow.last_us = f.time_us;
+    flow.frames++;
+    flow.bytes += f.data.size();
+    if (hdr == nullptr) {
+        return;
+    }
+    if (frame_crc(f.data) != hdr->crc) {
+        flow.crc_fail++;
+        return;
+    }
+    if (!flow.have_seq) {
+        flow.have_seq = true;
+        flow.last_seq = hdr->seq_num;
+        return;
+    }
+    uint16_t diff = (uint16_t)(hdr->seq_num - flow.last_seq);
+    if (diff == 0) {
+        flow.duplicates++;
+    } else if (diff < 0x8000) {
+        flow.skipped += diff - 1;
+        flow.longest_skip = std::max<uint64_t>(flow.longest_skip, diff - 1);
+        flow.last_seq = hdr->seq_num;
+    } else {
+        flow.late++;
+    }
+}
+
+void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options] [FILE...]\n"
+            "  Reads node logs, serial captures or pcap files, standard input if none.\n"
+            "  --frames                 print every frame\n"
+            "  --write FILE             write the frames read as a pcap file\n",
+            prog);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] = {
+        { "frames", no_argument, nullptr, 'f' },
+        { "write", required_argument, nullptr, 'w' },
+        { "help", no_argument, nullptr, 'h' },
+        { nullptr, 0, nullptr, 0 },
+    };
+    bool print_frames = false;
+    std::string write_path;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "", options, nullptr)) != -1) {
+        switch (opt) {
+        case 'f': print_frames = true; break;
+        case 'w': write_path = optarg; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    std::vector<Frame> frames;
+    if (optind == argc) {
+        espnow_pcap::read_input(std::cin, "stdin", frames);
+    }
+    for (int i = optind; i < argc; i++) {
+        std::ifstream file(argv[i], std::ios::binary);
+        if (!file) {
+            std::cerr << argv[i] << ": cannot open\n";
+            return 1;
+        }
+        if (!espnow_pcap::read_input(file, argv[i], frames)) {
+            return 1;
+        }
+    }
+    /* Inputs from several nodes are merged by time since boot, which is only roughly common. */
+    std::stable_sort(frames.begin(), frames.end(), [](const Frame &a, const Frame &b) {
+        return a.time_us < b.time_us;
+    });
+
+    if (!write_path.empty()) {
+        espnow_pcap::write_pcap(write_path, frames);
+    }
+
+    std::map<FlowKey, Flow> flows;
+    for (const Frame &f : frames) {
+        if (print_frames) {
+            print_frame(f);
+        }
+        example_espnow_data_t hdr;
+        bool has_hdr = f.data.size() >= sizeof(hdr);
+        if (has_hdr) {
+            memcpy(&hdr, f.data.data(), sizeof(hdr));
+        }
+        Mac src, dst;
+        std::copy(f.hdr.src, f.hdr.src + ESP_NOW_ETH_ALEN, src.begin());
+        std::copy(f.hdr.dst, f.hdr.dst + ESP_NOW_ETH_ALEN, dst.begin());
+        FlowKey key(f.hdr.dir, src, dst, has_hdr ? hdr.type : -1);
+        add_to_flow(flows[key], f, has_hdr ? &hdr : nullptr);
+    }
+
+    printf("%-2s %-17s %-17s %-9s %7s %8s %5s %7s %6s %5s %5s %9s %9s %9s\n", "", "source", "destination",
+           "type", "frames", "bytes", "crc", "skipped", "burst", "dup", "late", "gap_ms", "max_gap", "received");
+    for (const auto &[key, flow] : flows) {
+        const auto &[dir, src, dst, type] = key;
+        double mean_gap = flow.frames > 1 ? (flow.last_us - flow.first_us) / 1e3 / (flow.frames - 1) : 0;
+        std::string received = "-";
+        if (dir == ESPNOW_PCAP_RX) {
+            auto sent = flows.find(FlowKey(ESPNOW_PCAP_TX, src, dst, type));
+            if (sent != flows.end()) {
+                received = std::to_string(flow.frames) + "/" + std::to_string(sent->second.frames);
+            }
+        }
+        printf("%-2s %-17s %-17s %-9s %7" PRIu64 " %8" PRIu64 " %5" PRIu64 " %7" PRIu64 " %6" PRIu64 " %5" PRIu64
+               " %5" PRIu64 " %9.2f %9.2f %9s\n",
+               dir == ESPNOW_PCAP_TX ? "tx" : "rx", mac_str(src.data()).c_str(), mac_str(dst.data()).c_str(),
+               type_str(type).c_str(), flow.frames, flow.bytes, flow.crc_fail, flow.skipped, flow.longest_skip,
+               flow.duplicates, flow.late, mean_gap, flow.longest_gap_us / 1e3, received.c_str());
+    }
+    return 0;
+}
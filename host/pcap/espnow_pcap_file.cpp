@@ -0,0 +1,180 @@
+/* ESPNOW capture files
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include "espnow_pcap_file.hpp"
+
+namespace espnow_pcap {
+
+namespace {
+
+constexpr uint32_t PCAP_MAGIC = 0xa1b2c3d4;
+constexpr size_t PCAP_FILE_HDR_LEN = 24;
+constexpr size_t PCAP_REC_HDR_LEN = 16;
+constexpr uint16_t CRC16_POLY_REFLECTED = 0x8408;
+
+uint32_t load32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void store32(std::vector<uint8_t> &out, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) {
+        out.push_back((uint8_t)(v >> (8 * i)));
+    }
+}
+
+/* Parse the pcap record at rec, with len bytes of input left. */
+bool parse_record(const uint8_t *rec, size_t len, Frame &frame)
+{
+    if (len < PCAP_REC_HDR_LEN) {
+        return false;
+    }
+    uint32_t incl_len = load32(rec + 8);
+    if (incl_len < sizeof(espnow_pcap_hdr_t) || len < PCAP_REC_HDR_LEN + incl_len) {
+        return false;
+    }
+    frame.time_us = (uint64_t)load32(rec) * 1000000 + load32(rec + 4);
+    memcpy(&frame.hdr, rec + PCAP_REC_HDR_LEN, sizeof(espnow_pcap_hdr_t));
+    frame.data.assign(rec + PCAP_REC_HDR_LEN + sizeof(espnow_pcap_hdr_t), rec + PCAP_REC_HDR_LEN + incl_len);
+    return frame.hdr.version == ESPNOW_PCAP_VERSION;
+}
+
+bool from_hex(const std::string &hex, std::vector<uint8_t> &out)
+{
+    out.clear();
+    if (hex.size() % 2 != 0) {
+        return false;
+    }
+    for (size_t i = 0; i < hex.size(); i += 2) {
+        unsigned v;
+        if (sscanf(hex.c_str() + i, "%2x", &v) != 1) {
+            return false;
+        }
+        out.push_back((uint8_t)v);
+    }
+    return true;
+}
+
+} // namespace
+
+uint16_t frame_crc(const uint8_t *data, size_t len)
+{
+    uint16_t crc = 0;                // UINT16_MAX, inverted on entry.
+    size_t crc_offset = offsetof(example_espnow_data_t, crc);
+
+    for (size_t i = 0; i < len; i++) {
+        uint8_t b = (i == crc_offset || i == crc_offset + 1) ? 0 : data[i];
+        crc ^= b;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC16_POLY_REFLECTED : crc >> 1;
+        }
+    }
+    return (uint16_t)~crc;
+}
+
+bool read_input(std::istream &in, const std::string &name, std::vector<Frame> &frames)
+{
+    std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    const uint8_t *p = (const uint8_t *)content.data();
+
+    if (content.size() >= PCAP_FILE_HDR_LEN && load32(p) == PCAP_MAGIC) {
+        if (load32(p + 20) != ESPNOW_PCAP_LINKTYPE) {
+            std::cerr << name << ": link type " << load32(p + 20) << " is not ESPNOW\n";
+            return false;
+        }
+        size_t pos = PCAP_FILE_HDR_LEN;
+        Frame frame;
+        while (pos < content.size() && parse_record(p + pos, content.size() - pos, frame)) {
+            pos += PCAP_REC_HDR_LEN + load32(p + pos + 8);
+            frames.push_back(frame);
+        }
+        if (pos != content.size()) {
+            std::cerr << name << ": truncated or malformed record at offset " << pos << "\n";
+        }
+        return true;
+    }
+
+    std::istringstream lines(content);
+    std::string line;
+    std::vector<uint8_t> bytes;
+    uint64_t newest_us = 0;          // Last frame of the previous dumps.
+    uint64_t dump_newest_us = 0;
+    bool in_dump = false;
+    size_t bad = 0;
+
+    while (std::getline(lines, line)) {
+        size_t at = line.find(ESPNOW_PCAP_LINE " ");
+        if (at == std::string::npos) {
+            continue;
+        }
+        std::string hex = line.substr(at + strlen(ESPNOW_PCAP_LINE " "));
+        hex.erase(hex.find_last_not_of(" \r\n") + 1);
+        if (hex == "end") {
+            in_dump = false;
+            newest_us = std::max(newest_us, dump_newest_us);
+            continue;
+        }
+        if (!from_hex(hex, bytes)) {
+            bad++;
+            continue;
+        }
+        if (bytes.size() == PCAP_FILE_HDR_LEN && load32(bytes.data()) == PCAP_MAGIC) {
+            in_dump = true;
+            dump_newest_us = newest_us;
+            continue;
+        }
+        Frame frame;
+        if (!in_dump || !parse_record(bytes.data(), bytes.size(), frame)) {
+            bad++;
+            continue;
+        }
+        if (frame.time_us > newest_us) {
+            dump_newest_us = std::max(dump_newest_us, frame.time_us);
+            frames.push_back(frame);
+        }
+    }
+    if (bad > 0) {
+        std::cerr << name << ": " << bad << " malformed " ESPNOW_PCAP_LINE " lines skipped\n";
+    }
+    return true;
+}
+
+void write_pcap(const std::string &path, const std::vector<Frame> &frames)
+{
+    std::vector<uint8_t> out;
+
+    store32(out, PCAP_MAGIC);
+    store32(out, 2 | (4 << 16));     // Version 2.4.
+    store32(out, 0);
+    store32(out, 0);
+    store32(out, sizeof(espnow_pcap_hdr_t) + ESP_NOW_MAX_DATA_LEN);
+    store32(out, ESPNOW_PCAP_LINKTYPE);
+    for (const Frame &f : frames) {
+        uint32_t len = sizeof(espnow_pcap_hdr_t) + f.data.size();
+        store32(out, (uint32_t)(f.time_us / 1000000));
+        store32(out, (uint32_t)(f.time_us % 1000000));
+        store32(out, len);
+        store32(out, len);
+        const uint8_t *hdr = (const uint8_t *)&f.hdr;
+        out.insert(out.end(), hdr, hdr + sizeof(espnow_pcap_hdr_t));
+        out.insert(out.end(), f.data.begin(), f.data.end());
+    }
+    std::ofstream file(path, std::ios::binary);
+    file.write((const char *)out.data(), out.size());
+}
+
+} // namespace espnow_pcap
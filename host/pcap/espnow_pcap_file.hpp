@@ -0,0 +1,55 @@
+/* ESPNOW capture files
+
+   Reading and writing of the frames captured by espnow_pcap.c, shared by the
+   host tools: pcap files of link type ESPNOW_PCAP_LINKTYPE, and the
+   ESPNOW_PCAP lines of "pcap dump" in node logs or serial captures.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESPNOW_PCAP_FILE_HPP
+#define ESPNOW_PCAP_FILE_HPP
+
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "esp_now.h"
+#include "espnow_example.h"
+#include "espnow_pcap.h"
+}
+
+namespace espnow_pcap {
+
+struct Frame {
+    uint64_t time_us;
+    espnow_pcap_hdr_t hdr;
+    std::vector<uint8_t> data;
+};
+
+/* Same CRC as espnow_crc16_frame(): bit-compatible with esp_crc16_le() from
+ * UINT16_MAX, over the frame with its CRC field read as zero. */
+uint16_t frame_crc(const uint8_t *data, size_t len);
+
+inline uint16_t frame_crc(const std::vector<uint8_t> &data)
+{
+    return frame_crc(data.data(), data.size());
+}
+
+/* Append the frames of a pcap file, or of the ESPNOW_PCAP lines of a log, to frames.
+ * Several dumps of one capture overlap; frames that are not newer than the last frame
+ * of the previous dump in the same input are skipped. Problems are reported on
+ * std::cerr under name; returns false if the input cannot be used at all. */
+bool read_input(std::istream &in, const std::string &name, std::vector<Frame> &frames);
+
+void write_pcap(const std::string &path, const std::vector<Frame> &frames);
+
+} // namespace espnow_pcap
+
+#endif
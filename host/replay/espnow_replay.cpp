@@ -0,0 +1,509 @@
+/* ESPNOW replay harness
+
+   Runs a corpus of frames through the master's receive path as fast as the
+   host allows, with ESPNOW and WiFi stubbed out, and reports the time, heap
+   allocations and, where perf_event_open is permitted, the cycles,
+   instructions, cache and branch misses per frame. The corpus is either the
+   frames of a capture read by espnow_pcap_decode, or synthetic traffic of a
+   number of slaves.
+
+   The corpus is replayed as many times as needed. Each copy gets its
+   sequence numbers moved past those of the previous copy, and its CRC
+   updated, so that the master handles it as new frames rather than as
+   duplicates; frames with a bad CRC stay bad.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <getopt.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "espnow_pcap_file.hpp"
+
+extern "C" {
+#include "sdkconfig.h"
+#include "host_shim.h"
+#include "espnow_reliable.h"
+#include "espnow_rtt.h"
+#include "espnow_stage.h"
+#include "host_replay.h"
+}
+
+namespace {
+
+using espnow_pcap::Frame;
+
+constexpr uint64_t DEFAULT_FRAMES = 1000000;
+constexpr uint64_t DEFAULT_WARMUP = 10000;
+constexpr int DEFAULT_SENDERS = 16;
+constexpr size_t PASS_MIN_FRAMES = 4096;   // Frames timed at once, so the clock costs nothing.
+
+/* Frames of the synthetic traffic of a slave, in turn. */
+constexpr uint8_t SYNTHETIC_TYPES[] = {
+    EXAMPLE_ESPNOW_DATA_BROADCAST, EXAMPLE_ESPNOW_DATA_UNICAST, EXAMPLE_ESPNOW_DATA_RELIABLE,
+    EXAMPLE_ESPNOW_DATA_UNICAST, EXAMPLE_ESPNOW_DATA_PROBE, EXAMPLE_ESPNOW_DATA_UNICAST,
+    EXAMPLE_ESPNOW_DATA_RELIABLE, EXAMPLE_ESPNOW_DATA_UNICAST,
+};
+
+std::atomic<uint64_t> s_allocs;
+std::atomic<uint64_t> s_frees;
+
+/* Hardware counters of the calling thread, in user space. */
+class PerfCounters {
+public:
+    static constexpr int NUM = 5;
+
+    PerfCounters()
+    {
+        static const uint64_t configs[NUM] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_REFERENCES,
+            PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES,
+        };
+
+        for (int i = 0; i < NUM; i++) {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.disabled = i == 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+            fds_[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fds_[0], 0);
+            if (fds_[i] < 0 && i == 0) {
+                error_ = strerror(errno);
+                return;
+            }
+        }
+    }
+
+    ~PerfCounters()
+    {
+        for (int fd : fds_) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    bool ok() const { return fds_[0] >= 0; }
+    const std::string &error() const { return error_; }
+
+    void reset() { group_ioctl(PERF_EVENT_IOC_RESET); }
+    void start() { group_ioctl(PERF_EVENT_IOC_ENABLE); }
+    void stop() { group_ioctl(PERF_EVENT_IOC_DISABLE); }
+
+    /* Counts since the reset, -1 for the counters the CPU does not have. */
+    std::vector<int64_t> read() const
+    {
+        std::vector<int64_t> counts(NUM, -1);
+        uint64_t buf[1 + NUM];
+
+        if (!ok() || ::read(fds_[0], buf, sizeof(buf)) <= 0) {
+            return counts;
+        }
+        for (int i = 0, value = 0; i < NUM && value < (int)buf[0]; i++) {
+            if (fds_[i] >= 0) {
+                counts[i] = (int64_t)buf[1 + value++];
+            }
+        }
+        return counts;
+    }
+
+private:
+    void group_ioctl(unsigned long request)
+    {
+        if (ok()) {
+            ioctl(fds_[0], request, PERF_IOC_FLAG_GROUP);
+        }
+    }
+
+    int fds_[NUM] = { -1, -1, -1, -1, -1 };
+    std::string error_;
+};
+
+/* One copy of the corpus after another, renumbered. */
+class Corpus {
+public:
+    explicit Corpus(std::vector<Frame> frames) : frames_(std::move(frames))
+    {
+        /* How far each copy moves the sequence numbers of a sender and type. */
+        std::map<SeqKey, std::pair<uint16_t, uint16_t>> ranges;
+        for (const Frame &f : frames_) {
+            const example_espnow_data_t *hdr = header(f);
+            if (hdr == nullptr) {
+                continue;
+            }
+            auto [it, added] = ranges.try_emplace(key(f, hdr), hdr->seq_num, hdr->seq_num);
+            auto &[first, last] = it->second;
+            if (!added && (int16_t)(hdr->seq_num - first) < 0) {
+                first = hdr->seq_num;
+            }
+            if (!added && (int16_t)(hdr->seq_num - last) > 0) {
+                last = hdr->seq_num;
+            }
+        }
+        for (const auto &[k, range] : ranges) {
+            spans_[k] = (uint16_t)(range.second - range.first + 1);
+        }
+    }
+
+    size_t size() const { return frames_.size(); }
+
+    /* Fill pass with the copies from copy on, at least PASS_MIN_FRAMES frames. */
+    void fill(uint64_t copy, std::vector<std::vector<uint8_t>> &data, std::vector<host_replay_frame_t> &pass) const
+    {
+        size_t copies = copies_per_pass();
+
+        data.resize(copies * frames_.size());
+        pass.resize(copies * frames_.size());
+        for (size_t c = 0, n = 0; c < copies; c++) {
+            for (const Frame &f : frames_) {
+                data[n] = f.data;
+                renumber(f, copy + c, data[n]);
+                host_replay_frame_t &frame = pass[n];
+                memcpy(frame.src, f.hdr.src, ESP_NOW_ETH_ALEN);
+                memcpy(frame.dst, f.hdr.dst, ESP_NOW_ETH_ALEN);
+                frame.rssi = f.hdr.rssi;
+                frame.len = (uint16_t)data[n].size();
+                frame.data = data[n].data();
+                n++;
+            }
+        }
+    }
+
+    size_t copies_per_pass() const { return (PASS_MIN_FRAMES + frames_.size() - 1) / frames_.size(); }
+
+private:
+    using SeqKey = std::tuple<std::string, int>;   // Source and type.
+
+    static const example_espnow_data_t *header(const Frame &f)
+    {
+        if (f.data.size() < sizeof(example_espnow_data_t)) {
+            return nullptr;
+        }
+        const example_espnow_data_t *hdr = (const example_espnow_data_t *)f.data.data();
+        return espnow_pcap::frame_crc(f.data) == hdr->crc ? hdr : nullptr;
+    }
+
+    static SeqKey key(const Frame &f, const example_espnow_data_t *hdr)
+    {
+        return SeqKey(std::string((const char *)f.hdr.src, ESP_NOW_ETH_ALEN), hdr->type);
+    }
+
+    void renumber(const Frame &f, uint64_t copy, std::vector<uint8_t> &data) const
+    {
+        const example_espnow_data_t *hdr = header(f);
+        if (hdr == nullptr || copy == 0) {
+            return;
+        }
+        uint16_t shift = (uint16_t)(spans_.at(key(f, hdr)) * copy);
+        example_espnow_data_t *out = (example_espnow_data_t *)data.data();
+        out->seq_num = (uint16_t)(out->seq_num + shift);
+        /* The window of reliable data moves with its sequence numbers. */
+        if (out->type == EXAMPLE_ESPNOW_DATA_RELIABLE &&
+            data.size() >= sizeof(example_espnow_data_t) + sizeof(espnow_reliable_hdr_t)) {
+            espnow_reliable_hdr_t *rel = (espnow_reliable_hdr_t *)out->payload;
+            rel->base = (uint16_t)(rel->base + shift);
+        }
+        out->crc = espnow_pcap::frame_crc(data);
+    }
+
+    std::vector<Frame> frames_;
+    std::map<SeqKey, uint16_t> spans_;
+};
+
+Frame synthetic_frame(int sender, uint8_t type, uint16_t seq, const uint8_t *master_mac)
+{
+    static const uint8_t broadcast_mac[ESP_NOW_ETH_ALEN] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+    Frame f = {};
+    std::vector<uint8_t> payload;
+
+    f.hdr.version = ESPNOW_PCAP_VERSION;
+    f.hdr.dir = ESPNOW_PCAP_RX;
+    f.hdr.rssi = (int8_t)(-40 - sender % 40);
+    /* The addresses of the simulated nodes, the master being node 0. */
+    const uint8_t src[ESP_NOW_ETH_ALEN] = { 0x02, 0x5e, 0x00, 0x00, (uint8_t)(sender >> 8), (uint8_t)sender };
+    memcpy(f.hdr.src, src, ESP_NOW_ETH_ALEN);
+    memcpy(f.hdr.dst, type == EXAMPLE_ESPNOW_DATA_BROADCAST ? broadcast_mac : master_mac, ESP_NOW_ETH_ALEN);
+
+    if (type == EXAMPLE_ESPNOW_DATA_RELIABLE) {
+        espnow_reliable_hdr_t rel = {};
+        rel.base = seq;
+        const uint8_t *p = (const uint8_t *)&rel;
+        payload.assign(p, p + sizeof(rel));
+        const char msg[] = "reliable message";
+        payload.insert(payload.end(), msg, msg + sizeof(msg));
+    } else if (type == EXAMPLE_ESPNOW_DATA_PROBE) {
+        espnow_rtt_probe_t probe = {};
+        probe.id = seq;
+        probe.sent_us = (int64_t)seq * 1000;
+        const uint8_t *p = (const uint8_t *)&probe;
+        payload.assign(p, p + sizeof(probe));
+    } else {
+        /* What example_espnow_data_prepare() of the slave sends. */
+        std::string msg = "hello_slave";
+        msg.resize(CONFIG_ESPNOW_SEND_LEN > sizeof(example_espnow_data_t) ?
+                   CONFIG_ESPNOW_SEND_LEN - sizeof(example_espnow_data_t) - 1 : 0);
+        payload.assign(msg.c_str(), msg.c_str() + msg.size() + 1);
+    }
+
+    example_espnow_data_t hdr = {};
+    hdr.type = type;
+    hdr.state = type == EXAMPLE_ESPNOW_DATA_BROADCAST ? 0 : 1;
+    hdr.seq_num = seq;
+    hdr.magic = 0x5eed0000u + (uint32_t)sender;
+    const uint8_t *p = (const uint8_t *)&hdr;
+    f.data.assign(p, p + sizeof(hdr));
+    f.data.insert(f.data.end(), payload.begin(), payload.end());
+    ((example_espnow_data_t *)f.data.data())->crc = espnow_pcap::frame_crc(f.data);
+    return f;
+}
+
+/* Every sender in turn sends the next frame of SYNTHETIC_TYPES. */
+std::vector<Frame> synthetic_corpus(int senders, const uint8_t *master_mac)
+{
+    std::vector<Frame> frames;
+    uint16_t seq[EXAMPLE_ESPNOW_DATA_MAX] = {};
+
+    for (uint8_t type : SYNTHETIC_TYPES) {
+        for (int s = 1; s <= senders; s++) {
+            frames.push_back(synthetic_frame(s, type, seq[type], master_mac));
+        }
+        seq[type]++;
+    }
+    return frames;
+}
+
+void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options] [FILE...]\n"
+            "  Replays the frames received in node logs, serial captures or pcap files through the\n"
+            "  master's receive path, or synthetic traffic without a file.\n"
+            "  --frames N               frames timed, default %" PRIu64 "\n"
+            "  --warmup N               frames replayed before timing, default %" PRIu64 "\n"
+            "  --synthetic SENDERS      slaves of the synthetic traffic, default %d\n"
+            "  --tx                     replay the frames the capture sent rather than received\n"
+            "  --output FILE            write what the master prints to FILE, default /dev/null\n",
+            prog, DEFAULT_FRAMES, DEFAULT_WARMUP, DEFAULT_SENDERS);
+}
+
+void print_per_frame(FILE *report, const char *name, int64_t count, uint64_t frames)
+{
+    if (count < 0) {
+        fprintf(report, "  %-22s n/a\n", name);
+    } else {
+        fprintf(report, "  %-22s %10.2f\n", name, (double)count / frames);
+    }
+}
+
+} // namespace
+
+/* Heap use of the code linked into the harness, see --wrap in CMakeLists.txt.
+ * The C library's own allocations, and those of the C++ runtime, are not counted. */
+extern "C" {
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t num, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+void *__wrap_malloc(size_t size)
+{
+    s_allocs.fetch_add(1, std::memory_order_relaxed);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t num, size_t size)
+{
+    s_allocs.fetch_add(1, std::memory_order_relaxed);
+    return __real_calloc(num, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    s_allocs.fetch_add(1, std::memory_order_relaxed);
+    return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr)
+{
+    if (ptr != nullptr) {
+        s_frees.fetch_add(1, std::memory_order_relaxed);
+    }
+    __real_free(ptr);
+}
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] = {
+        { "frames", required_argument, nullptr, 'n' },
+        { "warmup", required_argument, nullptr, 'w' },
+        { "synthetic", required_argument, nullptr, 's' },
+        { "tx", no_argument, nullptr, 't' },
+        { "output", required_argument, nullptr, 'o' },
+        { "help", no_argument, nullptr, 'h' },
+        { nullptr, 0, nullptr, 0 },
+    };
+    uint64_t timed_frames = DEFAULT_FRAMES;
+    uint64_t warmup_frames = DEFAULT_WARMUP;
+    int senders = DEFAULT_SENDERS;
+    uint8_t dir = ESPNOW_PCAP_RX;
+    const char *output = "/dev/null";
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "", options, nullptr)) != -1) {
+        switch (opt) {
+        case 'n': timed_frames = strtoull(optarg, nullptr, 0); break;
+        case 'w': warmup_frames = strtoull(optarg, nullptr, 0); break;
+        case 's': senders = atoi(optarg); break;
+        case 't': dir = ESPNOW_PCAP_TX; break;
+        case 'o': output = optarg; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (timed_frames == 0 || senders < 1 || senders > 0xffff) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* The master is quiet unless asked otherwise, and what it still prints, such as the
+     * metrics frames of the slaves, goes to the output file. */
+    setenv("ESPNOW_SIM_LOG_LEVEL", "0", 0);
+    FILE *report = fdopen(dup(STDOUT_FILENO), "w");
+    if (report == nullptr || freopen(output, "w", stdout) == nullptr) {
+        std::cerr << output << ": cannot open\n";
+        return 1;
+    }
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    host_log_init();
+    host_replay_init();
+
+    std::vector<Frame> frames;
+    std::string source;
+    if (optind == argc) {
+        uint8_t master_mac[ESP_NOW_ETH_ALEN];
+        esp_wifi_get_mac(WIFI_IF_STA, master_mac);
+        frames = synthetic_corpus(senders, master_mac);
+        source = "synthetic traffic of " + std::to_string(senders) + (senders == 1 ? " slave" : " slaves");
+    } else {
+        std::vector<Frame> read;
+        for (int i = optind; i < argc; i++) {
+            std::ifstream file(argv[i], std::ios::binary);
+            if (!file) {
+                std::cerr << argv[i] << ": cannot open\n";
+                return 1;
+            }
+            if (!espnow_pcap::read_input(file, argv[i], read)) {
+                return 1;
+            }
+        }
+        for (Frame &f : read) {
+            if (f.hdr.dir == dir && !f.data.empty() && f.data.size() <= ESP_NOW_MAX_DATA_LEN) {
+                frames.push_back(std::move(f));
+            }
+        }
+        source = std::string(dir == ESPNOW_PCAP_TX ? "sent" : "received") + " in the capture";
+    }
+    if (frames.empty()) {
+        std::cerr << "no frames to replay\n";
+        return 1;
+    }
+
+    Corpus corpus(std::move(frames));
+    std::vector<std::vector<uint8_t>> data;
+    std::vector<host_replay_frame_t> pass;
+    uint64_t copy = 0;
+
+    for (uint64_t done = 0; done < warmup_frames; done += pass.size()) {
+        corpus.fill(copy, data, pass);
+        copy += corpus.copies_per_pass();
+        host_replay_run(pass.data(), (int)pass.size());
+    }
+
+    PerfCounters perf;
+    host_replay_stats_t before, after;
+    uint64_t allocs = s_allocs.load();
+    uint64_t frees = s_frees.load();
+    uint64_t done = 0;
+    std::chrono::nanoseconds elapsed(0);
+
+    host_replay_get_stats(&before);
+    espnow_stage_reset();
+    perf.reset();
+    while (done < timed_frames) {
+        corpus.fill(copy, data, pass);
+        copy += corpus.copies_per_pass();
+        auto start = std::chrono::steady_clock::now();
+        perf.start();
+        host_replay_run(pass.data(), (int)pass.size());
+        perf.stop();
+        elapsed += std::chrono::steady_clock::now() - start;
+        done += pass.size();
+    }
+    allocs = s_allocs.load() - allocs;
+    frees = s_frees.load() - frees;
+    host_replay_get_stats(&after);
+    std::vector<int64_t> counts = perf.read();
+    static espnow_stage_report_t stages;
+    espnow_stage_get_report(&stages);
+
+    double ns = (double)elapsed.count();
+    fprintf(report, "Corpus: %zu frames, %s, event batch %d, %s\n", corpus.size(), source.c_str(), CONFIG_ESPNOW_EVENT_BATCH_SIZE,
+#if CONFIG_ESPNOW_EVENT_TRANSPORT_RING
+           "ring"
+#else
+           "queue"
+#endif
+          );
+    fprintf(report, "Replayed %" PRIu64 " frames in %.3f s: %.1f ns/frame, %.0f frames/s\n", done, ns / 1e9, ns / done,
+           done * 1e9 / ns);
+    fprintf(report, "  %-22s %10.2f\n", "replies/frame", (double)(after.sent - before.sent) / done);
+    fprintf(report, "  %-22s %10.2f\n", "send no mem/frame", (double)(after.send_no_mem - before.send_no_mem) / done);
+    fprintf(report, "  %-22s %10.4f\n", "allocations/frame", (double)allocs / done);
+    fprintf(report, "  %-22s %10.4f\n", "frees/frame", (double)frees / done);
+#if CONFIG_ESPNOW_STAGE_STATS
+    /* Microsecond timestamps, so only meaningful over many frames. */
+    fprintf(report, "  %-22s %10.1f\n", "ingest ns/frame",
+            stages.stage[ESPNOW_STAGE_INGEST].busy_us * 1e3 / done);
+    fprintf(report, "  %-22s %10.1f\n", "handle ns/frame",
+            stages.stage[ESPNOW_STAGE_HANDLE].busy_us * 1e3 / done);
+#endif
+    if (!perf.ok()) {
+        fprintf(report, "  hardware counters      n/a (perf_event_open: %s)\n", perf.error().c_str());
+        return 0;
+    }
+    print_per_frame(report, "cycles/frame", counts[0], done);
+    print_per_frame(report, "instructions/frame", counts[1], done);
+    print_per_frame(report, "cache refs/frame", counts[2], done);
+    print_per_frame(report, "cache misses/frame", counts[3], done);
+    print_per_frame(report, "branch misses/frame", counts[4], done);
+    if (counts[0] > 0 && counts[1] >= 0) {
+        fprintf(report, "  %-22s %10.2f\n", "instructions/cycle", (double)counts[1] / counts[0]);
+    }
+    return 0;
+}
@@ -0,0 +1,62 @@
+/* ESPNOW replay harness - interface of the master's and the slave's receive path
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef HOST_REPLAY_H
+#define HOST_REPLAY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_now.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* One frame as the radio hands it to the receive callback. */
+typedef struct {
+    uint8_t src[ESP_NOW_ETH_ALEN];
+    uint8_t dst[ESP_NOW_ETH_ALEN];
+    int8_t rssi;
+    uint16_t len;
+    const uint8_t *data;
+} host_replay_frame_t;
+
+typedef struct {
+    uint64_t sent;                        //Frames esp_now_send() accepted.
+    uint64_t send_no_mem;                 //Frames esp_now_send() refused because its queue was full.
+} host_replay_stats_t;
+
+/* host_replay_master.c or host_replay_slave.c: the code of the master or of the
+ * slave, with example_espnow_init() run as on the device except that the ESPNOW
+ * task is not started. */
+void host_replay_init(void);
+
+/* Run frames through the device as the WiFi task and the ESPNOW task would: the
+ * frames go through the receive callback into the event transport, and the events
+ * are handled in batches of CONFIG_ESPNOW_EVENT_BATCH_SIZE, replies and
+ * acknowledgements included. Every frame sent completes at once, successfully.
+ * Returns once no event is left. */
+void host_replay_run(const host_replay_frame_t *frames, int num);
+
+/* host_replay_stubs.c: ESPNOW and WiFi in place of the simulated medium. Frames
+ * sent wait in a queue of ESPNOW_SIM_TX_QUEUE frames, default 16, until their
+ * completion is taken. */
+void host_replay_stubs_init(void);
+
+/* Call the send callback for the oldest frame sent and not completed yet. Returns
+ * false if there is none. */
+bool host_replay_stubs_complete(void);
+
+void host_replay_get_stats(host_replay_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,116 @@
+/* ESPNOW replay harness - the slave's receive path
+
+   Builds the slave's espnow_example_main.c into the harness, as
+   host_replay_master.c does with the master's. example_espnow_init() runs
+   unchanged, but the ESPNOW task is not started; host_replay_init() sends its
+   first discovery broadcast and host_replay_run() takes its place, in the
+   calling thread, through example_espnow_handle_events().
+
+   Where the task deletes itself, once it has sent its data or failed to send,
+   the run ends and the slave starts over, as it would after a reboot.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <setjmp.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "host_replay.h"
+
+static void *s_replay_task_arg;
+static jmp_buf s_replay_task_exit;
+
+static BaseType_t replay_task_create(void *arg)
+{
+    s_replay_task_arg = arg;
+    return pdPASS;
+}
+
+static __attribute__((noreturn)) void replay_task_delete(void)
+{
+    longjmp(s_replay_task_exit, 1);
+}
+
+/* Only example_espnow_init() creates a task in the file, and only the ESPNOW task
+ * deletes itself. */
+#define xTaskCreatePinnedToCore(task, name, stack, arg, prio, handle, core)   replay_task_create(arg)
+#define vTaskDelete(task)                                                     replay_task_delete()
+#include "espnow_example_main.c"
+#undef xTaskCreatePinnedToCore
+#undef vTaskDelete
+
+/* Events the event transport can still take without blocking the caller, whatever
+ * their priority lane. */
+static int replay_event_room(void)
+{
+#if CONFIG_ESPNOW_EVENT_TRANSPORT_RING
+    uint32_t room = espnow_event_ring_room(ESPNOW_LANE_CONTROL);
+
+    for (int lane = 1; lane < ESPNOW_LANES; lane++) {
+        if (espnow_event_ring_room(lane) < room) {
+            room = espnow_event_ring_room(lane);
+        }
+    }
+    return (int)room;
+#else
+    return ESPNOW_QUEUE_SIZE - (int)uxQueueMessagesWaiting(s_example_espnow_queue);
+#endif
+}
+
+void host_replay_init(void)
+{
+    host_replay_stubs_init();
+    ESP_ERROR_CHECK( example_espnow_init() );
+    ESP_ERROR_CHECK( example_espnow_broadcast(s_replay_task_arg) );
+}
+
+void host_replay_run(const host_replay_frame_t *frames, int num)
+{
+    static example_espnow_event_t evts[ESPNOW_EVENT_BATCH_SIZE];
+    wifi_pkt_rx_ctrl_t rx_ctrl;
+    int next = 0;
+
+    if (setjmp(s_replay_task_exit) != 0) {
+        /* example_espnow_deinit() has run: the rest of the frames find the slave rebooted. */
+        host_replay_init();
+        return;
+    }
+    memset(&rx_ctrl, 0, sizeof(rx_ctrl));
+    for (;;) {
+        /* The WiFi task: completed sends first, then received frames, as long as the
+         * event transport takes them. At most a batch of frames arrives at a time. */
+        int room = replay_event_room();
+        bool posted = false;
+        while (room > 0 && host_replay_stubs_complete()) {
+            room--;
+            posted = true;
+        }
+        for (int i = 0; i < ESPNOW_EVENT_BATCH_SIZE && room > 0 && next < num; i++, room--) {
+            const host_replay_frame_t *frame = &frames[next++];
+            esp_now_recv_info_t recv_info = {
+                .src_addr = (uint8_t *)frame->src,
+                .des_addr = (uint8_t *)frame->dst,
+                .rx_ctrl = &rx_ctrl,
+            };
+            rx_ctrl.rssi = frame->rssi;
+            example_espnow_recv_cb(&recv_info, frame->data, frame->len);
+            posted = true;
+        }
+        if (!posted) {
+            break;
+        }
+
+        /* The ESPNOW task, until it has nothing left to wait for. */
+        int evt_num;
+        do {
+            evt_num = example_espnow_event_wait_batch(evts, ESPNOW_EVENT_BATCH_SIZE, 0);
+            int64_t start_us = esp_timer_get_time();
+            example_espnow_handle_events(s_replay_task_arg, evts, evt_num);
+            espnow_stage_batch(evts, evt_num, start_us);
+        } while (evt_num > 0);
+    }
+}
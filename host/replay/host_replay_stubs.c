@@ -0,0 +1,333 @@
+/* ESPNOW replay harness - ESPNOW and WiFi stubs
+
+   Stand in for the simulated medium of shim/espnow_sim.c: nothing is
+   transmitted. The peer list behaves as the driver's, and frames sent wait
+   in a short queue until host_replay_stubs_complete() calls the send
+   callback for them, so that the peer slots of the master are freed the way
+   they are on the device.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <string.h>
+#include "esp_mac.h"
+#include "esp_now.h"
+#include "esp_wifi.h"
+#include "host_shim.h"
+#include "host_replay.h"
+
+#define REPLAY_TX_QUEUE_MAX     64
+
+static struct {
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    bool now_init;
+    esp_now_send_cb_t send_cb;
+    esp_now_recv_cb_t recv_cb;
+    esp_now_peer_info_t peers[ESP_NOW_MAX_TOTAL_PEER_NUM];
+    int peer_num;
+    uint8_t tx[REPLAY_TX_QUEUE_MAX][ESP_NOW_ETH_ALEN];    //Destinations of the frames not completed yet.
+    int tx_head;
+    int tx_count;
+    int tx_queue_len;
+    host_replay_stats_t stats;
+} s_replay;
+
+void host_replay_stubs_init(void)
+{
+    /* The address of simulated node 0, where the master runs, or the slave replayed. */
+    static const uint8_t mac[ESP_NOW_ETH_ALEN] = { 0x02, 0x5e, 0x00, 0x00, 0x00, 0x00 };
+
+    memcpy(s_replay.mac, mac, ESP_NOW_ETH_ALEN);
+    s_replay.tx_queue_len = (int)host_env_long("ESPNOW_SIM_TX_QUEUE", 16);
+    if (s_replay.tx_queue_len < 1 || s_replay.tx_queue_len > REPLAY_TX_QUEUE_MAX) {
+        s_replay.tx_queue_len = REPLAY_TX_QUEUE_MAX;
+    }
+}
+
+bool host_replay_stubs_complete(void)
+{
+    uint8_t dest[ESP_NOW_ETH_ALEN];
+
+    if (s_replay.tx_count == 0) {
+        return false;
+    }
+    memcpy(dest, s_replay.tx[s_replay.tx_head], ESP_NOW_ETH_ALEN);
+    s_replay.tx_head = (s_replay.tx_head + 1) % REPLAY_TX_QUEUE_MAX;
+    s_replay.tx_count--;
+    if (s_replay.send_cb != NULL) {
+        s_replay.send_cb(dest, ESP_NOW_SEND_SUCCESS);
+    }
+    return true;
+}
+
+void host_replay_get_stats(host_replay_stats_t *stats)
+{
+    *stats = s_replay.stats;
+}
+
+/* esp_restart() prints the medium statistics; there is no medium. */
+void espnow_sim_log_stats(void)
+{
+}
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config)
+{
+    (void)config;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_deinit(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_storage(wifi_storage_t storage)
+{
+    (void)storage;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode)
+{
+    (void)mode;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_stop(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_channel(uint8_t primary, wifi_second_chan_t second)
+{
+    (void)second;
+    return primary >= 1 && primary <= 14 ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_wifi_set_protocol(wifi_interface_t ifx, uint8_t protocol_bitmap)
+{
+    (void)ifx;
+    (void)protocol_bitmap;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_mac(wifi_interface_t ifx, uint8_t mac[6])
+{
+    (void)ifx;
+    memcpy(mac, s_replay.mac, ESP_NOW_ETH_ALEN);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_connectionless_module_set_wake_interval(uint16_t wake_interval)
+{
+    (void)wake_interval;
+    return ESP_OK;
+}
+
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type)
+{
+    (void)type;
+    memcpy(mac, s_replay.mac, ESP_NOW_ETH_ALEN);
+    return ESP_OK;
+}
+
+esp_err_t esp_now_init(void)
+{
+    s_replay.now_init = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_deinit(void)
+{
+    s_replay.now_init = false;
+    s_replay.recv_cb = NULL;
+    s_replay.send_cb = NULL;
+    s_replay.peer_num = 0;
+    s_replay.tx_count = 0;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_get_version(uint32_t *version)
+{
+    if (version == NULL) {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+    *version = 1;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb)
+{
+    if (!s_replay.now_init) {
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    }
+    s_replay.recv_cb = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_unregister_recv_cb(void)
+{
+    return esp_now_register_recv_cb(NULL);
+}
+
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb)
+{
+    if (!s_replay.now_init) {
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    }
+    s_replay.send_cb = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_unregister_send_cb(void)
+{
+    return esp_now_register_send_cb(NULL);
+}
+
+static int replay_find_peer(const uint8_t *peer_addr)
+{
+    for (int i = 0; i < s_replay.peer_num; i++) {
+        if (memcmp(s_replay.peers[i].peer_addr, peer_addr, ESP_NOW_ETH_ALEN) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+esp_err_t esp_now_send(const uint8_t *peer_addr, const uint8_t *data, size_t len)
+{
+    if (data == NULL || len == 0 || len > ESP_NOW_MAX_DATA_LEN) {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+    if (!s_replay.now_init) {
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    }
+    /* The master only sends to one device at a time. */
+    if (peer_addr == NULL || replay_find_peer(peer_addr) < 0) {
+        return ESP_ERR_ESPNOW_NOT_FOUND;
+    }
+    if (s_replay.tx_count >= s_replay.tx_queue_len) {
+        s_replay.stats.send_no_mem++;
+        return ESP_ERR_ESPNOW_NO_MEM;
+    }
+    memcpy(s_replay.tx[(s_replay.tx_head + s_replay.tx_count) % REPLAY_TX_QUEUE_MAX], peer_addr, ESP_NOW_ETH_ALEN);
+    s_replay.tx_count++;
+    s_replay.stats.sent++;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer)
+{
+    if (peer == NULL) {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+    if (!s_replay.now_init) {
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    }
+    if (replay_find_peer(peer->peer_addr) >= 0) {
+        return ESP_ERR_ESPNOW_EXIST;
+    }
+    if (s_replay.peer_num == ESP_NOW_MAX_TOTAL_PEER_NUM) {
+        return ESP_ERR_ESPNOW_FULL;
+    }
+    s_replay.peers[s_replay.peer_num++] = *peer;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_del_peer(const uint8_t *peer_addr)
+{
+    if (peer_addr == NULL) {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+    int i = replay_find_peer(peer_addr);
+    if (i < 0) {
+        return ESP_ERR_ESPNOW_NOT_FOUND;
+    }
+    s_replay.peers[i] = s_replay.peers[--s_replay.peer_num];
+    return ESP_OK;
+}
+
+esp_err_t esp_now_mod_peer(const esp_now_peer_info_t *peer)
+{
+    if (peer == NULL) {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+    int i = replay_find_peer(peer->peer_addr);
+    if (i < 0) {
+        return ESP_ERR_ESPNOW_NOT_FOUND;
+    }
+    s_replay.peers[i] = *peer;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_get_peer(const uint8_t *peer_addr, esp_now_peer_info_t *peer)
+{
+    if (peer_addr == NULL || peer == NULL) {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+    int i = replay_find_peer(peer_addr);
+    if (i < 0) {
+        return ESP_ERR_ESPNOW_NOT_FOUND;
+    }
+    *peer = s_replay.peers[i];
+    return ESP_OK;
+}
+
+esp_err_t esp_now_fetch_peer(bool from_head, esp_now_peer_info_t *peer)
+{
+    static int cursor;
+
+    if (peer == NULL) {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+    if (from_head) {
+        cursor = 0;
+    }
+    /* Like the driver, broadcast and multicast peers are skipped. */
+    while (cursor < s_replay.peer_num && (s_replay.peers[cursor].peer_addr[0] & 0x01)) {
+        cursor++;
+    }
+    if (cursor == s_replay.peer_num) {
+        return ESP_ERR_ESPNOW_NOT_FOUND;
+    }
+    *peer = s_replay.peers[cursor++];
+    return ESP_OK;
+}
+
+bool esp_now_is_peer_exist(const uint8_t *peer_addr)
+{
+    return peer_addr != NULL && replay_find_peer(peer_addr) >= 0;
+}
+
+esp_err_t esp_now_get_peer_num(esp_now_peer_num_t *num)
+{
+    if (num == NULL) {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+    num->total_num = s_replay.peer_num;
+    num->encrypt_num = 0;
+    for (int i = 0; i < s_replay.peer_num; i++) {
+        num->encrypt_num += s_replay.peers[i].encrypt;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_now_set_pmk(const uint8_t *pmk)
+{
+    return pmk ? ESP_OK : ESP_ERR_ESPNOW_ARG;
+}
+
+esp_err_t esp_now_set_wake_window(uint16_t window)
+{
+    (void)window;
+    return ESP_OK;
+}
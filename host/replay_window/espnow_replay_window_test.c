@@ -0,0 +1,288 @@
+/* ESPNOW replay window - deterministic test
+
+   Runs espnow_replay.c of espnow_common over streams of sequence numbers whose
+   answer is known, the way the receive path uses it: every frame is checked,
+   and only frames accepted, and not marked corrupt, update the window.
+
+   The scenarios cover copies right after the frame, frames reordered within
+   the window and copied again, the window edge 63 and 64 behind the
+   highest frame, jumps ahead of the window, the wrap of the 16-bit sequence
+   number, a corrupt frame that must not mark its number as seen, and a sender
+   that restarts with a new magic. The reordered streams are drawn from --seed,
+   the same stream for the same seed. The statistics of the module must match
+   the frames checked, copies found and restarts. The exit status is 1 if any
+   check fails.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "espnow_replay.h"
+
+#define TEST_STREAM_MAX     4096
+#define TEST_MAGIC          0x12345678
+#define TEST_MAGIC_RESTART  0x9abcdef0
+
+typedef struct {
+    unsigned int seed;
+    uint32_t frames;
+    uint32_t rounds;
+} test_config_t;
+
+/* What the test expects the module to have counted. */
+typedef struct {
+    uint32_t checked;
+    uint32_t duplicates;
+    uint32_t restarts;
+} test_counts_t;
+
+static test_config_t s_cfg;
+static test_counts_t s_test_counts;
+static uint32_t s_test_failed;
+static const char *s_test_scenario;
+
+#define TEST_EXPECT(cond) do {                                                              \
+        if (!(cond)) {                                                                      \
+            printf("  %s: line %d: %s\n", s_test_scenario, __LINE__, #cond);                \
+            s_test_failed++;                                                                \
+        }                                                                                   \
+    } while (0)
+
+/* Check a frame as the receive path does, and record it if accepted and intact. */
+static bool test_frame(espnow_replay_t *win, uint32_t magic, uint16_t seq, bool intact)
+{
+    bool fresh = espnow_replay_check(win, magic, seq);
+
+    s_test_counts.checked++;
+    if (!fresh) {
+        s_test_counts.duplicates++;
+    } else if (intact) {
+        espnow_replay_update(win, magic, seq);
+    }
+    return fresh;
+}
+
+static void test_in_order(void)
+{
+    espnow_replay_t win;
+
+    s_test_scenario = "in order";
+    espnow_replay_init(&win);
+    for (uint32_t i = 0; i < s_cfg.frames; i++) {
+        TEST_EXPECT(test_frame(&win, TEST_MAGIC, (uint16_t)i, true));
+        TEST_EXPECT(!test_frame(&win, TEST_MAGIC, (uint16_t)i, true));
+    }
+}
+
+/* Arrival of a frame of a reordered stream: frame seq arrives in the order of key. */
+typedef struct {
+    double key;
+    uint16_t seq;
+} test_arrival_t;
+
+static int test_arrival_cmp(const void *a, const void *b)
+{
+    const test_arrival_t *x = a;
+    const test_arrival_t *y = b;
+
+    return x->key < y->key ? -1 : x->key > y->key ? 1 : (int)x->seq - (int)y->seq;
+}
+
+/* Frames arrive in a random order, each delayed by less than a quarter of the window,
+ * so that every frame arrives within the window of the highest one. Every frame also
+ * comes again once, a few frames later. */
+static void test_reordered(void)
+{
+    static test_arrival_t order[TEST_STREAM_MAX];
+    static bool seen[TEST_STREAM_MAX];
+    unsigned short seed[3] = { s_cfg.seed, s_cfg.seed >> 16, 0x330e };
+    uint32_t n = s_cfg.frames;
+    espnow_replay_t win;
+
+    s_test_scenario = "reordered";
+    for (uint32_t round = 0; round < s_cfg.rounds; round++) {
+        for (uint32_t i = 0; i < n; i++) {
+            order[i].key = i + erand48(seed) * (ESPNOW_REPLAY_WINDOW / 4);
+            order[i].seq = (uint16_t)i;
+        }
+        qsort(order, n, sizeof(order[0]), test_arrival_cmp);
+        memset(seen, 0, sizeof(seen));
+        espnow_replay_init(&win);
+        for (uint32_t i = 0; i < n; i++) {
+            uint16_t seq = order[i].seq;
+            TEST_EXPECT(test_frame(&win, TEST_MAGIC, seq, true));
+            seen[seq] = true;
+            /* A copy of one of the last frames. */
+            uint32_t back = (uint32_t)(erand48(seed) * (ESPNOW_REPLAY_WINDOW / 4));
+            TEST_EXPECT(!test_frame(&win, TEST_MAGIC, order[back < i ? i - back : 0].seq, true));
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            TEST_EXPECT(seen[i]);
+        }
+    }
+}
+
+static void test_window_edge(void)
+{
+    espnow_replay_t win;
+
+    s_test_scenario = "window edge";
+    espnow_replay_init(&win);
+    for (uint16_t seq = 0; seq <= 100; seq++) {
+        test_frame(&win, TEST_MAGIC, seq, true);
+    }
+    /* 63 behind the highest is the oldest number the window remembers. */
+    TEST_EXPECT(!test_frame(&win, TEST_MAGIC, 100 - (ESPNOW_REPLAY_WINDOW - 1), true));
+    /* 64 behind cannot be told apart from a new frame and is accepted. */
+    TEST_EXPECT(test_frame(&win, TEST_MAGIC, 100 - ESPNOW_REPLAY_WINDOW, false));
+
+    /* A frame missing from the window is accepted once, at the edge too. */
+    espnow_replay_init(&win);
+    test_frame(&win, TEST_MAGIC, 0, true);
+    test_frame(&win, TEST_MAGIC, ESPNOW_REPLAY_WINDOW - 1, true);
+    TEST_EXPECT(test_frame(&win, TEST_MAGIC, 1, true));
+    TEST_EXPECT(!test_frame(&win, TEST_MAGIC, 1, true));
+    TEST_EXPECT(!test_frame(&win, TEST_MAGIC, 0, true));
+
+    /* Moving the top by one pushes frame 0 out of the window. */
+    test_frame(&win, TEST_MAGIC, ESPNOW_REPLAY_WINDOW, true);
+    TEST_EXPECT(!test_frame(&win, TEST_MAGIC, 1, true));
+    TEST_EXPECT(test_frame(&win, TEST_MAGIC, 0, false));
+
+    /* A jump of a whole window forgets every frame before it. */
+    espnow_replay_init(&win);
+    for (uint16_t seq = 0; seq < 10; seq++) {
+        test_frame(&win, TEST_MAGIC, seq, true);
+    }
+    test_frame(&win, TEST_MAGIC, 9 + ESPNOW_REPLAY_WINDOW, true);
+    TEST_EXPECT(!test_frame(&win, TEST_MAGIC, 9 + ESPNOW_REPLAY_WINDOW, true));
+    TEST_EXPECT(test_frame(&win, TEST_MAGIC, 10, true));
+    TEST_EXPECT(!test_frame(&win, TEST_MAGIC, 10, true));
+}
+
+static void test_wrap(void)
+{
+    espnow_replay_t win;
+
+    s_test_scenario = "wrap";
+    espnow_replay_init(&win);
+    for (uint32_t i = 0; i < 20; i++) {
+        test_frame(&win, TEST_MAGIC, (uint16_t)(65530 + i), true);
+    }
+    TEST_EXPECT(!test_frame(&win, TEST_MAGIC, 65535, true));
+    TEST_EXPECT(!test_frame(&win, TEST_MAGIC, 0, true));
+    TEST_EXPECT(!test_frame(&win, TEST_MAGIC, 65530, true));
+    TEST_EXPECT(test_frame(&win, TEST_MAGIC, 14, true));
+}
+
+static void test_corrupt(void)
+{
+    espnow_replay_t win;
+
+    s_test_scenario = "corrupt";
+    espnow_replay_init(&win);
+    test_frame(&win, TEST_MAGIC, 0, true);
+    /* Frame 1 fails its CRC: its good copy must still get through. */
+    TEST_EXPECT(test_frame(&win, TEST_MAGIC, 1, false));
+    TEST_EXPECT(test_frame(&win, TEST_MAGIC, 1, true));
+    TEST_EXPECT(!test_frame(&win, TEST_MAGIC, 1, true));
+    /* A corrupt frame ahead of the window does not move it. */
+    TEST_EXPECT(test_frame(&win, TEST_MAGIC, 1000, false));
+    TEST_EXPECT(!test_frame(&win, TEST_MAGIC, 0, true));
+}
+
+static void test_restart(void)
+{
+    espnow_replay_t win;
+
+    s_test_scenario = "restart";
+    espnow_replay_init(&win);
+    for (uint16_t seq = 0; seq < 50; seq++) {
+        test_frame(&win, TEST_MAGIC, seq, true);
+    }
+    /* The sender restarted and numbers its frames from 0 again. */
+    for (uint16_t seq = 0; seq < 10; seq++) {
+        TEST_EXPECT(test_frame(&win, TEST_MAGIC_RESTART, seq, true));
+        if (seq == 0) {
+            s_test_counts.restarts++;
+        }
+        TEST_EXPECT(!test_frame(&win, TEST_MAGIC_RESTART, seq, true));
+    }
+    /* A late frame from before the restart starts the window over again. */
+    TEST_EXPECT(test_frame(&win, TEST_MAGIC, 49, true));
+    s_test_counts.restarts++;
+    TEST_EXPECT(test_frame(&win, TEST_MAGIC_RESTART, 9, true));
+    s_test_counts.restarts++;
+
+    /* The first frame ever seen is not a restart. */
+    espnow_replay_init(&win);
+    TEST_EXPECT(test_frame(&win, TEST_MAGIC_RESTART, 7, true));
+}
+
+static void test_usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --frames N               frames per stream, at most %d (1000)\n"
+            "  --rounds N               reordered streams (100)\n"
+            "  --seed N                 random seed of the reordered streams (1)\n",
+            prog, TEST_STREAM_MAX);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] = {
+        { "frames", required_argument, NULL, 'n' },
+        { "rounds", required_argument, NULL, 'r' },
+        { "seed", required_argument, NULL, 'S' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+    espnow_replay_stats_t stats;
+    int opt;
+
+    s_cfg = (test_config_t) {
+        .seed = 1,
+        .frames = 1000,
+        .rounds = 100,
+    };
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (opt) {
+        case 'n': s_cfg.frames = strtoul(optarg, NULL, 0); break;
+        case 'r': s_cfg.rounds = strtoul(optarg, NULL, 0); break;
+        case 'S': s_cfg.seed = strtoul(optarg, NULL, 0); break;
+        default:
+            test_usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (s_cfg.frames < 1 || s_cfg.frames > TEST_STREAM_MAX) {
+        test_usage(argv[0]);
+        return 1;
+    }
+
+    test_in_order();
+    test_reordered();
+    test_window_edge();
+    test_wrap();
+    test_corrupt();
+    test_restart();
+
+    s_test_scenario = "stats";
+    espnow_replay_get_stats(&stats);
+    TEST_EXPECT(stats.checked == s_test_counts.checked);
+    TEST_EXPECT(stats.duplicates == s_test_counts.duplicates);
+    TEST_EXPECT(stats.restarts == s_test_counts.restarts);
+
+    printf("%lu frames checked, %lu copies dropped, %lu restarts, %lu checks failed\n", (unsigned long)stats.checked,
+           (unsigned long)stats.duplicates, (unsigned long)stats.restarts, (unsigned long)s_test_failed);
+    printf("%s\n", s_test_failed == 0 ? "PASS" : "FAIL");
+    return s_test_failed == 0 ? 0 : 1;
+}
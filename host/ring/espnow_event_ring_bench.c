@@ -0,0 +1,298 @@
+/* ESPNOW event ring - callback to task transport benchmark
+
+   Moves example_espnow_event_t from a "wifi" task to an "espnow" task, once
+   through espnow_event_ring.c of espnow_common and once through a FreeRTOS
+   queue of ESPNOW_QUEUE_SIZE events, posted with xQueueSend() and
+   ESPNOW_MAXDELAY as the example does without
+   CONFIG_ESPNOW_EVENT_TRANSPORT_RING.
+
+   The wifi task stands in for the ESPNOW callbacks. It offers --events events,
+   --burst at a time, at random times, a Poisson process of --rate bursts per
+   second, or back to back with --rate 0. Every post is timed: the producer
+   latency is how long the callback would hold up the WiFi task. The ring never
+   blocks and drops an event when it is full; the queue blocks the producer
+   until there is room.
+
+   The espnow task takes every event, checks that they arrive in the order they
+   were posted and spends --service-us on each. Events per second count the
+   events taken from the first post to the last one taken, and the delivery
+   latency runs from the post to the take. The exit status is 1 if an event was
+   lost without being counted or arrived out of order.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+#include "esp_now.h"
+#include "host_shim.h"
+#include "espnow_example.h"
+#include "espnow_event_ring.h"
+#include "espnow_rtt.h"
+
+#define BENCH_QUEUE_WAIT    512           //ESPNOW_MAXDELAY of the example, in ticks.
+
+typedef enum {
+    BENCH_RING,
+    BENCH_QUEUE,
+} bench_transport_t;
+
+typedef struct {
+    bool ring;
+    bool queue;
+    uint32_t events;
+    uint32_t rate;                        //Bursts per second, 0 for back to back.
+    uint32_t burst;
+    uint32_t service_us;
+    unsigned int seed;
+} bench_config_t;
+
+typedef struct {
+    uint32_t taken;
+    uint32_t dropped;                     //Posts that failed: ring full, or queue still full after ESPNOW_MAXDELAY.
+    uint32_t misordered;
+    int64_t elapsed_us;
+    espnow_rtt_hist_t post;               //Producer latency, unit: ns.
+    espnow_rtt_hist_t delivery;           //From the post to the take, unit: us.
+} bench_result_t;
+
+static bench_config_t s_cfg;
+static bench_transport_t s_bench_transport;
+static QueueHandle_t s_bench_queue;
+static bench_result_t s_bench_result;
+static int64_t s_bench_start_us;
+static volatile uint32_t s_bench_posted;                  //Written by the wifi task, posts accepted.
+static volatile bool s_bench_offered;                     //The wifi task has offered every event.
+static volatile bool s_bench_ready;                       //The espnow task has registered itself.
+static volatile bool s_bench_done[2];                     //Of the wifi and the espnow task.
+
+static bool bench_post(const example_espnow_event_t *evt)
+{
+    if (s_bench_transport == BENCH_RING) {
+        return espnow_event_ring_push(ESPNOW_LANE_CONTROL, evt);
+    }
+    return xQueueSend(s_bench_queue, evt, BENCH_QUEUE_WAIT) == pdTRUE;
+}
+
+static bool bench_take(example_espnow_event_t *evt, TickType_t ticks)
+{
+    if (s_bench_transport == BENCH_RING) {
+        return espnow_event_ring_wait(evt, ticks);
+    }
+    return xQueueReceive(s_bench_queue, evt, ticks) == pdTRUE;
+}
+
+static void bench_wifi_task(void *arg)
+{
+    unsigned short seed[3] = { s_cfg.seed, s_cfg.seed >> 16, 0 };
+    example_espnow_event_t evt = { .id = EXAMPLE_ESPNOW_RECV_CB };
+    double due = 0;
+    uint32_t posted = 0;
+    uint32_t i = 0;
+
+    (void)arg;
+    s_bench_start_us = esp_timer_get_time();
+    while (i < s_cfg.events) {
+        if (s_cfg.rate > 0) {
+            due += -log(1.0 - erand48(seed)) * 1e6 / s_cfg.rate;
+            int64_t now = esp_timer_get_time();
+            if (s_bench_start_us + (int64_t)due > now) {
+                host_sleep_us(s_bench_start_us + (int64_t)due - now);
+            }
+        }
+        for (uint32_t n = 0; n < s_cfg.burst && i < s_cfg.events; n++, i++) {
+            evt.time_us = (uint32_t)esp_timer_get_time();
+            evt.info.recv_cb.data_len = posted;
+            uint64_t start_ns = host_time_ns();
+            bool ok = bench_post(&evt);
+            espnow_rtt_hist_record(&s_bench_result.post, (uint32_t)(host_time_ns() - start_ns));
+            if (ok) {
+                s_bench_posted = ++posted;
+            } else {
+                s_bench_result.dropped++;
+            }
+        }
+    }
+    s_bench_offered = true;
+    s_bench_done[0] = true;
+    vTaskDelete(NULL);
+}
+
+static void bench_espnow_task(void *arg)
+{
+    example_espnow_event_t evt;
+    uint32_t expected = 0;
+
+    (void)arg;
+    espnow_event_ring_set_consumer(xTaskGetCurrentTaskHandle());
+    s_bench_ready = true;
+    for (;;) {
+        if (!bench_take(&evt, 1)) {
+            if (s_bench_offered && s_bench_result.taken == s_bench_posted) {
+                break;
+            }
+            continue;
+        }
+        espnow_rtt_hist_record(&s_bench_result.delivery, (uint32_t)esp_timer_get_time() - evt.time_us);
+        if (evt.info.recv_cb.data_len != (int)expected) {
+            s_bench_result.misordered++;
+        }
+        expected = evt.info.recv_cb.data_len + 1;
+        s_bench_result.taken++;
+        s_bench_result.elapsed_us = esp_timer_get_time() - s_bench_start_us;
+        if (s_cfg.service_us > 0) {
+            host_sleep_us(s_cfg.service_us);
+        }
+    }
+    s_bench_done[1] = true;
+    vTaskDelete(NULL);
+}
+
+static bool bench_run(bench_transport_t transport)
+{
+    const bench_result_t *res = &s_bench_result;
+    espnow_event_ring_stats_t stats;
+
+    s_bench_transport = transport;
+    memset(&s_bench_result, 0, sizeof(s_bench_result));
+    espnow_rtt_hist_reset(&s_bench_result.post);
+    espnow_rtt_hist_reset(&s_bench_result.delivery);
+    s_bench_posted = 0;
+    s_bench_offered = false;
+    s_bench_ready = false;
+    s_bench_done[0] = false;
+    s_bench_done[1] = false;
+    espnow_event_ring_init();
+    if (transport == BENCH_QUEUE) {
+        s_bench_queue = xQueueCreate(ESPNOW_QUEUE_SIZE, sizeof(example_espnow_event_t));
+        if (s_bench_queue == NULL) {
+            return false;
+        }
+    }
+
+    if (xTaskCreate(bench_espnow_task, "espnow", 4096, NULL, 4, NULL) != pdPASS) {
+        return false;
+    }
+    while (!s_bench_ready) {
+        host_sleep_us(1000);
+    }
+    if (xTaskCreate(bench_wifi_task, "wifi", 4096, NULL, 23, NULL) != pdPASS) {
+        return false;
+    }
+    while (!s_bench_done[0] || !s_bench_done[1]) {
+        host_sleep_us(10000);
+    }
+    if (transport == BENCH_QUEUE) {
+        vQueueDelete(s_bench_queue);
+    }
+
+    printf("%s of %u events: %.0f events/s, %lu taken, %lu dropped, %lu out of order\n",
+           transport == BENCH_RING ? "ring" : "queue",
+           transport == BENCH_RING ? ESPNOW_EVENT_RING_SIZE : ESPNOW_QUEUE_SIZE,
+           res->elapsed_us > 0 ? res->taken * 1e6 / res->elapsed_us : 0.0, (unsigned long)res->taken,
+           (unsigned long)res->dropped, (unsigned long)res->misordered);
+    printf("  post     p50 %7lu ns, p99 %7lu ns, max %9lu ns\n",
+           (unsigned long)espnow_rtt_hist_percentile(&res->post, 500),
+           (unsigned long)espnow_rtt_hist_percentile(&res->post, 990), (unsigned long)res->post.max_us);
+    if (res->delivery.count > 0) {
+        printf("  delivery p50 %7lu us, p99 %7lu us, max %9lu us\n",
+               (unsigned long)espnow_rtt_hist_percentile(&res->delivery, 500),
+               (unsigned long)espnow_rtt_hist_percentile(&res->delivery, 990), (unsigned long)res->delivery.max_us);
+    }
+    if (transport == BENCH_RING) {
+        espnow_event_ring_get_stats(&stats);
+        printf("  wakeups %lu, high water %lu\n", (unsigned long)stats.wakeups,
+               (unsigned long)stats.lane[ESPNOW_LANE_CONTROL].high_water);
+    }
+    return res->misordered == 0 && res->taken + res->dropped == s_cfg.events;
+}
+
+static void bench_usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --transport ring|queue|both  transports to run (both)\n"
+            "  --events N               events offered per transport (200000)\n"
+            "  --rate N                 mean bursts per second, 0 for back to back (0)\n"
+            "  --burst N                events posted together (1)\n"
+            "  --service-us N           time the espnow task spends on an event (0)\n"
+            "  --seed N                 random seed (1)\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] = {
+        { "transport", required_argument, NULL, 't' },
+        { "events", required_argument, NULL, 'n' },
+        { "rate", required_argument, NULL, 'r' },
+        { "burst", required_argument, NULL, 'b' },
+        { "service-us", required_argument, NULL, 'u' },
+        { "seed", required_argument, NULL, 'S' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+    bool ok = true;
+    int opt;
+
+    s_cfg = (bench_config_t) {
+        .ring = true,
+        .queue = true,
+        .events = 200000,
+        .rate = 0,
+        .burst = 1,
+        .service_us = 0,
+        .seed = 1,
+    };
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (opt) {
+        case 't':
+            s_cfg.ring = strcmp(optarg, "queue") != 0;
+            s_cfg.queue = strcmp(optarg, "ring") != 0;
+            if (!s_cfg.ring && !s_cfg.queue) {
+                bench_usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'n': s_cfg.events = strtoul(optarg, NULL, 0); break;
+        case 'r': s_cfg.rate = strtoul(optarg, NULL, 0); break;
+        case 'b': s_cfg.burst = strtoul(optarg, NULL, 0); break;
+        case 'u': s_cfg.service_us = strtoul(optarg, NULL, 0); break;
+        case 'S': s_cfg.seed = strtoul(optarg, NULL, 0); break;
+        default:
+            bench_usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (s_cfg.events == 0 || s_cfg.burst == 0) {
+        bench_usage(argv[0]);
+        return 1;
+    }
+
+    host_log_init();
+    if (s_cfg.rate > 0) {
+        printf("%lu events, %lu bursts/s of %lu, %lu us per event taken\n", (unsigned long)s_cfg.events,
+               (unsigned long)s_cfg.rate, (unsigned long)s_cfg.burst, (unsigned long)s_cfg.service_us);
+    } else {
+        printf("%lu events back to back, %lu us per event taken\n", (unsigned long)s_cfg.events,
+               (unsigned long)s_cfg.service_us);
+    }
+    if (s_cfg.ring) {
+        ok = bench_run(BENCH_RING) && ok;
+    }
+    if (s_cfg.queue) {
+        ok = bench_run(BENCH_QUEUE) && ok;
+    }
+    return ok ? 0 : 1;
+}
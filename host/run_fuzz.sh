@@ -0,0 +1,29 @@
+#!/bin/sh
+# Run every fuzz harness for a fixed number of inputs.
+#
+# usage: run_fuzz.sh BUILD_DIR [RUNS] [SEED]
+#
+# Builds the harnesses and the seed corpus in BUILD_DIR, then runs each harness on
+# its seeds and RUNS inputs mutated from them, printing the inputs run per second.
+# A crashing input is written to BUILD_DIR/fuzz/crash-*. With Clang the harnesses
+# are libFuzzer targets and RUNS is libFuzzer's -runs.
+set -e
+
+BUILD_DIR=${1:?usage: run_fuzz.sh BUILD_DIR [RUNS] [SEED]}
+RUNS=${2:-1000000}
+SEED=${3:-1}
+HOST_DIR=$(cd "$(dirname "$0")" && pwd)
+
+cmake -S "$HOST_DIR" -B "$BUILD_DIR" > /dev/null
+cmake --build "$BUILD_DIR" --target espnow_fuzz_frame espnow_fuzz_master espnow_fuzz_slave espnow_fuzz_seeds > /dev/null
+BUILD_DIR=$(cd "$BUILD_DIR" && pwd)
+mkdir -p "$BUILD_DIR/fuzz"
+cd "$BUILD_DIR/fuzz"
+
+# The slave receives the same frames as the master and starts from the same seeds.
+for harness in frame master slave; do
+    seeds=$harness
+    [ "$harness" = slave ] && seeds=master
+    echo "espnow_fuzz_$harness:"
+    "$BUILD_DIR/espnow_fuzz_$harness" -runs="$RUNS" -seed="$SEED" "$BUILD_DIR/fuzz_seeds/$seeds" 2>&1 | tail -n 1
+done
@@ -0,0 +1,27 @@
+#!/bin/sh
+# Run one master and N slaves on the simulated ESPNOW medium.
+#
+# usage: run_sim.sh BUILD_DIR [SLAVES] [DURATION_S]
+#
+# Logs go to BUILD_DIR/sim/node<N>.log. Any ESPNOW_SIM_* variable set in the
+# environment (latency, loss, bit rate, ...) applies to every node.
+set -e
+
+BUILD_DIR=${1:?usage: run_sim.sh BUILD_DIR [SLAVES] [DURATION_S]}
+SLAVES=${2:-1}
+DURATION=${3:-30}
+LOG_DIR=$BUILD_DIR/sim
+
+mkdir -p "$LOG_DIR"
+export ESPNOW_SIM_NODES=$((SLAVES + 1))
+export ESPNOW_SIM_DURATION=$DURATION
+
+ESPNOW_SIM_NODE=0 "$BUILD_DIR/espnow_m" > "$LOG_DIR/node0.log" 2>&1 &
+node=1
+while [ "$node" -le "$SLAVES" ]; do
+    ESPNOW_SIM_NODE=$node "$BUILD_DIR/espnow_s" > "$LOG_DIR/node$node.log" 2>&1 &
+    node=$((node + 1))
+done
+wait
+
+grep -h "espnow_sim: node" "$LOG_DIR"/node*.log
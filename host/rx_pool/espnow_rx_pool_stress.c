@@ -0,0 +1,272 @@
+/* ESPNOW receive pool - multi-task claim/release stress
+
+   Runs espnow_rx_pool.c of espnow_common from --tasks tasks at once. Every task
+   claims slots until it holds --hold of them, or the pool is exhausted, then
+   releases one of its slots chosen at random, for --iterations rounds. More
+   tasks times slots held than the pool has make the pool run dry over and over.
+
+   Every claimed slot is marked with its owner, so a slot handed out twice is
+   caught, and filled with the owner and round, checked again before release, so
+   a slot written by two tasks at once is caught too. At the end every counter of
+   the pool must balance against the tasks' own counts and every slot must be
+   free again. malloc, calloc and realloc are wrapped, see CMakeLists.txt, and
+   must not be called while the tasks run. The exit status is 1 if any check
+   fails.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <getopt.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "host_shim.h"
+#include "espnow_rx_pool.h"
+
+#define STRESS_TASKS_MAX    32
+#define STRESS_HOLD_MAX     ESPNOW_RX_POOL_SIZE
+
+typedef struct {
+    int tasks;
+    int hold;
+    uint32_t iterations;
+    unsigned int seed;
+} stress_config_t;
+
+typedef struct {
+    uint32_t claimed;
+    uint32_t released;
+    uint32_t exhausted;
+    uint32_t double_claims;               //Slots claimed while another task owned them.
+    uint32_t corrupted;                   //Slots whose contents changed while held.
+} stress_task_stats_t;
+
+/* What a task writes into the slots it holds. */
+typedef struct {
+    uint32_t owner;
+    uint32_t round;
+} stress_stamp_t;
+
+static stress_config_t s_cfg;
+static _Atomic uint32_t s_stress_owner[ESPNOW_RX_POOL_SIZE];   //Task id + 1, or 0 while free.
+static stress_task_stats_t s_stress_stats[STRESS_TASKS_MAX];
+static _Atomic int s_stress_ready;
+static _Atomic bool s_stress_go;
+static _Atomic int s_stress_done;
+static _Atomic uint64_t s_stress_allocs;
+
+/* Heap use, see --wrap in CMakeLists.txt. */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t num, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+void *__wrap_malloc(size_t size)
+{
+    atomic_fetch_add_explicit(&s_stress_allocs, 1, memory_order_relaxed);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t num, size_t size)
+{
+    atomic_fetch_add_explicit(&s_stress_allocs, 1, memory_order_relaxed);
+    return __real_calloc(num, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    atomic_fetch_add_explicit(&s_stress_allocs, 1, memory_order_relaxed);
+    return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr)
+{
+    __real_free(ptr);
+}
+
+static void stress_fill(uint16_t slot, uint32_t owner, uint32_t round)
+{
+    stress_stamp_t stamp = { .owner = owner, .round = round };
+    uint8_t *data = espnow_rx_pool_data(slot);
+
+    for (size_t off = 0; off + sizeof(stamp) <= ESPNOW_RX_POOL_SLOT_LEN; off += sizeof(stamp)) {
+        memcpy(data + off, &stamp, sizeof(stamp));
+    }
+}
+
+static bool stress_intact(uint16_t slot, uint32_t owner, uint32_t round)
+{
+    stress_stamp_t stamp = { .owner = owner, .round = round };
+    const uint8_t *data = espnow_rx_pool_data(slot);
+
+    for (size_t off = 0; off + sizeof(stamp) <= ESPNOW_RX_POOL_SLOT_LEN; off += sizeof(stamp)) {
+        if (memcmp(data + off, &stamp, sizeof(stamp)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void stress_task(void *arg)
+{
+    uint32_t id = (uint32_t)(uintptr_t)arg;
+    stress_task_stats_t *stats = &s_stress_stats[id];
+    unsigned short seed[3] = { s_cfg.seed, s_cfg.seed >> 16, id };
+    uint16_t held[STRESS_HOLD_MAX];
+    uint32_t held_round[STRESS_HOLD_MAX];
+    int num = 0;
+
+    atomic_fetch_add(&s_stress_ready, 1);
+    while (!atomic_load(&s_stress_go)) {
+        portYIELD();
+    }
+    for (uint32_t round = 0; round < s_cfg.iterations; round++) {
+        while (num < s_cfg.hold) {
+            uint16_t slot = espnow_rx_pool_claim();
+            if (slot == ESPNOW_RX_POOL_INVALID_SLOT) {
+                stats->exhausted++;
+                break;
+            }
+            stats->claimed++;
+            uint32_t free_owner = 0;
+            if (!atomic_compare_exchange_strong(&s_stress_owner[slot], &free_owner, id + 1)) {
+                stats->double_claims++;
+            }
+            stress_fill(slot, id, round);
+            held[num] = slot;
+            held_round[num] = round;
+            num++;
+        }
+        if (num == 0) {
+            portYIELD();
+            continue;
+        }
+        int i = (int)(erand48(seed) * num);
+        uint16_t slot = held[i];
+        if (!stress_intact(slot, id, held_round[i])) {
+            stats->corrupted++;
+        }
+        atomic_store(&s_stress_owner[slot], 0);
+        espnow_rx_pool_release(slot);
+        stats->released++;
+        held[i] = held[num - 1];
+        held_round[i] = held_round[num - 1];
+        num--;
+    }
+    while (num > 0) {
+        num--;
+        atomic_store(&s_stress_owner[held[num]], 0);
+        espnow_rx_pool_release(held[num]);
+        stats->released++;
+    }
+    atomic_fetch_add(&s_stress_done, 1);
+    vTaskDelete(NULL);
+}
+
+static void stress_usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --tasks N                tasks claiming and releasing, at most %d (6)\n"
+            "  --hold N                 slots each task holds at most, at most %d (4)\n"
+            "  --iterations N           slots released by each task (500000)\n"
+            "  --seed N                 random seed (1)\n",
+            prog, STRESS_TASKS_MAX, STRESS_HOLD_MAX);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] = {
+        { "tasks", required_argument, NULL, 't' },
+        { "hold", required_argument, NULL, 'H' },
+        { "iterations", required_argument, NULL, 'n' },
+        { "seed", required_argument, NULL, 'S' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+    stress_task_stats_t total = { 0 };
+    espnow_rx_pool_stats_t pool;
+    uint32_t still_claimable = 0;
+    int opt;
+
+    s_cfg = (stress_config_t) {
+        .tasks = 6,
+        .hold = 4,
+        .iterations = 500000,
+        .seed = 1,
+    };
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (opt) {
+        case 't': s_cfg.tasks = atoi(optarg); break;
+        case 'H': s_cfg.hold = atoi(optarg); break;
+        case 'n': s_cfg.iterations = strtoul(optarg, NULL, 0); break;
+        case 'S': s_cfg.seed = strtoul(optarg, NULL, 0); break;
+        default:
+            stress_usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (s_cfg.tasks < 1 || s_cfg.tasks > STRESS_TASKS_MAX || s_cfg.hold < 1 || s_cfg.hold > STRESS_HOLD_MAX) {
+        stress_usage(argv[0]);
+        return 1;
+    }
+
+    host_log_init();
+    espnow_rx_pool_init();
+    for (int i = 0; i < s_cfg.tasks; i++) {
+        if (xTaskCreate(stress_task, "stress", 4096, (void *)(uintptr_t)i, 5, NULL) != pdPASS) {
+            return 1;
+        }
+    }
+    while (atomic_load(&s_stress_ready) < s_cfg.tasks) {
+        host_sleep_us(1000);
+    }
+    /* Creating the tasks allocates; from here on nothing may. */
+    uint64_t allocs = atomic_load(&s_stress_allocs);
+    int64_t start_us = esp_timer_get_time();
+    atomic_store(&s_stress_go, true);
+    while (atomic_load(&s_stress_done) < s_cfg.tasks) {
+        host_sleep_us(1000);
+    }
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+    allocs = atomic_load(&s_stress_allocs) - allocs;
+
+    for (int i = 0; i < s_cfg.tasks; i++) {
+        total.claimed += s_stress_stats[i].claimed;
+        total.released += s_stress_stats[i].released;
+        total.exhausted += s_stress_stats[i].exhausted;
+        total.double_claims += s_stress_stats[i].double_claims;
+        total.corrupted += s_stress_stats[i].corrupted;
+    }
+    espnow_rx_pool_get_stats(&pool);
+    /* Every slot must be back on the free list, and only those. */
+    while (espnow_rx_pool_claim() != ESPNOW_RX_POOL_INVALID_SLOT) {
+        still_claimable++;
+    }
+
+    bool ok = allocs == 0 && total.double_claims == 0 && total.corrupted == 0 &&
+              pool.claimed == total.claimed && pool.released == total.released && pool.claimed == pool.released &&
+              pool.exhausted == total.exhausted && pool.high_water <= ESPNOW_RX_POOL_SIZE &&
+              still_claimable == ESPNOW_RX_POOL_SIZE;
+
+    printf("%d tasks holding up to %d of %d slots, %lu rounds each: %.2f s, %.0f claims/s\n", s_cfg.tasks,
+           s_cfg.hold, ESPNOW_RX_POOL_SIZE, (unsigned long)s_cfg.iterations, elapsed_us / 1e6,
+           elapsed_us > 0 ? total.claimed * 1e6 / elapsed_us : 0.0);
+    printf("  pool:  %lu claimed, %lu released, %lu exhausted, high water %lu\n", (unsigned long)pool.claimed,
+           (unsigned long)pool.released, (unsigned long)pool.exhausted, (unsigned long)pool.high_water);
+    printf("  tasks: %lu claimed, %lu released, %lu exhausted\n", (unsigned long)total.claimed,
+           (unsigned long)total.released, (unsigned long)total.exhausted);
+    printf("  %lu slots handed out twice, %lu overwritten while held, %lu of %d free at the end, %llu allocations\n",
+           (unsigned long)total.double_claims, (unsigned long)total.corrupted, (unsigned long)still_claimable,
+           ESPNOW_RX_POOL_SIZE, (unsigned long long)allocs);
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,127 @@
+/* Host shim - console REPL on standard input
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "esp_console.h"
+
+#define HOST_CONSOLE_CMDS_MAX       16
+#define HOST_CONSOLE_ARGS_MAX       8
+
+struct esp_console_repl_s {
+    pthread_t thread;
+};
+
+static esp_console_cmd_t s_cmds[HOST_CONSOLE_CMDS_MAX];
+static int s_cmd_num;
+
+esp_err_t esp_console_cmd_register(const esp_console_cmd_t *cmd)
+{
+    if (cmd == NULL || cmd->command == NULL || strchr(cmd->command, ' ') != NULL || cmd->func == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int i = 0; i < s_cmd_num; i++) {
+        if (strcmp(s_cmds[i].command, cmd->command) == 0) {
+            s_cmds[i] = *cmd;
+            return ESP_OK;
+        }
+    }
+    if (s_cmd_num == HOST_CONSOLE_CMDS_MAX) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_cmds[s_cmd_num++] = *cmd;
+    return ESP_OK;
+}
+
+static int host_console_help(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    for (int i = 0; i < s_cmd_num; i++) {
+        printf("%s %s\n  %s\n\n", s_cmds[i].command, s_cmds[i].hint ? s_cmds[i].hint : "",
+               s_cmds[i].help ? s_cmds[i].help : "");
+    }
+    return 0;
+}
+
+esp_err_t esp_console_register_help_command(void)
+{
+    const esp_console_cmd_t cmd = {
+        .command = "help",
+        .help = "Print the list of registered commands",
+        .func = host_console_help,
+    };
+
+    return esp_console_cmd_register(&cmd);
+}
+
+esp_err_t esp_console_new_repl_uart(const esp_console_dev_uart_config_t *dev_config,
+                                    const esp_console_repl_config_t *repl_config, esp_console_repl_t **ret_repl)
+{
+    (void)dev_config;
+    (void)repl_config;
+    esp_console_repl_t *repl = calloc(1, sizeof(esp_console_repl_t));
+
+    if (repl == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    *ret_repl = repl;
+    return ESP_OK;
+}
+
+static void host_console_run(char *line)
+{
+    char *argv[HOST_CONSOLE_ARGS_MAX];
+    char *save;
+    int argc = 0;
+
+    for (char *arg = strtok_r(line, " \t\r\n", &save); arg != NULL && argc < HOST_CONSOLE_ARGS_MAX;
+         arg = strtok_r(NULL, " \t\r\n", &save)) {
+        argv[argc++] = arg;
+    }
+    if (argc == 0) {
+        return;
+    }
+    for (int i = 0; i < s_cmd_num; i++) {
+        if (strcmp(s_cmds[i].command, argv[0]) == 0) {
+            int ret = s_cmds[i].func(argc, argv);
+            if (ret != 0) {
+                printf("Command returned non-zero error code: 0x%x\n", ret);
+            }
+            fflush(stdout);
+            return;
+        }
+    }
+    printf("Unrecognized command\n");
+    fflush(stdout);
+}
+
+static void *host_console_thread(void *arg)
+{
+    char line[256];
+
+    (void)arg;
+    for (;;) {
+        if (fgets(line, sizeof(line), stdin) == NULL) {
+            return NULL;
+        }
+        host_console_run(line);
+    }
+}
+
+esp_err_t esp_console_start_repl(esp_console_repl_t *repl)
+{
+    if (pthread_create(&repl->thread, NULL, host_console_thread, repl) != 0) {
+        return ESP_FAIL;
+    }
+    pthread_detach(repl->thread);
+    return ESP_OK;
+}
@@ -0,0 +1,356 @@
+/* Host shim - logging, timers, MAC and the other small ESP-IDF services
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_cpu.h"
+#include "esp_crc.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_now.h"
+#include "nvs_flash.h"
+#include "host_shim.h"
+
+#ifndef CONFIG_LOG_DEFAULT_LEVEL
+#define CONFIG_LOG_DEFAULT_LEVEL ESP_LOG_INFO
+#endif
+
+esp_log_level_t esp_log_host_level = CONFIG_LOG_DEFAULT_LEVEL;
+
+static pthread_mutex_t s_log_lock = PTHREAD_MUTEX_INITIALIZER;
+static long s_log_baud;
+static uint64_t s_boot_ns;
+
+uint64_t host_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void host_sleep_us(uint64_t us)
+{
+    struct timespec ts = {
+        .tv_sec = us / 1000000,
+        .tv_nsec = (us % 1000000) * 1000,
+    };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+long host_env_long(const char *name, long def)
+{
+    const char *value = getenv(name);
+    char *end;
+
+    if (value == NULL || *value == '\0') {
+        return def;
+    }
+    long parsed = strtol(value, &end, 0);
+    return *end == '\0' ? parsed : def;
+}
+
+void host_log_init(void)
+{
+    s_boot_ns = host_time_ns();
+    esp_log_host_level = (esp_log_level_t)host_env_long("ESPNOW_SIM_LOG_LEVEL", esp_log_host_level);
+    s_log_baud = host_env_long("ESPNOW_SIM_UART_BAUD", 0);
+}
+
+uint32_t esp_log_timestamp(void)
+{
+    return (uint32_t)((host_time_ns() - s_boot_ns) / 1000000ULL);
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    va_list args;
+
+    (void)tag;
+    if (level > esp_log_host_level) {
+        return;
+    }
+    va_start(args, format);
+    pthread_mutex_lock(&s_log_lock);
+    int len = vprintf(format, args);
+    fflush(stdout);
+    /* A UART console blocks the writer until the line is out, 10 bits a character. */
+    if (s_log_baud > 0 && len > 0) {
+        host_sleep_us((uint64_t)len * 10 * 1000000 / s_log_baud);
+    }
+    pthread_mutex_unlock(&s_log_lock);
+    va_end(args);
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    /* Per-tag levels are not kept; "*" sets the global one. */
+    if (strcmp(tag, "*") == 0) {
+        esp_log_host_level = level;
+    }
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+    case ESP_OK: return "ESP_OK";
+    case ESP_FAIL: return "ESP_FAIL";
+    case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_CRC: return "ESP_ERR_INVALID_CRC";
+    case ESP_ERR_ESPNOW_NOT_INIT: return "ESP_ERR_ESPNOW_NOT_INIT";
+    case ESP_ERR_ESPNOW_ARG: return "ESP_ERR_ESPNOW_ARG";
+    case ESP_ERR_ESPNOW_NO_MEM: return "ESP_ERR_ESPNOW_NO_MEM";
+    case ESP_ERR_ESPNOW_FULL: return "ESP_ERR_ESPNOW_FULL";
+    case ESP_ERR_ESPNOW_NOT_FOUND: return "ESP_ERR_ESPNOW_NOT_FOUND";
+    case ESP_ERR_ESPNOW_INTERNAL: return "ESP_ERR_ESPNOW_INTERNAL";
+    case ESP_ERR_ESPNOW_EXIST: return "ESP_ERR_ESPNOW_EXIST";
+    case ESP_ERR_ESPNOW_IF: return "ESP_ERR_ESPNOW_IF";
+    default: return "UNKNOWN ERROR";
+    }
+}
+
+uint32_t esp_cpu_get_cycle_count(void)
+{
+    return (uint32_t)host_time_ns();
+}
+
+int esp_cpu_get_core_id(void)
+{
+    return 0;
+}
+
+uint16_t esp_crc16_le(uint16_t crc, uint8_t const *buf, uint32_t len)
+{
+    crc = ~crc;
+    while (len--) {
+        crc ^= *buf++;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : crc >> 1;
+        }
+    }
+    return ~crc;
+}
+
+uint32_t esp_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len)
+{
+    crc = ~crc;
+    while (len--) {
+        crc ^= *buf++;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+        }
+    }
+    return ~crc;
+}
+
+static unsigned short s_random_state[3];
+static pthread_mutex_t s_random_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t s_random_once = PTHREAD_ONCE_INIT;
+
+static void esp_random_seed(void)
+{
+    uint64_t now = host_time_ns();
+    s_random_state[0] = (unsigned short)now;
+    s_random_state[1] = (unsigned short)(now >> 16);
+    s_random_state[2] = (unsigned short)host_env_long("ESPNOW_SIM_NODE", 0);
+}
+
+uint32_t esp_random(void)
+{
+    uint32_t value;
+
+    pthread_once(&s_random_once, esp_random_seed);
+    pthread_mutex_lock(&s_random_lock);
+    value = (uint32_t)jrand48(s_random_state);
+    pthread_mutex_unlock(&s_random_lock);
+    return value;
+}
+
+void esp_fill_random(void *buf, size_t len)
+{
+    uint8_t *p = buf;
+    while (len > 0) {
+        uint32_t word = esp_random();
+        size_t n = len < sizeof(word) ? len : sizeof(word);
+        memcpy(p, &word, n);
+        p += n;
+        len -= n;
+    }
+}
+
+void esp_restart(void)
+{
+    ESP_LOGW("host", "esp_restart() called, exiting");
+    espnow_sim_log_stats();
+    exit(0);
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    return 0;
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_event_loop_create_default(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_event_loop_delete_default(void)
+{
+    return ESP_OK;
+}
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint64_t period_us;
+    uint64_t deadline_us;
+    bool armed;
+    bool deleted;
+};
+
+static void *esp_timer_thread(void *arg)
+{
+    struct esp_timer *timer = arg;
+
+    pthread_mutex_lock(&timer->lock);
+    while (!timer->deleted) {
+        if (!timer->armed) {
+            pthread_cond_wait(&timer->cond, &timer->lock);
+            continue;
+        }
+        uint64_t now = (uint64_t)esp_timer_get_time();
+        if (now < timer->deadline_us) {
+            uint64_t ns = host_time_ns() + (timer->deadline_us - now) * 1000;
+            struct timespec ts = { .tv_sec = ns / 1000000000ULL, .tv_nsec = ns % 1000000000ULL };
+            pthread_cond_timedwait(&timer->cond, &timer->lock, &ts);
+            continue;
+        }
+        if (timer->period_us) {
+            timer->deadline_us += timer->period_us;
+        } else {
+            timer->armed = false;
+        }
+        pthread_mutex_unlock(&timer->lock);
+        timer->callback(timer->arg);
+        pthread_mutex_lock(&timer->lock);
+    }
+    pthread_mutex_unlock(&timer->lock);
+    free(timer);
+    return NULL;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return (int64_t)((host_time_ns() - s_boot_ns) / 1000ULL);
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle)
+{
+    if (create_args == NULL || create_args->callback == NULL || out_handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct esp_timer *timer = calloc(1, sizeof(*timer));
+    if (timer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    timer->callback = create_args->callback;
+    timer->arg = create_args->arg;
+    pthread_mutex_init(&timer->lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&timer->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    if (pthread_create(&timer->thread, NULL, esp_timer_thread, timer) != 0) {
+        free(timer);
+        return ESP_ERR_NO_MEM;
+    }
+    pthread_detach(timer->thread);
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+static esp_err_t esp_timer_arm(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us)
+{
+    pthread_mutex_lock(&timer->lock);
+    if (timer->armed) {
+        pthread_mutex_unlock(&timer->lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->deadline_us = (uint64_t)esp_timer_get_time() + timeout_us;
+    timer->period_us = period_us;
+    timer->armed = true;
+    pthread_cond_signal(&timer->cond);
+    pthread_mutex_unlock(&timer->lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return esp_timer_arm(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)
+{
+    return esp_timer_arm(timer, period, period);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    pthread_mutex_lock(&timer->lock);
+    bool armed = timer->armed;
+    timer->armed = false;
+    pthread_cond_signal(&timer->cond);
+    pthread_mutex_unlock(&timer->lock);
+    return armed ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    pthread_mutex_lock(&timer->lock);
+    timer->deleted = true;
+    pthread_cond_signal(&timer->cond);
+    pthread_mutex_unlock(&timer->lock);
+    return ESP_OK;
+}
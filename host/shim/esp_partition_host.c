@@ -0,0 +1,206 @@
+/* Host shim - flash partitions backed by files
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "esp_partition.h"
+#include "esp_ota_ops.h"
+#include "esp_log.h"
+#include "host_shim.h"
+
+#define HOST_PARTITION_MAX          8
+#define HOST_SECTOR_SIZE            4096
+#define HOST_OTA_HANDLE             1     //Of the one update that may be open.
+
+typedef struct {
+    esp_partition_t part;                 //First, so that a partition pointer is a host_partition_t pointer.
+    int fd;
+} host_partition_t;
+
+static const char *TAG = "esp_partition";
+static host_partition_t s_partitions[HOST_PARTITION_MAX];
+static int s_partition_count;
+static pthread_mutex_t s_partition_lock = PTHREAD_MUTEX_INITIALIZER;
+static const esp_partition_t *s_ota_partition;     //Of the update open, or NULL.
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label)
+{
+    const char *dir = getenv("ESPNOW_SIM_FLASH_DIR");
+    const esp_partition_t *found = NULL;
+    char path[512];
+    struct stat st;
+    int fd;
+
+    if (label == NULL || label[0] == '\0') {
+        return NULL;
+    }
+    pthread_mutex_lock(&s_partition_lock);
+    for (int i = 0; i < s_partition_count; i++) {
+        if (strcmp(s_partitions[i].part.label, label) == 0) {
+            found = &s_partitions[i].part;
+            goto out;
+        }
+    }
+    snprintf(path, sizeof(path), "%s/node%ld/%s.bin", dir != NULL ? dir : "flash",
+             host_env_long("ESPNOW_SIM_NODE", 0), label);
+    if (s_partition_count == HOST_PARTITION_MAX || (fd = open(path, O_RDWR)) < 0) {
+        goto out;
+    }
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        goto out;
+    }
+    host_partition_t *p = &s_partitions[s_partition_count++];
+    p->part.type = type;
+    p->part.subtype = subtype;
+    p->part.size = (uint32_t)st.st_size;
+    p->part.erase_size = HOST_SECTOR_SIZE;
+    snprintf(p->part.label, sizeof(p->part.label), "%s", label);
+    p->fd = fd;
+    found = &p->part;
+    ESP_LOGI(TAG, "Partition %s: %s, %lu bytes", label, path, (unsigned long)p->part.size);
+out:
+    pthread_mutex_unlock(&s_partition_lock);
+    return found;
+}
+
+static bool host_partition_range_ok(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    return partition != NULL && offset <= partition->size && size <= partition->size - offset;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    if (!host_partition_range_ok(partition, src_offset, size)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    const host_partition_t *p = (const host_partition_t *)partition;
+    return pread(p->fd, dst, size, (off_t)src_offset) == (ssize_t)size ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size)
+{
+    uint8_t buf[HOST_SECTOR_SIZE];
+    const uint8_t *data = (const uint8_t *)src;
+
+    if (!host_partition_range_ok(partition, dst_offset, size)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    const host_partition_t *p = (const host_partition_t *)partition;
+    while (size > 0) {
+        size_t len = size < sizeof(buf) ? size : sizeof(buf);
+        if (pread(p->fd, buf, len, (off_t)dst_offset) != (ssize_t)len) {
+            return ESP_FAIL;
+        }
+        for (size_t i = 0; i < len; i++) {
+            buf[i] &= data[i];
+        }
+        if (pwrite(p->fd, buf, len, (off_t)dst_offset) != (ssize_t)len) {
+            return ESP_FAIL;
+        }
+        data += len;
+        dst_offset += len;
+        size -= len;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    uint8_t buf[HOST_SECTOR_SIZE];
+
+    if (!host_partition_range_ok(partition, offset, size)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (offset % HOST_SECTOR_SIZE != 0 || size % HOST_SECTOR_SIZE != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const host_partition_t *p = (const host_partition_t *)partition;
+    memset(buf, 0xFF, sizeof(buf));
+    for (size_t done = 0; done < size; done += sizeof(buf)) {
+        if (pwrite(p->fd, buf, sizeof(buf), (off_t)(offset + done)) != (ssize_t)sizeof(buf)) {
+            return ESP_FAIL;
+        }
+    }
+    return ESP_OK;
+}
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from)
+{
+    (void)start_from;
+    return esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, "ota_0");
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition)
+{
+    return partition != NULL ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle)
+{
+    size_t erase_size;
+    esp_err_t err;
+
+    if (partition == NULL || out_handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (image_size == OTA_SIZE_UNKNOWN) {
+        erase_size = partition->size;
+    } else if (image_size <= partition->size) {
+        erase_size = (image_size + HOST_SECTOR_SIZE - 1) / HOST_SECTOR_SIZE * HOST_SECTOR_SIZE;
+    } else {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    pthread_mutex_lock(&s_partition_lock);
+    if (s_ota_partition != NULL) {
+        pthread_mutex_unlock(&s_partition_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_ota_partition = partition;
+    pthread_mutex_unlock(&s_partition_lock);
+    err = esp_partition_erase_range(partition, 0, erase_size);
+    if (err != ESP_OK) {
+        esp_ota_abort(HOST_OTA_HANDLE);
+        return err;
+    }
+    *out_handle = HOST_OTA_HANDLE;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_write_with_offset(esp_ota_handle_t handle, const void *data, size_t size, uint32_t offset)
+{
+    if (handle != HOST_OTA_HANDLE || s_ota_partition == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    return esp_partition_write(s_ota_partition, offset, data, size);
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle)
+{
+    return esp_ota_abort(handle);
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle)
+{
+    esp_err_t err = ESP_OK;
+
+    pthread_mutex_lock(&s_partition_lock);
+    if (handle != HOST_OTA_HANDLE || s_ota_partition == NULL) {
+        err = ESP_ERR_NOT_FOUND;
+    }
+    s_ota_partition = NULL;
+    pthread_mutex_unlock(&s_partition_lock);
+    return err;
+}
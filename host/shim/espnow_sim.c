@@ -0,0 +1,835 @@
+/* Host shim - simulated ESPNOW medium
+
+   Every process is one node. Frames travel as UDP datagrams on the loopback
+   interface: node N listens on ESPNOW_SIM_PORT + N and owns the MAC address
+   02:5e:00:00:NN:NN. A single "wifi" thread per process plays the role of
+   the Wi-Fi task: it serialises transmissions at the configured bit rate,
+   applies loss and latency and runs the send and receive callbacks, so the
+   application sees the same threading as on target.
+
+   Environment:
+     ESPNOW_SIM_NODE          this node's index (0)
+     ESPNOW_SIM_NODES         number of nodes reached by a broadcast (8)
+     ESPNOW_SIM_PORT          UDP port of node 0 (47000)
+     ESPNOW_SIM_LATENCY_US    one-way propagation and processing delay (500)
+     ESPNOW_SIM_JITTER_US     uniform extra delay added per frame (0)
+     ESPNOW_SIM_LOSS          frame loss per transmission attempt, percent (0)
+     ESPNOW_SIM_DUP           unicast frames received twice, percent (0)
+     ESPNOW_SIM_CORRUPT       frames received with one bit flipped, percent (0)
+     ESPNOW_SIM_BITRATE       PHY rate in bit/s, 0 for no airtime (1000000)
+     ESPNOW_SIM_RETRIES       unicast retransmissions before failing (3)
+     ESPNOW_SIM_TX_QUEUE      frames the driver buffers before NO_MEM (16)
+     ESPNOW_SIM_RSSI          RSSI reported to receivers, dBm (-40)
+     ESPNOW_SIM_SEED          loss and jitter seed (node index)
+
+   Airtime is only serialised per node, not across the shared channel, and
+   acknowledgements are only lost through ESPNOW_SIM_DUP: the frame is then
+   retried and arrives twice. Encryption is accepted but not applied.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_now.h"
+#include "esp_wifi.h"
+#include "host_shim.h"
+
+#define ESPNOW_SIM_WIRE_MAGIC       0x45534e57
+#define ESPNOW_SIM_TX_QUEUE_MAX     64
+#define ESPNOW_SIM_RX_PENDING       128
+#define ESPNOW_SIM_PREAMBLE_US      192
+#define ESPNOW_SIM_OVERHEAD_BYTES   43
+
+#ifndef CONFIG_ESP_WIFI_ESPNOW_MAX_ENCRYPT_NUM
+#define CONFIG_ESP_WIFI_ESPNOW_MAX_ENCRYPT_NUM 7
+#endif
+
+static const char *TAG = "espnow_sim";
+
+typedef struct {
+    uint32_t magic;
+    uint8_t src[ESP_NOW_ETH_ALEN];
+    uint8_t dst[ESP_NOW_ETH_ALEN];
+    uint8_t channel;
+    int8_t rssi;
+    uint16_t len;
+    uint64_t deliver_at_ns;               //Sender's monotonic time plus latency.
+    uint8_t data[ESP_NOW_MAX_DATA_LEN];
+} espnow_sim_wire_t;
+
+typedef struct {
+    uint8_t dest[ESP_NOW_ETH_ALEN];
+    uint16_t len;
+    uint8_t data[ESP_NOW_MAX_DATA_LEN];
+} espnow_sim_tx_t;
+
+typedef struct {
+    uint32_t tx_frames;
+    uint32_t tx_bytes;
+    uint32_t tx_attempts;
+    uint32_t tx_lost;
+    uint32_t tx_fail;
+    uint32_t tx_no_mem;
+    uint32_t tx_dup;
+    uint32_t rx_frames;
+    uint32_t rx_bytes;
+    uint32_t rx_filtered;
+    uint32_t rx_overflow;
+    uint64_t airtime_us;
+} espnow_sim_stats_t;
+
+static struct {
+    int node;
+    int nodes;
+    int port;
+    uint32_t latency_us;
+    uint32_t jitter_us;
+    double loss;
+    double dup;
+    double corrupt;
+    uint32_t bitrate;
+    int retries;
+    int tx_queue_len;
+    int8_t rssi;
+    unsigned short seed[3];
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint8_t channel;
+
+    pthread_mutex_t lock;
+    int sock;
+    int wake[2];
+    pthread_t thread;
+    bool started;
+    bool now_init;
+    esp_now_recv_cb_t recv_cb;
+    esp_now_send_cb_t send_cb;
+
+    esp_now_peer_info_t peers[ESP_NOW_MAX_TOTAL_PEER_NUM];
+    int peer_num;
+
+    espnow_sim_tx_t tx[ESPNOW_SIM_TX_QUEUE_MAX];
+    int tx_head;
+    int tx_count;
+
+    espnow_sim_wire_t rx[ESPNOW_SIM_RX_PENDING];
+    int rx_count;
+
+    espnow_sim_stats_t stats;
+} s_sim = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .sock = -1,
+    .wake = { -1, -1 },
+    .channel = 1,
+};
+
+static const uint8_t s_sim_broadcast[ESP_NOW_ETH_ALEN] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+static double espnow_sim_env_double(const char *name, double def)
+{
+    const char *value = getenv(name);
+    char *end;
+
+    if (value == NULL || *value == '\0') {
+        return def;
+    }
+    double parsed = strtod(value, &end);
+    return *end == '\0' ? parsed : def;
+}
+
+static void espnow_sim_node_mac(int node, uint8_t mac[ESP_NOW_ETH_ALEN])
+{
+    mac[0] = 0x02;
+    mac[1] = 0x5e;
+    mac[2] = 0x00;
+    mac[3] = 0x00;
+    mac[4] = (uint8_t)(node >> 8);
+    mac[5] = (uint8_t)node;
+}
+
+/* Node index owning mac, or -1 when it is not a simulated node. */
+static int espnow_sim_mac_node(const uint8_t *mac)
+{
+    if (mac[0] != 0x02 || mac[1] != 0x5e || mac[2] != 0x00 || mac[3] != 0x00) {
+        return -1;
+    }
+    int node = (mac[4] << 8) | mac[5];
+    return node < s_sim.nodes ? node : -1;
+}
+
+void espnow_sim_init(void)
+{
+    s_sim.node = (int)host_env_long("ESPNOW_SIM_NODE", 0);
+    s_sim.nodes = (int)host_env_long("ESPNOW_SIM_NODES", 8);
+    s_sim.port = (int)host_env_long("ESPNOW_SIM_PORT", 47000);
+    s_sim.latency_us = (uint32_t)host_env_long("ESPNOW_SIM_LATENCY_US", 500);
+    s_sim.jitter_us = (uint32_t)host_env_long("ESPNOW_SIM_JITTER_US", 0);
+    s_sim.loss = espnow_sim_env_double("ESPNOW_SIM_LOSS", 0.0) / 100.0;
+    s_sim.dup = espnow_sim_env_double("ESPNOW_SIM_DUP", 0.0) / 100.0;
+    s_sim.corrupt = espnow_sim_env_double("ESPNOW_SIM_CORRUPT", 0.0) / 100.0;
+    s_sim.bitrate = (uint32_t)host_env_long("ESPNOW_SIM_BITRATE", 1000000);
+    s_sim.retries = (int)host_env_long("ESPNOW_SIM_RETRIES", 3);
+    s_sim.tx_queue_len = (int)host_env_long("ESPNOW_SIM_TX_QUEUE", 16);
+    s_sim.rssi = (int8_t)host_env_long("ESPNOW_SIM_RSSI", -40);
+
+    long seed = host_env_long("ESPNOW_SIM_SEED", s_sim.node);
+    s_sim.seed[0] = 0x330e;
+    s_sim.seed[1] = (unsigned short)seed;
+    s_sim.seed[2] = (unsigned short)(seed >> 16);
+
+    if (s_sim.tx_queue_len < 1 || s_sim.tx_queue_len > ESPNOW_SIM_TX_QUEUE_MAX) {
+        s_sim.tx_queue_len = ESPNOW_SIM_TX_QUEUE_MAX;
+    }
+    if (s_sim.node < 0 || s_sim.node >= s_sim.nodes) {
+        fprintf(stderr, "ESPNOW_SIM_NODE %d out of range for %d nodes\n", s_sim.node, s_sim.nodes);
+        exit(1);
+    }
+    espnow_sim_node_mac(s_sim.node, s_sim.mac);
+}
+
+void espnow_sim_log_stats(void)
+{
+    espnow_sim_stats_t stats;
+
+    pthread_mutex_lock(&s_sim.lock);
+    stats = s_sim.stats;
+    pthread_mutex_unlock(&s_sim.lock);
+
+    ESP_LOGI(TAG, "node %d tx: %lu frames, %lu bytes, %lu attempts, %lu lost, %lu failed, %lu no_mem, %lu dup, "
+             "airtime %llu us",
+             s_sim.node, (unsigned long)stats.tx_frames, (unsigned long)stats.tx_bytes,
+             (unsigned long)stats.tx_attempts, (unsigned long)stats.tx_lost, (unsigned long)stats.tx_fail,
+             (unsigned long)stats.tx_no_mem, (unsigned long)stats.tx_dup, (unsigned long long)stats.airtime_us);
+    ESP_LOGI(TAG, "node %d rx: %lu frames, %lu bytes, %lu filtered, %lu overflow",
+             s_sim.node, (unsigned long)stats.rx_frames, (unsigned long)stats.rx_bytes,
+             (unsigned long)stats.rx_filtered, (unsigned long)stats.rx_overflow);
+}
+
+static uint32_t espnow_sim_airtime_us(size_t len)
+{
+    if (s_sim.bitrate == 0) {
+        return 0;
+    }
+    return ESPNOW_SIM_PREAMBLE_US +
+           (uint32_t)((uint64_t)(len + ESPNOW_SIM_OVERHEAD_BYTES) * 8 * 1000000 / s_sim.bitrate);
+}
+
+static bool espnow_sim_lost(void)
+{
+    return s_sim.loss > 0 && erand48(s_sim.seed) < s_sim.loss;
+}
+
+static bool espnow_sim_dup(void)
+{
+    return s_sim.dup > 0 && erand48(s_sim.seed) < s_sim.dup;
+}
+
+static void espnow_sim_put(int node, const espnow_sim_tx_t *tx, uint64_t now_ns)
+{
+    espnow_sim_wire_t wire = {
+        .magic = ESPNOW_SIM_WIRE_MAGIC,
+        .channel = s_sim.channel,
+        .rssi = s_sim.rssi,
+        .len = tx->len,
+    };
+    uint32_t delay_us = s_sim.latency_us;
+    if (s_sim.jitter_us) {
+        delay_us += (uint32_t)(erand48(s_sim.seed) * s_sim.jitter_us);
+    }
+    wire.deliver_at_ns = now_ns + (uint64_t)delay_us * 1000;
+    memcpy(wire.src, s_sim.mac, ESP_NOW_ETH_ALEN);
+    memcpy(wire.dst, tx->dest, ESP_NOW_ETH_ALEN);
+    memcpy(wire.data, tx->data, tx->len);
+    /* Corruption that the frame check sequence missed: only the application's own CRC can catch it. */
+    if (s_sim.corrupt > 0 && tx->len > 0 && erand48(s_sim.seed) < s_sim.corrupt) {
+        uint32_t bit = (uint32_t)(erand48(s_sim.seed) * tx->len * 8);
+        wire.data[bit / 8] ^= (uint8_t)(1U << (bit % 8));
+    }
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons((uint16_t)(s_sim.port + node)),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    /* A node that is not running simply does not hear the frame. */
+    sendto(s_sim.sock, &wire, offsetof(espnow_sim_wire_t, data) + tx->len, 0,
+           (struct sockaddr *)&addr, sizeof(addr));
+}
+
+/* Puts tx on the air. Returns the airtime used and whether the frame was
+ * acknowledged. Called on the wifi thread without the lock held. */
+static uint64_t espnow_sim_transmit(const espnow_sim_tx_t *tx, uint64_t now_ns, esp_now_send_status_t *status)
+{
+    uint32_t airtime = espnow_sim_airtime_us(tx->len);
+    uint32_t attempts = 0, lost = 0, dup = 0;
+
+    if (memcmp(tx->dest, s_sim_broadcast, ESP_NOW_ETH_ALEN) == 0) {
+        attempts = 1;
+        for (int node = 0; node < s_sim.nodes; node++) {
+            if (node == s_sim.node) {
+                continue;
+            }
+            if (espnow_sim_lost()) {
+                lost++;
+                continue;
+            }
+            espnow_sim_put(node, tx, now_ns + (uint64_t)airtime * 1000);
+        }
+        *status = ESP_NOW_SEND_SUCCESS;
+    } else {
+        int node = espnow_sim_mac_node(tx->dest);
+        *status = ESP_NOW_SEND_FAIL;
+        for (int i = 0; i <= s_sim.retries; i++) {
+            attempts++;
+            if (node < 0 || espnow_sim_lost()) {
+                lost++;
+                continue;
+            }
+            espnow_sim_put(node, tx, now_ns + (uint64_t)airtime * attempts * 1000);
+            /* The receiver's acknowledgement was lost: the same frame goes out again. */
+            if (i < s_sim.retries && espnow_sim_dup()) {
+                attempts++;
+                dup++;
+                espnow_sim_put(node, tx, now_ns + (uint64_t)airtime * attempts * 1000);
+            }
+            *status = ESP_NOW_SEND_SUCCESS;
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&s_sim.lock);
+    s_sim.stats.tx_frames++;
+    s_sim.stats.tx_bytes += tx->len;
+    s_sim.stats.tx_attempts += attempts;
+    s_sim.stats.tx_lost += lost;
+    s_sim.stats.tx_dup += dup;
+    s_sim.stats.airtime_us += (uint64_t)airtime * attempts;
+    if (*status != ESP_NOW_SEND_SUCCESS) {
+        s_sim.stats.tx_fail++;
+    }
+    pthread_mutex_unlock(&s_sim.lock);
+    return (uint64_t)airtime * attempts;
+}
+
+/* Keeps s_sim.rx ordered by delivery time; only the wifi thread touches it. */
+static void espnow_sim_rx_insert(const espnow_sim_wire_t *wire)
+{
+    if (s_sim.rx_count == ESPNOW_SIM_RX_PENDING) {
+        s_sim.stats.rx_overflow++;
+        return;
+    }
+    int i = s_sim.rx_count++;
+    while (i > 0 && s_sim.rx[i - 1].deliver_at_ns > wire->deliver_at_ns) {
+        s_sim.rx[i] = s_sim.rx[i - 1];
+        i--;
+    }
+    s_sim.rx[i] = *wire;
+}
+
+static void espnow_sim_receive(void)
+{
+    espnow_sim_wire_t wire;
+
+    for (;;) {
+        ssize_t n = recv(s_sim.sock, &wire, sizeof(wire), MSG_DONTWAIT);
+        if (n < 0) {
+            return;
+        }
+        if (n < (ssize_t)offsetof(espnow_sim_wire_t, data) || wire.magic != ESPNOW_SIM_WIRE_MAGIC ||
+            wire.len > ESP_NOW_MAX_DATA_LEN || n != (ssize_t)(offsetof(espnow_sim_wire_t, data) + wire.len)) {
+            continue;
+        }
+        if (wire.channel != s_sim.channel ||
+            (memcmp(wire.dst, s_sim.mac, ESP_NOW_ETH_ALEN) != 0 &&
+             memcmp(wire.dst, s_sim_broadcast, ESP_NOW_ETH_ALEN) != 0)) {
+            pthread_mutex_lock(&s_sim.lock);
+            s_sim.stats.rx_filtered++;
+            pthread_mutex_unlock(&s_sim.lock);
+            continue;
+        }
+        pthread_mutex_lock(&s_sim.lock);
+        espnow_sim_rx_insert(&wire);
+        pthread_mutex_unlock(&s_sim.lock);
+    }
+}
+
+static void espnow_sim_deliver(const espnow_sim_wire_t *wire, uint64_t now_ns)
+{
+    wifi_pkt_rx_ctrl_t rx_ctrl = {
+        .rssi = wire->rssi,
+        .noise_floor = -95,
+        .channel = wire->channel,
+        .timestamp = (uint32_t)(now_ns / 1000),
+        .sig_len = wire->len + ESPNOW_SIM_OVERHEAD_BYTES,
+    };
+    uint8_t src[ESP_NOW_ETH_ALEN], dst[ESP_NOW_ETH_ALEN];
+    memcpy(src, wire->src, ESP_NOW_ETH_ALEN);
+    memcpy(dst, wire->dst, ESP_NOW_ETH_ALEN);
+    esp_now_recv_info_t info = {
+        .src_addr = src,
+        .des_addr = dst,
+        .rx_ctrl = &rx_ctrl,
+    };
+
+    pthread_mutex_lock(&s_sim.lock);
+    esp_now_recv_cb_t recv_cb = s_sim.now_init ? s_sim.recv_cb : NULL;
+    s_sim.stats.rx_frames++;
+    s_sim.stats.rx_bytes += wire->len;
+    pthread_mutex_unlock(&s_sim.lock);
+
+    if (recv_cb) {
+        recv_cb(&info, wire->data, wire->len);
+    }
+}
+
+static void *espnow_sim_wifi_task(void *arg)
+{
+    espnow_sim_tx_t tx;
+    espnow_sim_wire_t wire;
+    bool tx_busy = false;
+    uint64_t tx_done_ns = 0;
+    esp_now_send_status_t tx_status = ESP_NOW_SEND_SUCCESS;
+
+    (void)arg;
+    for (;;) {
+        uint64_t now = host_time_ns();
+
+        if (tx_busy && now >= tx_done_ns) {
+            tx_busy = false;
+            pthread_mutex_lock(&s_sim.lock);
+            esp_now_send_cb_t send_cb = s_sim.now_init ? s_sim.send_cb : NULL;
+            pthread_mutex_unlock(&s_sim.lock);
+            if (send_cb) {
+                send_cb(tx.dest, tx_status);
+            }
+        }
+
+        if (!tx_busy) {
+            pthread_mutex_lock(&s_sim.lock);
+            if (s_sim.tx_count > 0) {
+                tx = s_sim.tx[s_sim.tx_head];
+                s_sim.tx_head = (s_sim.tx_head + 1) % ESPNOW_SIM_TX_QUEUE_MAX;
+                s_sim.tx_count--;
+                tx_busy = true;
+            }
+            pthread_mutex_unlock(&s_sim.lock);
+            if (tx_busy) {
+                tx_done_ns = now + espnow_sim_transmit(&tx, now, &tx_status) * 1000;
+                continue;
+            }
+        }
+
+        pthread_mutex_lock(&s_sim.lock);
+        bool due = s_sim.rx_count > 0 && s_sim.rx[0].deliver_at_ns <= now;
+        if (due) {
+            wire = s_sim.rx[0];
+            s_sim.rx_count--;
+            memmove(&s_sim.rx[0], &s_sim.rx[1], s_sim.rx_count * sizeof(s_sim.rx[0]));
+        }
+        uint64_t next_ns = s_sim.rx_count > 0 ? s_sim.rx[0].deliver_at_ns : UINT64_MAX;
+        pthread_mutex_unlock(&s_sim.lock);
+        if (due) {
+            espnow_sim_deliver(&wire, now);
+            continue;
+        }
+
+        if (tx_busy && tx_done_ns < next_ns) {
+            next_ns = tx_done_ns;
+        }
+        int timeout_ms = -1;
+        if (next_ns != UINT64_MAX) {
+            /* Round up so the loop does not spin on sub-millisecond waits. */
+            timeout_ms = next_ns > now ? (int)((next_ns - now + 999999) / 1000000) : 0;
+        }
+        struct pollfd fds[2] = {
+            { .fd = s_sim.sock, .events = POLLIN },
+            { .fd = s_sim.wake[0], .events = POLLIN },
+        };
+        if (poll(fds, 2, timeout_ms) > 0) {
+            if (fds[1].revents & POLLIN) {
+                char buf[64];
+                while (read(s_sim.wake[0], buf, sizeof(buf)) > 0) {
+                }
+            }
+            if (fds[0].revents & POLLIN) {
+                espnow_sim_receive();
+            }
+        }
+    }
+    return NULL;
+}
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config)
+{
+    (void)config;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_deinit(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_storage(wifi_storage_t storage)
+{
+    (void)storage;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode)
+{
+    (void)mode;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void)
+{
+    if (s_sim.started) {
+        return ESP_OK;
+    }
+    s_sim.sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (s_sim.sock < 0) {
+        return ESP_FAIL;
+    }
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons((uint16_t)(s_sim.port + s_sim.node)),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    if (bind(s_sim.sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        ESP_LOGE(TAG, "bind to port %d failed: %s", s_sim.port + s_sim.node, strerror(errno));
+        close(s_sim.sock);
+        s_sim.sock = -1;
+        return ESP_FAIL;
+    }
+    if (pipe(s_sim.wake) != 0) {
+        return ESP_FAIL;
+    }
+    fcntl(s_sim.wake[0], F_SETFL, O_NONBLOCK);
+    fcntl(s_sim.wake[1], F_SETFL, O_NONBLOCK);
+    if (pthread_create(&s_sim.thread, NULL, espnow_sim_wifi_task, NULL) != 0) {
+        return ESP_FAIL;
+    }
+    pthread_detach(s_sim.thread);
+    s_sim.started = true;
+    ESP_LOGI(TAG, "node %d/%d mac " MACSTR " port %d, latency %lu us, loss %.2f%%, %lu bit/s",
+             s_sim.node, s_sim.nodes, MAC2STR(s_sim.mac), s_sim.port + s_sim.node,
+             (unsigned long)s_sim.latency_us, s_sim.loss * 100, (unsigned long)s_sim.bitrate);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_stop(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_channel(uint8_t primary, wifi_second_chan_t second)
+{
+    (void)second;
+    if (primary < 1 || primary > 14) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_sim.lock);
+    s_sim.channel = primary;
+    pthread_mutex_unlock(&s_sim.lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_protocol(wifi_interface_t ifx, uint8_t protocol_bitmap)
+{
+    (void)ifx;
+    (void)protocol_bitmap;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_mac(wifi_interface_t ifx, uint8_t mac[6])
+{
+    (void)ifx;
+    memcpy(mac, s_sim.mac, ESP_NOW_ETH_ALEN);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_connectionless_module_set_wake_interval(uint16_t wake_interval)
+{
+    (void)wake_interval;
+    return ESP_OK;
+}
+
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type)
+{
+    (void)type;
+    memcpy(mac, s_sim.mac, ESP_NOW_ETH_ALEN);
+    return ESP_OK;
+}
+
+esp_err_t esp_now_init(void)
+{
+    if (!s_sim.started) {
+        return ESP_ERR_ESPNOW_INTERNAL;
+    }
+    pthread_mutex_lock(&s_sim.lock);
+    s_sim.now_init = true;
+    pthread_mutex_unlock(&s_sim.lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_now_deinit(void)
+{
+    pthread_mutex_lock(&s_sim.lock);
+    s_sim.now_init = false;
+    s_sim.recv_cb = NULL;
+    s_sim.send_cb = NULL;
+    s_sim.peer_num = 0;
+    s_sim.tx_count = 0;
+    pthread_mutex_unlock(&s_sim.lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_now_get_version(uint32_t *version)
+{
+    if (version == NULL) {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+    *version = 1;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb)
+{
+    pthread_mutex_lock(&s_sim.lock);
+    esp_err_t ret = s_sim.now_init ? ESP_OK : ESP_ERR_ESPNOW_NOT_INIT;
+    if (ret == ESP_OK) {
+        s_sim.recv_cb = cb;
+    }
+    pthread_mutex_unlock(&s_sim.lock);
+    return ret;
+}
+
+esp_err_t esp_now_unregister_recv_cb(void)
+{
+    return esp_now_register_recv_cb(NULL);
+}
+
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb)
+{
+    pthread_mutex_lock(&s_sim.lock);
+    esp_err_t ret = s_sim.now_init ? ESP_OK : ESP_ERR_ESPNOW_NOT_INIT;
+    if (ret == ESP_OK) {
+        s_sim.send_cb = cb;
+    }
+    pthread_mutex_unlock(&s_sim.lock);
+    return ret;
+}
+
+esp_err_t esp_now_unregister_send_cb(void)
+{
+    return esp_now_register_send_cb(NULL);
+}
+
+/* Index of peer_addr in s_sim.peers, or -1. Called with the lock held. */
+static int espnow_sim_find_peer(const uint8_t *peer_addr)
+{
+    for (int i = 0; i < s_sim.peer_num; i++) {
+        if (memcmp(s_sim.peers[i].peer_addr, peer_addr, ESP_NOW_ETH_ALEN) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int espnow_sim_encrypt_num(void)
+{
+    int num = 0;
+    for (int i = 0; i < s_sim.peer_num; i++) {
+        num += s_sim.peers[i].encrypt;
+    }
+    return num;
+}
+
+/* Queues one frame for the wifi thread. Called with the lock held. */
+static esp_err_t espnow_sim_enqueue(const uint8_t *dest, const uint8_t *data, size_t len)
+{
+    if (s_sim.tx_count >= s_sim.tx_queue_len) {
+        s_sim.stats.tx_no_mem++;
+        return ESP_ERR_ESPNOW_NO_MEM;
+    }
+    espnow_sim_tx_t *tx = &s_sim.tx[(s_sim.tx_head + s_sim.tx_count) % ESPNOW_SIM_TX_QUEUE_MAX];
+    memcpy(tx->dest, dest, ESP_NOW_ETH_ALEN);
+    memcpy(tx->data, data, len);
+    tx->len = (uint16_t)len;
+    s_sim.tx_count++;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_send(const uint8_t *peer_addr, const uint8_t *data, size_t len)
+{
+    esp_err_t ret = ESP_OK;
+
+    if (data == NULL || len == 0 || len > ESP_NOW_MAX_DATA_LEN) {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+    pthread_mutex_lock(&s_sim.lock);
+    if (!s_sim.now_init) {
+        ret = ESP_ERR_ESPNOW_NOT_INIT;
+    } else if (peer_addr == NULL) {
+        /* Every unicast peer in the list gets its own copy. */
+        for (int i = 0; i < s_sim.peer_num && ret == ESP_OK; i++) {
+            if (memcmp(s_sim.peers[i].peer_addr, s_sim_broadcast, ESP_NOW_ETH_ALEN) != 0) {
+                ret = espnow_sim_enqueue(s_sim.peers[i].peer_addr, data, len);
+            }
+        }
+    } else if (espnow_sim_find_peer(peer_addr) < 0) {
+        ret = ESP_ERR_ESPNOW_NOT_FOUND;
+    } else {
+        ret = espnow_sim_enqueue(peer_addr, data, len);
+    }
+    pthread_mutex_unlock(&s_sim.lock);
+
+    if (ret == ESP_OK) {
+        (void)!write(s_sim.wake[1], "", 1);
+    }
+    return ret;
+}
+
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer)
+{
+    esp_err_t ret = ESP_OK;
+
+    if (peer == NULL) {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+    pthread_mutex_lock(&s_sim.lock);
+    if (!s_sim.now_init) {
+        ret = ESP_ERR_ESPNOW_NOT_INIT;
+    } else if (espnow_sim_find_peer(peer->peer_addr) >= 0) {
+        ret = ESP_ERR_ESPNOW_EXIST;
+    } else if (s_sim.peer_num == ESP_NOW_MAX_TOTAL_PEER_NUM ||
+               (peer->encrypt && espnow_sim_encrypt_num() >= CONFIG_ESP_WIFI_ESPNOW_MAX_ENCRYPT_NUM)) {
+        ret = ESP_ERR_ESPNOW_FULL;
+    } else {
+        s_sim.peers[s_sim.peer_num++] = *peer;
+    }
+    pthread_mutex_unlock(&s_sim.lock);
+    return ret;
+}
+
+esp_err_t esp_now_del_peer(const uint8_t *peer_addr)
+{
+    esp_err_t ret = ESP_ERR_ESPNOW_NOT_FOUND;
+
+    if (peer_addr == NULL) {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+    pthread_mutex_lock(&s_sim.lock);
+    int i = espnow_sim_find_peer(peer_addr);
+    if (i >= 0) {
+        s_sim.peers[i] = s_sim.peers[--s_sim.peer_num];
+        ret = ESP_OK;
+    }
+    pthread_mutex_unlock(&s_sim.lock);
+    return ret;
+}
+
+esp_err_t esp_now_mod_peer(const esp_now_peer_info_t *peer)
+{
+    esp_err_t ret = ESP_ERR_ESPNOW_NOT_FOUND;
+
+    if (peer == NULL) {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+    pthread_mutex_lock(&s_sim.lock);
+    int i = espnow_sim_find_peer(peer->peer_addr);
+    if (i >= 0) {
+        s_sim.peers[i] = *peer;
+        ret = ESP_OK;
+    }
+    pthread_mutex_unlock(&s_sim.lock);
+    return ret;
+}
+
+esp_err_t esp_now_get_peer(const uint8_t *peer_addr, esp_now_peer_info_t *peer)
+{
+    esp_err_t ret = ESP_ERR_ESPNOW_NOT_FOUND;
+
+    if (peer_addr == NULL || peer == NULL) {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+    pthread_mutex_lock(&s_sim.lock);
+    int i = espnow_sim_find_peer(peer_addr);
+    if (i >= 0) {
+        *peer = s_sim.peers[i];
+        ret = ESP_OK;
+    }
+    pthread_mutex_unlock(&s_sim.lock);
+    return ret;
+}
+
+esp_err_t esp_now_fetch_peer(bool from_head, esp_now_peer_info_t *peer)
+{
+    static int cursor;
+    esp_err_t ret = ESP_ERR_ESPNOW_NOT_FOUND;
+
+    if (peer == NULL) {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+    pthread_mutex_lock(&s_sim.lock);
+    if (from_head) {
+        cursor = 0;
+    }
+    /* Like the driver, broadcast and multicast peers are skipped. */
+    while (cursor < s_sim.peer_num && (s_sim.peers[cursor].peer_addr[0] & 0x01)) {
+        cursor++;
+    }
+    if (cursor < s_sim.peer_num) {
+        *peer = s_sim.peers[cursor++];
+        ret = ESP_OK;
+    }
+    pthread_mutex_unlock(&s_sim.lock);
+    return ret;
+}
+
+bool esp_now_is_peer_exist(const uint8_t *peer_addr)
+{
+    pthread_mutex_lock(&s_sim.lock);
+    bool exist = peer_addr != NULL && espnow_sim_find_peer(peer_addr) >= 0;
+    pthread_mutex_unlock(&s_sim.lock);
+    return exist;
+}
+
+esp_err_t esp_now_get_peer_num(esp_now_peer_num_t *num)
+{
+    if (num == NULL) {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+    pthread_mutex_lock(&s_sim.lock);
+    num->total_num = s_sim.peer_num;
+    num->encrypt_num = espnow_sim_encrypt_num();
+    pthread_mutex_unlock(&s_sim.lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_now_set_pmk(const uint8_t *pmk)
+{
+    return pmk ? ESP_OK : ESP_ERR_ESPNOW_ARG;
+}
+
+esp_err_t esp_now_set_wake_window(uint16_t window)
+{
+    (void)window;
+    return ESP_OK;
+}
@@ -0,0 +1,378 @@
+/* Host shim - FreeRTOS tasks, queues and notifications on POSIX threads
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "host_shim.h"
+
+struct host_task {
+    pthread_t thread;
+    TaskFunction_t fn;
+    void *arg;
+    char name[16];
+    UBaseType_t priority;
+    BaseType_t core_id;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify;                      //Notification value, used as a counting semaphore.
+};
+
+struct host_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    uint8_t *buf;
+    UBaseType_t item_size;
+    UBaseType_t length;
+    UBaseType_t head;
+    UBaseType_t count;
+};
+
+static pthread_key_t s_task_key;
+static pthread_once_t s_task_key_once = PTHREAD_ONCE_INIT;
+
+static void host_task_key_init(void)
+{
+    pthread_key_create(&s_task_key, NULL);
+}
+
+static void host_cond_init(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static struct host_task *host_task_alloc(const char *name, UBaseType_t priority, BaseType_t core_id)
+{
+    struct host_task *task = calloc(1, sizeof(*task));
+    if (task == NULL) {
+        return NULL;
+    }
+    strncpy(task->name, name ? name : "", sizeof(task->name) - 1);
+    task->priority = priority;
+    task->core_id = core_id;
+    pthread_mutex_init(&task->lock, NULL);
+    host_cond_init(&task->cond);
+    return task;
+}
+
+/* Absolute CLOCK_MONOTONIC deadline for a wait of ticks, or NULL for
+ * portMAX_DELAY. */
+static const struct timespec *host_deadline(TickType_t ticks, struct timespec *ts)
+{
+    if (ticks == portMAX_DELAY) {
+        return NULL;
+    }
+    uint64_t ns = host_time_ns() + (uint64_t)pdTICKS_TO_MS(ticks) * 1000000ULL;
+    ts->tv_sec = ns / 1000000000ULL;
+    ts->tv_nsec = ns % 1000000000ULL;
+    return ts;
+}
+
+/* Returns false once the deadline has passed. */
+static bool host_cond_wait(pthread_cond_t *cond, pthread_mutex_t *lock, const struct timespec *deadline)
+{
+    if (deadline == NULL) {
+        pthread_cond_wait(cond, lock);
+        return true;
+    }
+    return pthread_cond_timedwait(cond, lock, deadline) != ETIMEDOUT;
+}
+
+static void *host_task_entry(void *arg)
+{
+    struct host_task *task = arg;
+
+    pthread_once(&s_task_key_once, host_task_key_init);
+    pthread_setspecific(s_task_key, task);
+    task->fn(task->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pxTaskCode, const char *pcName, const uint32_t usStackDepth,
+                                   void *pvParameters, UBaseType_t uxPriority, TaskHandle_t *pxCreatedTask,
+                                   const BaseType_t xCoreID)
+{
+    (void)usStackDepth;
+
+    struct host_task *task = host_task_alloc(pcName, uxPriority, xCoreID);
+    if (task == NULL) {
+        return pdFAIL;
+    }
+    task->fn = pxTaskCode;
+    task->arg = pvParameters;
+    if (pthread_create(&task->thread, NULL, host_task_entry, task) != 0) {
+        free(task);
+        return pdFAIL;
+    }
+    pthread_detach(task->thread);
+    if (pxCreatedTask) {
+        *pxCreatedTask = task;
+    }
+    return pdPASS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    pthread_once(&s_task_key_once, host_task_key_init);
+    struct host_task *task = pthread_getspecific(s_task_key);
+    if (task == NULL) {
+        /* The main thread (app_main) or a shim thread such as the Wi-Fi
+         * task: adopt it lazily. */
+        task = host_task_alloc("main", 1, 0);
+        task->thread = pthread_self();
+        pthread_setspecific(s_task_key, task);
+    }
+    return task;
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete)
+{
+    if (xTaskToDelete == NULL || xTaskToDelete == xTaskGetCurrentTaskHandle()) {
+        /* The task record stays allocated: handles to it may still be held
+         * by notifiers, as with a deleted-but-not-yet-reaped TCB. */
+        pthread_exit(NULL);
+    }
+    pthread_cancel(xTaskToDelete->thread);
+}
+
+void vTaskDelay(const TickType_t xTicksToDelay)
+{
+    if (xTicksToDelay == 0) {
+        sched_yield();
+        return;
+    }
+    host_sleep_us((uint64_t)pdTICKS_TO_MS(xTicksToDelay) * 1000);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(host_time_ns() / 1000000ULL / portTICK_PERIOD_MS);
+}
+
+TickType_t xTaskGetTickCountFromISR(void)
+{
+    return xTaskGetTickCount();
+}
+
+const char *pcTaskGetName(TaskHandle_t xTaskToQuery)
+{
+    if (xTaskToQuery == NULL) {
+        xTaskToQuery = xTaskGetCurrentTaskHandle();
+    }
+    return xTaskToQuery->name;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t xTask)
+{
+    (void)xTask;
+    return 0;
+}
+
+void vTaskPrioritySet(TaskHandle_t xTask, UBaseType_t uxNewPriority)
+{
+    if (xTask == NULL) {
+        xTask = xTaskGetCurrentTaskHandle();
+    }
+    xTask->priority = uxNewPriority;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t xTask)
+{
+    if (xTask == NULL) {
+        xTask = xTaskGetCurrentTaskHandle();
+    }
+    return xTask->priority;
+}
+
+BaseType_t xPortGetCoreID(void)
+{
+    BaseType_t core_id = xTaskGetCurrentTaskHandle()->core_id;
+    return core_id == tskNO_AFFINITY ? 0 : core_id;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify)
+{
+    pthread_mutex_lock(&xTaskToNotify->lock);
+    xTaskToNotify->notify++;
+    pthread_cond_signal(&xTaskToNotify->cond);
+    pthread_mutex_unlock(&xTaskToNotify->lock);
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    xTaskNotifyGive(xTaskToNotify);
+    if (pxHigherPriorityTaskWoken) {
+        *pxHigherPriorityTaskWoken = pdFALSE;
+    }
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait)
+{
+    struct host_task *task = xTaskGetCurrentTaskHandle();
+    struct timespec ts;
+    const struct timespec *deadline = host_deadline(xTicksToWait, &ts);
+    uint32_t value;
+
+    pthread_mutex_lock(&task->lock);
+    while (task->notify == 0 && xTicksToWait != 0) {
+        if (!host_cond_wait(&task->cond, &task->lock, deadline)) {
+            break;
+        }
+    }
+    value = task->notify;
+    if (value != 0) {
+        task->notify = xClearCountOnExit ? 0 : value - 1;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize)
+{
+    struct host_queue *queue = calloc(1, sizeof(*queue));
+    if (queue == NULL) {
+        return NULL;
+    }
+    if (uxItemSize > 0) {
+        queue->buf = malloc(uxQueueLength * uxItemSize);
+        if (queue->buf == NULL) {
+            free(queue);
+            return NULL;
+        }
+    }
+    queue->item_size = uxItemSize;
+    queue->length = uxQueueLength;
+    pthread_mutex_init(&queue->lock, NULL);
+    host_cond_init(&queue->not_empty);
+    host_cond_init(&queue->not_full);
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t xQueue)
+{
+    if (xQueue == NULL) {
+        return;
+    }
+    pthread_mutex_destroy(&xQueue->lock);
+    pthread_cond_destroy(&xQueue->not_empty);
+    pthread_cond_destroy(&xQueue->not_full);
+    free(xQueue->buf);
+    free(xQueue);
+}
+
+static BaseType_t host_queue_send(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait,
+                                  bool to_front)
+{
+    struct timespec ts;
+    const struct timespec *deadline = host_deadline(xTicksToWait, &ts);
+
+    pthread_mutex_lock(&xQueue->lock);
+    while (xQueue->count == xQueue->length) {
+        if (xTicksToWait == 0 || !host_cond_wait(&xQueue->not_full, &xQueue->lock, deadline)) {
+            pthread_mutex_unlock(&xQueue->lock);
+            return errQUEUE_FULL;
+        }
+    }
+    UBaseType_t index;
+    if (to_front) {
+        xQueue->head = (xQueue->head + xQueue->length - 1) % xQueue->length;
+        index = xQueue->head;
+    } else {
+        index = (xQueue->head + xQueue->count) % xQueue->length;
+    }
+    if (xQueue->item_size > 0) {
+        memcpy(xQueue->buf + index * xQueue->item_size, pvItemToQueue, xQueue->item_size);
+    }
+    xQueue->count++;
+    pthread_cond_signal(&xQueue->not_empty);
+    pthread_mutex_unlock(&xQueue->lock);
+    return pdPASS;
+}
+
+BaseType_t xQueueSend(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait)
+{
+    return host_queue_send(xQueue, pvItemToQueue, xTicksToWait, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait)
+{
+    return host_queue_send(xQueue, pvItemToQueue, xTicksToWait, true);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void *pvBuffer, TickType_t xTicksToWait)
+{
+    struct timespec ts;
+    const struct timespec *deadline = host_deadline(xTicksToWait, &ts);
+
+    pthread_mutex_lock(&xQueue->lock);
+    while (xQueue->count == 0) {
+        if (xTicksToWait == 0 || !host_cond_wait(&xQueue->not_empty, &xQueue->lock, deadline)) {
+            pthread_mutex_unlock(&xQueue->lock);
+            return errQUEUE_EMPTY;
+        }
+    }
+    if (xQueue->item_size > 0) {
+        memcpy(pvBuffer, xQueue->buf + xQueue->head * xQueue->item_size, xQueue->item_size);
+    }
+    xQueue->head = (xQueue->head + 1) % xQueue->length;
+    xQueue->count--;
+    pthread_cond_signal(&xQueue->not_full);
+    pthread_mutex_unlock(&xQueue->lock);
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t xQueue)
+{
+    pthread_mutex_lock(&xQueue->lock);
+    UBaseType_t count = xQueue->count;
+    pthread_mutex_unlock(&xQueue->lock);
+    return count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t xQueue)
+{
+    pthread_mutex_lock(&xQueue->lock);
+    UBaseType_t spaces = xQueue->length - xQueue->count;
+    pthread_mutex_unlock(&xQueue->lock);
+    return spaces;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t uxMaxCount, UBaseType_t uxInitialCount)
+{
+    SemaphoreHandle_t sem = xQueueCreate(uxMaxCount, 0);
+    if (sem) {
+        sem->count = uxInitialCount;
+    }
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return xSemaphoreCreateCounting(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    /* No priority inheritance and no recursion, which the examples do not
+     * rely on. */
+    return xSemaphoreCreateCounting(1, 1);
+}
@@ -0,0 +1,64 @@
+/* Host shim - GPIO interrupts from signals
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <signal.h>
+#include <stddef.h>
+#include "driver/gpio.h"
+
+typedef struct {
+    gpio_int_type_t intr_type;
+    gpio_isr_t handler;
+    void *arg;
+} host_gpio_t;
+
+static host_gpio_t s_gpio[GPIO_NUM_MAX];
+
+static void host_gpio_on_signal(int sig)
+{
+    (void)sig;
+    for (int i = 0; i < GPIO_NUM_MAX; i++) {
+        if (s_gpio[i].handler != NULL &&
+            (s_gpio[i].intr_type == GPIO_INTR_NEGEDGE || s_gpio[i].intr_type == GPIO_INTR_ANYEDGE)) {
+            s_gpio[i].handler(s_gpio[i].arg);
+        }
+    }
+}
+
+esp_err_t gpio_config(const gpio_config_t *cfg)
+{
+    if (cfg == NULL || cfg->pin_bit_mask >> GPIO_NUM_MAX != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int i = 0; i < GPIO_NUM_MAX; i++) {
+        if (cfg->pin_bit_mask & (1ULL << i)) {
+            s_gpio[i].intr_type = cfg->intr_type;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags)
+{
+    struct sigaction sa = { .sa_handler = host_gpio_on_signal };
+
+    (void)intr_alloc_flags;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    return sigaction(SIGUSR1, &sa, NULL) == 0 ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args)
+{
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_gpio[gpio_num].arg = args;
+    s_gpio[gpio_num].handler = isr_handler;
+    return ESP_OK;
+}
@@ -0,0 +1,52 @@
+/* Host shim - process entry point
+
+   Runs app_main() as the main task, as the ESP-IDF startup code does, then
+   keeps the process alive for ESPNOW_SIM_DURATION seconds (forever when 0)
+   and prints the medium statistics on the way out.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "host_shim.h"
+
+void app_main(void);
+
+static void host_on_signal(int sig)
+{
+    (void)sig;
+    /* Leave through exit() so the statistics are printed. */
+    exit(0);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    host_log_init();
+    espnow_sim_init();
+    atexit(espnow_sim_log_stats);
+    signal(SIGINT, host_on_signal);
+    signal(SIGTERM, host_on_signal);
+
+    app_main();
+
+    long duration = host_env_long("ESPNOW_SIM_DURATION", 0);
+    if (duration > 0) {
+        host_sleep_us((uint64_t)duration * 1000000);
+        return 0;
+    }
+    for (;;) {
+        pause();
+    }
+}
@@ -0,0 +1,29 @@
+/* Host shim - shared helpers
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef HOST_SHIM_H
+#define HOST_SHIM_H
+
+#include <stdint.h>
+
+/* CLOCK_MONOTONIC, shared by every process on the machine, so timestamps
+ * can be compared across simulated nodes. */
+uint64_t host_time_ns(void);
+void host_sleep_us(uint64_t us);
+
+/* Integer from the environment, or def when unset or malformed. */
+long host_env_long(const char *name, long def);
+
+void host_log_init(void);
+
+/* Simulated ESPNOW medium, see espnow_sim.c. */
+void espnow_sim_init(void);
+void espnow_sim_log_stats(void);
+
+#endif
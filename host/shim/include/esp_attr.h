@@ -0,0 +1,18 @@
+/* Host shim for esp_attr.h
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESP_ATTR_H
+#define ESP_ATTR_H
+
+/* There is no IRAM or RTC memory: code and data stay where the compiler puts them. */
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
+
+#endif
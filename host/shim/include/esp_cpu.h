@@ -0,0 +1,20 @@
+/* Host shim for esp_cpu.h
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESP_CPU_H
+#define ESP_CPU_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/* On the host the "cycle" counter is the monotonic clock in nanoseconds. */
+uint32_t esp_cpu_get_cycle_count(void);
+int esp_cpu_get_core_id(void);
+
+#endif
@@ -0,0 +1,18 @@
+/* Host shim for esp_crc.h
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESP_CRC_H
+#define ESP_CRC_H
+
+#include <stdint.h>
+
+uint16_t esp_crc16_le(uint16_t crc, uint8_t const *buf, uint32_t len);
+uint32_t esp_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len);
+
+#endif
@@ -0,0 +1,39 @@
+/* Host shim for esp_ota_ops.h
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESP_OTA_OPS_H
+#define ESP_OTA_OPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_partition.h"
+
+#define OTA_SIZE_UNKNOWN            0xffffffff
+
+typedef uint32_t esp_ota_handle_t;
+
+/* The partition labelled "ota_0", if there is one. */
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from);
+
+/* Erases the sectors image_size bytes cover, or the whole partition with
+ * OTA_SIZE_UNKNOWN. One update may be open at a time. */
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle);
+
+esp_err_t esp_ota_write_with_offset(esp_ota_handle_t handle, const void *data, size_t size, uint32_t offset);
+
+/* Does not check the image; there is nothing to boot. Frees the handle. */
+esp_err_t esp_ota_end(esp_ota_handle_t handle);
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle);
+
+/* Does not check the image; there is nothing to boot. */
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition);
+
+#endif
@@ -0,0 +1,18 @@
+/* Host shim for freertos/timers.h
+
+   Software timers are not used by the examples; the header only exists so
+   that they build unchanged.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef TIMERS_H
+#define TIMERS_H
+
+#include "freertos/FreeRTOS.h"
+
+#endif
@@ -0,0 +1,262 @@
+/* ESPNOW application workers - skewed traffic benchmark
+
+   Submits messages of a number of peers to espnow_workers.c of Espnow_m at
+   random times, a Poisson process of a given rate, and reports how long they wait, for the busiest peer and for the
+   others, and how busy each worker was. The peer of every message is drawn from
+   a Zipf distribution: with skew 0 every peer sends as much, with skew 1 the
+   busiest of 16 peers sends 30% of the messages, with skew 2 63%.
+
+   The application handler blocks for --work-us on every message, like a flash
+   write or a hardware crypto operation; blocked workers overlap even on a host
+   with a single CPU. Messages arrive on schedule whether or not the previous ones
+   were taken, and their latency counts from their scheduled arrival, so a
+   submitter falling behind with 0 workers is charged for it. A message whose
+   shard is full, or that would hold more than ESPNOW_WORKERS_SLOTS_MAX receive
+   buffers with the others, is dropped and counted, as the master drops such
+   frames.
+
+   Every handler checks that the messages of its peer arrive in the order they
+   were submitted.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "host_shim.h"
+#include "espnow_workers.h"
+
+#define BENCH_PEERS_MAX     256
+
+typedef struct {
+    int workers;
+    int peers;
+    double skew;
+    uint32_t rate;                        //Messages per second.
+    uint32_t work_us;
+    uint32_t seconds;
+    unsigned int seed;
+} bench_config_t;
+
+static bench_config_t s_cfg;
+static double s_zipf_cdf[BENCH_PEERS_MAX];
+static uint16_t s_bench_seq[BENCH_PEERS_MAX];             //Next sequence number submitted, per peer.
+static uint16_t s_bench_expected[BENCH_PEERS_MAX];        //Next sequence number to be handled, per peer.
+static uint32_t s_bench_sent[BENCH_PEERS_MAX];
+static uint32_t s_bench_dropped[BENCH_PEERS_MAX];
+static portMUX_TYPE s_bench_lock = portMUX_INITIALIZER_UNLOCKED;
+static espnow_rtt_hist_t s_bench_hot;                     //Latency of the busiest peer.
+static espnow_rtt_hist_t s_bench_cold;                    //Latency of every other peer.
+static uint32_t s_bench_done;
+static uint32_t s_bench_misordered;
+
+static void bench_zipf_init(void)
+{
+    double sum = 0;
+
+    for (int i = 0; i < s_cfg.peers; i++) {
+        sum += 1.0 / pow(i + 1, s_cfg.skew);
+        s_zipf_cdf[i] = sum;
+    }
+    for (int i = 0; i < s_cfg.peers; i++) {
+        s_zipf_cdf[i] /= sum;
+    }
+}
+
+/* Peer of the next message; peer 0 is the busiest. */
+static int bench_zipf_peer(void)
+{
+    double u = rand() / ((double)RAND_MAX + 1);
+    int lo = 0;
+    int hi = s_cfg.peers - 1;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (s_zipf_cdf[mid] > u) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
+
+/* The application handler. The module runs the jobs of a peer one at a time, so
+ * s_bench_expected of a peer is only touched by one worker at a time. */
+static void bench_job(const espnow_worker_job_t *job, void *arg)
+{
+    (void)arg;
+    if (s_cfg.work_us > 0) {
+        host_sleep_us(s_cfg.work_us);
+    }
+    bool in_order = job->slot == s_bench_expected[job->key];
+    s_bench_expected[job->key] = job->slot + 1;
+    uint32_t latency_us = (uint32_t)esp_timer_get_time() - job->time_us;
+
+    taskENTER_CRITICAL(&s_bench_lock);
+    espnow_rtt_hist_record(job->key == 0 ? &s_bench_hot : &s_bench_cold, latency_us);
+    s_bench_done++;
+    if (!in_order) {
+        s_bench_misordered++;
+    }
+    taskEXIT_CRITICAL(&s_bench_lock);
+}
+
+static void bench_print_latency(const char *name, const espnow_rtt_hist_t *hist)
+{
+    if (hist->count == 0) {
+        printf("  %-8s no messages\n", name);
+        return;
+    }
+    printf("  %-8s %8lu messages, p50 %7lu us, p99 %7lu us, max %7lu us\n", name, (unsigned long)hist->count,
+           (unsigned long)espnow_rtt_hist_percentile(hist, 500), (unsigned long)espnow_rtt_hist_percentile(hist, 990),
+           (unsigned long)hist->max_us);
+}
+
+static void bench_usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --workers N              application workers, 0 to run in the submitting task (4)\n"
+            "  --peers N                peers sending, at most %d (16)\n"
+            "  --skew S                 Zipf exponent of the traffic of the peers (1.0)\n"
+            "  --rate N                 mean messages per second (800)\n"
+            "  --work-us N              time the handler blocks per message (1000)\n"
+            "  --seconds N              time messages are sent for (5)\n"
+            "  --seed N                 random seed (1)\n",
+            prog, BENCH_PEERS_MAX);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] = {
+        { "workers", required_argument, NULL, 'w' },
+        { "peers", required_argument, NULL, 'p' },
+        { "skew", required_argument, NULL, 's' },
+        { "rate", required_argument, NULL, 'r' },
+        { "work-us", required_argument, NULL, 'u' },
+        { "seconds", required_argument, NULL, 'd' },
+        { "seed", required_argument, NULL, 'S' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+    static espnow_workers_report_t report;
+    int opt;
+
+    s_cfg = (bench_config_t) {
+        .workers = 4,
+        .peers = 16,
+        .skew = 1.0,
+        .rate = 800,
+        .work_us = 1000,
+        .seconds = 5,
+        .seed = 1,
+    };
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (opt) {
+        case 'w': s_cfg.workers = atoi(optarg); break;
+        case 'p': s_cfg.peers = atoi(optarg); break;
+        case 's': s_cfg.skew = atof(optarg); break;
+        case 'r': s_cfg.rate = strtoul(optarg, NULL, 0); break;
+        case 'u': s_cfg.work_us = strtoul(optarg, NULL, 0); break;
+        case 'd': s_cfg.seconds = strtoul(optarg, NULL, 0); break;
+        case 'S': s_cfg.seed = strtoul(optarg, NULL, 0); break;
+        default:
+            bench_usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (s_cfg.workers < 0 || s_cfg.workers > ESPNOW_WORKERS_MAX || s_cfg.peers < 1 || s_cfg.peers > BENCH_PEERS_MAX
+        || s_cfg.rate == 0 || s_cfg.seconds == 0) {
+        bench_usage(argv[0]);
+        return 1;
+    }
+
+    host_log_init();
+    srand(s_cfg.seed);
+    bench_zipf_init();
+    espnow_rtt_hist_reset(&s_bench_hot);
+    espnow_rtt_hist_reset(&s_bench_cold);
+    if (espnow_workers_init(s_cfg.workers, bench_job, NULL) != ESP_OK) {
+        return 1;
+    }
+
+    uint64_t total = (uint64_t)s_cfg.rate * s_cfg.seconds;
+    int64_t start_us = esp_timer_get_time();
+    double due = 0;
+    for (uint64_t i = 0; i < total; i++) {
+        due += -log(1.0 - rand() / ((double)RAND_MAX + 1)) * 1e6 / s_cfg.rate;
+        int64_t due_us = start_us + (int64_t)due;
+        int64_t now = esp_timer_get_time();
+        if (due_us > now) {
+            host_sleep_us(due_us - now);
+        }
+        int peer = bench_zipf_peer();
+        espnow_worker_job_t job = {
+            .key = peer,
+            .slot = s_bench_seq[peer],
+            .time_us = (uint32_t)due_us,
+        };
+        s_bench_sent[peer]++;
+        if (espnow_workers_submit(&job)) {
+            s_bench_seq[peer]++;
+        } else {
+            s_bench_dropped[peer]++;
+        }
+    }
+    int64_t sent_us = esp_timer_get_time() - start_us;
+
+    /* Let the workers drain the shards. */
+    uint32_t dropped = 0;
+    for (int i = 0; i < s_cfg.peers; i++) {
+        dropped += s_bench_dropped[i];
+    }
+    for (;;) {
+        taskENTER_CRITICAL(&s_bench_lock);
+        uint32_t done = s_bench_done;
+        taskEXIT_CRITICAL(&s_bench_lock);
+        if (done + dropped >= total) {
+            break;
+        }
+        host_sleep_us(1000);
+    }
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+    espnow_workers_get_report(&report);
+
+    uint32_t cold_sent = 0;
+    uint32_t cold_dropped = 0;
+    for (int i = 1; i < s_cfg.peers; i++) {
+        cold_sent += s_bench_sent[i];
+        cold_dropped += s_bench_dropped[i];
+    }
+    printf("workers %d, %d peers, skew %.2f (busiest %.0f%%), %lu msg/s offered, %lu us work: "
+           "%.0f msg/s handled, %lu dropped, %lu out of order\n",
+           s_cfg.workers, s_cfg.peers, s_cfg.skew, 100.0 * s_zipf_cdf[0], (unsigned long)s_cfg.rate,
+           (unsigned long)s_cfg.work_us, s_bench_done * 1e6 / elapsed_us, (unsigned long)dropped,
+           (unsigned long)s_bench_misordered);
+    printf("  sending took %.2f s, draining %.2f s more\n", sent_us / 1e6, (elapsed_us - sent_us) / 1e6);
+    bench_print_latency("busiest", &s_bench_hot);
+    bench_print_latency("others", &s_bench_cold);
+    printf("  others dropped %lu of %lu\n", (unsigned long)cold_dropped, (unsigned long)cold_sent);
+    for (int i = 0; i < (s_cfg.workers > 0 ? s_cfg.workers : 1); i++) {
+        const espnow_worker_stats_t *stats = &report.worker[i];
+        printf("  worker %d: %6lu jobs, %6lu stolen, %5.1f%% busy\n", i, (unsigned long)stats->jobs,
+               (unsigned long)stats->stolen, 100.0 * stats->busy_us / elapsed_us);
+    }
+    printf("  receive buffers held: high water %u of %d\n", report.held_high_water, ESPNOW_WORKERS_SLOTS_MAX);
+    printf("  shard high water:");
+    for (int i = 0; i < ESPNOW_WORKERS_SHARDS; i++) {
+        printf(" %u", report.high_water[i]);
+    }
+    printf("\n");
+    return s_bench_misordered == 0 ? 0 : 1;
+}